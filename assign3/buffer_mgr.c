@@ -1,109 +1,440 @@
 #include "buffer_mgr.h"
+#include "buffer_mgr_trace.h"
 #include "storage_mgr.h"
 #include "dberror.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#define LRU_K_DEFAULT 2
+#define LRU_K_MAX 8
 
 typedef struct PageFrame {
-    BM_PageHandle page;
+    PageNumber pageNum;
+    char *data;
     bool dirty;
     int fixCount;
-    struct PageFrame *next;
+    unsigned long loadTime;              // FIFO
+    unsigned long history[LRU_K_MAX];    // LRU / LRU-K, most recent first
+    bool refBit;                         // CLOCK
+    long accessCount;                    // LFU and per-frame statistics
 } PageFrame;
 
+// Every pool function runs under lock, so a pool can be shared with a
+// background writer such as the checkpointer. Page contents are only
+// protected by pins: a pinned page is never written back by flushPage.
 typedef struct BM_MgmtData {
+    pthread_mutex_t lock;
     PageFrame *pageFrames;
-    int numReadIO;
-    int numWriteIO;
+    SM_FileHandle fileHandle;
+    unsigned long tick;
+    int clockHand;
+    int lruK;
+    BM_PoolStatistics stats;
+    BM_Trace *trace;
+    BM_WriteHook writeHook;
 } BM_MgmtData;
 
+static long long nowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static PageFrame *findFrame(BM_MgmtData *mgmtData, int numPages, PageNumber pageNum) {
+    for (int i = 0; i < numPages; i++)
+        if (mgmtData->pageFrames[i].pageNum == pageNum)
+            return &mgmtData->pageFrames[i];
+    return NULL;
+}
+
+static RC writeFrame(BM_MgmtData *mgmtData, PageFrame *frame) {
+    if (mgmtData->writeHook != NULL && mgmtData->writeHook(frame->pageNum, frame->data) != RC_OK)
+        return RC_WRITE_FAILED;
+    if (writeBlock(frame->pageNum, &mgmtData->fileHandle, frame->data) != RC_OK)
+        return RC_WRITE_FAILED;
+    mgmtData->stats.numWriteIO++;
+    frame->dirty = false;
+    return RC_OK;
+}
+
+static void touchFrame(BM_MgmtData *mgmtData, PageFrame *frame) {
+    memmove(&frame->history[1], &frame->history[0], sizeof(unsigned long) * (LRU_K_MAX - 1));
+    frame->history[0] = ++mgmtData->tick;
+    frame->refBit = true;
+    frame->accessCount++;
+}
+
+// Returns the unpinned frame the pool's strategy would replace next, or NULL
+// when every frame is pinned. Empty frames are always taken first.
+static PageFrame *chooseVictim(BM_BufferPool *bm, BM_MgmtData *mgmtData) {
+    PageFrame *victim = NULL;
+    int i;
+
+    for (i = 0; i < bm->numPages; i++)
+        if (mgmtData->pageFrames[i].pageNum == NO_PAGE)
+            return &mgmtData->pageFrames[i];
+
+    if (bm->strategy == RS_CLOCK) {
+        // two full sweeps clear every reference bit, so a third finds a victim
+        for (i = 0; i < 3 * bm->numPages; i++) {
+            PageFrame *frame = &mgmtData->pageFrames[mgmtData->clockHand];
+            mgmtData->clockHand = (mgmtData->clockHand + 1) % bm->numPages;
+            if (frame->fixCount > 0)
+                continue;
+            if (!frame->refBit)
+                return frame;
+            frame->refBit = false;
+        }
+        return NULL;
+    }
+
+    for (i = 0; i < bm->numPages; i++) {
+        PageFrame *frame = &mgmtData->pageFrames[i];
+        if (frame->fixCount > 0)
+            continue;
+        if (victim == NULL) {
+            victim = frame;
+            continue;
+        }
+        switch (bm->strategy) {
+            case RS_LRU:
+                if (frame->history[0] < victim->history[0])
+                    victim = frame;
+                break;
+            case RS_LFU:
+                if (frame->accessCount < victim->accessCount
+                        || (frame->accessCount == victim->accessCount && frame->loadTime < victim->loadTime))
+                    victim = frame;
+                break;
+            case RS_LRU_K: {
+                // a zero K-th access means "fewer than K references": infinite distance
+                unsigned long frameK = frame->history[mgmtData->lruK - 1];
+                unsigned long victimK = victim->history[mgmtData->lruK - 1];
+                if (frameK < victimK || (frameK == victimK && frame->history[0] < victim->history[0]))
+                    victim = frame;
+                break;
+            }
+            case RS_FIFO:
+            default:
+                if (frame->loadTime < victim->loadTime)
+                    victim = frame;
+                break;
+        }
+    }
+    return victim;
+}
+
 RC initBufferPool(BM_BufferPool *bm, const char *pageFileName, int numPages, ReplacementStrategy strategy, void *stratData) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)calloc(1, sizeof(BM_MgmtData));
+    if (mgmtData == NULL) return RC_MEMORY_ALLOCATION_ERROR;
+
     bm->pageFile = (char *)malloc(strlen(pageFileName) + 1);
     strcpy(bm->pageFile, pageFileName);
     bm->numPages = numPages;
     bm->strategy = strategy;
-    
-    BM_MgmtData *mgmtData = (BM_MgmtData *)malloc(sizeof(BM_MgmtData));
+
+    if (openPageFile(bm->pageFile, &mgmtData->fileHandle) != RC_OK) {
+        free(bm->pageFile);
+        free(mgmtData);
+        return RC_FILE_NOT_FOUND;
+    }
+
     mgmtData->pageFrames = (PageFrame *)calloc(numPages, sizeof(PageFrame));
-    mgmtData->numReadIO = 0;
-    mgmtData->numWriteIO = 0;
+    for (int i = 0; i < numPages; i++) {
+        mgmtData->pageFrames[i].pageNum = NO_PAGE;
+        mgmtData->pageFrames[i].data = (char *)malloc(PAGE_SIZE);
+    }
+
+    mgmtData->lruK = LRU_K_DEFAULT;
+    if (strategy == RS_LRU_K && stratData != NULL) {
+        int k = *(int *)stratData;
+        mgmtData->lruK = (k < 1) ? 1 : (k > LRU_K_MAX ? LRU_K_MAX : k);
+    }
+    mgmtData->stats.numFrames = numPages;
+    pthread_mutex_init(&mgmtData->lock, NULL);
     bm->mgmtData = mgmtData;
-    
+
     return RC_OK;
 }
 
 RC shutdownBufferPool(BM_BufferPool *bm) {
     BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    RC rc = RC_OK;
+    int i;
+
+    for (i = 0; i < bm->numPages; i++)
+        if (mgmtData->pageFrames[i].fixCount > 0)
+            rc = RC_BM_PINNED_PAGES_IN_POOL;
+
+    // pinned pages are still written back so no committed change is lost
+    for (i = 0; i < bm->numPages; i++) {
+        PageFrame *frame = &mgmtData->pageFrames[i];
+        if (frame->pageNum != NO_PAGE && frame->dirty && writeFrame(mgmtData, frame) != RC_OK)
+            rc = RC_WRITE_FAILED;
+        free(frame->data);
+    }
+
+    if (syncPageFile(&mgmtData->fileHandle) != RC_OK)
+        rc = RC_WRITE_FAILED;
+    closePageFile(&mgmtData->fileHandle);
+    pthread_mutex_destroy(&mgmtData->lock);
     free(mgmtData->pageFrames);
     free(mgmtData);
     free(bm->pageFile);
+    bm->mgmtData = NULL;
+    return rc;
+}
+
+static RC pinFrame(BM_BufferPool *bm, BM_MgmtData *mgmtData, BM_PageHandle *page, PageNumber pageNum) {
+    PageFrame *frame;
+    long long start, waited;
+
+    if (pageNum < 0)
+        return RC_READ_NON_EXISTING_PAGE;
+
+    frame = findFrame(mgmtData, bm->numPages, pageNum);
+    if (frame != NULL) {
+        frame->fixCount++;
+        touchFrame(mgmtData, frame);
+        mgmtData->stats.numPins++;
+        mgmtData->stats.numHits++;
+        if (mgmtData->trace != NULL)
+            traceAccess(mgmtData->trace, pageNum, BM_TRACE_PIN);
+        page->pageNum = pageNum;
+        page->data = frame->data;
+        return RC_OK;
+    }
+
+    start = nowNanos();
+    frame = chooseVictim(bm, mgmtData);
+    if (frame == NULL)
+        return RC_BM_NO_FREE_FRAME;
+
+    if (frame->pageNum != NO_PAGE) {
+        mgmtData->stats.numEvictions++;
+        if (frame->dirty) {
+            if (writeFrame(mgmtData, frame) != RC_OK)
+                return RC_WRITE_FAILED;
+            mgmtData->stats.numDirtyEvictions++;
+        }
+    }
+
+    if (readBlock(pageNum, &mgmtData->fileHandle, frame->data) != RC_OK) {
+        frame->pageNum = NO_PAGE;
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    mgmtData->stats.numReadIO++;
+
+    frame->pageNum = pageNum;
+    frame->dirty = false;
+    frame->fixCount = 1;
+    frame->loadTime = mgmtData->tick + 1;
+    frame->accessCount = 0;
+    memset(frame->history, 0, sizeof(frame->history));
+    touchFrame(mgmtData, frame);
+
+    waited = nowNanos() - start;
+    mgmtData->stats.pinWaitNanos += waited;
+    if (waited > mgmtData->stats.maxPinWaitNanos)
+        mgmtData->stats.maxPinWaitNanos = waited;
+    mgmtData->stats.numPins++;
+    mgmtData->stats.numMisses++;
+    if (mgmtData->trace != NULL)
+        traceAccess(mgmtData->trace, pageNum, BM_TRACE_PIN);
+
+    page->pageNum = pageNum;
+    page->data = frame->data;
     return RC_OK;
 }
 
 RC pinPage(BM_BufferPool *bm, BM_PageHandle *page, PageNumber pageNum) {
     BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
-    mgmtData->numReadIO++;
-    
-    page->pageNum = pageNum;
-    page->data = (char *)malloc(PAGE_SIZE);
-    
-    SM_FileHandle fileHandle;
-    if (openPageFile(bm->pageFile, &fileHandle) != RC_OK)
-        return RC_FILE_NOT_FOUND;
-    
-    if (readBlock(pageNum, &fileHandle, page->data) != RC_OK)
-        return RC_READ_NON_EXISTING_PAGE;
+    RC rc;
 
-    closePageFile(&fileHandle);
-    return RC_OK;
+    pthread_mutex_lock(&mgmtData->lock);
+    rc = pinFrame(bm, mgmtData, page, pageNum);
+    pthread_mutex_unlock(&mgmtData->lock);
+    return rc;
 }
 
 RC unpinPage(BM_BufferPool *bm, BM_PageHandle *page) {
-    free(page->data);
-    return RC_OK;
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    PageFrame *frame;
+
+    pthread_mutex_lock(&mgmtData->lock);
+    frame = findFrame(mgmtData, bm->numPages, page->pageNum);
+    if (frame != NULL && frame->fixCount > 0)
+        frame->fixCount--;
+    if (frame != NULL && mgmtData->trace != NULL)
+        traceAccess(mgmtData->trace, page->pageNum, BM_TRACE_UNPIN);
+    pthread_mutex_unlock(&mgmtData->lock);
+    return (frame == NULL) ? RC_BM_PAGE_NOT_IN_POOL : RC_OK;
 }
 
 RC markDirty(BM_BufferPool *bm, BM_PageHandle *page) {
-    return RC_OK;
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    PageFrame *frame;
+
+    pthread_mutex_lock(&mgmtData->lock);
+    frame = findFrame(mgmtData, bm->numPages, page->pageNum);
+    if (frame != NULL)
+        frame->dirty = true;
+    pthread_mutex_unlock(&mgmtData->lock);
+    return (frame == NULL) ? RC_BM_PAGE_NOT_IN_POOL : RC_OK;
 }
 
 RC forcePage(BM_BufferPool *bm, BM_PageHandle *page) {
     BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
-    mgmtData->numWriteIO++;
-    
-    SM_FileHandle fileHandle;
-    if (openPageFile(bm->pageFile, &fileHandle) != RC_OK)
-        return RC_FILE_NOT_FOUND;
-    
-    if (writeBlock(page->pageNum, &fileHandle, page->data) != RC_OK)
-        return RC_WRITE_FAILED;
-    
-    closePageFile(&fileHandle);
+    PageFrame *frame;
+    RC rc = RC_BM_PAGE_NOT_IN_POOL;
+
+    pthread_mutex_lock(&mgmtData->lock);
+    frame = findFrame(mgmtData, bm->numPages, page->pageNum);
+    if (frame != NULL)
+        rc = writeFrame(mgmtData, frame);
+    pthread_mutex_unlock(&mgmtData->lock);
+    return rc;
+}
+
+RC forceFlushPool(BM_BufferPool *bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    RC rc = RC_OK;
+
+    pthread_mutex_lock(&mgmtData->lock);
+    for (int i = 0; i < bm->numPages && rc == RC_OK; i++) {
+        PageFrame *frame = &mgmtData->pageFrames[i];
+        if (frame->pageNum != NO_PAGE && frame->dirty && frame->fixCount == 0)
+            rc = writeFrame(mgmtData, frame);
+    }
+    pthread_mutex_unlock(&mgmtData->lock);
+    return rc;
+}
+
+// Writes one page back if it is in the pool and dirty. A pinned page may be
+// in the middle of a change, so it is left alone and reported instead.
+RC flushPage(BM_BufferPool *bm, PageNumber pageNum) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    PageFrame *frame;
+    RC rc = RC_OK;
+
+    pthread_mutex_lock(&mgmtData->lock);
+    frame = findFrame(mgmtData, bm->numPages, pageNum);
+    if (frame != NULL && frame->dirty)
+        rc = (frame->fixCount > 0) ? RC_BM_PAGE_PINNED : writeFrame(mgmtData, frame);
+    pthread_mutex_unlock(&mgmtData->lock);
+    return rc;
+}
+
+RC syncPool(BM_BufferPool *bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    RC rc;
+
+    pthread_mutex_lock(&mgmtData->lock);
+    rc = syncPageFile(&mgmtData->fileHandle);
+    pthread_mutex_unlock(&mgmtData->lock);
+    return rc;
+}
+
+RC truncatePool(BM_BufferPool *bm, int numPages) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    RC rc = RC_OK;
+    int i;
+
+    pthread_mutex_lock(&mgmtData->lock);
+    for (i = 0; i < bm->numPages; i++)
+        if (mgmtData->pageFrames[i].pageNum >= numPages && mgmtData->pageFrames[i].fixCount > 0)
+            rc = RC_BM_PAGE_PINNED;
+    for (i = 0; i < bm->numPages && rc == RC_OK; i++) {
+        PageFrame *frame = &mgmtData->pageFrames[i];
+        if (frame->pageNum >= numPages) {
+            frame->pageNum = NO_PAGE;
+            frame->dirty = false;
+        }
+    }
+    if (rc == RC_OK)
+        rc = truncatePageFile(numPages, &mgmtData->fileHandle);
+    pthread_mutex_unlock(&mgmtData->lock);
+    return rc;
+}
+
+RC setWriteHook(BM_BufferPool *bm, BM_WriteHook hook) {
+    ((BM_MgmtData *)bm->mgmtData)->writeHook = hook;
     return RC_OK;
 }
 
 PageNumber *getFrameContents(BM_BufferPool *bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
     PageNumber *contents = (PageNumber *)malloc(sizeof(PageNumber) * bm->numPages);
+    pthread_mutex_lock(&mgmtData->lock);
     for (int i = 0; i < bm->numPages; i++)
-        contents[i] = NO_PAGE;
+        contents[i] = mgmtData->pageFrames[i].pageNum;
+    pthread_mutex_unlock(&mgmtData->lock);
     return contents;
 }
 
 bool *getDirtyFlags(BM_BufferPool *bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
     bool *dirtyFlags = (bool *)malloc(sizeof(bool) * bm->numPages);
+    pthread_mutex_lock(&mgmtData->lock);
     for (int i = 0; i < bm->numPages; i++)
-        dirtyFlags[i] = false;
+        dirtyFlags[i] = mgmtData->pageFrames[i].dirty;
+    pthread_mutex_unlock(&mgmtData->lock);
     return dirtyFlags;
 }
 
 int *getFixCounts(BM_BufferPool *bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
     int *fixCounts = (int *)malloc(sizeof(int) * bm->numPages);
+    pthread_mutex_lock(&mgmtData->lock);
     for (int i = 0; i < bm->numPages; i++)
-        fixCounts[i] = 0;
+        fixCounts[i] = mgmtData->pageFrames[i].fixCount;
+    pthread_mutex_unlock(&mgmtData->lock);
     return fixCounts;
 }
 
-RC forceFlushPool(BM_BufferPool *bm) {
+int getNumReadIO(BM_BufferPool *bm) {
+    return ((BM_MgmtData *)bm->mgmtData)->stats.numReadIO;
+}
+
+int getNumWriteIO(BM_BufferPool *bm) {
+    return ((BM_MgmtData *)bm->mgmtData)->stats.numWriteIO;
+}
+
+RC getPoolStatistics(BM_BufferPool *bm, BM_PoolStatistics *stats, BM_FrameStatistics *frames) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+
+    pthread_mutex_lock(&mgmtData->lock);
+    if (stats != NULL)
+        *stats = mgmtData->stats;
+
+    if (frames != NULL) {
+        for (int i = 0; i < bm->numPages; i++) {
+            PageFrame *frame = &mgmtData->pageFrames[i];
+            frames[i].pageNum = frame->pageNum;
+            frames[i].dirty = frame->dirty;
+            frames[i].fixCount = frame->fixCount;
+            frames[i].accessCount = frame->accessCount;
+        }
+    }
+    pthread_mutex_unlock(&mgmtData->lock);
+    return RC_OK;
+}
+
+RC resetPoolStatistics(BM_BufferPool *bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+
+    // per-frame access counts also drive LFU, so they are left untouched
+    pthread_mutex_lock(&mgmtData->lock);
+    memset(&mgmtData->stats, 0, sizeof(BM_PoolStatistics));
+    mgmtData->stats.numFrames = bm->numPages;
+    pthread_mutex_unlock(&mgmtData->lock);
+    return RC_OK;
+}
+
+RC setPoolTrace(BM_BufferPool *bm, BM_Trace *trace) {
+    ((BM_MgmtData *)bm->mgmtData)->trace = trace;
     return RC_OK;
 }
@@ -33,6 +33,32 @@ typedef struct BM_PageHandle {
 	char *data;
 } BM_PageHandle;
 
+// Pool-wide counters, filled in one call by getPoolStatistics
+typedef struct BM_PoolStatistics {
+	int numFrames;
+	long numPins;           // pinPage calls that returned a frame
+	long numHits;           // pins served from a frame already in the pool
+	long numMisses;         // pins that had to read the page from disk
+	long numEvictions;      // frames reassigned to a different page
+	long numDirtyEvictions; // evictions that wrote the old page back first
+	int numReadIO;
+	int numWriteIO;
+	long long pinWaitNanos;    // total time spent servicing misses in pinPage
+	long long maxPinWaitNanos; // slowest single miss
+} BM_PoolStatistics;
+
+// Per-frame state; accessCount counts pins since the page was loaded
+typedef struct BM_FrameStatistics {
+	PageNumber pageNum;
+	bool dirty;
+	int fixCount;
+	long accessCount;
+} BM_FrameStatistics;
+
+// Called before a dirty page is written back, e.g. to flush the log up to
+// the page's LSN first. A hook error cancels the write.
+typedef RC (*BM_WriteHook)(PageNumber pageNum, char *data);
+
 // convenience macros
 #define MAKE_POOL()					\
 		((BM_BufferPool *) malloc (sizeof(BM_BufferPool)))
@@ -46,11 +72,17 @@ RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName,
 		void *stratData);
 RC shutdownBufferPool(BM_BufferPool *const bm);
 RC forceFlushPool(BM_BufferPool *const bm);
+RC setWriteHook(BM_BufferPool *const bm, BM_WriteHook hook);
+RC syncPool(BM_BufferPool *const bm);
+// Drops the pages from numPages on, without writing them back, and cuts
+// them off the page file. Fails with RC_BM_PAGE_PINNED if one is pinned.
+RC truncatePool(BM_BufferPool *const bm, const int numPages);
 
 // Buffer Manager Interface Access Pages
 RC markDirty (BM_BufferPool *const bm, BM_PageHandle *const page);
 RC unpinPage (BM_BufferPool *const bm, BM_PageHandle *const page);
 RC forcePage (BM_BufferPool *const bm, BM_PageHandle *const page);
+RC flushPage (BM_BufferPool *const bm, const PageNumber pageNum);
 RC pinPage (BM_BufferPool *const bm, BM_PageHandle *const page, 
 		const PageNumber pageNum);
 
@@ -60,5 +92,9 @@ bool *getDirtyFlags (BM_BufferPool *const bm);
 int *getFixCounts (BM_BufferPool *const bm);
 int getNumReadIO (BM_BufferPool *const bm);
 int getNumWriteIO (BM_BufferPool *const bm);
+// frames is either NULL or a caller-owned array of bm->numPages entries
+RC getPoolStatistics (BM_BufferPool *const bm, BM_PoolStatistics *stats,
+		BM_FrameStatistics *frames);
+RC resetPoolStatistics (BM_BufferPool *const bm);
 
 #endif
@@ -50,6 +50,35 @@ sprintPoolContent (BM_BufferPool *const bm)
 	return message;
 }
 
+void
+printPoolStatistics (BM_BufferPool *const bm)
+{
+	BM_PoolStatistics stats;
+	BM_FrameStatistics *frames;
+	int i;
+
+	frames = (BM_FrameStatistics *) malloc(sizeof(BM_FrameStatistics) * bm->numPages);
+	getPoolStatistics(bm, &stats, frames);
+
+	printf("{");
+	printStrat(bm);
+	printf(" %i}: pins %li, hits %li, misses %li, hit ratio %.3f\n", stats.numFrames,
+			stats.numPins, stats.numHits, stats.numMisses,
+			(stats.numPins == 0) ? 0.0 : (double) stats.numHits / stats.numPins);
+	printf("evictions %li (dirty %li), read IO %i, write IO %i\n",
+			stats.numEvictions, stats.numDirtyEvictions, stats.numReadIO, stats.numWriteIO);
+	printf("pin wait %.3f ms total, %.3f us avg miss, %.3f us max\n",
+			stats.pinWaitNanos / 1e6,
+			(stats.numMisses == 0) ? 0.0 : stats.pinWaitNanos / 1e3 / stats.numMisses,
+			stats.maxPinWaitNanos / 1e3);
+
+	for (i = 0; i < bm->numPages; i++)
+		printf("%s[%i%s%i:%li]", ((i == 0) ? "" : ","), frames[i].pageNum,
+				(frames[i].dirty ? "x": " "), frames[i].fixCount, frames[i].accessCount);
+	printf("\n");
+
+	free(frames);
+}
 
 void
 printPageContent (BM_PageHandle *const page)
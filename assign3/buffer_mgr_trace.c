@@ -0,0 +1,160 @@
+#include "buffer_mgr_trace.h"
+#include "dberror.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TRACE_MAGIC 0x52544D42 // "BMTR"
+#define TRACE_VERSION 1
+
+// A seqlock per slot: the writer clears seq before filling the slot and
+// publishes it last, so a dump drops slots being written while it copies
+typedef struct TraceSlot {
+    _Atomic unsigned long seq;
+    long long timestamp;
+    PageNumber pageNum;
+    int op;
+} TraceSlot;
+
+struct BM_Trace {
+    TraceSlot *slots;
+    unsigned long mask;
+    _Atomic unsigned long head;
+};
+
+// on-disk layout, fixed-width so traces move between machines
+typedef struct TraceFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t numEntries;
+    uint64_t dropped;
+} TraceFileHeader;
+
+typedef struct TraceFileEntry {
+    int64_t timestamp;
+    int32_t pageNum;
+    int32_t op;
+} TraceFileEntry;
+
+BM_Trace *createTrace(int capacity) {
+    unsigned long size = 1;
+    BM_Trace *trace;
+
+    if (capacity <= 0) return NULL;
+    while (size < (unsigned long)capacity) size <<= 1;
+
+    trace = (BM_Trace *)malloc(sizeof(BM_Trace));
+    if (trace == NULL) return NULL;
+    trace->slots = (TraceSlot *)calloc(size, sizeof(TraceSlot));
+    if (trace->slots == NULL) {
+        free(trace);
+        return NULL;
+    }
+    trace->mask = size - 1;
+    atomic_init(&trace->head, 0);
+    return trace;
+}
+
+void freeTrace(BM_Trace *trace) {
+    if (trace == NULL) return;
+    free(trace->slots);
+    free(trace);
+}
+
+void traceAccess(BM_Trace *trace, PageNumber pageNum, BM_TraceOp op) {
+    struct timespec ts;
+    unsigned long idx = atomic_fetch_add_explicit(&trace->head, 1, memory_order_relaxed);
+    TraceSlot *slot = &trace->slots[idx & trace->mask];
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->timestamp = (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    slot->pageNum = pageNum;
+    slot->op = op;
+    atomic_store_explicit(&slot->seq, idx + 1, memory_order_release);
+}
+
+long getTraceDropped(BM_Trace *trace) {
+    unsigned long head = atomic_load(&trace->head);
+    return (head > trace->mask + 1) ? (long)(head - trace->mask - 1) : 0;
+}
+
+RC dumpTrace(BM_Trace *trace, const char *fileName) {
+    unsigned long head = atomic_load_explicit(&trace->head, memory_order_acquire);
+    unsigned long first = (head > trace->mask + 1) ? head - trace->mask - 1 : 0;
+    TraceFileHeader header;
+    TraceFileEntry entry;
+    unsigned long i;
+    FILE *file = fopen(fileName, "wb");
+
+    if (file == NULL) return RC_FILE_NOT_FOUND;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.dropped = first;
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        return RC_WRITE_FAILED;
+    }
+
+    for (i = first; i < head; i++) {
+        TraceSlot *slot = &trace->slots[i & trace->mask];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != i + 1)
+            continue; // still being written, or already overwritten
+        entry.timestamp = slot->timestamp;
+        entry.pageNum = slot->pageNum;
+        entry.op = slot->op;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != i + 1)
+            continue; // reused by a writer while it was copied
+        if (fwrite(&entry, sizeof(entry), 1, file) != 1) {
+            fclose(file);
+            return RC_WRITE_FAILED;
+        }
+        header.numEntries++;
+    }
+
+    // patch in the number of entries actually written
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    fclose(file);
+    return RC_OK;
+}
+
+RC readTrace(const char *fileName, BM_TraceEntry **entries, int *numEntries) {
+    TraceFileHeader header;
+    TraceFileEntry entry;
+    uint64_t i;
+    FILE *file = fopen(fileName, "rb");
+
+    if (file == NULL) return RC_FILE_NOT_FOUND;
+    if (fread(&header, sizeof(header), 1, file) != 1
+            || header.magic != TRACE_MAGIC || header.version != TRACE_VERSION) {
+        fclose(file);
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+
+    *entries = (BM_TraceEntry *)malloc(sizeof(BM_TraceEntry) * (header.numEntries + 1));
+    if (*entries == NULL) {
+        fclose(file);
+        return RC_MEMORY_ALLOCATION_ERROR;
+    }
+
+    for (i = 0; i < header.numEntries; i++) {
+        if (fread(&entry, sizeof(entry), 1, file) != 1)
+            break;
+        (*entries)[i].timestamp = entry.timestamp;
+        (*entries)[i].pageNum = entry.pageNum;
+        (*entries)[i].op = (BM_TraceOp)entry.op;
+    }
+    *numEntries = (int)i;
+
+    fclose(file);
+    return RC_OK;
+}
@@ -0,0 +1,35 @@
+#ifndef BUFFER_MGR_TRACE_H
+#define BUFFER_MGR_TRACE_H
+
+#include "buffer_mgr.h"
+
+// Page access operations recorded by a trace
+typedef enum BM_TraceOp {
+	BM_TRACE_PIN = 0,
+	BM_TRACE_UNPIN = 1
+} BM_TraceOp;
+
+typedef struct BM_TraceEntry {
+	long long timestamp; // CLOCK_MONOTONIC nanoseconds
+	PageNumber pageNum;
+	BM_TraceOp op;
+} BM_TraceEntry;
+
+// Fixed-size ring of the most recent accesses; writers claim slots with an
+// atomic counter, so recording never takes a lock. Older entries are
+// overwritten once the ring is full.
+typedef struct BM_Trace BM_Trace;
+
+BM_Trace *createTrace (int capacity);
+void freeTrace (BM_Trace *trace);
+void traceAccess (BM_Trace *trace, PageNumber pageNum, BM_TraceOp op);
+long getTraceDropped (BM_Trace *trace);
+
+// binary trace files
+RC dumpTrace (BM_Trace *trace, const char *fileName);
+RC readTrace (const char *fileName, BM_TraceEntry **entries, int *numEntries);
+
+// attach a trace to a pool (NULL detaches); pinPage and unpinPage record into it
+RC setPoolTrace (BM_BufferPool *const bm, BM_Trace *trace);
+
+#endif
@@ -15,6 +15,12 @@ typedef int RC;
 #define RC_WRITE_FAILED 3
 #define RC_READ_NON_EXISTING_PAGE 4
 
+/* Buffer Manager Errors */
+#define RC_BM_NO_FREE_FRAME 100
+#define RC_BM_PINNED_PAGES_IN_POOL 101
+#define RC_BM_PAGE_NOT_IN_POOL 102
+#define RC_BM_PAGE_PINNED 103
+
 /* Record Manager Errors */
 #define RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE 200
 #define RC_RM_EXPR_RESULT_IS_NOT_BOOLEAN 201
@@ -22,6 +28,15 @@ typedef int RC;
 #define RC_RM_NO_MORE_TUPLES 203
 #define RC_RM_NO_PRINT_FOR_DATATYPE 204
 #define RC_RM_UNKNOWN_DATATYPE 205
+#define RC_RM_ATTR_TYPE_MISMATCH 206
+#define RC_RM_RECORD_TOO_LARGE 207
+#define RC_RM_NO_SUCH_TUPLE 208
+#define RC_RM_PAGE_FULL 209
+#define RC_RM_WRITE_CONFLICT 210
+#define RC_RM_NO_TRANSACTION 211
+#define RC_RM_TRANSACTION_ACTIVE 212
+#define RC_RM_SCHEMA_TOO_LARGE 213
+#define RC_RM_NO_SUCH_ATTR 214
 
 /* Index Manager Errors */
 #define RC_IM_KEY_NOT_FOUND 300
@@ -29,6 +44,10 @@ typedef int RC;
 #define RC_IM_N_TO_LARGE 302
 #define RC_IM_NO_MORE_ENTRIES 303
 
+/* Lock Manager Errors */
+#define RC_LK_DEADLOCK 400
+#define RC_LK_TIMEOUT 401
+
 /* General Errors */
 #define RC_GENERAL_ERROR -99
 #define RC_ERROR -1
@@ -14,6 +14,9 @@ valueEquals (Value *left, Value *right, Value *result)
 		THROW(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, "equality comparison only supported for values of the same datatype");
 
 	result->dt = DT_BOOL;
+	result->isNull = left->isNull || right->isNull;
+	if (result->isNull)
+		return RC_OK;
 
 	switch(left->dt) {
 	case DT_INT:
@@ -40,6 +43,9 @@ valueSmaller (Value *left, Value *right, Value *result)
 		THROW(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, "equality comparison only supported for values of the same datatype");
 
 	result->dt = DT_BOOL;
+	result->isNull = left->isNull || right->isNull;
+	if (result->isNull)
+		return RC_OK;
 
 	switch(left->dt) {
 	case DT_INT:
@@ -64,6 +70,7 @@ boolNot (Value *input, Value *result)
 	if (input->dt != DT_BOOL)
 		THROW(RC_RM_BOOLEAN_EXPR_ARG_IS_NOT_BOOLEAN, "boolean NOT requires boolean input");
 	result->dt = DT_BOOL;
+	result->isNull = input->isNull;
 	result->v.boolV = !(input->v.boolV);
 
 	return RC_OK;
@@ -74,7 +81,11 @@ boolAnd (Value *left, Value *right, Value *result)
 {
 	if (left->dt != DT_BOOL || right->dt != DT_BOOL)
 		THROW(RC_RM_BOOLEAN_EXPR_ARG_IS_NOT_BOOLEAN, "boolean AND requires boolean inputs");
-	result->v.boolV = (left->v.boolV && right->v.boolV);
+	result->dt = DT_BOOL;
+	// false if either side is, whether or not the other is NULL
+	result->v.boolV = (left->v.boolV || left->isNull) && (right->v.boolV || right->isNull);
+	result->isNull = result->v.boolV && (left->isNull || right->isNull);
+	result->v.boolV = result->v.boolV && !result->isNull;
 
 	return RC_OK;
 }
@@ -84,7 +95,10 @@ boolOr (Value *left, Value *right, Value *result)
 {
 	if (left->dt != DT_BOOL || right->dt != DT_BOOL)
 		THROW(RC_RM_BOOLEAN_EXPR_ARG_IS_NOT_BOOLEAN, "boolean OR requires boolean inputs");
-	result->v.boolV = (left->v.boolV || right->v.boolV);
+	result->dt = DT_BOOL;
+	// true if either side is, whether or not the other is NULL
+	result->v.boolV = (left->v.boolV && !left->isNull) || (right->v.boolV && !right->isNull);
+	result->isNull = !result->v.boolV && (left->isNull || right->isNull);
 
 	return RC_OK;
 }
@@ -140,9 +154,38 @@ evalExpr (Record *record, Schema *schema, Expr *expr, Value **result)
 		CPVAL(*result,expr->expr.cons);
 		break;
 	case EXPR_ATTRREF:
-		free(*result);
-		CHECK(getAttr(record, schema, expr->expr.attrRef, result));
+	{
+		int attr = expr->expr.attrRef;
+		(*result)->dt = schema->dataTypes[attr];
+		if (isAttrNull(record, schema, attr))
+		{
+			(*result)->isNull = TRUE;
+			(*result)->v.stringV = NULL;
+			break;
+		}
+		switch((*result)->dt)
+		{
+		case DT_INT:
+			(*result)->v.intV = getAttrInt(record, schema, attr);
+			break;
+		case DT_FLOAT:
+			(*result)->v.floatV = getAttrFloat(record, schema, attr);
+			break;
+		case DT_BOOL:
+			(*result)->v.boolV = getAttrBool(record, schema, attr);
+			break;
+		case DT_STRING:
+		{
+			int len;
+			const char *str = getAttrString(record, schema, attr, &len);
+			(*result)->v.stringV = (char *) malloc(len + 1);
+			memcpy((*result)->v.stringV, str, len);
+			(*result)->v.stringV[len] = '\0';
+		}
 		break;
+		}
+	}
+	break;
 	}
 
 	return RC_OK;
@@ -188,3 +231,340 @@ freeVal (Value *val)
 	free(val);
 }
 
+
+// Compiled conditions. The program runs over a stack of three-valued
+// booleans; comparisons read their operands straight from the record.
+#define TRI_FALSE 0
+#define TRI_TRUE 1
+#define TRI_NULL 2
+
+typedef enum ProgCode {
+	PROG_PUSH,      // a constant boolean
+	PROG_ATTR_BOOL, // a boolean attribute
+	PROG_COMPARE,
+	PROG_NOT,
+	PROG_AND,
+	PROG_OR
+} ProgCode;
+
+// an attribute, or a constant when attrNum is -1
+typedef struct ProgOperand {
+	int attrNum;
+	int offset;
+	Value value;
+	int length;     // of a constant string
+} ProgOperand;
+
+typedef struct ProgInstr {
+	ProgCode code;
+	OpType op;      // of PROG_COMPARE
+	DataType dt;    // of its operands
+	char constant;  // of PROG_PUSH
+	int attrNum;    // of PROG_ATTR_BOOL
+	ProgOperand args[2];
+} ProgInstr;
+
+struct ExprProgram {
+	Schema *schema;
+	ProgInstr *code;
+	int length;
+	char *stack;
+	int stackSize;
+};
+
+// an operand's value as read for a comparison
+typedef struct ProgValue {
+	int intV;
+	float floatV;
+	bool boolV;
+	const char *stringV;
+	int length;
+} ProgValue;
+
+static int
+countNodes (Expr *expr)
+{
+	if (expr->type != EXPR_OP)
+		return 1;
+	if (expr->expr.op->type == OP_BOOL_NOT)
+		return 1 + countNodes(expr->expr.op->args[0]);
+	return 1 + countNodes(expr->expr.op->args[0]) + countNodes(expr->expr.op->args[1]);
+}
+
+static char
+toTri (Value *value)
+{
+	if (value->isNull)
+		return TRI_NULL;
+	return value->v.boolV ? TRI_TRUE : TRI_FALSE;
+}
+
+static bool
+compileOperand (ExprProgram *program, Expr *expr, ProgOperand *operand, DataType *dt)
+{
+	Schema *schema = program->schema;
+
+	if (expr->type == EXPR_ATTRREF)
+	{
+		if (expr->expr.attrRef < 0 || expr->expr.attrRef >= schema->numAttr)
+			return FALSE;
+		operand->attrNum = expr->expr.attrRef;
+		operand->offset = schema->attrOffsets[operand->attrNum];
+		*dt = schema->dataTypes[operand->attrNum];
+		return TRUE;
+	}
+	if (expr->type != EXPR_CONST)
+		return FALSE;
+	operand->attrNum = -1;
+	CPVAL(&operand->value, expr->expr.cons);
+	if (operand->value.dt == DT_STRING && !operand->value.isNull)
+		operand->length = strlen(operand->value.v.stringV);
+	*dt = operand->value.dt;
+	return TRUE;
+}
+
+// Appends the instructions of expr, whose value ends up at stack depth
+// depth + 1. Fails for what evalExpr would reject and for comparisons of
+// anything but attributes and constants.
+static bool
+compileNode (ExprProgram *program, Expr *expr, int depth)
+{
+	ProgInstr *instr;
+	DataType dt[2];
+
+	if (depth + 1 > program->stackSize)
+		program->stackSize = depth + 1;
+	switch(expr->type)
+	{
+	case EXPR_CONST:
+		if (expr->expr.cons->dt != DT_BOOL)
+			return FALSE;
+		instr = &program->code[program->length++];
+		instr->code = PROG_PUSH;
+		instr->constant = toTri(expr->expr.cons);
+		return TRUE;
+	case EXPR_ATTRREF:
+		if (expr->expr.attrRef < 0 || expr->expr.attrRef >= program->schema->numAttr
+				|| program->schema->dataTypes[expr->expr.attrRef] != DT_BOOL)
+			return FALSE;
+		instr = &program->code[program->length++];
+		instr->code = PROG_ATTR_BOOL;
+		instr->attrNum = expr->expr.attrRef;
+		return TRUE;
+	case EXPR_OP:
+		break;
+	}
+
+	switch(expr->expr.op->type)
+	{
+	case OP_BOOL_NOT:
+		if (!compileNode(program, expr->expr.op->args[0], depth))
+			return FALSE;
+		program->code[program->length++].code = PROG_NOT;
+		return TRUE;
+	case OP_BOOL_AND:
+	case OP_BOOL_OR:
+		if (!compileNode(program, expr->expr.op->args[0], depth)
+				|| !compileNode(program, expr->expr.op->args[1], depth + 1))
+			return FALSE;
+		program->code[program->length++].code = (expr->expr.op->type == OP_BOOL_AND) ? PROG_AND : PROG_OR;
+		return TRUE;
+	case OP_COMP_EQUAL:
+	case OP_COMP_SMALLER:
+		instr = &program->code[program->length++];
+		memset(instr, 0, sizeof(ProgInstr));
+		instr->code = PROG_COMPARE;
+		instr->op = expr->expr.op->type;
+		if (!compileOperand(program, expr->expr.op->args[0], &instr->args[0], &dt[0])
+				|| !compileOperand(program, expr->expr.op->args[1], &instr->args[1], &dt[1]))
+			return FALSE;
+		instr->dt = dt[0];
+		return dt[0] == dt[1];
+	}
+	return FALSE;
+}
+
+static void
+loadOperand (ExprProgram *program, ProgOperand *operand, DataType dt, Record *record, ProgValue *value)
+{
+	const char *data = record->data + operand->offset;
+
+	switch(dt)
+	{
+	case DT_INT:
+		if (operand->attrNum < 0)
+			value->intV = operand->value.v.intV;
+		else
+			memcpy(&value->intV, data, sizeof(int));
+		break;
+	case DT_FLOAT:
+		if (operand->attrNum < 0)
+			value->floatV = operand->value.v.floatV;
+		else
+			memcpy(&value->floatV, data, sizeof(float));
+		break;
+	case DT_BOOL:
+		if (operand->attrNum < 0)
+			value->boolV = operand->value.v.boolV;
+		else
+			memcpy(&value->boolV, data, sizeof(bool));
+		break;
+	case DT_STRING:
+		if (operand->attrNum < 0)
+		{
+			value->stringV = operand->value.v.stringV;
+			value->length = operand->length;
+		}
+		else
+			value->stringV = getAttrString(record, program->schema, operand->attrNum, &value->length);
+		break;
+	}
+}
+
+static bool
+operandNull (ProgOperand *operand, Record *record, Schema *schema)
+{
+	if (operand->attrNum < 0)
+		return operand->value.isNull;
+	return isAttrNull(record, schema, operand->attrNum);
+}
+
+static char
+compare (ExprProgram *program, ProgInstr *instr, Record *record)
+{
+	ProgValue l, r;
+	int cmp = 0;
+
+	if (operandNull(&instr->args[0], record, program->schema) || operandNull(&instr->args[1], record, program->schema))
+		return TRI_NULL;
+	loadOperand(program, &instr->args[0], instr->dt, record, &l);
+	loadOperand(program, &instr->args[1], instr->dt, record, &r);
+	switch(instr->dt)
+	{
+	case DT_INT:
+		cmp = (l.intV > r.intV) - (l.intV < r.intV);
+		break;
+	case DT_FLOAT:
+		if (instr->op == OP_COMP_EQUAL)
+			return (l.floatV == r.floatV) ? TRI_TRUE : TRI_FALSE;
+		return (l.floatV < r.floatV) ? TRI_TRUE : TRI_FALSE;
+	case DT_BOOL:
+		cmp = (int) l.boolV - (int) r.boolV;
+		break;
+	case DT_STRING:
+		// as strcmp; neither holds a NUL within its length
+		cmp = memcmp(l.stringV, r.stringV, (l.length < r.length) ? l.length : r.length);
+		if (cmp == 0)
+			cmp = l.length - r.length;
+		break;
+	}
+	if (instr->op == OP_COMP_EQUAL)
+		return (cmp == 0) ? TRI_TRUE : TRI_FALSE;
+	return (cmp < 0) ? TRI_TRUE : TRI_FALSE;
+}
+
+ExprProgram *
+compileExpr (Expr *expr, Schema *schema)
+{
+	ExprProgram *program = (ExprProgram *) calloc(1, sizeof(ExprProgram));
+
+	if (program == NULL)
+		return NULL;
+	program->schema = schema;
+	program->code = (ProgInstr *) calloc(countNodes(expr), sizeof(ProgInstr));
+	if (program->code == NULL || !compileNode(program, expr, 0)
+			|| (program->stack = (char *) malloc(program->stackSize)) == NULL)
+	{
+		freeProgram(program);
+		return NULL;
+	}
+	return program;
+}
+
+bool
+evalProgram (ExprProgram *program, Record *record)
+{
+	char *stack = program->stack;
+	int top = 0;
+	char l, r;
+
+	for(int i = 0; i < program->length; i++)
+	{
+		ProgInstr *instr = &program->code[i];
+		switch(instr->code)
+		{
+		case PROG_PUSH:
+			stack[top++] = instr->constant;
+			break;
+		case PROG_ATTR_BOOL:
+			if (isAttrNull(record, program->schema, instr->attrNum))
+				stack[top++] = TRI_NULL;
+			else
+				stack[top++] = getAttrBool(record, program->schema, instr->attrNum) ? TRI_TRUE : TRI_FALSE;
+			break;
+		case PROG_COMPARE:
+			stack[top++] = compare(program, instr, record);
+			break;
+		case PROG_NOT:
+			if (stack[top - 1] != TRI_NULL)
+				stack[top - 1] = !stack[top - 1];
+			break;
+		case PROG_AND:
+			r = stack[--top];
+			l = stack[top - 1];
+			if (l == TRI_FALSE || r == TRI_FALSE)
+				stack[top - 1] = TRI_FALSE;
+			else if (l == TRI_NULL || r == TRI_NULL)
+				stack[top - 1] = TRI_NULL;
+			else
+				stack[top - 1] = TRI_TRUE;
+			break;
+		case PROG_OR:
+			r = stack[--top];
+			l = stack[top - 1];
+			if (l == TRI_TRUE || r == TRI_TRUE)
+				stack[top - 1] = TRI_TRUE;
+			else if (l == TRI_NULL || r == TRI_NULL)
+				stack[top - 1] = TRI_NULL;
+			else
+				stack[top - 1] = TRI_FALSE;
+			break;
+		}
+	}
+	return top == 1 && stack[0] == TRI_TRUE;
+}
+
+bool
+programComparison (ExprProgram *program, int *attrNum, OpType *op, Value **constant, bool *constFirst)
+{
+	ProgInstr *instr = &program->code[0];
+	int c;
+
+	if (program->length != 1 || instr->code != PROG_COMPARE)
+		return FALSE;
+	if ((instr->args[0].attrNum < 0) == (instr->args[1].attrNum < 0))
+		return FALSE;
+	c = (instr->args[0].attrNum < 0) ? 0 : 1;
+	if (instr->args[c].value.isNull)
+		return FALSE;
+	*attrNum = instr->args[1 - c].attrNum;
+	*op = instr->op;
+	*constant = &instr->args[c].value;
+	*constFirst = (c == 0);
+	return TRUE;
+}
+
+void
+freeProgram (ExprProgram *program)
+{
+	for(int i = 0; program->code != NULL && i < program->length; i++)
+	{
+		ProgInstr *instr = &program->code[i];
+		for(int j = 0; instr->code == PROG_COMPARE && j < 2; j++)
+			if (instr->args[j].attrNum < 0 && instr->args[j].value.dt == DT_STRING)
+				free(instr->args[j].value.v.stringV);
+	}
+	free(program->code);
+	free(program->stack);
+	free(program);
+}
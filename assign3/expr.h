@@ -34,7 +34,9 @@ typedef struct Operator {
   Expr **args;
 } Operator;
 
-// expression evaluation methods
+// expression evaluation methods. A comparison with a NULL operand is NULL;
+// AND, OR and NOT follow three-valued logic, so NULL AND false is false
+// and NULL OR true is true.
 extern RC valueEquals (Value *left, Value *right, Value *result);
 extern RC valueSmaller (Value *left, Value *right, Value *result);
 extern RC boolNot (Value *input, Value *result);
@@ -44,10 +46,49 @@ extern RC evalExpr (Record *record, Schema *schema, Expr *expr, Value **result);
 extern RC freeExpr (Expr *expr);
 extern void freeVal(Value *val);
 
+// A condition compiled for evaluating it against many records: a flat
+// program with the attributes' offsets and types resolved, which evaluates
+// without allocating. compileExpr returns NULL for a condition evalExpr
+// would reject, or whose comparisons take anything but attributes and
+// constants; evalExpr still evaluates those. evalProgram tells whether the
+// condition is true for the record, not false or NULL. A program keeps its
+// own copy of the constants, but is used by one thread at a time.
+typedef struct ExprProgram ExprProgram;
+
+extern ExprProgram *compileExpr (Expr *expr, Schema *schema);
+extern bool evalProgram (ExprProgram *program, Record *record);
+extern void freeProgram (ExprProgram *program);
+// Whether the program is a single comparison of an attribute with a
+// constant that is not NULL, constFirst telling which side the constant is
+extern bool programComparison (ExprProgram *program, int *attrNum, OpType *op, Value **constant, bool *constFirst);
+
+// Comparison kernels (expr_simd.c) for many values of an int or float
+// attribute at once: count values, each stride bytes after the one
+// before, starting at base. They set selection to the indexes of the
+// values for which value OP constant holds (constant OP value if
+// constFirst), as valueEquals and valueSmaller tell, and return how many
+// there are. AVX2 or SSE4.2 is used when the processor has it; NULLs are
+// the caller's to leave out.
+typedef enum SimdLevel {
+  SIMD_SCALAR = 0,
+  SIMD_SSE42 = 1,
+  SIMD_AVX2 = 2
+} SimdLevel;
+
+extern int selectCompare (DataType dt, OpType op, bool constFirst, const char *base, int stride, int count,
+		const Value *constant, int *selection);
+extern SimdLevel getSimdLevel (void);
+// Limits the kernels to a level, for testing; returns the level now used
+extern SimdLevel setSimdLevel (SimdLevel level);
+
 
 #define CPVAL(_result,_input)						\
   do {									\
     (_result)->dt = _input->dt;						\
+    (_result)->isNull = _input->isNull;					\
+    if (_input->isNull)							\
+      (_result)->v.stringV = NULL;					\
+    else								\
   switch(_input->dt)							\
     {									\
     case DT_INT:							\
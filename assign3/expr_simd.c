@@ -0,0 +1,233 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "expr.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86 1
+#endif
+
+// What a kernel tests each value v for: v = c, v < c or c < v
+typedef enum SimdTest {
+	TEST_EQUAL,
+	TEST_SMALLER,
+	TEST_GREATER
+} SimdTest;
+
+typedef int (*IntKernel) (const char *base, int stride, int count, SimdTest test, int value, int *selection);
+typedef int (*FloatKernel) (const char *base, int stride, int count, SimdTest test, float value, int *selection);
+
+static pthread_once_t simdOnce = PTHREAD_ONCE_INIT;
+static SimdLevel supportedLevel = SIMD_SCALAR;
+static SimdLevel currentLevel = SIMD_SCALAR;
+
+static int
+selectIntsScalar (const char *base, int stride, int count, SimdTest test, int value, int *selection)
+{
+	int n = 0, v;
+
+	for(int i = 0; i < count; i++)
+	{
+		memcpy(&v, base + (size_t) i * stride, sizeof(int));
+		// branch-free, so selective and unselective filters cost the same
+		selection[n] = i;
+		n += (test == TEST_EQUAL) ? (v == value) : (test == TEST_SMALLER) ? (v < value) : (v > value);
+	}
+	return n;
+}
+
+static int
+selectFloatsScalar (const char *base, int stride, int count, SimdTest test, float value, int *selection)
+{
+	int n = 0;
+	float v;
+
+	for(int i = 0; i < count; i++)
+	{
+		memcpy(&v, base + (size_t) i * stride, sizeof(float));
+		selection[n] = i;
+		n += (test == TEST_EQUAL) ? (v == value) : (test == TEST_SMALLER) ? (v < value) : (v > value);
+	}
+	return n;
+}
+
+#ifdef SIMD_X86
+
+// The values from start on that a vector no longer covers, with their
+// indexes from the start of the batch
+static int
+tailScalarInts (const char *base, int stride, int start, int count, SimdTest test, int value, int *selection)
+{
+	int n = selectIntsScalar(base + (size_t) start * stride, stride, count - start, test, value, selection);
+
+	for(int k = 0; k < n; k++)
+		selection[k] += start;
+	return n;
+}
+
+static int
+tailScalarFloats (const char *base, int stride, int start, int count, SimdTest test, float value, int *selection)
+{
+	int n = selectFloatsScalar(base + (size_t) start * stride, stride, count - start, test, value, selection);
+
+	for(int k = 0; k < n; k++)
+		selection[k] += start;
+	return n;
+}
+
+// Appends the lanes set in mask, from the first, as indexes from start
+static inline int
+appendMask (unsigned mask, int start, int *selection, int n)
+{
+	while (mask != 0)
+	{
+		selection[n++] = start + __builtin_ctz(mask);
+		mask &= mask - 1;
+	}
+	return n;
+}
+
+__attribute__((target("sse4.2"))) static inline __m128i
+loadInts4 (const char *base, int stride, int i)
+{
+	int v[4];
+
+	if (stride == sizeof(int))
+		return _mm_loadu_si128((const __m128i *) (base + (size_t) i * stride));
+	for(int k = 0; k < 4; k++)
+		memcpy(&v[k], base + (size_t) (i + k) * stride, sizeof(int));
+	return _mm_loadu_si128((const __m128i *) v);
+}
+
+__attribute__((target("sse4.2"))) static int
+selectIntsSse42 (const char *base, int stride, int count, SimdTest test, int value, int *selection)
+{
+	__m128i c = _mm_set1_epi32(value), v, m;
+	int n = 0, i;
+
+	for(i = 0; i + 4 <= count; i += 4)
+	{
+		v = loadInts4(base, stride, i);
+		m = (test == TEST_EQUAL) ? _mm_cmpeq_epi32(v, c)
+				: (test == TEST_SMALLER) ? _mm_cmpgt_epi32(c, v) : _mm_cmpgt_epi32(v, c);
+		n = appendMask(_mm_movemask_ps(_mm_castsi128_ps(m)), i, selection, n);
+	}
+	return n + tailScalarInts(base, stride, i, count, test, value, selection + n);
+}
+
+__attribute__((target("sse4.2"))) static int
+selectFloatsSse42 (const char *base, int stride, int count, SimdTest test, float value, int *selection)
+{
+	__m128 c = _mm_set1_ps(value), v, m;
+	int n = 0, i;
+
+	for(i = 0; i + 4 <= count; i += 4)
+	{
+		v = _mm_castsi128_ps(loadInts4(base, stride, i));
+		m = (test == TEST_EQUAL) ? _mm_cmpeq_ps(v, c)
+				: (test == TEST_SMALLER) ? _mm_cmplt_ps(v, c) : _mm_cmpgt_ps(v, c);
+		n = appendMask(_mm_movemask_ps(m), i, selection, n);
+	}
+	return n + tailScalarFloats(base, stride, i, count, test, value, selection + n);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+loadInts8 (const char *base, int stride, int i, __m256i offsets)
+{
+	if (stride == sizeof(int))
+		return _mm256_loadu_si256((const __m256i *) (base + (size_t) i * stride));
+	return _mm256_i32gather_epi32((const int *) (base + (size_t) i * stride), offsets, 1);
+}
+
+__attribute__((target("avx2"))) static int
+selectIntsAvx2 (const char *base, int stride, int count, SimdTest test, int value, int *selection)
+{
+	__m256i c = _mm256_set1_epi32(value), v, m;
+	__m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+	int n = 0, i;
+
+	for(i = 0; i + 8 <= count; i += 8)
+	{
+		v = loadInts8(base, stride, i, offsets);
+		m = (test == TEST_EQUAL) ? _mm256_cmpeq_epi32(v, c)
+				: (test == TEST_SMALLER) ? _mm256_cmpgt_epi32(c, v) : _mm256_cmpgt_epi32(v, c);
+		n = appendMask(_mm256_movemask_ps(_mm256_castsi256_ps(m)), i, selection, n);
+	}
+	return n + tailScalarInts(base, stride, i, count, test, value, selection + n);
+}
+
+__attribute__((target("avx2"))) static int
+selectFloatsAvx2 (const char *base, int stride, int count, SimdTest test, float value, int *selection)
+{
+	__m256 c = _mm256_set1_ps(value), v, m;
+	__m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+	int n = 0, i;
+
+	for(i = 0; i + 8 <= count; i += 8)
+	{
+		v = _mm256_castsi256_ps(loadInts8(base, stride, i, offsets));
+		m = (test == TEST_EQUAL) ? _mm256_cmp_ps(v, c, _CMP_EQ_OQ)
+				: (test == TEST_SMALLER) ? _mm256_cmp_ps(v, c, _CMP_LT_OQ) : _mm256_cmp_ps(v, c, _CMP_GT_OQ);
+		n = appendMask(_mm256_movemask_ps(m), i, selection, n);
+	}
+	return n + tailScalarFloats(base, stride, i, count, test, value, selection + n);
+}
+
+#endif // SIMD_X86
+
+static void
+detectLevel (void)
+{
+#ifdef SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		supportedLevel = SIMD_AVX2;
+	else if (__builtin_cpu_supports("sse4.2"))
+		supportedLevel = SIMD_SSE42;
+#endif
+	currentLevel = supportedLevel;
+}
+
+SimdLevel
+getSimdLevel (void)
+{
+	pthread_once(&simdOnce, detectLevel);
+	return currentLevel;
+}
+
+SimdLevel
+setSimdLevel (SimdLevel level)
+{
+	pthread_once(&simdOnce, detectLevel);
+	currentLevel = (level < supportedLevel) ? level : supportedLevel;
+	return currentLevel;
+}
+
+int
+selectCompare (DataType dt, OpType op, bool constFirst, const char *base, int stride, int count,
+		const Value *constant, int *selection)
+{
+	SimdTest test = (op == OP_COMP_EQUAL) ? TEST_EQUAL : constFirst ? TEST_GREATER : TEST_SMALLER;
+	IntKernel ints = selectIntsScalar;
+	FloatKernel floats = selectFloatsScalar;
+
+#ifdef SIMD_X86
+	switch(getSimdLevel())
+	{
+	case SIMD_AVX2:
+		ints = selectIntsAvx2;
+		floats = selectFloatsAvx2;
+		break;
+	case SIMD_SSE42:
+		ints = selectIntsSse42;
+		floats = selectFloatsSse42;
+		break;
+	case SIMD_SCALAR:
+		break;
+	}
+#endif
+	if (dt == DT_INT)
+		return ints(base, stride, count, test, constant->v.intV, selection);
+	return floats(base, stride, count, test, constant->v.floatV, selection);
+}
@@ -0,0 +1,349 @@
+#include "lock_mgr.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LK_BUCKETS 1024
+#define LK_DEFAULT_TIMEOUT_MILLIS 10000
+
+// Whether a mode held by one transaction lets another be granted
+static const bool compatible[LK_NUM_MODES][LK_NUM_MODES] = {
+    //           IS     IX     S      SIX    X
+    /* IS  */ { true,  true,  true,  true,  false },
+    /* IX  */ { true,  true,  false, false, false },
+    /* S   */ { true,  false, true,  false, false },
+    /* SIX */ { true,  false, false, false, false },
+    /* X   */ { false, false, false, false, false }
+};
+
+// The weakest mode that covers both
+static const LK_Mode combined[LK_NUM_MODES][LK_NUM_MODES] = {
+    /* IS  */ { LOCK_IS,  LOCK_IX,  LOCK_S,   LOCK_SIX, LOCK_X },
+    /* IX  */ { LOCK_IX,  LOCK_IX,  LOCK_SIX, LOCK_SIX, LOCK_X },
+    /* S   */ { LOCK_S,   LOCK_SIX, LOCK_S,   LOCK_SIX, LOCK_X },
+    /* SIX */ { LOCK_SIX, LOCK_SIX, LOCK_SIX, LOCK_SIX, LOCK_X },
+    /* X   */ { LOCK_X,   LOCK_X,   LOCK_X,   LOCK_X,   LOCK_X }
+};
+
+struct LK_Lock;
+struct LK_Owner;
+
+// A transaction's hold on a lock, or its wait for one. A conversion to a
+// stronger mode waits with the weaker one still granted.
+typedef struct LK_Request {
+    struct LK_Owner *owner;
+    struct LK_Lock *lock;
+    LK_Mode mode;    // granted mode
+    LK_Mode wanted;  // mode asked for; equals mode unless waiting
+    bool granted;
+    struct LK_Request *next;      // in the lock's queue, oldest first
+    struct LK_Request *nextOwned; // among the owner's requests
+} LK_Request;
+
+// A table (rid.page < 0) or record lock; exists while it has requests
+typedef struct LK_Lock {
+    char *table;
+    RID rid;
+    LK_Request *queue;
+    struct LK_Lock *next; // in its bucket
+} LK_Lock;
+
+typedef struct LK_Owner {
+    TxnId xid;
+    LK_Request *requests;
+    LK_Request *waiting; // request it is blocked on, or NULL
+    pthread_cond_t wake;
+    unsigned visited;    // deadlock search that last reached it
+    struct LK_Owner *next;
+} LK_Owner;
+
+// Locks and their owners, both hashed, under a single mutex: requests
+// hold it only to look at a queue, and the deadlock search needs every
+// queue to stay still while it follows the wait-for graph.
+static struct {
+    pthread_mutex_t lock;
+    LK_Lock *locks[LK_BUCKETS];
+    LK_Owner *owners[LK_BUCKETS];
+    int timeoutMillis;
+    unsigned search;
+    LK_Statistics stats;
+} lockState = { .lock = PTHREAD_MUTEX_INITIALIZER, .timeoutMillis = LK_DEFAULT_TIMEOUT_MILLIS };
+
+static unsigned lockHash(const char *table, RID rid) {
+    unsigned hash = 2166136261u; // FNV-1a
+    for (const char *c = table; *c != '\0'; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 16777619u;
+    }
+    hash ^= (unsigned)rid.page * 2654435761u;
+    hash ^= (unsigned)rid.slot * 40503u;
+    return hash % LK_BUCKETS;
+}
+
+static LK_Owner *findOwner(TxnId xid, bool create) {
+    LK_Owner **bucket = &lockState.owners[xid % LK_BUCKETS];
+    LK_Owner *owner;
+
+    for (owner = *bucket; owner != NULL; owner = owner->next)
+        if (owner->xid == xid)
+            return owner;
+    if (!create || (owner = (LK_Owner *)calloc(1, sizeof(LK_Owner))) == NULL)
+        return NULL;
+    owner->xid = xid;
+    pthread_cond_init(&owner->wake, NULL);
+    owner->next = *bucket;
+    *bucket = owner;
+    return owner;
+}
+
+static LK_Lock *findLock(const char *table, RID rid) {
+    LK_Lock **bucket = &lockState.locks[lockHash(table, rid)];
+    LK_Lock *lock;
+
+    for (lock = *bucket; lock != NULL; lock = lock->next)
+        if (lock->rid.page == rid.page && lock->rid.slot == rid.slot && strcmp(lock->table, table) == 0)
+            return lock;
+    if ((lock = (LK_Lock *)calloc(1, sizeof(LK_Lock))) == NULL)
+        return NULL;
+    if ((lock->table = (char *)malloc(strlen(table) + 1)) == NULL) {
+        free(lock);
+        return NULL;
+    }
+    strcpy(lock->table, table);
+    lock->rid = rid;
+    lock->next = *bucket;
+    *bucket = lock;
+    return lock;
+}
+
+static void freeLockIfUnused(LK_Lock *lock) {
+    LK_Lock **link = &lockState.locks[lockHash(lock->table, lock->rid)];
+
+    if (lock->queue != NULL)
+        return;
+    while (*link != lock)
+        link = &(*link)->next;
+    *link = lock->next;
+    free(lock->table);
+    free(lock);
+}
+
+static bool isWaiting(const LK_Request *r) {
+    return !r->granted || r->wanted != r->mode;
+}
+
+// Whether q keeps r from being granted. ahead tells whether q is before r
+// in the queue: a new request waits behind every waiting request before
+// it and every pending conversion, so waiters are served in order, while a
+// conversion only waits for the modes others hold.
+static bool blocks(const LK_Request *q, const LK_Request *r, bool ahead) {
+    if (q->owner == r->owner)
+        return false;
+    if (q->granted && !compatible[q->mode][r->wanted])
+        return true;
+    return !r->granted && isWaiting(q) && (ahead || q->granted);
+}
+
+static bool grantable(const LK_Request *r) {
+    bool ahead = true;
+
+    for (const LK_Request *q = r->lock->queue; q != NULL; q = q->next) {
+        if (q == r)
+            ahead = false;
+        else if (blocks(q, r, ahead))
+            return false;
+    }
+    return true;
+}
+
+// Grants what can now be granted after a lock was released or a request
+// gave up
+static void wakeWaiters(LK_Lock *lock) {
+    for (LK_Request *q = lock->queue; q != NULL; q = q->next) {
+        if (isWaiting(q) && grantable(q)) {
+            q->mode = q->wanted;
+            q->granted = true;
+            pthread_cond_signal(&q->owner->wake);
+        }
+    }
+}
+
+// Depth-first search of the wait-for graph from owner for a path back to
+// the transaction that started the search
+static bool reaches(LK_Owner *owner, LK_Owner *start) {
+    LK_Request *r = owner->waiting;
+    bool ahead = true;
+
+    owner->visited = lockState.search;
+    for (LK_Request *q = r->lock->queue; q != NULL; q = q->next) {
+        if (q == r) {
+            ahead = false;
+            continue;
+        }
+        if (!blocks(q, r, ahead))
+            continue;
+        if (q->owner == start)
+            return true;
+        if (q->owner->waiting != NULL && q->owner->visited != lockState.search
+                && reaches(q->owner, start))
+            return true;
+    }
+    return false;
+}
+
+static void unlinkRequest(LK_Request *r) {
+    LK_Request **link;
+
+    for (link = &r->lock->queue; *link != r; link = &(*link)->next)
+        ;
+    *link = r->next;
+    for (link = &r->owner->requests; *link != r; link = &(*link)->nextOwned)
+        ;
+    *link = r->nextOwned;
+}
+
+// Withdraws a request that is still waiting; a conversion falls back to the
+// mode already held
+static void cancel(LK_Request *r) {
+    LK_Lock *lock = r->lock;
+
+    if (r->granted) {
+        r->wanted = r->mode;
+    } else {
+        unlinkRequest(r);
+        free(r);
+    }
+    wakeWaiters(lock);
+    freeLockIfUnused(lock);
+}
+
+static RC acquire(TxnId xid, const char *table, RID rid, LK_Mode mode) {
+    struct timespec deadline;
+    LK_Owner *owner;
+    LK_Lock *lock;
+    LK_Request *r;
+    int timeout;
+    RC rc = RC_OK;
+
+    pthread_mutex_lock(&lockState.lock);
+    if ((owner = findOwner(xid, true)) == NULL || (lock = findLock(table, rid)) == NULL) {
+        pthread_mutex_unlock(&lockState.lock);
+        return RC_MEMORY_ALLOCATION_ERROR;
+    }
+
+    for (r = lock->queue; r != NULL && r->owner != owner; r = r->next)
+        ;
+    if (r != NULL) {
+        if (combined[r->mode][mode] == r->mode) {
+            pthread_mutex_unlock(&lockState.lock);
+            return RC_OK;
+        }
+        r->wanted = combined[r->mode][mode];
+    } else {
+        if ((r = (LK_Request *)calloc(1, sizeof(LK_Request))) == NULL) {
+            freeLockIfUnused(lock);
+            pthread_mutex_unlock(&lockState.lock);
+            return RC_MEMORY_ALLOCATION_ERROR;
+        }
+        r->owner = owner;
+        r->lock = lock;
+        r->mode = r->wanted = mode;
+        LK_Request **tail = &lock->queue;
+        while (*tail != NULL)
+            tail = &(*tail)->next;
+        *tail = r;
+        r->nextOwned = owner->requests;
+        owner->requests = r;
+    }
+
+    if (grantable(r)) {
+        r->mode = r->wanted;
+        r->granted = true;
+        pthread_mutex_unlock(&lockState.lock);
+        return RC_OK;
+    }
+
+    timeout = lockState.timeoutMillis;
+    if (timeout > 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout / 1000;
+        deadline.tv_nsec += (long)(timeout % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    // waiting can only close a cycle through this new edge, so checking
+    // here finds every deadlock as soon as it forms
+    lockState.stats.numWaits++;
+    owner->waiting = r;
+    lockState.search++;
+    if (reaches(owner, owner)) {
+        lockState.stats.numDeadlocks++;
+        rc = RC_LK_DEADLOCK;
+    }
+    while (rc == RC_OK && isWaiting(r)) {
+        if (timeout == 0)
+            pthread_cond_wait(&owner->wake, &lockState.lock);
+        else if (pthread_cond_timedwait(&owner->wake, &lockState.lock, &deadline) == ETIMEDOUT && isWaiting(r)) {
+            lockState.stats.numTimeouts++;
+            rc = RC_LK_TIMEOUT;
+        }
+    }
+    owner->waiting = NULL;
+    if (rc != RC_OK)
+        cancel(r);
+    pthread_mutex_unlock(&lockState.lock);
+    return rc;
+}
+
+RC lockTable(TxnId xid, const char *table, LK_Mode mode) {
+    RID rid = { -1, -1 };
+    return acquire(xid, table, rid, mode);
+}
+
+RC lockRecord(TxnId xid, const char *table, RID rid, LK_Mode mode) {
+    return acquire(xid, table, rid, mode);
+}
+
+void unlockAll(TxnId xid) {
+    LK_Owner **link;
+    LK_Owner *owner;
+    LK_Request *r;
+
+    pthread_mutex_lock(&lockState.lock);
+    for (link = &lockState.owners[xid % LK_BUCKETS]; *link != NULL && (*link)->xid != xid; link = &(*link)->next)
+        ;
+    if ((owner = *link) == NULL) {
+        pthread_mutex_unlock(&lockState.lock);
+        return;
+    }
+    *link = owner->next;
+
+    while ((r = owner->requests) != NULL) {
+        LK_Lock *lock = r->lock;
+        unlinkRequest(r);
+        free(r);
+        wakeWaiters(lock);
+        freeLockIfUnused(lock);
+    }
+    pthread_mutex_unlock(&lockState.lock);
+    pthread_cond_destroy(&owner->wake);
+    free(owner);
+}
+
+void setLockTimeout(int millis) {
+    pthread_mutex_lock(&lockState.lock);
+    lockState.timeoutMillis = (millis < 0) ? 0 : millis;
+    pthread_mutex_unlock(&lockState.lock);
+}
+
+void getLockStatistics(LK_Statistics *stats) {
+    pthread_mutex_lock(&lockState.lock);
+    *stats = lockState.stats;
+    pthread_mutex_unlock(&lockState.lock);
+}
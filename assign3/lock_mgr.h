@@ -0,0 +1,41 @@
+#ifndef LOCK_MGR_H
+#define LOCK_MGR_H
+
+#include "dberror.h"
+#include "log_mgr.h"
+#include "tables.h"
+
+// Hierarchical locks on tables and on the records in them, held by
+// transactions until they end. A record lock needs an intention lock of
+// the same kind on its table: IS before S, IX before X.
+typedef enum LK_Mode {
+	LOCK_IS = 0,
+	LOCK_IX = 1,
+	LOCK_S = 2,
+	LOCK_SIX = 3, // S on the whole table plus IX for changing some of its records
+	LOCK_X = 4
+} LK_Mode;
+
+#define LK_NUM_MODES 5
+
+typedef struct LK_Statistics {
+	long numWaits;     // requests that could not be granted at once
+	long numDeadlocks; // requests refused because waiting would close a cycle
+	long numTimeouts;
+} LK_Statistics;
+
+// Each returns once the lock is granted, RC_LK_DEADLOCK if waiting for it
+// would close a cycle in the wait-for graph, or RC_LK_TIMEOUT if it was not
+// granted in time. A transaction asking again for a lock it holds gets the
+// stronger of both modes. Locks are named by table file name. Thread-safe.
+extern RC lockTable (TxnId xid, const char *table, LK_Mode mode);
+extern RC lockRecord (TxnId xid, const char *table, RID rid, LK_Mode mode);
+
+// Releases every lock of the transaction and wakes those waiting for them
+extern void unlockAll (TxnId xid);
+
+// Longest wait for a lock; 0 waits until it is granted or a deadlock shows
+extern void setLockTimeout (int millis);
+extern void getLockStatistics (LK_Statistics *stats);
+
+#endif // LOCK_MGR_H
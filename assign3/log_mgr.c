@@ -0,0 +1,657 @@
+#define _GNU_SOURCE // fallocate
+#include "log_mgr.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_MAGIC 0x4C415752 // "RWAL"
+#define LOG_VERSION 2
+#define LOG_BUFFER_SIZE (64 * 1024)
+#define LOG_ALIGN(n) (((n) + 7) & ~7u)
+
+// Unchanged runs shorter than this are logged as part of the surrounding
+// range, so a change does not turn into many tiny ranges.
+#define LOG_RANGE_GAP 8
+#define LOG_MAX_RANGES (PAGE_SIZE / (LOG_RANGE_GAP + 1) + 1)
+
+// The file starts with this header; the record at file offset off has
+// LSN baseLSN + off. Records before startLSN are no longer needed by
+// recovery and their space may have been released. nextXid is where
+// transaction ids resume when the records that used them are gone.
+typedef struct LogFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    LSN baseLSN;
+    LSN startLSN;
+    TxnId nextXid;
+    uint32_t unused;
+} LogFileHeader;
+
+// A transaction with records in the log but no commit record yet
+typedef struct ActiveTxn {
+    TxnId xid;
+    LSN firstLSN;
+} ActiveTxn;
+
+// Records are appended to buf. A flush swaps buf with spare and writes
+// spare outside the lock, so other threads can keep appending meanwhile.
+static struct {
+    bool open;
+    int fd;
+    pthread_mutex_t lock;
+    pthread_cond_t flushed;
+    pthread_cond_t grown;
+    char *buf;
+    size_t len, cap;
+    char *spare;
+    size_t spareCap;
+    LSN baseLSN;
+    LSN startLSN;
+    LSN endLSN;     // LSN the next record gets
+    LSN flushedLSN; // every record below this is on disk
+    bool flushing;
+    TxnId nextXid;
+    ActiveTxn *active;
+    int numActive, activeCap;
+    int delayMicros;
+    LM_Statistics stats;
+} logState = { .open = false, .lock = PTHREAD_MUTEX_INITIALIZER,
+    .flushed = PTHREAD_COND_INITIALIZER, .grown = PTHREAD_COND_INITIALIZER };
+
+static uint32_t checksum(const char *data, size_t length) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool writeAll(int fd, const char *data, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t n = pwrite(fd, data, length, offset);
+        if (n <= 0)
+            return false;
+        data += n;
+        length -= n;
+        offset += n;
+    }
+    return true;
+}
+
+static bool writeHeader(int fd, LSN baseLSN, LSN startLSN, TxnId nextXid) {
+    LogFileHeader header;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = LOG_MAGIC;
+    header.version = LOG_VERSION;
+    header.baseLSN = baseLSN;
+    header.startLSN = startLSN;
+    header.nextXid = nextXid;
+    return writeAll(fd, (char *)&header, sizeof(header), 0) && fdatasync(fd) == 0;
+}
+
+// File offset of the first record recovery needs
+static off_t startOffset(LSN baseLSN, LSN startLSN) {
+    return (startLSN == NO_LSN) ? (off_t)sizeof(LogFileHeader) : (off_t)(startLSN - baseLSN);
+}
+
+// Reads records from the start of the log until the first one that is
+// incomplete or damaged, which marks where a crash cut the log off.
+static off_t scanLog(int fd, LSN baseLSN, LSN startLSN, TxnId *maxXid) {
+    off_t off = startOffset(baseLSN, startLSN);
+    LM_RecordHeader header;
+    char *record = NULL;
+    size_t cap = 0;
+
+    *maxXid = NO_TXN;
+    while (pread(fd, &header, sizeof(header), off) == (ssize_t)sizeof(header)) {
+        uint32_t sum = header.checksum;
+        if (header.length < sizeof(header) || header.lsn != baseLSN + off)
+            break;
+        if (header.length > cap) {
+            cap = header.length;
+            record = (char *)realloc(record, cap);
+        }
+        if (pread(fd, record, header.length, off) != (ssize_t)header.length)
+            break;
+        ((LM_RecordHeader *)record)->checksum = 0;
+        if (checksum(record, header.length) != sum)
+            break;
+        if (header.xid > *maxXid)
+            *maxXid = header.xid;
+        off += header.length;
+    }
+    free(record);
+    return off;
+}
+
+RC openLog(const char *fileName) {
+    LogFileHeader header;
+    struct stat st;
+    TxnId maxXid = NO_TXN;
+    off_t end = sizeof(LogFileHeader);
+    int fd;
+
+    if (logState.open)
+        return RC_OK;
+
+    fd = open(fileName, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return RC_FILE_NOT_FOUND;
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(LogFileHeader)
+            || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+            || header.magic != LOG_MAGIC || header.version != LOG_VERSION) {
+        header.baseLSN = header.startLSN = 0;
+        header.nextXid = NO_TXN + 1;
+        if (ftruncate(fd, 0) != 0 || !writeHeader(fd, 0, NO_LSN, header.nextXid)) {
+            close(fd);
+            return RC_WRITE_FAILED;
+        }
+    } else {
+        end = scanLog(fd, header.baseLSN, header.startLSN, &maxXid);
+        if (end < st.st_size && ftruncate(fd, end) != 0) {
+            close(fd);
+            return RC_WRITE_FAILED;
+        }
+    }
+
+    pthread_mutex_lock(&logState.lock);
+    logState.fd = fd;
+    logState.cap = logState.spareCap = LOG_BUFFER_SIZE;
+    logState.buf = (char *)malloc(logState.cap);
+    logState.spare = (char *)malloc(logState.spareCap);
+    logState.len = 0;
+    logState.baseLSN = header.baseLSN;
+    logState.startLSN = header.startLSN;
+    logState.numActive = 0;
+    logState.endLSN = logState.flushedLSN = header.baseLSN + end;
+    logState.flushing = false;
+    logState.nextXid = (maxXid >= header.nextXid) ? maxXid + 1 : header.nextXid;
+    memset(&logState.stats, 0, sizeof(LM_Statistics));
+    logState.open = true;
+    pthread_mutex_unlock(&logState.lock);
+    return RC_OK;
+}
+
+RC closeLog(void) {
+    RC rc;
+
+    if (!logState.open)
+        return RC_OK;
+    rc = flushLog(logState.endLSN);
+
+    pthread_mutex_lock(&logState.lock);
+    logState.open = false;
+    close(logState.fd);
+    free(logState.buf);
+    free(logState.spare);
+    free(logState.active);
+    logState.buf = logState.spare = NULL;
+    logState.active = NULL;
+    logState.activeCap = 0;
+    pthread_cond_broadcast(&logState.grown);
+    pthread_mutex_unlock(&logState.lock);
+    return rc;
+}
+
+bool logIsOpen(void) {
+    return logState.open;
+}
+
+TxnId newTxnId(void) {
+    TxnId xid;
+
+    pthread_mutex_lock(&logState.lock);
+    xid = logState.nextXid++;
+    pthread_mutex_unlock(&logState.lock);
+    return xid;
+}
+
+TxnId getNextTxnId(void) {
+    TxnId xid;
+
+    pthread_mutex_lock(&logState.lock);
+    xid = logState.nextXid;
+    pthread_mutex_unlock(&logState.lock);
+    return xid;
+}
+
+// Keeps the table of active transactions up to date. Called with the lock
+// held for every record appended.
+static void trackTxn(LM_RecordHeader *header) {
+    int i;
+
+    if (header->xid == NO_TXN)
+        return;
+    for (i = 0; i < logState.numActive; i++)
+        if (logState.active[i].xid == header->xid)
+            break;
+
+    if (header->type == LOG_COMMIT || header->type == LOG_ABORT) {
+        if (i < logState.numActive)
+            logState.active[i] = logState.active[--logState.numActive];
+    } else if (i == logState.numActive) {
+        if (logState.numActive == logState.activeCap) {
+            logState.activeCap = (logState.activeCap == 0) ? 16 : 2 * logState.activeCap;
+            logState.active = (ActiveTxn *)realloc(logState.active, sizeof(ActiveTxn) * logState.activeCap);
+        }
+        logState.active[i].xid = header->xid;
+        logState.active[i].firstLSN = header->lsn;
+        logState.numActive++;
+    }
+}
+
+// Assigns the record its LSN and checksum and copies it to the log buffer.
+// Called with the lock held.
+static LSN appendLocked(char *record) {
+    LM_RecordHeader *header = (LM_RecordHeader *)record;
+    LSN lsn;
+
+    if (!logState.open)
+        return NO_LSN;
+    lsn = header->lsn = logState.endLSN;
+    header->checksum = 0;
+    header->checksum = checksum(record, header->length);
+
+    if (logState.len + header->length > logState.cap) {
+        while (logState.len + header->length > logState.cap)
+            logState.cap *= 2;
+        logState.buf = (char *)realloc(logState.buf, logState.cap);
+    }
+    memcpy(logState.buf + logState.len, record, header->length);
+    logState.len += header->length;
+    logState.endLSN += header->length;
+    logState.stats.numRecords++;
+    logState.stats.numBytes += header->length;
+    trackTxn(header);
+    pthread_cond_broadcast(&logState.grown);
+    return lsn;
+}
+
+static LSN appendRecord(char *record) {
+    LSN lsn;
+
+    pthread_mutex_lock(&logState.lock);
+    lsn = appendLocked(record);
+    pthread_mutex_unlock(&logState.lock);
+    return lsn;
+}
+
+static void initHeader(LM_RecordHeader *header, LM_RecordType type, TxnId xid, LSN prevLSN, const char *fileName) {
+    memset(header, 0, sizeof(LM_RecordHeader));
+    header->length = sizeof(LM_RecordHeader);
+    header->type = type;
+    header->xid = xid;
+    header->prevLSN = prevLSN;
+    header->pageNum = -1;
+    if (fileName != NULL) {
+        header->fileNameLength = strlen(fileName);
+        header->length += header->fileNameLength;
+    }
+}
+
+LSN logPageUpdate(TxnId xid, LSN prevLSN, const char *fileName, int pageNum,
+        int offset, int length, const char *before, const char *after) {
+    LM_Range ranges[LOG_MAX_RANGES];
+    LM_RecordHeader header;
+    int numRanges = 0, dataBytes = 0, i = offset, end = offset + length;
+    char *record, *out;
+    LSN lsn;
+
+    if (!logState.open)
+        return NO_LSN;
+
+    // find the changed ranges, merging those separated by short equal runs
+    while (i < end) {
+        int start, last, same;
+        while (i < end && before[i] == after[i])
+            i++;
+        if (i == end)
+            break;
+        start = last = i;
+        for (same = 0; i < end && same < LOG_RANGE_GAP; i++) {
+            if (before[i] != after[i]) {
+                last = i;
+                same = 0;
+            } else {
+                same++;
+            }
+        }
+        ranges[numRanges].offset = start;
+        ranges[numRanges].length = last - start + 1;
+        dataBytes += 2 * ranges[numRanges].length;
+        numRanges++;
+    }
+    if (numRanges == 0)
+        return NO_LSN;
+
+    initHeader(&header, LOG_UPDATE, xid, prevLSN, fileName);
+    header.pageNum = pageNum;
+    header.numRanges = numRanges;
+    header.length = LOG_ALIGN(header.length + numRanges * sizeof(LM_Range) + dataBytes);
+
+    record = (char *)calloc(header.length, 1);
+    if (record == NULL)
+        return NO_LSN;
+    memcpy(record, &header, sizeof(header));
+    out = record + sizeof(header);
+    memcpy(out, fileName, header.fileNameLength);
+    out += header.fileNameLength;
+    memcpy(out, ranges, numRanges * sizeof(LM_Range));
+    out += numRanges * sizeof(LM_Range);
+    for (i = 0; i < numRanges; i++) {
+        memcpy(out, before + ranges[i].offset, ranges[i].length);
+        out += ranges[i].length;
+        memcpy(out, after + ranges[i].offset, ranges[i].length);
+        out += ranges[i].length;
+    }
+
+    lsn = appendRecord(record);
+    free(record);
+    return lsn;
+}
+
+LSN logCommit(TxnId xid, LSN prevLSN) {
+    LM_RecordHeader header;
+
+    initHeader(&header, LOG_COMMIT, xid, prevLSN, NULL);
+    return appendRecord((char *)&header);
+}
+
+LSN logAbort(TxnId xid, LSN prevLSN) {
+    LM_RecordHeader header;
+
+    initHeader(&header, LOG_ABORT, xid, prevLSN, NULL);
+    return appendRecord((char *)&header);
+}
+
+LSN logRow(TxnId xid, LSN prevLSN, const char *fileName, const char *data, int length) {
+    LM_RecordHeader header;
+    char *record;
+    LSN lsn;
+
+    if (!logState.open)
+        return NO_LSN;
+    initHeader(&header, LOG_ROW, xid, prevLSN, fileName);
+    header.pageNum = length;
+    header.length = LOG_ALIGN(header.length + length);
+    record = (char *)calloc(header.length, 1);
+    if (record == NULL)
+        return NO_LSN;
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), fileName, header.fileNameLength);
+    memcpy(record + sizeof(header) + header.fileNameLength, data, length);
+    lsn = appendRecord(record);
+    free(record);
+    return lsn;
+}
+
+LSN logCreate(const char *fileName) {
+    LM_RecordHeader header;
+    char *record;
+    LSN lsn;
+
+    initHeader(&header, LOG_CREATE, NO_TXN, NO_LSN, fileName);
+    header.length = LOG_ALIGN(header.length);
+    record = (char *)calloc(header.length, 1);
+    if (record == NULL)
+        return NO_LSN;
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), fileName, header.fileNameLength);
+    lsn = appendRecord(record);
+    free(record);
+    return lsn;
+}
+
+RC flushLog(LSN lsn) {
+    RC rc = RC_OK;
+    bool counted = false;
+
+    pthread_mutex_lock(&logState.lock);
+    while (logState.open && logState.flushedLSN <= lsn && logState.flushedLSN < logState.endLSN) {
+        char *data;
+        size_t len, cap;
+        LSN target;
+
+        if (!counted) {
+            logState.stats.numFlushRequests++;
+            counted = true;
+        }
+        if (logState.flushing) {
+            // someone else is writing; their write may already cover us
+            pthread_cond_wait(&logState.flushed, &logState.lock);
+            continue;
+        }
+
+        // become the leader: write out everything appended so far
+        logState.flushing = true;
+        if (logState.delayMicros > 0) {
+            pthread_mutex_unlock(&logState.lock);
+            usleep(logState.delayMicros);
+            pthread_mutex_lock(&logState.lock);
+        }
+        data = logState.buf;
+        len = logState.len;
+        cap = logState.cap;
+        target = logState.endLSN;
+        logState.buf = logState.spare;
+        logState.cap = logState.spareCap;
+        logState.len = 0;
+        pthread_mutex_unlock(&logState.lock);
+
+        if (!writeAll(logState.fd, data, len, (off_t)(target - len - logState.baseLSN))
+                || fdatasync(logState.fd) != 0)
+            rc = RC_WRITE_FAILED;
+
+        pthread_mutex_lock(&logState.lock);
+        logState.spare = data;
+        logState.spareCap = cap;
+        logState.flushing = false;
+        logState.stats.numSyncs++;
+        if (rc == RC_OK)
+            logState.flushedLSN = target;
+        pthread_cond_broadcast(&logState.flushed);
+        if (rc != RC_OK)
+            break;
+    }
+    pthread_mutex_unlock(&logState.lock);
+    return rc;
+}
+
+LSN getFlushedLSN(void) {
+    LSN lsn;
+
+    pthread_mutex_lock(&logState.lock);
+    lsn = logState.flushedLSN;
+    pthread_mutex_unlock(&logState.lock);
+    return lsn;
+}
+
+RC truncateLog(void) {
+    RC rc = RC_OK;
+
+    if (!logState.open)
+        return RC_OK;
+    if ((rc = flushLog(logState.endLSN)) != RC_OK)
+        return rc;
+
+    pthread_mutex_lock(&logState.lock);
+    while (logState.flushing)
+        pthread_cond_wait(&logState.flushed, &logState.lock);
+    if (logState.len == 0) {
+        // keep LSNs increasing: the next record gets the current end LSN
+        logState.baseLSN = logState.endLSN - sizeof(LogFileHeader);
+        logState.startLSN = NO_LSN;
+        logState.numActive = 0;
+        if (ftruncate(logState.fd, sizeof(LogFileHeader)) != 0
+                || !writeHeader(logState.fd, logState.baseLSN, NO_LSN, logState.nextXid))
+            rc = RC_WRITE_FAILED;
+    }
+    pthread_mutex_unlock(&logState.lock);
+    return rc;
+}
+
+RC readLog(char **records, size_t *length) {
+    RC rc = RC_OK;
+    off_t start;
+    size_t len;
+
+    *records = NULL;
+    *length = 0;
+    if (!logState.open)
+        return RC_FILE_HANDLE_NOT_INIT;
+    if ((rc = flushLog(logState.endLSN)) != RC_OK)
+        return rc;
+
+    pthread_mutex_lock(&logState.lock);
+    start = startOffset(logState.baseLSN, logState.startLSN);
+    len = logState.flushedLSN - logState.baseLSN - start;
+    *records = (char *)malloc(len > 0 ? len : 1);
+    if (*records == NULL)
+        rc = RC_MEMORY_ALLOCATION_ERROR;
+    else if (len > 0 && pread(logState.fd, *records, len, start) != (ssize_t)len)
+        rc = RC_READ_NON_EXISTING_PAGE;
+    else
+        *length = len;
+    pthread_mutex_unlock(&logState.lock);
+    return rc;
+}
+
+LSN getEndLSN(void) {
+    LSN lsn;
+
+    pthread_mutex_lock(&logState.lock);
+    lsn = logState.endLSN;
+    pthread_mutex_unlock(&logState.lock);
+    return lsn;
+}
+
+bool waitLogGrowth(LSN from, long bytes, int timeoutMillis) {
+    struct timespec deadline;
+    bool grown;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeoutMillis / 1000;
+    deadline.tv_nsec += (long)(timeoutMillis % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&logState.lock);
+    while (logState.open && logState.endLSN < from + bytes)
+        if (pthread_cond_timedwait(&logState.grown, &logState.lock, &deadline) != 0)
+            break;
+    grown = logState.open && logState.endLSN >= from + bytes;
+    pthread_mutex_unlock(&logState.lock);
+    return grown;
+}
+
+LSN logCheckpointBegin(LSN redoLSN, const LM_DirtyPage *pages, int numPages, LSN *oldestActive) {
+    LM_RecordHeader header;
+    char *record, *out;
+    size_t length = sizeof(LM_RecordHeader) + 2 * sizeof(int32_t);
+    int32_t count;
+    LSN lsn;
+    int i;
+
+    for (i = 0; i < numPages; i++)
+        length += sizeof(int32_t) + sizeof(uint16_t) + strlen(pages[i].fileName);
+
+    // the active table is copied and the record appended under one lock, so
+    // the record shows exactly the transactions active at its LSN
+    pthread_mutex_lock(&logState.lock);
+    length = LOG_ALIGN(length + logState.numActive * sizeof(ActiveTxn));
+    record = (char *)calloc(length, 1);
+    initHeader(&header, LOG_CHECKPOINT_BEGIN, NO_TXN, redoLSN, NULL);
+    header.length = length;
+    memcpy(record, &header, sizeof(header));
+
+    out = record + sizeof(header);
+    count = logState.numActive;
+    memcpy(out, &count, sizeof(int32_t));
+    out += sizeof(int32_t);
+    memcpy(out, logState.active, logState.numActive * sizeof(ActiveTxn));
+    out += logState.numActive * sizeof(ActiveTxn);
+    count = numPages;
+    memcpy(out, &count, sizeof(int32_t));
+    out += sizeof(int32_t);
+    for (i = 0; i < numPages; i++) {
+        uint16_t nameLength = strlen(pages[i].fileName);
+        int32_t pageNum = pages[i].pageNum;
+        memcpy(out, &pageNum, sizeof(int32_t));
+        memcpy(out + sizeof(int32_t), &nameLength, sizeof(uint16_t));
+        memcpy(out + sizeof(int32_t) + sizeof(uint16_t), pages[i].fileName, nameLength);
+        out += sizeof(int32_t) + sizeof(uint16_t) + nameLength;
+    }
+
+    *oldestActive = redoLSN;
+    for (i = 0; i < logState.numActive; i++)
+        if (logState.active[i].firstLSN < *oldestActive)
+            *oldestActive = logState.active[i].firstLSN;
+    lsn = appendLocked(record);
+    pthread_mutex_unlock(&logState.lock);
+
+    free(record);
+    return lsn;
+}
+
+LSN logCheckpointEnd(LSN beginLSN) {
+    LM_RecordHeader header;
+
+    initHeader(&header, LOG_CHECKPOINT_END, NO_TXN, beginLSN, NULL);
+    return appendRecord((char *)&header);
+}
+
+RC truncateLogBefore(LSN lsn) {
+    LSN baseLSN;
+    TxnId nextXid;
+    off_t end;
+    int fd;
+
+    pthread_mutex_lock(&logState.lock);
+    if (!logState.open || lsn <= logState.startLSN || lsn > logState.flushedLSN) {
+        pthread_mutex_unlock(&logState.lock);
+        return RC_OK;
+    }
+    fd = logState.fd;
+    baseLSN = logState.baseLSN;
+    nextXid = logState.nextXid;
+    pthread_mutex_unlock(&logState.lock);
+
+    // appends only ever write past the header, so it can be rewritten
+    // without holding up writers
+    if (!writeHeader(fd, baseLSN, lsn, nextXid))
+        return RC_WRITE_FAILED;
+
+    pthread_mutex_lock(&logState.lock);
+    logState.startLSN = lsn;
+    pthread_mutex_unlock(&logState.lock);
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+    // give the space of the released records back to the file system
+    end = (off_t)(lsn - baseLSN) & ~(off_t)(PAGE_SIZE - 1);
+    if (end > PAGE_SIZE)
+        fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, PAGE_SIZE, end - PAGE_SIZE);
+#else
+    (void)end;
+#endif
+    return RC_OK;
+}
+
+void setGroupCommitDelay(int micros) {
+    logState.delayMicros = (micros < 0) ? 0 : micros;
+}
+
+void getLogStatistics(LM_Statistics *stats) {
+    pthread_mutex_lock(&logState.lock);
+    *stats = logState.stats;
+    pthread_mutex_unlock(&logState.lock);
+}
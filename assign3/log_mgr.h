@@ -0,0 +1,145 @@
+#ifndef LOG_MGR_H
+#define LOG_MGR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dberror.h"
+#include "dt.h"
+
+// A log sequence number is the byte address of a record in the log. LSNs
+// keep increasing across truncations, so a page stamped with an LSN can
+// always be compared against any later record.
+typedef uint64_t LSN;
+typedef uint32_t TxnId;
+
+#define NO_LSN 0
+#define NO_TXN 0
+
+// Every page that is logged starts with the LSN of its latest logged change.
+// Recovery compares it with a record's LSN to tell whether the page on disk
+// already carries that change.
+#define PAGE_LSN(page) (*(LSN *) (page))
+
+typedef enum LM_RecordType {
+	LOG_UPDATE = 1, // before and after images of the changed ranges of a page
+	LOG_COMMIT = 2,
+	LOG_CREATE = 3, // a table file was (re)created; older records for it are void
+	LOG_CHECKPOINT_BEGIN = 4,
+	LOG_CHECKPOINT_END = 5,
+	LOG_ROW = 6,   // logical change made by a transaction, undone if it never ends
+	LOG_ABORT = 7  // the transaction's row changes have been undone
+} LM_RecordType;
+
+// Fixed part of every record, padded to a multiple of 8 bytes. A LOG_UPDATE
+// is followed by the file name, numRanges LM_Range entries and then, for each
+// range, its before image and its after image. A LOG_CREATE is followed by
+// the file name. A LOG_CHECKPOINT_BEGIN keeps its redo LSN in prevLSN and is
+// followed by the active transactions and the dirty page table. A LOG_ROW is
+// followed by the file name and pageNum bytes of data that only the row undo
+// handler interprets.
+typedef struct LM_RecordHeader {
+	uint32_t length;   // whole record, including this header
+	uint32_t checksum; // of the whole record with this field zeroed
+	LSN lsn;
+	LSN prevLSN;       // previous record of the same transaction
+	TxnId xid;
+	uint16_t type;
+	uint16_t fileNameLength;
+	int32_t pageNum;
+	uint16_t numRanges;
+	uint16_t unused;
+} LM_RecordHeader;
+
+typedef struct LM_Range {
+	uint16_t offset;
+	uint16_t length;
+} LM_Range;
+
+typedef struct LM_Statistics {
+	long numRecords;
+	long long numBytes;
+	long numFlushRequests; // flushLog calls that had to wait for a write
+	long numSyncs;         // fdatasync calls; fewer than requests when commits are grouped
+} LM_Statistics;
+
+// The log is shared by every open table. All functions are thread-safe.
+extern RC openLog (const char *fileName);
+extern RC closeLog (void);
+extern bool logIsOpen (void);
+
+// Transaction ids keep increasing across restarts and truncations
+extern TxnId newTxnId (void);
+extern TxnId getNextTxnId (void);
+
+// Appending only buffers the record; flushLog makes it durable. Each
+// returns the LSN of the new record, or NO_LSN when nothing was logged.
+// Recovery undoes the updates of a transaction that never committed by
+// restoring their before images, so once a transaction has updated a page,
+// no other one may update it until the first has logged its commit.
+extern LSN logPageUpdate (TxnId xid, LSN prevLSN, const char *fileName, int pageNum,
+		int offset, int length, const char *before, const char *after);
+extern LSN logCommit (TxnId xid, LSN prevLSN);
+extern LSN logAbort (TxnId xid, LSN prevLSN);
+extern LSN logRow (TxnId xid, LSN prevLSN, const char *fileName, const char *data, int length);
+extern LSN logCreate (const char *fileName);
+
+// Returns once every record up to and including lsn is on disk. Callers
+// that arrive while a write is in progress wait for it and are then
+// flushed together by a single write and fdatasync (group commit).
+extern RC flushLog (LSN lsn);
+extern LSN getFlushedLSN (void);
+
+// Empties the log. Only safe once every page it describes is on disk.
+extern RC truncateLog (void);
+
+// Returns a malloc'd copy of every durable record, oldest first
+extern RC readLog (char **records, size_t *length);
+
+// A page that was dirty in some buffer pool when a checkpoint began
+typedef struct LM_DirtyPage {
+	const char *fileName;
+	int pageNum;
+} LM_DirtyPage;
+
+// Fuzzy checkpoints. The caller notes the redo LSN (getEndLSN) before
+// collecting the dirty pages, logs them with logCheckpointBegin, writes
+// them out while transactions keep running, and logs logCheckpointEnd once
+// they are synced. Everything before min(redo LSN, oldestActive) can then
+// be released with truncateLogBefore.
+extern LSN getEndLSN (void);
+extern LSN logCheckpointBegin (LSN redoLSN, const LM_DirtyPage *pages, int numPages, LSN *oldestActive);
+extern LSN logCheckpointEnd (LSN beginLSN);
+extern RC truncateLogBefore (LSN lsn);
+
+// Waits until the log has grown by at least bytes past from, or until the
+// timeout expires or the log is closed. Returns whether it grew.
+extern bool waitLogGrowth (LSN from, long bytes, int timeoutMillis);
+
+typedef struct LM_RecoveryStatistics {
+	long numRecords;
+	long numRedone; // updates reapplied because the page on disk was older
+	long numUndone; // updates of transactions that never committed
+	int numLosers;
+	int numThreads; // redo runs one thread per page partition
+	long numRowsUndone; // LOG_ROW records of transactions that never ended
+} LM_RecoveryStatistics;
+
+// Rolls back one logged row change; called by recovery, newest first, for
+// every LOG_ROW of a transaction with neither a commit nor an abort record
+typedef RC (*LM_RowUndoHandler)(TxnId xid, const char *fileName, const char *data, int length);
+extern void setRowUndoHandler (LM_RowUndoHandler handler);
+
+// Brings every page file named in the log to the state left by committed
+// transactions: redoes every update the page does not yet carry (by page
+// LSN), then undoes the updates of transactions without a commit record,
+// then hands the row changes of unfinished transactions to the row undo
+// handler. Recovered files are synced and the log is truncated. Must run
+// before any table is opened. stats may be NULL.
+extern RC recoverLog (LM_RecoveryStatistics *stats);
+
+// Time the flushing thread waits for other commits to join its write
+extern void setGroupCommitDelay (int micros);
+extern void getLogStatistics (LM_Statistics *stats);
+
+#endif // LOG_MGR_H
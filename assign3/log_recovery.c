@@ -0,0 +1,357 @@
+#include "log_mgr.h"
+#include "storage_mgr.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RECOVERY_MAX_THREADS 8
+#define RECOVERY_MIN_UPDATES_PER_THREAD 64
+
+typedef struct RecoveryFile {
+    char *name;
+    LSN createLSN; // updates before the latest LOG_CREATE are void
+    bool exists;
+} RecoveryFile;
+
+typedef struct RecoveryUpdate {
+    LM_RecordHeader *header;
+    int file;
+} RecoveryUpdate;
+
+static LM_RowUndoHandler rowUndoHandler = NULL;
+
+// One redo partition. Each thread opens its own handle per file, so
+// threads never share a FILE position.
+typedef struct RedoWork {
+    RecoveryUpdate *updates;
+    int numUpdates;
+    RecoveryFile *files;
+    int numFiles;
+    long numRedone;
+    RC rc;
+} RedoWork;
+
+static const char *recordFileName(LM_RecordHeader *header) {
+    return (const char *)header + sizeof(LM_RecordHeader);
+}
+
+// Writes each range's before or after image into the page.
+static void applyImages(char *page, LM_RecordHeader *header, bool redo) {
+    const char *rangeData = recordFileName(header) + header->fileNameLength;
+    const char *images = rangeData + header->numRanges * sizeof(LM_Range);
+    LM_Range range;
+
+    for (int i = 0; i < header->numRanges; i++) {
+        memcpy(&range, rangeData + i * sizeof(LM_Range), sizeof(LM_Range));
+        memcpy(page + range.offset, images + (redo ? range.length : 0), range.length);
+        images += 2 * range.length;
+    }
+}
+
+static int findFile(RecoveryFile **files, int *numFiles, LM_RecordHeader *header) {
+    const char *name = recordFileName(header);
+    int i;
+
+    for (i = 0; i < *numFiles; i++)
+        if (strlen((*files)[i].name) == header->fileNameLength
+                && memcmp((*files)[i].name, name, header->fileNameLength) == 0)
+            return i;
+
+    *files = (RecoveryFile *)realloc(*files, sizeof(RecoveryFile) * (*numFiles + 1));
+    (*files)[i].name = (char *)malloc(header->fileNameLength + 1);
+    memcpy((*files)[i].name, name, header->fileNameLength);
+    (*files)[i].name[header->fileNameLength] = '\0';
+    (*files)[i].createLSN = NO_LSN;
+    (*files)[i].exists = (access((*files)[i].name, F_OK) == 0);
+    (*numFiles)++;
+    return i;
+}
+
+static int comparePageOrder(const void *a, const void *b) {
+    const RecoveryUpdate *x = (const RecoveryUpdate *)a, *y = (const RecoveryUpdate *)b;
+
+    if (x->file != y->file)
+        return x->file - y->file;
+    if (x->header->pageNum != y->header->pageNum)
+        return x->header->pageNum - y->header->pageNum;
+    return (x->header->lsn < y->header->lsn) ? -1 : (x->header->lsn > y->header->lsn);
+}
+
+// Opens file f on first use; returns NULL if it cannot be opened.
+static SM_FileHandle *fileHandle(SM_FileHandle *handles, bool *opened, RecoveryFile *files, int f) {
+    if (!opened[f]) {
+        if (openPageFile(files[f].name, &handles[f]) != RC_OK)
+            return NULL;
+        opened[f] = true;
+    }
+    return &handles[f];
+}
+
+static RC closeHandles(SM_FileHandle *handles, bool *opened, int numFiles) {
+    RC rc = RC_OK;
+
+    for (int f = 0; f < numFiles; f++) {
+        if (!opened[f])
+            continue;
+        if (syncPageFile(&handles[f]) != RC_OK)
+            rc = RC_WRITE_FAILED;
+        closePageFile(&handles[f]);
+    }
+    return rc;
+}
+
+// Redoes one partition page by page: each page is read once, receives every
+// update newer than its LSN in log order, and is written back once.
+static void *redoPartition(void *arg) {
+    RedoWork *work = (RedoWork *)arg;
+    SM_FileHandle *handles = (SM_FileHandle *)calloc(work->numFiles, sizeof(SM_FileHandle));
+    bool *opened = (bool *)calloc(work->numFiles, sizeof(bool));
+    SM_FileHandle *handle = NULL;
+    char page[PAGE_SIZE];
+    bool changed = false;
+    int i;
+
+    qsort(work->updates, work->numUpdates, sizeof(RecoveryUpdate), comparePageOrder);
+
+    for (i = 0; i < work->numUpdates && work->rc == RC_OK; i++) {
+        RecoveryUpdate *u = &work->updates[i];
+
+        if (i == 0 || u->file != u[-1].file || u->header->pageNum != u[-1].header->pageNum) {
+            if (changed && writeBlock(u[-1].header->pageNum, handle, page) != RC_OK)
+                work->rc = RC_WRITE_FAILED;
+            changed = false;
+            handle = fileHandle(handles, opened, work->files, u->file);
+            if (handle == NULL || readBlock(u->header->pageNum, handle, page) != RC_OK) {
+                work->rc = RC_FILE_NOT_FOUND;
+                break;
+            }
+        }
+        if (PAGE_LSN(page) < u->header->lsn) {
+            applyImages(page, u->header, true);
+            PAGE_LSN(page) = u->header->lsn;
+            changed = true;
+            work->numRedone++;
+        }
+    }
+    if (changed && work->rc == RC_OK && writeBlock(work->updates[i - 1].header->pageNum, handle, page) != RC_OK)
+        work->rc = RC_WRITE_FAILED;
+
+    if (closeHandles(handles, opened, work->numFiles) != RC_OK && work->rc == RC_OK)
+        work->rc = RC_WRITE_FAILED;
+    free(handles);
+    free(opened);
+    return NULL;
+}
+
+static int redoThreads(int numUpdates) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int n = numUpdates / RECOVERY_MIN_UPDATES_PER_THREAD;
+
+    if (n > cores) n = (int)cores;
+    if (n > RECOVERY_MAX_THREADS) n = RECOVERY_MAX_THREADS;
+    return (n < 1) ? 1 : n;
+}
+
+static int partitionOf(RecoveryUpdate *update, int numThreads) {
+    unsigned int h = (unsigned int)update->file * 2654435761u ^ (unsigned int)update->header->pageNum;
+    return (int)(h % numThreads);
+}
+
+// Partitions updates by page so that each page is redone by exactly one
+// thread, in log order.
+static RC redo(RecoveryUpdate *updates, int numUpdates, RecoveryFile *files, int numFiles, LM_RecoveryStatistics *stats) {
+    int numThreads = redoThreads(numUpdates);
+    RedoWork work[RECOVERY_MAX_THREADS];
+    pthread_t threads[RECOVERY_MAX_THREADS];
+    bool started[RECOVERY_MAX_THREADS];
+    RC rc = RC_OK;
+    int t, i;
+
+    memset(work, 0, sizeof(work));
+    for (i = 0; i < numUpdates; i++)
+        work[partitionOf(&updates[i], numThreads)].numUpdates++;
+    for (t = 0; t < numThreads; t++) {
+        work[t].updates = (RecoveryUpdate *)malloc(sizeof(RecoveryUpdate) * (work[t].numUpdates + 1));
+        work[t].numUpdates = 0;
+        work[t].files = files;
+        work[t].numFiles = numFiles;
+    }
+    for (i = 0; i < numUpdates; i++) {
+        RedoWork *w = &work[partitionOf(&updates[i], numThreads)];
+        w->updates[w->numUpdates++] = updates[i];
+    }
+
+    // a partition whose thread cannot be started is redone here instead
+    for (t = 0; t < numThreads; t++) {
+        started[t] = (numThreads > 1 && pthread_create(&threads[t], NULL, redoPartition, &work[t]) == 0);
+        if (!started[t])
+            redoPartition(&work[t]);
+    }
+    for (t = 0; t < numThreads; t++)
+        if (started[t])
+            pthread_join(threads[t], NULL);
+
+    stats->numThreads = numThreads;
+    for (t = 0; t < numThreads; t++) {
+        stats->numRedone += work[t].numRedone;
+        if (work[t].rc != RC_OK)
+            rc = work[t].rc;
+        free(work[t].updates);
+    }
+    return rc;
+}
+
+// Rolls back losers newest first by restoring before images. That is only
+// right because no other transaction changes a page between a loser's
+// update of it and the loser's commit record: callers of logPageUpdate must
+// log the commit before anyone else may change the page, as record_mgr does
+// by committing each op with the table latch held. The page LSN is left
+// alone, so a crash during undo redoes nothing twice and simply undoes
+// again.
+static RC undo(RecoveryUpdate *updates, int numUpdates, RecoveryFile *files, int numFiles,
+        const char *committed, TxnId minXid, LM_RecoveryStatistics *stats) {
+    SM_FileHandle *handles = (SM_FileHandle *)calloc(numFiles, sizeof(SM_FileHandle));
+    bool *opened = (bool *)calloc(numFiles, sizeof(bool));
+    char page[PAGE_SIZE];
+    RC rc = RC_OK;
+
+    for (int i = numUpdates - 1; i >= 0 && rc == RC_OK; i--) {
+        LM_RecordHeader *header = updates[i].header;
+        SM_FileHandle *handle;
+
+        if (committed[header->xid - minXid])
+            continue;
+        handle = fileHandle(handles, opened, files, updates[i].file);
+        if (handle == NULL || readBlock(header->pageNum, handle, page) != RC_OK) {
+            rc = RC_FILE_NOT_FOUND;
+            break;
+        }
+        applyImages(page, header, false);
+        if (writeBlock(header->pageNum, handle, page) != RC_OK)
+            rc = RC_WRITE_FAILED;
+        stats->numUndone++;
+    }
+
+    if (closeHandles(handles, opened, numFiles) != RC_OK && rc == RC_OK)
+        rc = RC_WRITE_FAILED;
+    free(handles);
+    free(opened);
+    return rc;
+}
+
+void setRowUndoHandler(LM_RowUndoHandler handler) {
+    rowUndoHandler = handler;
+}
+
+// Hands the row changes of transactions that neither committed nor aborted
+// to the row undo handler, newest first. Runs once redo and undo have made
+// every page consistent, so the handler may open the tables normally.
+static RC undoRows(LM_RecordHeader **rows, int numRows, const char *ended, TxnId minXid, LM_RecoveryStatistics *stats) {
+    RC rc = RC_OK;
+
+    for (int i = numRows - 1; i >= 0 && rc == RC_OK; i--) {
+        LM_RecordHeader *header = rows[i];
+        char *name;
+
+        if (ended[header->xid - minXid])
+            continue;
+        name = (char *)malloc(header->fileNameLength + 1);
+        memcpy(name, recordFileName(header), header->fileNameLength);
+        name[header->fileNameLength] = '\0';
+        rc = rowUndoHandler(header->xid, name, recordFileName(header) + header->fileNameLength, header->pageNum);
+        free(name);
+        stats->numRowsUndone++;
+    }
+    return rc;
+}
+
+RC recoverLog(LM_RecoveryStatistics *stats) {
+    LM_RecoveryStatistics local;
+    RecoveryFile *files = NULL;
+    RecoveryUpdate *updates = NULL;
+    LM_RecordHeader **rows = NULL;
+    char *log, *committed = NULL, *seen = NULL, *ended = NULL;
+    size_t length, off;
+    int numFiles = 0, numUpdates = 0, numRows = 0, i;
+    TxnId minXid = 0, maxXid = 0;
+    RC rc;
+
+    if (stats == NULL)
+        stats = &local;
+    memset(stats, 0, sizeof(LM_RecoveryStatistics));
+
+    if ((rc = readLog(&log, &length)) != RC_OK)
+        return rc;
+
+    // analysis: find the files, the latest create of each, and the xid range
+    for (off = 0; off < length; off += ((LM_RecordHeader *)(log + off))->length) {
+        LM_RecordHeader *header = (LM_RecordHeader *)(log + off);
+        stats->numRecords++;
+        if (header->type == LOG_CREATE) {
+            int f = findFile(&files, &numFiles, header);
+            files[f].createLSN = header->lsn;
+        } else if (header->type == LOG_UPDATE) {
+            findFile(&files, &numFiles, header);
+            numUpdates++;
+        } else if (header->type == LOG_ROW) {
+            numRows++;
+        }
+        if (header->xid != NO_TXN) {
+            if (minXid == 0 || header->xid < minXid) minXid = header->xid;
+            if (header->xid > maxXid) maxXid = header->xid;
+        }
+    }
+
+    // collect the updates that still apply and the committed transactions
+    updates = (RecoveryUpdate *)malloc(sizeof(RecoveryUpdate) * (numUpdates > 0 ? numUpdates : 1));
+    committed = (char *)calloc(maxXid - minXid + 1, 1);
+    seen = (char *)calloc(maxXid - minXid + 1, 1);
+    ended = (char *)calloc(maxXid - minXid + 1, 1);
+    rows = (LM_RecordHeader **)malloc(sizeof(LM_RecordHeader *) * (numRows > 0 ? numRows : 1));
+    numUpdates = numRows = 0;
+    for (off = 0; off < length; off += ((LM_RecordHeader *)(log + off))->length) {
+        LM_RecordHeader *header = (LM_RecordHeader *)(log + off);
+        if (header->type == LOG_COMMIT) {
+            committed[header->xid - minXid] = 1;
+            ended[header->xid - minXid] = 1;
+        } else if (header->type == LOG_ABORT) {
+            ended[header->xid - minXid] = 1;
+        } else if (header->type == LOG_ROW) {
+            rows[numRows++] = header;
+        } else if (header->type == LOG_UPDATE) {
+            int f = findFile(&files, &numFiles, header);
+            if (!files[f].exists || header->lsn < files[f].createLSN)
+                continue;
+            updates[numUpdates].header = header;
+            updates[numUpdates].file = f;
+            numUpdates++;
+            seen[header->xid - minXid] = 1;
+        }
+    }
+    for (i = 0; numUpdates > 0 && i <= (int)(maxXid - minXid); i++)
+        if (seen[i] && !committed[i])
+            stats->numLosers++;
+
+    rc = redo(updates, numUpdates, files, numFiles, stats);
+    if (rc == RC_OK && stats->numLosers > 0)
+        rc = undo(updates, numUpdates, files, numFiles, committed, minXid, stats);
+    if (rc == RC_OK && numRows > 0 && rowUndoHandler != NULL)
+        rc = undoRows(rows, numRows, ended, minXid, stats);
+
+    // every recovered page is now synced, so the log has done its job
+    if (rc == RC_OK)
+        rc = truncateLog();
+
+    for (i = 0; i < numFiles; i++)
+        free(files[i].name);
+    free(files);
+    free(updates);
+    free(rows);
+    free(committed);
+    free(seen);
+    free(ended);
+    free(log);
+    return rc;
+}
@@ -3,239 +3,1849 @@
 #include "buffer_mgr.h"
 #include "dberror.h"
 #include "tables.h"
+#include "rm_page.h"
+#include "rm_txn.h"
+#include "lock_mgr.h"
+#include "log_mgr.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-#define PAGE_METADATA_SIZE sizeof(int)
-#define SLOT_SIZE 20
-
+#include <time.h>
+
+#define RM_LOG_FILE "rm.wal"
+
+// The background checkpointer runs once the log has grown by this much
+#define RM_CHECKPOINT_INTERVAL (16L * 1024 * 1024)
+#define RM_CHECKPOINT_POLL_MILLIS 100
+// A checkpoint gives up on a page that stays pinned this long
+#define RM_CHECKPOINT_PIN_RETRIES 1000
+#define RM_CHECKPOINT_RETRY_NANOS 1000000L
+
+// Log state of one record manager call. The page changes of each call are
+// logged as a transaction of their own that commits before it returns. Its
+// row changes belong to txn: the caller's transaction, or one lasting just
+// for this call, in which case both commit together and the call waits for
+// the commit record to reach the log.
+typedef struct RM_Op {
+    TxnId xid;
+    LSN lastLSN;
+    RM_Transaction *txn; // NULL for undo and pruning, which change no versions of their own
+    RM_Transaction single;
+} RM_Op;
+
+// Open tables, so the checkpointer can reach their buffer pools. A table
+// leaves the list only after its pool has been flushed and synced.
+static RM_TableMgmt *openTables = NULL;
+static int numOpenTables = 0;
+static pthread_mutex_t tablesLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Ids of the tables opened since the record manager started, by file name.
+// A table keeps its id when it is closed and opened again, so RM_ToastRefs
+// in records read before still find it. Guarded by tablesLock.
+typedef struct RM_TableName {
+    char *name;
+    int tableId;
+    struct RM_TableName *next;
+} RM_TableName;
+
+static RM_TableName *tableNames = NULL;
+static int nextTableId = 1;
+
+// Checkpoints run one at a time, either on request or from the
+// background thread
+static pthread_mutex_t checkpointLock = PTHREAD_MUTEX_INITIALIZER;
+static LSN lastCheckpointLSN = NO_LSN;
+static long checkpointInterval = RM_CHECKPOINT_INTERVAL;
+static int checkpointRate = 0;
+static pthread_t checkpointer;
+static bool checkpointerRunning = false;
+static bool checkpointerStop = false;
+
+static void *runCheckpointer(void *arg);
+static void writeBackHeader(RM_TableMgmt *mgmt);
+static RC undoLoggedRows(TxnId xid, const char *fileName, const char *data, int length);
+
+// mgmtData optionally names the log file. Whatever the log holds from a
+// previous run that did not shut down cleanly is recovered before any table
+// can be opened.
 RC initRecordManager(void *mgmtData) {
+    RC rc;
+
     initStorageManager();
+    if (logIsOpen())
+        return RC_OK;
+    if ((rc = openLog(mgmtData != NULL ? (char *)mgmtData : RM_LOG_FILE)) != RC_OK)
+        return rc;
+    setRowUndoHandler(undoLoggedRows);
+    if ((rc = recoverLog(NULL)) != RC_OK)
+        return rc;
+
+    lastCheckpointLSN = getEndLSN();
+    checkpointerStop = false;
+    checkpointerRunning = (pthread_create(&checkpointer, NULL, runCheckpointer, NULL) == 0);
     return RC_OK;
 }
 
 RC shutdownRecordManager() {
-    return RC_OK;
+    if (checkpointerRunning) {
+        pthread_mutex_lock(&checkpointLock);
+        checkpointerStop = true;
+        pthread_mutex_unlock(&checkpointLock);
+        pthread_join(checkpointer, NULL);
+        checkpointerRunning = false;
+    }
+
+    // closed tables have all their pages on disk, so the log is no longer needed
+    pthread_mutex_lock(&tablesLock);
+    if (numOpenTables == 0)
+        truncateLog();
+    while (tableNames != NULL) {
+        RM_TableName *next = tableNames->next;
+        free(tableNames->name);
+        free(tableNames);
+        tableNames = next;
+    }
+    pthread_mutex_unlock(&tablesLock);
+    return closeLog();
+}
+
+void setCheckpointInterval(long logBytes) {
+    pthread_mutex_lock(&checkpointLock);
+    checkpointInterval = logBytes;
+    pthread_mutex_unlock(&checkpointLock);
+}
+
+void setCheckpointRate(int pagesPerSecond) {
+    pthread_mutex_lock(&checkpointLock);
+    checkpointRate = (pagesPerSecond < 0) ? 0 : pagesPerSecond;
+    pthread_mutex_unlock(&checkpointLock);
+}
+
+static void sleepNanos(long nanos) {
+    struct timespec delay = { nanos / 1000000000L, nanos % 1000000000L };
+    nanosleep(&delay, NULL);
+}
+
+// Collects the logged pages that are dirty in any open pool. File names are
+// copied, since a table may close while the checkpoint is running.
+static int collectDirtyPages(LM_DirtyPage **pages) {
+    int numPages = 0, cap = 0;
+
+    *pages = NULL;
+    for (RM_TableMgmt *t = openTables; t != NULL; t = t->next) {
+        BM_FrameStatistics *frames = (BM_FrameStatistics *)malloc(sizeof(BM_FrameStatistics) * t->bm.numPages);
+        getPoolStatistics(&t->bm, NULL, frames);
+        for (int i = 0; i < t->bm.numPages; i++) {
+            if (!frames[i].dirty || frames[i].pageNum == NO_PAGE || IS_FSM_PAGE(frames[i].pageNum))
+                continue;
+            if (numPages == cap) {
+                cap = (cap == 0) ? 64 : 2 * cap;
+                *pages = (LM_DirtyPage *)realloc(*pages, sizeof(LM_DirtyPage) * cap);
+            }
+            char *name = (char *)malloc(strlen(t->bm.pageFile) + 1);
+            strcpy(name, t->bm.pageFile);
+            (*pages)[numPages].fileName = name;
+            (*pages)[numPages].pageNum = frames[i].pageNum;
+            numPages++;
+        }
+        free(frames);
+    }
+    return numPages;
+}
+
+// Writes one page back if its table is still open. A page that stays pinned
+// is retried until it is released, without holding up the table list.
+static RC checkpointPage(LM_DirtyPage *page) {
+    RC rc = RC_OK;
+
+    for (int attempt = 0; attempt < RM_CHECKPOINT_PIN_RETRIES; attempt++) {
+        pthread_mutex_lock(&tablesLock);
+        rc = RC_OK;
+        for (RM_TableMgmt *t = openTables; t != NULL; t = t->next)
+            if (strcmp(t->bm.pageFile, page->fileName) == 0)
+                rc = flushPage(&t->bm, page->pageNum);
+        pthread_mutex_unlock(&tablesLock);
+        if (rc != RC_BM_PAGE_PINNED)
+            return rc;
+        sleepNanos(RM_CHECKPOINT_RETRY_NANOS);
+    }
+    return rc;
+}
+
+// A fuzzy checkpoint. The redo point is taken before the dirty pages are
+// collected, so every change older than it is either on one of those pages
+// or already on disk. The pages are then written, at most checkpointRate
+// per second, while other calls keep running; once they are synced the log
+// before the redo point (or the first record of the oldest transaction
+// still running) is released.
+RC checkpoint(void) {
+    LM_DirtyPage *pages;
+    LSN redoLSN, beginLSN, keepLSN;
+    long pause;
+    int numPages, i;
+    RC rc = RC_OK;
+
+    if (!logIsOpen())
+        return RC_FILE_HANDLE_NOT_INIT;
+
+    pthread_mutex_lock(&checkpointLock);
+    pause = (checkpointRate > 0) ? 1000000000L / checkpointRate : 0;
+
+    // the counters written back now are flushed with the other pages
+    pthread_mutex_lock(&tablesLock);
+    for (RM_TableMgmt *t = openTables; t != NULL; t = t->next)
+        writeBackHeader(t);
+    pthread_mutex_unlock(&tablesLock);
+    redoLSN = lastCheckpointLSN = getEndLSN();
+
+    pthread_mutex_lock(&tablesLock);
+    numPages = collectDirtyPages(&pages);
+    beginLSN = logCheckpointBegin(redoLSN, pages, numPages, &keepLSN);
+    pthread_mutex_unlock(&tablesLock);
+
+    for (i = 0; i < numPages && rc == RC_OK; i++) {
+        rc = checkpointPage(&pages[i]);
+        if (pause > 0)
+            sleepNanos(pause);
+    }
+
+    if (rc == RC_OK) {
+        pthread_mutex_lock(&tablesLock);
+        for (RM_TableMgmt *t = openTables; t != NULL && rc == RC_OK; t = t->next)
+            rc = syncPool(&t->bm);
+        pthread_mutex_unlock(&tablesLock);
+    }
+    if (rc == RC_OK)
+        rc = flushLog(logCheckpointEnd(beginLSN));
+    if (rc == RC_OK)
+        rc = truncateLogBefore(keepLSN);
+    pthread_mutex_unlock(&checkpointLock);
+
+    for (i = 0; i < numPages; i++)
+        free((char *)pages[i].fileName);
+    free(pages);
+    return rc;
+}
+
+static void *runCheckpointer(void *arg) {
+    for (;;) {
+        LSN from;
+        long interval;
+
+        pthread_mutex_lock(&checkpointLock);
+        if (checkpointerStop) {
+            pthread_mutex_unlock(&checkpointLock);
+            return NULL;
+        }
+        from = lastCheckpointLSN;
+        interval = checkpointInterval;
+        pthread_mutex_unlock(&checkpointLock);
+
+        if (interval <= 0)
+            sleepNanos(RM_CHECKPOINT_POLL_MILLIS * 1000000L);
+        else if (waitLogGrowth(from, interval, RM_CHECKPOINT_POLL_MILLIS))
+            checkpoint();
+    }
+}
+
+// Enforces the write-ahead rule: a logged page reaches disk only after the
+// log records describing it.
+static RC flushLogForPage(PageNumber pageNum, char *data) {
+    if (IS_FSM_PAGE(pageNum))
+        return RC_OK;
+    return flushLog(PAGE_LSN(data));
+}
+
+static void beginOp(RM_Op *op) {
+    op->lastLSN = NO_LSN;
+    op->txn = getCurrentTransaction();
+    if (op->txn != NULL) {
+        op->xid = newTxnId();
+        return;
+    }
+    op->txn = &op->single;
+    startTransaction(op->txn);
+    op->xid = op->txn->xid;
+}
+
+static void beginPageOp(RM_Op *op) {
+    op->xid = newTxnId();
+    op->lastLSN = NO_LSN;
+    op->txn = NULL;
+}
+
+// Logs row changes so they can be undone should their transaction never
+// end. Must come before the commit of the page changes that made them.
+static void logRowChanges(RM_TableMgmt *mgmt, RM_Op *op, const RM_RowChange *changes, int n) {
+    RM_Transaction *txn = op->txn;
+    LSN lsn;
+
+    if (n == 0)
+        return;
+    if (txn == &op->single) {
+        lsn = logRow(op->xid, op->lastLSN, mgmt->bm.pageFile, (const char *)changes, n * sizeof(RM_RowChange));
+        if (lsn != NO_LSN)
+            op->lastLSN = lsn;
+        return;
+    }
+    lsn = logRow(txn->xid, txn->lastLSN, mgmt->bm.pageFile, (const char *)changes, n * sizeof(RM_RowChange));
+    if (lsn != NO_LSN)
+        txn->lastLSN = lsn;
+    for (int i = 0; i < n; i++)
+        addUndo(txn, mgmt->bm.pageFile, changes[i]);
+}
+
+// Marks a pinned page dirty, logs how it changed since before was copied
+// from it and stamps it with the record's LSN. The page is dirty before its
+// record is in the log, so a checkpoint whose redo point is past the record
+// finds the page among the dirty ones.
+static void logChange(RM_TableMgmt *mgmt, RM_Op *op, BM_PageHandle *page, const char *before) {
+    LSN lsn;
+
+    markDirty(&mgmt->bm, page);
+    lsn = logPageUpdate(op->xid, op->lastLSN, mgmt->bm.pageFile, page->pageNum,
+            sizeof(LSN), PAGE_SIZE - sizeof(LSN), before, page->data);
+    if (lsn != NO_LSN) {
+        PAGE_LSN(page->data) = lsn;
+        op->lastLSN = lsn;
+    }
+}
+
+// Logs the commit of the op's page changes, while the latch is still held.
+// Recovery undoes an op that never committed by restoring the before-images
+// of its pages, so no other op may change them before this record is logged.
+static void commitOp(RM_Op *op) {
+    LSN lsn;
+
+    if (op->lastLSN == NO_LSN)
+        return;
+    lsn = logCommit(op->xid, op->lastLSN);
+    if (lsn != NO_LSN)
+        op->lastLSN = lsn;
+}
+
+// Ends an op once the latch is released. Inside a transaction the page
+// changes need not be durable before the transaction commits, and undo can
+// always be repeated, so only calls made outside a transaction wait for the
+// log.
+static RC endOp(RM_Op *op) {
+    RC rc = RC_OK;
+
+    if (op->txn != &op->single)
+        return RC_OK;
+    if (op->lastLSN != NO_LSN)
+        rc = flushLog(op->lastLSN);
+    endTransaction(op->txn);
+    return rc;
+}
+
+// Decides whether the transaction may change a record whose current version
+// is v: not if it was deleted, nor if a transaction it does not see created
+// or deleted it.
+static RC checkWrite(RM_Transaction *txn, const RM_TupleVersion *v) {
+    if (v->xmax != NO_TXN)
+        return xidVisible(&txn->snapshot, v->xmax) ? RC_RM_NO_SUCH_TUPLE : RC_RM_WRITE_CONFLICT;
+    return xidVisible(&txn->snapshot, v->xmin) ? RC_OK : RC_RM_WRITE_CONFLICT;
+}
+
+// Takes the locks a change to a record needs, waiting for the transaction
+// changing it to end. A call outside a transaction then renews its
+// snapshot, so a change committed meanwhile is not a conflict. Locks are
+// never waited for with the latch held.
+static RC lockForWrite(RM_TableMgmt *mgmt, RM_Op *op, RID id) {
+    RC rc = lockTable(op->txn->xid, mgmt->bm.pageFile, LOCK_IX);
+
+    if (rc == RC_OK)
+        rc = lockRecord(op->txn->xid, mgmt->bm.pageFile, id, LOCK_X);
+    if (rc == RC_OK && op->txn == &op->single)
+        renewSnapshot(op->txn);
+    return rc;
+}
+
+static int headerInt(char *header, int offset) {
+    int value;
+    memcpy(&value, header + offset, sizeof(int));
+    return value;
+}
+
+static void setHeaderInt(char *header, int offset, int value) {
+    memcpy(header + offset, &value, sizeof(int));
+}
+
+static const char *attrName(Schema *schema, int attr) {
+    return (schema->attrNames != NULL && schema->attrNames[attr] != NULL) ? schema->attrNames[attr] : "";
+}
+
+// Bytes the schema takes in the table header, from TABLE_HEADER_ATTRS on
+static size_t schemaHeaderSize(Schema *schema) {
+    size_t size = (2 * schema->numAttr + 1 + schema->keySize) * sizeof(int);
+
+    for (int i = 0; i < schema->numAttr; i++)
+        size += sizeof(uint16_t) + strlen(attrName(schema, i));
+    return size;
+}
+
+static void writeTableSchema(char *header, Schema *schema) {
+    char *out = header + TABLE_HEADER_ATTRS + 2 * schema->numAttr * sizeof(int);
+    uint16_t length;
+
+    setHeaderInt(header, TABLE_HEADER_NUM_ATTR, schema->numAttr);
+    for (int i = 0; i < schema->numAttr; i++) {
+        setHeaderInt(header, TABLE_HEADER_ATTRS + (2 * i) * sizeof(int), schema->dataTypes[i]);
+        setHeaderInt(header, TABLE_HEADER_ATTRS + (2 * i + 1) * sizeof(int), schema->typeLength[i]);
+    }
+    memcpy(out, &schema->keySize, sizeof(int));
+    out += sizeof(int);
+    for (int i = 0; i < schema->keySize; i++, out += sizeof(int))
+        memcpy(out, &schema->keyAttrs[i], sizeof(int));
+    for (int i = 0; i < schema->numAttr; i++) {
+        length = strlen(attrName(schema, i));
+        memcpy(out, &length, sizeof(uint16_t));
+        memcpy(out + sizeof(uint16_t), attrName(schema, i), length);
+        out += sizeof(uint16_t) + length;
+    }
+}
+
+// Decodes the schema stored in the table header. The table owns it and its
+// arrays until it is closed.
+static Schema *readTableSchema(char *header) {
+    int numAttr = headerInt(header, TABLE_HEADER_NUM_ATTR);
+    int n = (numAttr > 0) ? numAttr : 1;
+    char *in = header + TABLE_HEADER_ATTRS + 2 * numAttr * sizeof(int);
+    DataType *dataTypes = (DataType *)malloc(sizeof(DataType) * n);
+    int *typeLength = (int *)malloc(sizeof(int) * n);
+    char **attrNames = (char **)calloc(n, sizeof(char *));
+    int *keyAttrs;
+    Schema *schema = NULL;
+    bool ok;
+    int keySize;
+    uint16_t length;
+
+    memcpy(&keySize, in, sizeof(int));
+    in += sizeof(int);
+    keyAttrs = (int *)malloc(sizeof(int) * (keySize > 0 ? keySize : 1));
+    ok = (dataTypes != NULL && typeLength != NULL && attrNames != NULL && keyAttrs != NULL);
+
+    for (int i = 0; ok && i < keySize; i++, in += sizeof(int))
+        memcpy(&keyAttrs[i], in, sizeof(int));
+    for (int i = 0; ok && i < numAttr; i++) {
+        dataTypes[i] = (DataType)headerInt(header, TABLE_HEADER_ATTRS + (2 * i) * sizeof(int));
+        typeLength[i] = headerInt(header, TABLE_HEADER_ATTRS + (2 * i + 1) * sizeof(int));
+        memcpy(&length, in, sizeof(uint16_t));
+        if ((attrNames[i] = (char *)malloc(length + 1)) == NULL) {
+            ok = false;
+            break;
+        }
+        memcpy(attrNames[i], in + sizeof(uint16_t), length);
+        attrNames[i][length] = '\0';
+        in += sizeof(uint16_t) + length;
+    }
+
+    if (ok)
+        schema = createSchema(numAttr, attrNames, dataTypes, typeLength, keySize, keyAttrs);
+    if (schema == NULL) {
+        for (int i = 0; attrNames != NULL && i < numAttr; i++)
+            free(attrNames[i]);
+        free(attrNames);
+        free(dataTypes);
+        free(typeLength);
+        free(keyAttrs);
+    }
+    return schema;
+}
+
+static void freeTableSchema(Schema *schema) {
+    for (int i = 0; i < schema->numAttr; i++)
+        free(schema->attrNames[i]);
+    free(schema->attrNames);
+    free(schema->dataTypes);
+    free(schema->typeLength);
+    free(schema->keyAttrs);
+    freeSchema(schema);
+}
+
+// Flags the header stale before the first change to the counters since
+// they were written back. The flag is logged with that change, so a crash
+// either loses both or leaves the header flagged. Called with the latch
+// held exclusively.
+static void markHeaderStale(RM_TableMgmt *mgmt, RM_Op *op) {
+    BM_PageHandle header;
+    char before[PAGE_SIZE];
+
+    if (mgmt->headerStale || pinPage(&mgmt->bm, &header, 0) != RC_OK)
+        return;
+    memcpy(before, header.data, PAGE_SIZE);
+    setHeaderInt(header.data, TABLE_HEADER_FLAGS, headerInt(header.data, TABLE_HEADER_FLAGS) | TABLE_COUNTS_STALE);
+    logChange(mgmt, op, &header, before);
+    unpinPage(&mgmt->bm, &header);
+    mgmt->headerStale = true;
+}
+
+// Writes the counters back to the header, if they changed since the last
+// time, and clears its stale flag.
+static void writeBackHeader(RM_TableMgmt *mgmt) {
+    BM_PageHandle header;
+    char before[PAGE_SIZE];
+    RM_Op op;
+
+    pthread_rwlock_wrlock(&mgmt->latch);
+    if (mgmt->headerStale && pinPage(&mgmt->bm, &header, 0) == RC_OK) {
+        beginPageOp(&op);
+        memcpy(before, header.data, PAGE_SIZE);
+        setHeaderInt(header.data, TABLE_HEADER_NUM_TUPLES, atomic_load(&mgmt->numTuples));
+        setHeaderInt(header.data, TABLE_HEADER_NUM_PAGES, atomic_load(&mgmt->numPages));
+        setHeaderInt(header.data, TABLE_HEADER_FLAGS, headerInt(header.data, TABLE_HEADER_FLAGS) & ~TABLE_COUNTS_STALE);
+        logChange(mgmt, &op, &header, before);
+        unpinPage(&mgmt->bm, &header);
+        commitOp(&op);
+        mgmt->headerStale = false;
+    }
+    pthread_rwlock_unlock(&mgmt->latch);
+}
+
+// Rebuilds the tuple count of a table whose header was left stale from
+// the records not deleted. The page count in the header is always exact.
+static void recountTable(RM_TableMgmt *mgmt) {
+    BM_PageHandle page;
+    RM_TupleVersion version;
+    int numTuples = 0, numPages = atomic_load(&mgmt->numPages);
+    uint16_t flags;
+    char *tuple;
+
+    for (int p = 0; p < numPages; p++) {
+        if (!IS_DATA_PAGE(p) || pinPage(&mgmt->bm, &page, p) != RC_OK)
+            continue;
+        for (int slot = 0; slot < PAGE_HEADER(page.data)->numSlots; slot++) {
+            tuple = pageGetTuple(page.data, slot, NULL, &flags);
+            if (tuple == NULL || (flags & (SLOT_REDIRECT | SLOT_VERSION | SLOT_TOAST)))
+                continue;
+            memcpy(&version, tuple + ((flags & SLOT_MOVED) ? sizeof(RID) : 0), sizeof(RM_TupleVersion));
+            if (version.xmax == NO_TXN)
+                numTuples++;
+        }
+        unpinPage(&mgmt->bm, &page);
+    }
+    atomic_store(&mgmt->numTuples, numTuples);
+}
+
+// Sets the page count. Unlike the tuple count it is logged at once: after
+// a crash the pages past it may hold anything, so it must never be behind.
+static void setTablePages(RM_TableMgmt *mgmt, RM_Op *op, int numPages) {
+    BM_PageHandle header;
+    char before[PAGE_SIZE];
+
+    if (pinPage(&mgmt->bm, &header, 0) != RC_OK)
+        return;
+    memcpy(before, header.data, PAGE_SIZE);
+    setHeaderInt(header.data, TABLE_HEADER_NUM_PAGES, numPages);
+    logChange(mgmt, op, &header, before);
+    unpinPage(&mgmt->bm, &header);
+    atomic_store(&mgmt->numPages, numPages);
 }
 
 RC createTable(char *name, Schema *schema) {
+    return createTableWithOptions(name, schema, NULL);
+}
+
+RC createTableWithOptions(char *name, Schema *schema, RM_TableOptions *options) {
     SM_FileHandle fHandle;
+    bool pax = (options != NULL && options->layout == RM_LAYOUT_PAX);
+
+    if (TABLE_HEADER_ATTRS + schemaHeaderSize(schema) > PAGE_SIZE)
+        return RC_RM_SCHEMA_TOO_LARGE;
+    // every version carries a version header, and one that has moved off its
+    // home page also its home RID
+    if (!pax && maxTupleSize(schema) + (int)(sizeof(RID) + sizeof(RM_TupleVersion)) > PAGE_MAX_TUPLE_SIZE)
+        return RC_RM_RECORD_TOO_LARGE;
+    if (pax && paxCapacity(schema, NULL) < 1)
+        return RC_RM_RECORD_TOO_LARGE;
+    for (int i = 0; options != NULL && i < options->numBloomAttrs; i++)
+        if (options->bloomAttrs[i] < 0 || options->bloomAttrs[i] >= schema->numAttr)
+            return RC_RM_NO_SUCH_ATTR;
+
     if (createPageFile(name) != RC_OK) return RC_FILE_NOT_FOUND;
     if (openPageFile(name, &fHandle) != RC_OK) return RC_FILE_HANDLE_NOT_INIT;
     
     char *pageData = (char *)calloc(PAGE_SIZE, sizeof(char));
     if (!pageData) return RC_MEMORY_ALLOCATION_ERROR;
     
-    int numRecords = 0;
-    memcpy(pageData, &numRecords, sizeof(int));
+    setHeaderInt(pageData, TABLE_HEADER_NUM_TUPLES, 0);
+    setHeaderInt(pageData, TABLE_HEADER_RECORD_SIZE, getRecordSize(schema));
+    setHeaderInt(pageData, TABLE_HEADER_NUM_PAGES, 2); // header and the first map page
+    setHeaderInt(pageData, TABLE_HEADER_FLAGS, !pax ? 0
+            : TABLE_LAYOUT_PAX | (options->compress ? TABLE_COMPRESSED : 0));
+    writeTableSchema(pageData, schema);
 
     if (writeBlock(0, &fHandle, pageData) != RC_OK) {
         free(pageData);
         return RC_WRITE_FAILED;
     }
 
+    // an all-zero map page records every data page as full
+    memset(pageData, 0, PAGE_SIZE);
+    if (writeBlock(FSM_GROUP_PAGE(0), &fHandle, pageData) != RC_OK) {
+        free(pageData);
+        return RC_WRITE_FAILED;
+    }
+
+    // later changes are only logged, so the initial pages must be durable
     free(pageData);
+    if (syncPageFile(&fHandle) != RC_OK) {
+        closePageFile(&fHandle);
+        return RC_WRITE_FAILED;
+    }
     closePageFile(&fHandle);
+    // a side file left by an earlier table of the name goes
+    if (options != NULL && options->numBloomAttrs > 0) {
+        if (createBloomFile(name, options->bloomAttrs, options->numBloomAttrs) != RC_OK)
+            return RC_WRITE_FAILED;
+    } else {
+        destroyBloomFile(name);
+    }
+    logCreate(name);
     return RC_OK;
 }
 
+// The id of the table in a file, the same every time it is opened. Called
+// with tablesLock held; -1 if out of memory, which no reference matches.
+static int tableIdOf(const char *name) {
+    RM_TableName *entry;
+
+    for (entry = tableNames; entry != NULL; entry = entry->next)
+        if (strcmp(entry->name, name) == 0)
+            return entry->tableId;
+    entry = (RM_TableName *)malloc(sizeof(RM_TableName));
+    if (entry == NULL || (entry->name = (char *)malloc(strlen(name) + 1)) == NULL) {
+        free(entry);
+        return -1;
+    }
+    strcpy(entry->name, name);
+    entry->tableId = nextTableId++;
+    entry->next = tableNames;
+    tableNames = entry;
+    return entry->tableId;
+}
+
 RC openTable(RM_TableData *rel, char *name) {
+    RM_TableMgmt *mgmt = (RM_TableMgmt *)malloc(sizeof(RM_TableMgmt));
+    BM_PageHandle page;
+
+    if (mgmt == NULL) return RC_MEMORY_ALLOCATION_ERROR;
+    if (initBufferPool(&mgmt->bm, name, TABLE_POOL_SIZE, RS_FIFO, NULL) != RC_OK) {
+        free(mgmt);
+        return RC_FILE_NOT_FOUND;
+    }
+
+    if (pinPage(&mgmt->bm, &page, 0) != RC_OK) {
+        shutdownBufferPool(&mgmt->bm);
+        free(mgmt);
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    mgmt->schema = readTableSchema(page.data);
+    atomic_init(&mgmt->numTuples, headerInt(page.data, TABLE_HEADER_NUM_TUPLES));
+    atomic_init(&mgmt->numPages, headerInt(page.data, TABLE_HEADER_NUM_PAGES));
+    mgmt->headerStale = (headerInt(page.data, TABLE_HEADER_FLAGS) & TABLE_COUNTS_STALE) != 0;
+    mgmt->zones = NULL;
+    mgmt->pax = (headerInt(page.data, TABLE_HEADER_FLAGS) & TABLE_LAYOUT_PAX) != 0;
+    mgmt->compress = (headerInt(page.data, TABLE_HEADER_FLAGS) & TABLE_COMPRESSED) != 0;
+    unpinPage(&mgmt->bm, &page);
+    if (mgmt->schema == NULL) {
+        shutdownBufferPool(&mgmt->bm);
+        free(mgmt);
+        return RC_MEMORY_ALLOCATION_ERROR;
+    }
+    mgmt->fsmHint = 0;
+    mgmt->toasts = false;
+    for (int i = 0; i < mgmt->schema->numAttr && !mgmt->pax; i++)
+        if (mgmt->schema->dataTypes[i] == DT_STRING && mgmt->schema->typeLength[i] > TOAST_THRESHOLD)
+            mgmt->toasts = true;
+    mgmt->paxRowSize = 0;
+    if (mgmt->pax)
+        paxCapacity(mgmt->schema, &mgmt->paxRowSize);
+    pthread_rwlock_init(&mgmt->latch, NULL);
+    setWriteHook(&mgmt->bm, flushLogForPage);
+    if (mgmt->headerStale)
+        recountTable(mgmt);
+    mgmt->tableId = -1;
+    mgmt->blooms = openBloomMap(mgmt, name);
+
+    pthread_mutex_lock(&tablesLock);
+    mgmt->tableId = tableIdOf(name);
+    mgmt->next = openTables;
+    openTables = mgmt;
+    numOpenTables++;
+    pthread_mutex_unlock(&tablesLock);
+
     rel->name = name;
-    rel->mgmtData = malloc(sizeof(BM_BufferPool));
-    initBufferPool((BM_BufferPool *)rel->mgmtData, name, 3, RS_FIFO, NULL);
+    rel->schema = mgmt->schema;
+    rel->mgmtData = mgmt;
     return RC_OK;
 }
 
 RC closeTable(RM_TableData *rel) {
-    shutdownBufferPool((BM_BufferPool *)rel->mgmtData);
-    free(rel->mgmtData);
-    return RC_OK;
+    RM_TableMgmt *mgmt = (RM_TableMgmt *)rel->mgmtData;
+    RM_TableMgmt **link;
+    RC rc;
+
+    writeBackHeader(mgmt);
+    if (mgmt->blooms != NULL)
+        closeBloomMap(mgmt->blooms, atomic_load(&mgmt->numPages));
+
+    // the pool is shut down before the table leaves the list, so a running
+    // checkpoint cannot finish while its pages are still being written
+    pthread_mutex_lock(&tablesLock);
+    rc = shutdownBufferPool(&mgmt->bm);
+    for (link = &openTables; *link != mgmt; link = &(*link)->next)
+        ;
+    *link = mgmt->next;
+    numOpenTables--;
+    pthread_mutex_unlock(&tablesLock);
+
+    pthread_rwlock_destroy(&mgmt->latch);
+    freeZoneMap(mgmt->zones);
+    freeTableSchema(mgmt->schema);
+    free(mgmt);
+    rel->schema = NULL;
+    rel->mgmtData = NULL;
+    return rc;
 }
 
 RC deleteTable(char *name) {
+    destroyBloomFile(name);
     return destroyPageFile(name);
 }
 
 int getNumTuples(RM_TableData *rel) {
-    BM_BufferPool *bm = (BM_BufferPool *)rel->mgmtData;
-    BM_PageHandle page;
-
-    if (pinPage(bm, &page, 0) != RC_OK) {
-        return -1;
-    }
-
-    int numTuples = 0;
-    memcpy(&numTuples, page.data, sizeof(int));
+    return atomic_load(&((RM_TableMgmt *)rel->mgmtData)->numTuples);
+}
 
-    if (numTuples < 0 || numTuples > 1000000) {
-        printf("Warning: numTuples is corrupted: %d. Resetting to 0.\n", numTuples);
-        numTuples = 0;
-        memcpy(page.data, &numTuples, sizeof(int));
-        markDirty(bm, &page);
-        forcePage(bm, &page);
-    }
+// Records a category of free space for a data page in the map.
+static void fsmRecord(RM_TableMgmt *mgmt, int pageNum, int category) {
+    BM_PageHandle fsm;
+    int group = FSM_GROUP_OF(pageNum);
 
-    printf("Debug: Read numTuples from metadata: %d\n", numTuples);
+    if (pinPage(&mgmt->bm, &fsm, FSM_GROUP_PAGE(group)) != RC_OK)
+        return;
+    fsmPageSet(fsm.data, FSM_LEAF_OF(pageNum), category);
+    markDirty(&mgmt->bm, &fsm);
+    unpinPage(&mgmt->bm, &fsm);
 
-    unpinPage(bm, &page);
-    return numTuples;
+    if (category > 0 && group < mgmt->fsmHint)
+        mgmt->fsmHint = group;
 }
 
-RC insertRecord(RM_TableData *rel, Record *record) {
-    BM_BufferPool *bm = (BM_BufferPool *)rel->mgmtData;
-    BM_PageHandle page;
-    int numTuples;
+// Records the current free space of a pinned data page in the map.
+static void fsmUpdate(RM_TableMgmt *mgmt, BM_PageHandle *page) {
+    fsmRecord(mgmt, page->pageNum, fsmCategory(PAGE_HEADER(page->data)->freeBytes));
+}
 
-    if (pinPage(bm, &page, 0) != RC_OK) {
-        return RC_FILE_HANDLE_NOT_INIT;
+// Returns the first data page the map says has at least the given category
+// of free space, or -1 if none does.
+static int fsmSearch(RM_TableMgmt *mgmt, int numPages, int category) {
+    BM_PageHandle fsm;
+    int group, leaf, full;
+
+    for (group = mgmt->fsmHint; FSM_GROUP_PAGE(group) < numPages; group++) {
+        if (pinPage(&mgmt->bm, &fsm, FSM_GROUP_PAGE(group)) != RC_OK)
+            return -1;
+        leaf = fsmPageSearch(fsm.data, category);
+        full = (fsm.data[0] == 0);
+        unpinPage(&mgmt->bm, &fsm);
+
+        if (full && group == mgmt->fsmHint)
+            mgmt->fsmHint = group + 1;
+        if (leaf >= 0 && FSM_DATA_PAGE(group, leaf) < numPages)
+            return FSM_DATA_PAGE(group, leaf);
     }
+    return -1;
+}
 
-    memcpy(&numTuples, page.data, sizeof(int));
-    if (numTuples < 0) {
-        printf("Warning: numTuples is corrupted, resetting to 0.\n");
-        numTuples = 0;
+// Stores an encoded tuple on a page the free-space map says has room, or on
+// a page appended to the table, and leaves that page pinned in *page so
+// callers can keep filling it. before receives the page as it was when
+// pinned, for logging. A new page is counted under op.
+static RC placeTuple(RM_TableMgmt *mgmt, RM_Op *op, const char *tuple, int length, uint16_t flags, BM_PageHandle *page, char *before, RID *rid) {
+    BM_BufferPool *bm = &mgmt->bm;
+    int numPages = atomic_load(&mgmt->numPages);
+    int need = length + sizeof(RM_Slot);
+    int category = (need + FSM_CATEGORY_SIZE - 1) / FSM_CATEGORY_SIZE;
+    int pageNum, slot = -1;
+
+    // a PAX page's free bytes are a multiple of the row size, so any page
+    // in this category has a free row
+    if (mgmt->pax)
+        category = mgmt->paxRowSize / FSM_CATEGORY_SIZE;
+
+    while ((pageNum = fsmSearch(mgmt, numPages, category)) >= 0) {
+        if (pinPage(bm, page, pageNum) != RC_OK)
+            return RC_READ_NON_EXISTING_PAGE;
+        memcpy(before, page->data, PAGE_SIZE);
+        slot = pageInsert(page->data, tuple, length, flags);
+        if (slot >= 0)
+            break;
+        // the map overstated this page's room; correct it and look again.
+        // An encoded PAX page may have the free bytes and still not take
+        // the row, so it drops below the category asked for either way.
+        int current = fsmCategory(PAGE_HEADER(page->data)->freeBytes);
+        fsmRecord(mgmt, pageNum, (current < category) ? current : category - 1);
+        unpinPage(bm, page);
     }
 
-    printf("Debug: Before Insertion, Num Tuples: %d\n", numTuples);
+    if (slot < 0) {
+        pageNum = numPages;
+        if (IS_FSM_PAGE(pageNum)) {
+            if (pinPage(bm, page, pageNum) != RC_OK)
+                return RC_READ_NON_EXISTING_PAGE;
+            memset(page->data, 0, PAGE_SIZE);
+            markDirty(bm, page);
+            unpinPage(bm, page);
+            pageNum++;
+        }
+        if (pinPage(bm, page, pageNum) != RC_OK)
+            return RC_READ_NON_EXISTING_PAGE;
+        memcpy(before, page->data, PAGE_SIZE);
+        if (mgmt->pax)
+            paxPageInit(page->data, mgmt->schema, mgmt->compress);
+        else
+            pageInit(page->data);
+        slot = pageInsert(page->data, tuple, length, flags);
+        setTablePages(mgmt, op, pageNum + 1);
+    }
 
-    int pageNum = 1 + (numTuples / (PAGE_SIZE / SLOT_SIZE)); 
-    int slot = numTuples % (PAGE_SIZE / SLOT_SIZE); 
+    rid->page = page->pageNum;
+    rid->slot = slot;
+    return RC_OK;
+}
 
-    record->id.page = pageNum;
-    record->id.slot = slot;
+// Encodes a record's attributes as stored after the version header and
+// returns their length. A PAX page takes them as they are in the record.
+static int encodeRecord(RM_TableMgmt *mgmt, const char *recordData, char *attrs) {
+    if (!mgmt->pax)
+        return encodeTuple(mgmt->schema, recordData, attrs);
+    memcpy(attrs, recordData, mgmt->schema->recordSize);
+    return mgmt->schema->recordSize;
+}
 
-    if (pinPage(bm, &page, pageNum) != RC_OK) {
-        return RC_FILE_HANDLE_NOT_INIT;
+// Adds a current version written to a page to the page's zones, once a
+// scan has built the zone map, and to its Bloom filters. attrs are encoded
+// as encodeRecord does.
+static void addPageValues(RM_TableMgmt *mgmt, int pageNum, const char *attrs) {
+    char *recordData = (char *)attrs;
+
+    if (mgmt->zones == NULL && mgmt->blooms == NULL)
+        return;
+    if (!mgmt->pax) {
+        if ((recordData = (char *)malloc(mgmt->schema->recordSize)) == NULL) {
+            if (mgmt->zones != NULL)
+                mgmt->zones->incomplete = true;
+            if (mgmt->blooms != NULL)
+                mgmt->blooms->incomplete = true;
+            return;
+        }
+        decodeTuple(mgmt->schema, attrs, recordData, mgmt->tableId);
     }
+    if (mgmt->zones != NULL)
+        zoneMapAdd(mgmt->zones, mgmt->schema, pageNum, recordData);
+    if (mgmt->blooms != NULL)
+        bloomMapAdd(mgmt->blooms, mgmt->schema, pageNum, recordData);
+    if (!mgmt->pax)
+        free(recordData);
+}
 
-    memset(page.data + PAGE_METADATA_SIZE + (slot * SLOT_SIZE), 0, SLOT_SIZE);
+// Publishes a data page filled by placeTuple: records its free space in the
+// map, logs everything added to it under one record and unpins it.
+static void releaseFilledPage(RM_TableMgmt *mgmt, RM_Op *op, BM_PageHandle *page, const char *before) {
+    fsmUpdate(mgmt, page);
+    logChange(mgmt, op, page, before);
+    unpinPage(&mgmt->bm, page);
+}
 
-    strncpy(page.data + PAGE_METADATA_SIZE + (slot * SLOT_SIZE), record->data, SLOT_SIZE - 1);
-    page.data[PAGE_METADATA_SIZE + (slot * SLOT_SIZE) + SLOT_SIZE - 1] = '\0'; 
+// Pins the page holding the current version of the record named by a home
+// RID, following a redirect stub, and returns the version and its length.
+static RC pinTuple(RM_TableMgmt *mgmt, RID id, BM_PageHandle *page, char **tuple, int *length) {
+    BM_BufferPool *bm = &mgmt->bm;
+    uint16_t flags;
+    RID target;
+    int len;
 
-    markDirty(bm, &page);
-    forcePage(bm, &page);
-    unpinPage(bm, &page);
+    if (!IS_DATA_PAGE(id.page) || pinPage(bm, page, id.page) != RC_OK)
+        return RC_READ_NON_EXISTING_PAGE;
 
-    if (pinPage(bm, &page, 0) != RC_OK) {
-        return RC_FILE_HANDLE_NOT_INIT;
+    *tuple = pageGetTuple(page->data, id.slot, &len, &flags);
+    if (*tuple == NULL || (flags & (SLOT_MOVED | SLOT_VERSION | SLOT_TOAST))) {
+        unpinPage(bm, page);
+        return RC_RM_NO_SUCH_TUPLE;
+    }
+    if (!(flags & SLOT_REDIRECT)) {
+        if (length != NULL)
+            *length = len;
+        return RC_OK;
     }
 
-    numTuples++;
-    memcpy(page.data, &numTuples, sizeof(int));
+    memcpy(&target, *tuple, sizeof(RID));
+    unpinPage(bm, page);
+    if (pinPage(bm, page, target.page) != RC_OK)
+        return RC_READ_NON_EXISTING_PAGE;
+    *tuple = pageGetTuple(page->data, target.slot, &len, NULL);
+    if (*tuple == NULL) {
+        unpinPage(bm, page);
+        return RC_RM_NO_SUCH_TUPLE;
+    }
+    *tuple += sizeof(RID);
+    if (length != NULL)
+        *length = len - sizeof(RID);
+    return RC_OK;
+}
 
-    markDirty(bm, &page);
-    forcePage(bm, &page);
-    unpinPage(bm, &page);
+// Changes the tuple count by delta.
+static void addTuples(RM_TableMgmt *mgmt, RM_Op *op, int delta) {
+    markHeaderStale(mgmt, op);
+    atomic_fetch_add(&mgmt->numTuples, delta);
+}
 
-    printf("Debug: After Insertion, Num Tuples: %d\n", numTuples);
-    printf("Debug: Record inserted at Page: %d, Slot: %d with Data: %s\n", record->id.page, record->id.slot, record->data);
+// Stores a replaced version where the free-space map finds room and
+// returns its RID.
+static RC storeVersion(RM_TableMgmt *mgmt, RM_Op *op, const char *version, int length, RID *rid) {
+    BM_PageHandle page;
+    char before[PAGE_SIZE];
+    RC rc;
+
+    rc = placeTuple(mgmt, op, version, length, SLOT_VERSION, &page, before, rid);
+    if (rc == RC_OK)
+        releaseFilledPage(mgmt, op, &page, before);
+    return rc;
+}
+
+// Frees a slot and logs the change to its page.
+static void freeSlot(RM_TableMgmt *mgmt, RM_Op *op, RID rid) {
+    BM_PageHandle page;
+    char before[PAGE_SIZE];
+
+    if (pinPage(&mgmt->bm, &page, rid.page) != RC_OK)
+        return;
+    memcpy(before, page.data, PAGE_SIZE);
+    pageDelete(page.data, rid.slot);
+    fsmUpdate(mgmt, &page);
+    logChange(mgmt, op, &page, before);
+    unpinPage(&mgmt->bm, &page);
+}
 
+// Whether an encoded tuple has strings to be stored out of line
+static bool hasToasted(Schema *schema, const char *attrs) {
+    uint16_t prefix;
+
+    attrs += NULL_BITMAP_SIZE(schema->numAttr);
+    for (int i = 0; i < schema->numAttr; attrs += encodedAttrSize(schema->dataTypes[i], attrs), i++) {
+        if (schema->dataTypes[i] != DT_STRING)
+            continue;
+        memcpy(&prefix, attrs, sizeof(uint16_t));
+        if (prefix == TOAST_MARK)
+            return true;
+    }
+    return false;
+}
+
+// Stores the long strings of an encoded tuple out of line and fills in the
+// pointers encodeTuple left for them; recordData holds their values. A
+// chain is written from its last chunk back, so each chunk knows the next.
+static RC storeToasted(RM_TableMgmt *mgmt, RM_Op *op, const char *recordData, char *attrs) {
+    Schema *schema = mgmt->schema;
+    BM_PageHandle page;
+    char chunk[PAGE_SIZE], before[PAGE_SIZE];
+    RM_ToastPointer pointer;
+    RM_ToastChunk header;
+    uint16_t prefix;
+    int offset, length;
+    RC rc;
+
+    if (!mgmt->toasts)
+        return RC_OK;
+    attrs += NULL_BITMAP_SIZE(schema->numAttr);
+    for (int i = 0; i < schema->numAttr; attrs += encodedAttrSize(schema->dataTypes[i], attrs), i++) {
+        if (schema->dataTypes[i] != DT_STRING)
+            continue;
+        memcpy(&prefix, attrs, sizeof(uint16_t));
+        if (prefix != TOAST_MARK)
+            continue;
+        memcpy(&pointer, attrs + sizeof(uint16_t), sizeof(RM_ToastPointer));
+        header.stamp = pointer.stamp = op->xid;
+        header.next.page = header.next.slot = -1;
+        for (offset = (pointer.length - 1) / TOAST_CHUNK_SIZE * TOAST_CHUNK_SIZE; offset >= 0; offset -= TOAST_CHUNK_SIZE) {
+            length = pointer.length - offset;
+            if (length > TOAST_CHUNK_SIZE)
+                length = TOAST_CHUNK_SIZE;
+            memcpy(chunk, &header, sizeof(RM_ToastChunk));
+            memcpy(chunk + sizeof(RM_ToastChunk), recordData + schema->attrOffsets[i] + offset, length);
+            rc = placeTuple(mgmt, op, chunk, sizeof(RM_ToastChunk) + length, SLOT_TOAST, &page, before, &header.next);
+            if (rc != RC_OK)
+                return rc;
+            releaseFilledPage(mgmt, op, &page, before);
+        }
+        pointer.first = header.next;
+        memcpy(attrs + sizeof(uint16_t), &pointer, sizeof(RM_ToastPointer));
+    }
     return RC_OK;
 }
 
-RC deleteRecord(RM_TableData *rel, RID id) {
-    BM_BufferPool *bm = (BM_BufferPool *)rel->mgmtData;
+// Frees the out-of-line values of an encoded tuple. The tuple must not be
+// on a pinned page, since freeing logs the pages of the chunks.
+static void freeToasted(RM_TableMgmt *mgmt, RM_Op *op, const char *attrs) {
+    Schema *schema = mgmt->schema;
     BM_PageHandle page;
+    RM_ToastPointer pointer;
+    RM_ToastChunk header;
+    uint16_t prefix, flags;
+    char *tuple;
+    RID rid;
+
+    if (!mgmt->toasts)
+        return;
+    attrs += NULL_BITMAP_SIZE(schema->numAttr);
+    for (int i = 0; i < schema->numAttr; attrs += encodedAttrSize(schema->dataTypes[i], attrs), i++) {
+        if (schema->dataTypes[i] != DT_STRING)
+            continue;
+        memcpy(&prefix, attrs, sizeof(uint16_t));
+        if (prefix != TOAST_MARK)
+            continue;
+        memcpy(&pointer, attrs + sizeof(uint16_t), sizeof(RM_ToastPointer));
+        for (rid = pointer.first; rid.page >= 0 && pinPage(&mgmt->bm, &page, rid.page) == RC_OK; rid = header.next) {
+            tuple = pageGetTuple(page.data, rid.slot, NULL, &flags);
+            if (tuple != NULL && (flags & SLOT_TOAST))
+                memcpy(&header, tuple, sizeof(RM_ToastChunk));
+            unpinPage(&mgmt->bm, &page);
+            if (tuple == NULL || !(flags & SLOT_TOAST) || header.stamp != pointer.stamp)
+                break;
+            freeSlot(mgmt, op, rid);
+        }
+    }
+}
 
-    if (pinPage(bm, &page, 0) != RC_OK) {
-        return RC_READ_NON_EXISTING_PAGE;
+// Fetches the value an RM_ToastRef in a string attribute refers to into
+// its place. The value is gone if its table is not open or its version was
+// removed since the record was read; the reference is then left in place,
+// so the record still tells what it held.
+static RC fetchToasted(char *attr, int typeLength) {
+    RM_TableMgmt *mgmt;
+    BM_PageHandle page;
+    RM_ToastRef ref;
+    RM_ToastChunk header;
+    uint16_t flags;
+    char *tuple;
+    int length, done = 0;
+    RID rid;
+    RC rc = RC_OK;
+
+    if (typeLength <= TOAST_THRESHOLD || attr[0] != '\0' || attr[1] != TOAST_REF_MAGIC)
+        return RC_OK;
+    memcpy(&ref, attr, sizeof(RM_ToastRef));
+
+    pthread_mutex_lock(&tablesLock);
+    for (mgmt = openTables; mgmt != NULL && mgmt->tableId != ref.tableId; mgmt = mgmt->next)
+        ;
+    if (mgmt == NULL) {
+        pthread_mutex_unlock(&tablesLock);
+        return RC_RM_NO_SUCH_TUPLE;
+    }
+    pthread_rwlock_rdlock(&mgmt->latch);
+    memset(attr, 0, typeLength);
+    for (rid = ref.pointer.first; done < ref.pointer.length && rc == RC_OK; rid = header.next) {
+        if (!IS_DATA_PAGE(rid.page) || pinPage(&mgmt->bm, &page, rid.page) != RC_OK) {
+            rc = RC_RM_NO_SUCH_TUPLE;
+            break;
+        }
+        tuple = pageGetTuple(page.data, rid.slot, &length, &flags);
+        if (tuple != NULL && (flags & SLOT_TOAST))
+            memcpy(&header, tuple, sizeof(RM_ToastChunk));
+        if (tuple == NULL || !(flags & SLOT_TOAST) || header.stamp != ref.pointer.stamp) {
+            rc = RC_RM_NO_SUCH_TUPLE;
+        } else {
+            length -= sizeof(RM_ToastChunk);
+            if (length > ref.pointer.length - done)
+                length = ref.pointer.length - done;
+            memcpy(attr + done, tuple + sizeof(RM_ToastChunk), length);
+            done += length;
+        }
+        unpinPage(&mgmt->bm, &page);
     }
+    pthread_rwlock_unlock(&mgmt->latch);
+    pthread_mutex_unlock(&tablesLock);
 
-    int numTuples;
-    memcpy(&numTuples, page.data, sizeof(int));
+    if (rc != RC_OK) {
+        memset(attr, 0, typeLength);
+        memcpy(attr, &ref, sizeof(RM_ToastRef));
+    }
+    return rc;
+}
 
-    printf("Debug: Before Deletion, Num Tuples: %d\n", numTuples);
+// Fetches every value of the record still stored out of line, so it can be
+// encoded again. Fails if one is gone, rather than store it empty.
+static RC fetchToastedRecord(Schema *schema, Record *record) {
+    RC rc;
+
+    for (int i = 0; i < schema->numAttr; i++) {
+        if (schema->dataTypes[i] != DT_STRING)
+            continue;
+        rc = fetchToasted(record->data + schema->attrOffsets[i], schema->typeLength[i]);
+        if (rc != RC_OK)
+            return rc;
+    }
+    return RC_OK;
+}
 
-    if (numTuples > 0) {
-        numTuples--;
+// Replaces the current version of a record. Updates in place when it fits
+// the home page (compacting it if needed). Otherwise the version moves to
+// another page and the home slot keeps a redirect, so the record's RID
+// never changes. tuple holds the home RID followed by length bytes of the
+// new version.
+static RC writeCurrent(RM_TableMgmt *mgmt, RM_Op *op, RID id, char *tuple, int length) {
+    BM_BufferPool *bm = &mgmt->bm;
+    BM_PageHandle page, moved;
+    char before[PAGE_SIZE], movedBefore[PAGE_SIZE];
+    char *stub;
+    uint16_t flags;
+    RID target;
+    int current = id.page;
+    RC rc;
+
+    if (!IS_DATA_PAGE(id.page) || pinPage(bm, &page, id.page) != RC_OK) {
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    memcpy(before, page.data, PAGE_SIZE);
+
+    stub = pageGetTuple(page.data, id.slot, NULL, &flags);
+    if (stub == NULL || (flags & (SLOT_MOVED | SLOT_VERSION | SLOT_TOAST))) {
+        unpinPage(bm, &page);
+        return RC_RM_NO_SUCH_TUPLE;
+    }
+
+    if (flags & SLOT_REDIRECT) {
+        memcpy(&target, stub, sizeof(RID));
+        current = target.page;
+        if (pinPage(bm, &moved, target.page) != RC_OK) {
+            unpinPage(bm, &page);
+            return RC_READ_NON_EXISTING_PAGE;
+        }
+        memcpy(movedBefore, moved.data, PAGE_SIZE);
+        rc = pageUpdate(moved.data, target.slot, tuple, length + sizeof(RID), SLOT_MOVED);
+        if (rc != RC_OK)
+            pageDelete(moved.data, target.slot);
+        fsmUpdate(mgmt, &moved);
+        logChange(mgmt, op, &moved, movedBefore);
+        unpinPage(bm, &moved);
     } else {
-        printf("Warning: Trying to delete from an empty table.\n");
+        rc = pageUpdate(page.data, id.slot, tuple + sizeof(RID), length, 0);
     }
 
-    memcpy(page.data, &numTuples, sizeof(int));
-    markDirty(bm, &page);
-    forcePage(bm, &page);
+    if (rc != RC_OK) {
+        rc = placeTuple(mgmt, op, tuple, length + sizeof(RID), SLOT_MOVED, &moved, movedBefore, &target);
+        if (rc == RC_OK)
+            releaseFilledPage(mgmt, op, &moved, movedBefore);
+        if (rc == RC_OK)
+            rc = pageUpdate(page.data, id.slot, (char *)&target, sizeof(RID), SLOT_REDIRECT);
+        // older versions are now reached from the new page
+        if (rc == RC_OK && mgmt->zones != NULL && target.page != current)
+            zoneMapMerge(mgmt->zones, mgmt->schema, target.page, current);
+        if (rc == RC_OK && mgmt->blooms != NULL && target.page != current)
+            bloomMapMerge(mgmt->blooms, target.page, current);
+        current = target.page;
+    }
+    if (rc == RC_OK)
+        addPageValues(mgmt, current, tuple + sizeof(RID) + sizeof(RM_TupleVersion));
+
+    fsmUpdate(mgmt, &page);
+    logChange(mgmt, op, &page, before);
     unpinPage(bm, &page);
+    return rc;
+}
 
-    if (pinPage(bm, &page, id.page) != RC_OK) {
-        return RC_READ_NON_EXISTING_PAGE;
+// Removes a record, its moved copy and its out-of-line values.
+static void removeRecord(RM_TableMgmt *mgmt, RM_Op *op, RID id) {
+    BM_BufferPool *bm = &mgmt->bm;
+    BM_PageHandle page;
+    char before[PAGE_SIZE], copy[PAGE_SIZE];
+    char *tuple;
+    uint16_t flags;
+    int length;
+
+    if (mgmt->toasts && pinTuple(mgmt, id, &page, &tuple, &length) == RC_OK) {
+        memcpy(copy, tuple, length);
+        unpinPage(bm, &page);
+        freeToasted(mgmt, op, copy + sizeof(RM_TupleVersion));
+    }
+    if (!IS_DATA_PAGE(id.page) || pinPage(bm, &page, id.page) != RC_OK)
+        return;
+    memcpy(before, page.data, PAGE_SIZE);
+    tuple = pageGetTuple(page.data, id.slot, NULL, &flags);
+    if (tuple != NULL && (flags & SLOT_REDIRECT)) {
+        RID target;
+        memcpy(&target, tuple, sizeof(RID));
+        freeSlot(mgmt, op, target);
     }
-    page.data[PAGE_METADATA_SIZE + (id.slot * SLOT_SIZE)] = '\0';
-    markDirty(bm, &page);
+    pageDelete(page.data, id.slot);
+    fsmUpdate(mgmt, &page);
+    logChange(mgmt, op, &page, before);
     unpinPage(bm, &page);
+}
 
-    printf("Debug: After Deletion, Num Tuples: %d\n", numTuples);
-    return RC_OK;
+RC insertRecord(RM_TableData *rel, Record *record) {
+    return insertRecords(rel, &record, 1);
 }
 
-RC updateRecord(RM_TableData *rel, Record *record) {
-    BM_BufferPool *bm = (BM_BufferPool *)rel->mgmtData;
+// Inserts n records, filling each data page under a single pin and logging
+// each page once per batch. On error the records before the failing one
+// stay inserted and are counted.
+RC insertRecords(RM_TableData *rel, Record **records, int n) {
+    RM_TableMgmt *mgmt = (RM_TableMgmt *)rel->mgmtData;
     BM_PageHandle page;
+    char tuple[PAGE_SIZE], before[PAGE_SIZE];
+    RM_TupleVersion version;
+    RM_RowChange *changes;
+    int length, slot, i;
+    bool pinned = FALSE;
+    RM_Op op;
+    RC rc = RC_OK;
+
+    changes = (RM_RowChange *)malloc(sizeof(RM_RowChange) * (n > 0 ? n : 1));
+    if (changes == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    // a record read from any table may hold references, PAX tables included
+    for (i = 0; i < n; i++) {
+        if ((rc = fetchToastedRecord(mgmt->schema, records[i])) != RC_OK) {
+            free(changes);
+            return rc;
+        }
+    }
+    beginOp(&op);
+    // new records need no locks of their own: no other transaction sees
+    // them before this one ends
+    if ((rc = lockTable(op.txn->xid, mgmt->bm.pageFile, LOCK_IX)) != RC_OK) {
+        endOp(&op);
+        free(changes);
+        return rc;
+    }
+    pthread_rwlock_wrlock(&mgmt->latch);
+
+    version.xmin = op.txn->xid;
+    version.xmax = NO_TXN;
+    version.prev.page = version.prev.slot = -1;
+    memcpy(tuple, &version, sizeof(RM_TupleVersion));
+
+    for (i = 0; i < n; i++) {
+        length = sizeof(RM_TupleVersion) + encodeRecord(mgmt, records[i]->data, tuple + sizeof(RM_TupleVersion));
+        if (mgmt->toasts && hasToasted(mgmt->schema, tuple + sizeof(RM_TupleVersion))) {
+            // chunks may go to the page being filled, which is logged as one change
+            if (pinned)
+                releaseFilledPage(mgmt, &op, &page, before);
+            pinned = FALSE;
+            rc = storeToasted(mgmt, &op, records[i]->data, tuple + sizeof(RM_TupleVersion));
+            if (rc != RC_OK)
+                break;
+        }
 
-    if (pinPage(bm, &page, record->id.page) != RC_OK) {
-        return RC_READ_NON_EXISTING_PAGE;
+        if (pinned) {
+            slot = pageInsert(page.data, tuple, length, 0);
+            if (slot >= 0) {
+                records[i]->id.page = page.pageNum;
+                records[i]->id.slot = slot;
+                addPageValues(mgmt, page.pageNum, tuple + sizeof(RM_TupleVersion));
+                changes[i].kind = ROW_INSERT;
+                changes[i].rid = records[i]->id;
+                continue;
+            }
+            releaseFilledPage(mgmt, &op, &page, before);
+            pinned = FALSE;
+        }
+
+        rc = placeTuple(mgmt, &op, tuple, length, 0, &page, before, &records[i]->id);
+        if (rc != RC_OK)
+            break;
+        addPageValues(mgmt, records[i]->id.page, tuple + sizeof(RM_TupleVersion));
+        changes[i].kind = ROW_INSERT;
+        changes[i].rid = records[i]->id;
+        pinned = TRUE;
     }
+    if (pinned)
+        releaseFilledPage(mgmt, &op, &page, before);
+
+    if (i > 0)
+        addTuples(mgmt, &op, i);
+    logRowChanges(mgmt, &op, changes, i);
+    commitOp(&op);
+    pthread_rwlock_unlock(&mgmt->latch);
+
+    if (endOp(&op) != RC_OK && rc == RC_OK)
+        rc = RC_WRITE_FAILED;
+    free(changes);
+    return rc;
+}
 
-    memset(page.data + PAGE_METADATA_SIZE + (record->id.slot * SLOT_SIZE), 0, SLOT_SIZE);
+// Frees a chain of older versions.
+static void freeChain(RM_TableMgmt *mgmt, RM_Op *op, RID rid) {
+    BM_PageHandle page;
+    RM_TupleVersion version;
+    char copy[PAGE_SIZE];
+    char *tuple;
+    uint16_t flags;
+    int length;
+
+    while (rid.page >= 0 && pinPage(&mgmt->bm, &page, rid.page) == RC_OK) {
+        tuple = pageGetTuple(page.data, rid.slot, &length, &flags);
+        if (tuple != NULL && (flags & SLOT_VERSION))
+            memcpy(copy, tuple, length);
+        unpinPage(&mgmt->bm, &page);
+        if (tuple == NULL || !(flags & SLOT_VERSION))
+            break;
+        memcpy(&version, copy, sizeof(RM_TupleVersion));
+        freeToasted(mgmt, op, copy + sizeof(RM_TupleVersion));
+        freeSlot(mgmt, op, rid);
+        rid = version.prev;
+    }
+}
 
-    strncpy(page.data + PAGE_METADATA_SIZE + (record->id.slot * SLOT_SIZE), record->data, SLOT_SIZE - 1);
-    page.data[PAGE_METADATA_SIZE + (record->id.slot * SLOT_SIZE) + SLOT_SIZE - 1] = '\0';
+// Removes the versions that the ended transaction xid deleted or replaced
+// in a record, once no snapshot can see them any more. Those still seen
+// stay for a later vacuum.
+static void pruneRow(RM_TableMgmt *mgmt, TxnId xid, RID rid) {
+    BM_PageHandle page;
+    RM_TupleVersion version;
+    char before[PAGE_SIZE];
+    char *tuple;
+    RID chain;
+    RM_Op op;
+
+    if (!xidVisibleToAll(xid))
+        return;
+    pthread_rwlock_wrlock(&mgmt->latch);
+    beginPageOp(&op);
+    if (pinTuple(mgmt, rid, &page, &tuple, NULL) == RC_OK) {
+        memcpy(&version, tuple, sizeof(RM_TupleVersion));
+        chain = version.prev;
+        if (version.xmax == xid) {
+            unpinPage(&mgmt->bm, &page);
+            removeRecord(mgmt, &op, rid);
+            freeChain(mgmt, &op, chain);
+        } else if (version.xmin == xid && chain.page >= 0) {
+            memcpy(before, page.data, PAGE_SIZE);
+            version.prev.page = version.prev.slot = -1;
+            memcpy(tuple, &version, sizeof(RM_TupleVersion));
+            logChange(mgmt, &op, &page, before);
+            unpinPage(&mgmt->bm, &page);
+            freeChain(mgmt, &op, chain);
+        } else {
+            unpinPage(&mgmt->bm, &page);
+        }
+    }
+    commitOp(&op);
+    pthread_rwlock_unlock(&mgmt->latch);
+}
 
-    printf("Debug: Updated record at Page: %d, Slot: %d with Data: '%s'\n", record->id.page, record->id.slot, record->data);
+// Removes what no snapshot can reach any more of the record with home RID
+// rid: the whole record if every snapshot sees it deleted, and otherwise
+// the versions older than the newest one every snapshot sees.
+static void vacuumRow(RM_TableMgmt *mgmt, RM_Op *op, RID rid) {
+    BM_PageHandle page;
+    RM_TupleVersion version;
+    char before[PAGE_SIZE];
+    char *tuple;
+    uint16_t flags;
+    RID chain;
+
+    if (pinTuple(mgmt, rid, &page, &tuple, NULL) != RC_OK)
+        return;
+    memcpy(&version, tuple, sizeof(RM_TupleVersion));
+    if (version.xmax != NO_TXN && xidVisibleToAll(version.xmax)) {
+        unpinPage(&mgmt->bm, &page);
+        removeRecord(mgmt, op, rid);
+        freeChain(mgmt, op, version.prev);
+        return;
+    }
 
-    markDirty(bm, &page);
-    forcePage(bm, &page);
-    unpinPage(bm, &page);
+    while ((chain = version.prev).page >= 0) {
+        if (xidVisibleToAll(version.xmin)) {
+            memcpy(before, page.data, PAGE_SIZE);
+            version.prev.page = version.prev.slot = -1;
+            memcpy(tuple, &version, sizeof(RM_TupleVersion));
+            logChange(mgmt, op, &page, before);
+            unpinPage(&mgmt->bm, &page);
+            freeChain(mgmt, op, chain);
+            return;
+        }
+        unpinPage(&mgmt->bm, &page);
+        if (pinPage(&mgmt->bm, &page, chain.page) != RC_OK)
+            return;
+        tuple = pageGetTuple(page.data, chain.slot, NULL, &flags);
+        if (tuple == NULL || !(flags & SLOT_VERSION))
+            break;
+        memcpy(&version, tuple, sizeof(RM_TupleVersion));
+    }
+    unpinPage(&mgmt->bm, &page);
+}
 
-    return RC_OK;
+// Vacuums the records whose home is one data page, then compacts it and
+// records its free space. Holds the latch for this page only.
+static void vacuumPage(RM_TableMgmt *mgmt, int pageNum) {
+    BM_PageHandle page;
+    char before[PAGE_SIZE];
+    int numSlots;
+    RID rid;
+    RM_Op op;
+
+    pthread_rwlock_wrlock(&mgmt->latch);
+    if (pageNum >= atomic_load(&mgmt->numPages) || pinPage(&mgmt->bm, &page, pageNum) != RC_OK) {
+        pthread_rwlock_unlock(&mgmt->latch);
+        return;
+    }
+    numSlots = PAGE_HEADER(page.data)->numSlots;
+    unpinPage(&mgmt->bm, &page);
+
+    beginPageOp(&op);
+    rid.page = pageNum;
+    for (rid.slot = 0; rid.slot < numSlots; rid.slot++)
+        vacuumRow(mgmt, &op, rid);
+
+    if (pinPage(&mgmt->bm, &page, pageNum) == RC_OK) {
+        if (pageFragmented(page.data)) {
+            memcpy(before, page.data, PAGE_SIZE);
+            pageCompact(page.data);
+            logChange(mgmt, &op, &page, before);
+        }
+        fsmUpdate(mgmt, &page);
+        unpinPage(&mgmt->bm, &page);
+        // values removed by the vacuum leave the filters
+        if (mgmt->blooms != NULL)
+            bloomMapRebuildPage(mgmt, pageNum);
+    }
+    commitOp(&op);
+    pthread_rwlock_unlock(&mgmt->latch);
 }
 
-RC getRecord(RM_TableData *rel, RID id, Record *record) {
-    BM_BufferPool *bm = (BM_BufferPool *)rel->mgmtData;
+// Cuts the empty pages at the end of the table off the file, keeping the
+// header and the first map page. The new page count reaches the log before
+// the file shrinks.
+static RC truncateTable(RM_TableMgmt *mgmt) {
     BM_PageHandle page;
+    int numPages, keep;
+    bool empty;
+    RM_Op op;
+    RC rc = RC_OK;
+
+    pthread_rwlock_wrlock(&mgmt->latch);
+    numPages = keep = atomic_load(&mgmt->numPages);
+    while (keep > FSM_GROUP_PAGE(0) + 1) {
+        if (IS_DATA_PAGE(keep - 1)) {
+            if (pinPage(&mgmt->bm, &page, keep - 1) != RC_OK)
+                break;
+            empty = (PAGE_HEADER(page.data)->numSlots == 0);
+            unpinPage(&mgmt->bm, &page);
+            if (!empty)
+                break;
+        }
+        keep--;
+    }
 
-    if (pinPage(bm, &page, id.page) != RC_OK) {
-        printf("Debug: Failed to pin page %d\n", id.page);
-        return RC_READ_NON_EXISTING_PAGE;
+    if (keep < numPages) {
+        // the map still covers the dropped pages of a group that stays
+        for (int p = keep; p < numPages; p++) {
+            if (!IS_DATA_PAGE(p) || FSM_GROUP_PAGE(FSM_GROUP_OF(p)) >= keep
+                    || pinPage(&mgmt->bm, &page, FSM_GROUP_PAGE(FSM_GROUP_OF(p))) != RC_OK)
+                continue;
+            fsmPageSet(page.data, FSM_LEAF_OF(p), 0);
+            markDirty(&mgmt->bm, &page);
+            unpinPage(&mgmt->bm, &page);
+        }
+        beginPageOp(&op);
+        setTablePages(mgmt, &op, keep);
+        if (op.lastLSN != NO_LSN)
+            rc = flushLog(logCommit(op.xid, op.lastLSN));
+        if (rc == RC_OK)
+            rc = truncatePool(&mgmt->bm, keep);
+        // a page still pinned by a scan stays in the file, past the end
+        if (rc == RC_BM_PAGE_PINNED)
+            rc = RC_OK;
+    }
+    pthread_rwlock_unlock(&mgmt->latch);
+    return rc;
+}
+
+RC vacuumTable(RM_TableData *rel) {
+    RM_TableMgmt *mgmt = (RM_TableMgmt *)rel->mgmtData;
+
+    for (int p = 0; p < atomic_load(&mgmt->numPages); p++)
+        if (IS_DATA_PAGE(p))
+            vacuumPage(mgmt, p);
+    return truncateTable(mgmt);
+}
+
+// Marks the current version deleted by the caller's transaction. It stays
+// in place for snapshots that still see it.
+RC deleteRecord(RM_TableData *rel, RID id) {
+    RM_TableMgmt *mgmt = (RM_TableMgmt *)rel->mgmtData;
+    BM_BufferPool *bm = &mgmt->bm;
+    BM_PageHandle page;
+    char before[PAGE_SIZE];
+    char *tuple;
+    RM_TupleVersion version;
+    RM_RowChange change;
+    RM_Op op;
+    RC rc;
+
+    beginOp(&op);
+    rc = lockForWrite(mgmt, &op, id);
+    pthread_rwlock_wrlock(&mgmt->latch);
+    if (rc == RC_OK)
+        rc = pinTuple(mgmt, id, &page, &tuple, NULL);
+    if (rc == RC_OK) {
+        memcpy(&version, tuple, sizeof(RM_TupleVersion));
+        rc = checkWrite(op.txn, &version);
+        if (rc == RC_OK) {
+            memcpy(before, page.data, PAGE_SIZE);
+            version.xmax = op.txn->xid;
+            memcpy(tuple, &version, sizeof(RM_TupleVersion));
+            logChange(mgmt, &op, &page, before);
+        }
+        unpinPage(bm, &page);
+    }
+
+    if (rc == RC_OK) {
+        if (atomic_load(&mgmt->numTuples) > 0)
+            addTuples(mgmt, &op, -1);
+        change.kind = ROW_DELETE;
+        change.rid = id;
+        logRowChanges(mgmt, &op, &change, 1);
+    }
+    commitOp(&op);
+    pthread_rwlock_unlock(&mgmt->latch);
+
+    if (endOp(&op) != RC_OK && rc == RC_OK)
+        rc = RC_WRITE_FAILED;
+    if (rc == RC_OK && op.txn == &op.single)
+        pruneRow(mgmt, op.xid, id);
+    return rc;
+}
+
+// Writes a new current version. The version it replaces is kept as an
+// older version for snapshots that still see it, unless the caller's
+// transaction created it and so no one else can.
+RC updateRecord(RM_TableData *rel, Record *record) {
+    RM_TableMgmt *mgmt = (RM_TableMgmt *)rel->mgmtData;
+    BM_PageHandle page;
+    char tuple[PAGE_SIZE], old[PAGE_SIZE];
+    char *current;
+    RM_TupleVersion version, next;
+    RM_RowChange change;
+    int length, oldLength = 0;
+    RM_Op op;
+    RC rc;
+
+    if ((rc = fetchToastedRecord(mgmt->schema, record)) != RC_OK)
+        return rc;
+    // the home RID prefix is only stored if the tuple has to move
+    memcpy(tuple, &record->id, sizeof(RID));
+    length = sizeof(RM_TupleVersion) + encodeRecord(mgmt, record->data, tuple + sizeof(RID) + sizeof(RM_TupleVersion));
+
+    beginOp(&op);
+    rc = lockForWrite(mgmt, &op, record->id);
+    pthread_rwlock_wrlock(&mgmt->latch);
+    if (rc == RC_OK)
+        rc = pinTuple(mgmt, record->id, &page, &current, &oldLength);
+    if (rc == RC_OK) {
+        memcpy(&version, current, sizeof(RM_TupleVersion));
+        oldLength = pageCopyTuple(page.data, current, oldLength, old);
+        unpinPage(&mgmt->bm, &page);
+        rc = checkWrite(op.txn, &version);
+    }
+
+    if (rc == RC_OK) {
+        next.xmin = op.txn->xid;
+        next.xmax = NO_TXN;
+        next.prev = version.prev;
+        if (version.xmin != op.txn->xid) {
+            version.xmax = op.txn->xid;
+            memcpy(old, &version, sizeof(RM_TupleVersion));
+            rc = storeVersion(mgmt, &op, old, oldLength, &next.prev);
+        }
+    }
+    if (rc == RC_OK)
+        rc = storeToasted(mgmt, &op, record->data, tuple + sizeof(RID) + sizeof(RM_TupleVersion));
+    if (rc == RC_OK) {
+        memcpy(tuple + sizeof(RID), &next, sizeof(RM_TupleVersion));
+        rc = writeCurrent(mgmt, &op, record->id, tuple, length);
+        if (rc != RC_OK) {
+            freeToasted(mgmt, &op, tuple + sizeof(RID) + sizeof(RM_TupleVersion));
+        } else if (version.xmin != op.txn->xid) {
+            change.kind = ROW_UPDATE;
+            change.rid = record->id;
+            logRowChanges(mgmt, &op, &change, 1);
+        } else {
+            // the replaced version was the transaction's own and is gone
+            freeToasted(mgmt, &op, old + sizeof(RM_TupleVersion));
+        }
+    }
+    commitOp(&op);
+    pthread_rwlock_unlock(&mgmt->latch);
+    if (endOp(&op) != RC_OK && rc == RC_OK)
+        rc = RC_WRITE_FAILED;
+    if (rc == RC_OK && op.txn == &op.single)
+        pruneRow(mgmt, op.xid, record->id);
+    return rc;
+}
+
+// Returns the version of the record that the caller's transaction sees, or
+// the latest committed one outside a transaction.
+RC getRecord(RM_TableData *rel, RID id, Record *record) {
+    RM_TableMgmt *mgmt = (RM_TableMgmt *)rel->mgmtData;
+    BM_BufferPool *bm = &mgmt->bm;
+    RM_Transaction *txn = getCurrentTransaction();
+    RM_Snapshot snapshot;
+    BM_PageHandle page;
+    char *tuple;
+    RC rc;
+
+    // the snapshot decides what is read, so the record itself is not locked
+    if (txn != NULL && (rc = lockTable(txn->xid, bm->pageFile, LOCK_IS)) != RC_OK)
+        return rc;
+    pthread_rwlock_rdlock(&mgmt->latch);
+    if ((rc = pinTuple(mgmt, id, &page, &tuple, NULL)) != RC_OK) {
+        pthread_rwlock_unlock(&mgmt->latch);
+        return rc;
     }
 
     if (record->data == NULL) {
-        record->data = (char *)malloc(SLOT_SIZE);
+        record->data = (char *)malloc(getRecordSize(mgmt->schema));
         if (record->data == NULL) {
-            printf("Debug: Memory allocation failed for record->data\n");
+            unpinPage(bm, &page);
+            pthread_rwlock_unlock(&mgmt->latch);
             return RC_MEMORY_ALLOCATION_ERROR;
         }
     }
 
-    char *recordData = page.data + PAGE_METADATA_SIZE + (id.slot * SLOT_SIZE);
-    strncpy(record->data, recordData, SLOT_SIZE - 1);
-    record->data[SLOT_SIZE - 1] = '\0';  
+    if (txn != NULL) {
+        rc = readVisibleVersion(mgmt, &txn->snapshot, page.data, tuple, record->data);
+    } else {
+        takeSnapshot(&snapshot, NO_TXN);
+        rc = readVisibleVersion(mgmt, &snapshot, page.data, tuple, record->data);
+        freeSnapshot(&snapshot);
+    }
+    unpinPage(bm, &page);
+    pthread_rwlock_unlock(&mgmt->latch);
+    if (rc != RC_OK)
+        return rc;
+    record->id = id;
+    return RC_OK;
+}
+
+// Rolls back one row change of transaction xid. Each step first checks that
+// the change is still there, so undoing twice, as after a crash during an
+// abort, does no harm.
+static void undoRowChange(RM_TableMgmt *mgmt, TxnId xid, const RM_RowChange *change) {
+    BM_PageHandle page;
+    char tuple[PAGE_SIZE], before[PAGE_SIZE], discarded[PAGE_SIZE];
+    char *current, *older;
+    RM_TupleVersion version;
+    RID replaced;
+    int length, currentLength;
+    RM_Op op;
+
+    beginPageOp(&op);
+    if (pinTuple(mgmt, change->rid, &page, &current, &currentLength) != RC_OK)
+        return;
+    memcpy(&version, current, sizeof(RM_TupleVersion));
+
+    if (change->kind == ROW_DELETE && version.xmax == xid) {
+        memcpy(before, page.data, PAGE_SIZE);
+        version.xmax = NO_TXN;
+        memcpy(current, &version, sizeof(RM_TupleVersion));
+        logChange(mgmt, &op, &page, before);
+        unpinPage(&mgmt->bm, &page);
+        addTuples(mgmt, &op, 1);
+    } else if (change->kind == ROW_INSERT && version.xmin == xid) {
+        unpinPage(&mgmt->bm, &page);
+        removeRecord(mgmt, &op, change->rid);
+        addTuples(mgmt, &op, -1);
+    } else if (change->kind == ROW_UPDATE && version.xmin == xid && version.prev.page >= 0) {
+        // make the replaced version current again
+        replaced = version.prev;
+        memcpy(discarded, current, currentLength);
+        unpinPage(&mgmt->bm, &page);
+        if (pinPage(&mgmt->bm, &page, replaced.page) != RC_OK)
+            return;
+        older = pageGetTuple(page.data, replaced.slot, &length, NULL);
+        if (older != NULL) {
+            memcpy(tuple, &change->rid, sizeof(RID));
+            length = pageCopyTuple(page.data, older, length, tuple + sizeof(RID));
+        }
+        unpinPage(&mgmt->bm, &page);
+        if (older == NULL)
+            return;
+        memcpy(&version, tuple + sizeof(RID), sizeof(RM_TupleVersion));
+        version.xmax = NO_TXN;
+        memcpy(tuple + sizeof(RID), &version, sizeof(RM_TupleVersion));
+        // the restored version takes over the out-of-line values of the
+        // older one, so only the slot is freed
+        if (writeCurrent(mgmt, &op, change->rid, tuple, length) == RC_OK) {
+            freeToasted(mgmt, &op, discarded + sizeof(RM_TupleVersion));
+            freeSlot(mgmt, &op, replaced);
+        }
+    } else {
+        unpinPage(&mgmt->bm, &page);
+    }
+    commitOp(&op);
+}
+
+static RM_TableMgmt *findOpenTable(const char *fileName) {
+    RM_TableMgmt *mgmt = NULL;
 
-    printf("Debug: Retrieved Record from Page: %d, Slot: %d -> %s\n", id.page, id.slot, record->data);
+    pthread_mutex_lock(&tablesLock);
+    for (RM_TableMgmt *t = openTables; t != NULL && mgmt == NULL; t = t->next)
+        if (strcmp(t->bm.pageFile, fileName) == 0)
+            mgmt = t;
+    pthread_mutex_unlock(&tablesLock);
+    return mgmt;
+}
 
-    unpinPage(bm, &page);
+// Undoes a change in the named table, opening it for the duration if no
+// one has it open.
+static void undoChangeIn(const char *fileName, TxnId xid, const RM_RowChange *change) {
+    RM_TableMgmt *mgmt = findOpenTable(fileName);
+    RM_TableData rel;
+
+    if (mgmt != NULL) {
+        pthread_rwlock_wrlock(&mgmt->latch);
+        undoRowChange(mgmt, xid, change);
+        pthread_rwlock_unlock(&mgmt->latch);
+    } else if (openTable(&rel, (char *)fileName) == RC_OK) {
+        undoRowChange((RM_TableMgmt *)rel.mgmtData, xid, change);
+        closeTable(&rel);
+    }
+}
+
+// Row undo handler for recovery; the table may have been deleted since.
+static RC undoLoggedRows(TxnId xid, const char *fileName, const char *data, int length) {
+    RM_RowChange change;
+
+    for (int i = length / (int)sizeof(RM_RowChange) - 1; i >= 0; i--) {
+        memcpy(&change, data + i * sizeof(RM_RowChange), sizeof(RM_RowChange));
+        undoChangeIn(fileName, xid, &change);
+    }
+    return RC_OK;
+}
+
+RC beginTransaction(void) {
+    RM_Transaction *txn;
+
+    if (getCurrentTransaction() != NULL)
+        return RC_RM_TRANSACTION_ACTIVE;
+    txn = (RM_Transaction *)malloc(sizeof(RM_Transaction));
+    if (txn == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    startTransaction(txn);
+    setCurrentTransaction(txn);
+    return RC_OK;
+}
+
+RC commitTransaction(void) {
+    RM_Transaction *txn = getCurrentTransaction();
+    RM_UndoEntry *undo;
+    int numUndo;
+    RC rc = RC_OK;
+
+    if (txn == NULL)
+        return RC_RM_NO_TRANSACTION;
+    if (txn->lastLSN != NO_LSN)
+        rc = flushLog(logCommit(txn->xid, txn->lastLSN));
+    setCurrentTransaction(NULL);
+
+    // endTransaction frees the undo list, which also names what to prune
+    undo = txn->undo;
+    numUndo = txn->numUndo;
+    txn->undo = NULL;
+    txn->numUndo = 0;
+    endTransaction(txn);
+    for (int i = 0; i < numUndo; i++) {
+        RM_TableMgmt *mgmt = findOpenTable(undo[i].fileName);
+        if (mgmt != NULL && undo[i].change.kind != ROW_INSERT)
+            pruneRow(mgmt, txn->xid, undo[i].change.rid);
+        free(undo[i].fileName);
+    }
+    free(undo);
+    free(txn);
+    return rc;
+}
+
+// Restores every version the transaction replaced, newest change first.
+// Its own versions stay invisible to others until it ends.
+RC abortTransaction(void) {
+    RM_Transaction *txn = getCurrentTransaction();
+
+    if (txn == NULL)
+        return RC_RM_NO_TRANSACTION;
+    for (int i = txn->numUndo - 1; i >= 0; i--)
+        undoChangeIn(txn->undo[i].fileName, txn->xid, &txn->undo[i].change);
+    if (txn->lastLSN != NO_LSN)
+        logAbort(txn->xid, txn->lastLSN);
+    endTransaction(txn);
+    setCurrentTransaction(NULL);
+    free(txn);
     return RC_OK;
 }
 
 int getRecordSize(Schema *schema) {
-    return SLOT_SIZE;
+    return schema->recordSize;
+}
+
+static int attrSize(DataType dt, int typeLength) {
+    switch (dt) {
+        case DT_INT: return sizeof(int);
+        case DT_FLOAT: return sizeof(float);
+        case DT_BOOL: return sizeof(bool);
+        case DT_STRING: return typeLength;
+    }
+    return 0;
+}
+
+static int attrAlign(DataType dt) {
+    return (dt == DT_STRING) ? 1 : attrSize(dt, 0);
+}
+
+// Attributes are laid out in schema order after the null bitmap, each at
+// the next offset aligned for its type, so getAttr/setAttr need one offset
+// load per attribute.
+static void computeLayout(Schema *schema) {
+    int offset = NULL_BITMAP_SIZE(schema->numAttr), maxAlign = 1;
+
+    for (int i = 0; i < schema->numAttr; i++) {
+        int align = attrAlign(schema->dataTypes[i]);
+        offset = (offset + align - 1) / align * align;
+        schema->attrOffsets[i] = offset;
+        offset += attrSize(schema->dataTypes[i], schema->typeLength[i]);
+        if (align > maxAlign) maxAlign = align;
+    }
+    offset = (offset + maxAlign - 1) / maxAlign * maxAlign;
+    schema->recordSize = (offset > 0) ? offset : 1;
 }
 
 Schema *createSchema(int numAttr, char **attrNames, DataType *dataTypes, int *typeLength, int keySize, int *keys) {
     Schema *schema = (Schema *)malloc(sizeof(Schema));
+    if (schema == NULL) return NULL;
     schema->numAttr = numAttr;
     schema->attrNames = attrNames;
     schema->dataTypes = dataTypes;
     schema->typeLength = typeLength;
     schema->keyAttrs = keys;
     schema->keySize = keySize;
+    schema->attrOffsets = (int *)malloc(sizeof(int) * (numAttr > 0 ? numAttr : 1));
+    if (schema->attrOffsets == NULL) {
+        free(schema);
+        return NULL;
+    }
+    computeLayout(schema);
     return schema;
 }
 
 RC freeSchema(Schema *schema) {
+    free(schema->attrOffsets);
     free(schema);
     return RC_OK;
 }
@@ -263,27 +1873,42 @@ RC freeRecord(Record *record) {
 RC getAttr(Record *record, Schema *schema, int attrNum, Value **value) {
     if (record == NULL || schema == NULL || value == NULL) return RC_ERROR;
 
+    if (attrNum < 0 || attrNum >= schema->numAttr) return RC_ERROR;
+
+    char *attrData = record->data + schema->attrOffsets[attrNum];
+
+    if (isAttrNull(record, schema, attrNum)) {
+        MAKE_NULL_VALUE(*value, schema->dataTypes[attrNum]);
+        return (*value != NULL) ? RC_OK : RC_MEMORY_ALLOCATION_ERROR;
+    }
     *value = (Value *)malloc(sizeof(Value));
     if (*value == NULL) return RC_MEMORY_ALLOCATION_ERROR;
+    (*value)->isNull = false;
 
     switch (schema->dataTypes[attrNum]) {
         case DT_INT:
             (*value)->dt = DT_INT;
-            memcpy(&((*value)->v.intV), record->data + (attrNum * sizeof(int)), sizeof(int));
+            memcpy(&((*value)->v.intV), attrData, sizeof(int));
             break;
-        case DT_STRING:
+        case DT_STRING: {
+            RC rc = fetchToasted(attrData, schema->typeLength[attrNum]);
+            if (rc != RC_OK) {
+                free(*value);
+                return rc;
+            }
             (*value)->dt = DT_STRING;
             (*value)->v.stringV = (char *)malloc(schema->typeLength[attrNum] + 1);
-            strncpy((*value)->v.stringV, record->data + (attrNum * schema->typeLength[attrNum]), schema->typeLength[attrNum]);
+            strncpy((*value)->v.stringV, attrData, schema->typeLength[attrNum]);
             (*value)->v.stringV[schema->typeLength[attrNum]] = '\0';
             break;
+        }
         case DT_FLOAT:
             (*value)->dt = DT_FLOAT;
-            memcpy(&((*value)->v.floatV), record->data + (attrNum * sizeof(float)), sizeof(float));
+            memcpy(&((*value)->v.floatV), attrData, sizeof(float));
             break;
         case DT_BOOL:
             (*value)->dt = DT_BOOL;
-            memcpy(&((*value)->v.boolV), record->data + (attrNum * sizeof(bool)), sizeof(bool));
+            memcpy(&((*value)->v.boolV), attrData, sizeof(bool));
             break;
         default:
             free(*value);
@@ -293,6 +1918,109 @@ RC getAttr(Record *record, Schema *schema, int attrNum, Value **value) {
     return RC_OK;
 }
 
+RC setAttr(Record *record, Schema *schema, int attrNum, Value *value) {
+    if (record == NULL || schema == NULL || value == NULL) return RC_ERROR;
+    if (attrNum < 0 || attrNum >= schema->numAttr) return RC_ERROR;
+    if (value->dt != schema->dataTypes[attrNum]) return RC_RM_ATTR_TYPE_MISMATCH;
+
+    if (value->isNull) {
+        setAttrNull(record, schema, attrNum);
+        return RC_OK;
+    }
+    switch (value->dt) {
+        case DT_INT:
+            setAttrInt(record, schema, attrNum, value->v.intV);
+            break;
+        case DT_STRING:
+            setAttrString(record, schema, attrNum, value->v.stringV, strlen(value->v.stringV));
+            break;
+        case DT_FLOAT:
+            setAttrFloat(record, schema, attrNum, value->v.floatV);
+            break;
+        case DT_BOOL:
+            setAttrBool(record, schema, attrNum, value->v.boolV);
+            break;
+        default:
+            return RC_RM_UNKNOWN_DATATYPE;
+    }
+
+    return RC_OK;
+}
+
+int getAttrInt(Record *record, Schema *schema, int attrNum) {
+    int value;
+    memcpy(&value, record->data + schema->attrOffsets[attrNum], sizeof(int));
+    return value;
+}
+
+float getAttrFloat(Record *record, Schema *schema, int attrNum) {
+    float value;
+    memcpy(&value, record->data + schema->attrOffsets[attrNum], sizeof(float));
+    return value;
+}
+
+bool getAttrBool(Record *record, Schema *schema, int attrNum) {
+    bool value;
+    memcpy(&value, record->data + schema->attrOffsets[attrNum], sizeof(bool));
+    return value;
+}
+
+// Returns a pointer into the record; the string is only NUL-terminated when
+// shorter than its declared length, so callers must use *length. A value
+// stored out of line is fetched first, or reads as empty if it is gone;
+// getAttr reports why, and the record keeps its reference either way.
+const char *getAttrString(Record *record, Schema *schema, int attrNum, int *length) {
+    char *attrData = record->data + schema->attrOffsets[attrNum];
+    const char *end;
+
+    fetchToasted(attrData, schema->typeLength[attrNum]);
+    end = memchr(attrData, '\0', schema->typeLength[attrNum]);
+    *length = (end != NULL) ? (int)(end - attrData) : schema->typeLength[attrNum];
+    return attrData;
+}
+
+bool isAttrNull(Record *record, Schema *schema, int attrNum) {
+    if (attrNum < 0 || attrNum >= schema->numAttr) return false;
+    return (record->data[attrNum / 8] >> (attrNum % 8)) & 1;
+}
+
+// Zeroes the value too, so every NULL is stored, encoded and compared alike
+void setAttrNull(Record *record, Schema *schema, int attrNum) {
+    record->data[attrNum / 8] |= (char)(1 << (attrNum % 8));
+    memset(record->data + schema->attrOffsets[attrNum], 0, attrSize(schema->dataTypes[attrNum], schema->typeLength[attrNum]));
+}
+
+static void clearNull(Record *record, int attrNum) {
+    record->data[attrNum / 8] &= (char)~(1 << (attrNum % 8));
+}
+
+void setAttrInt(Record *record, Schema *schema, int attrNum, int value) {
+    clearNull(record, attrNum);
+    memcpy(record->data + schema->attrOffsets[attrNum], &value, sizeof(int));
+}
+
+void setAttrFloat(Record *record, Schema *schema, int attrNum, float value) {
+    clearNull(record, attrNum);
+    memcpy(record->data + schema->attrOffsets[attrNum], &value, sizeof(float));
+}
+
+void setAttrBool(Record *record, Schema *schema, int attrNum, bool value) {
+    clearNull(record, attrNum);
+    memcpy(record->data + schema->attrOffsets[attrNum], &value, sizeof(bool));
+}
+
+// Strings longer than the declared length are truncated; shorter ones are
+// zero padded so equal values always compare equal byte for byte.
+void setAttrString(Record *record, Schema *schema, int attrNum, const char *value, int length) {
+    char *attrData = record->data + schema->attrOffsets[attrNum];
+    int maxLength = schema->typeLength[attrNum];
+
+    clearNull(record, attrNum);
+    if (length > maxLength) length = maxLength;
+    memcpy(attrData, value, length);
+    memset(attrData + length, 0, maxLength - length);
+}
+
 int main() {
     printf("Initializing Record Manager...\n");
     initRecordManager(NULL);
@@ -324,8 +2052,9 @@ int main() {
         printf("Error creating record.\n");
         return 1;
     }
-    strncpy(record->data, "test_data", SLOT_SIZE - 1);
-    record->data[SLOT_SIZE - 1] = '\0';
+    setAttrInt(record, schema, 0, 1);
+    setAttrString(record, schema, 1, "test_data", strlen("test_data"));
+    setAttrInt(record, schema, 2, 20);
 
     printf("Debug: Before Insertion, Num Tuples: %d\n", getNumTuples(&table));
 
@@ -347,24 +2076,13 @@ int main() {
         return 1;
     }
 
-    printf("Inserted Data: %s\n", record->data);
-    printf("Retrieved Data: %s\n", retrieved->data);
-
-    printf("Testing Delete...\n");
-    printf("Debug: Before Deletion, Num Tuples: %d\n", getNumTuples(&table));
-
-    if (deleteRecord(&table, record->id) != RC_OK) {
-        printf("Delete failed!\n");
-        return 1;
-    }
-    printf("Debug: Record deleted at Page: %d, Slot: %d\n", record->id.page, record->id.slot);
-    printf("Debug: After Deletion, Num Tuples: %d\n", getNumTuples(&table));
+    printf("Inserted Data: %s\n", serializeRecord(record, schema));
+    printf("Retrieved Data: %s\n", serializeRecord(retrieved, schema));
 
     printf("Testing Update...\n");
-    strncpy(record->data, "updated_data", SLOT_SIZE - 1);
-    record->data[SLOT_SIZE - 1] = '\0';
+    setAttrString(record, schema, 1, "updated", strlen("updated"));
 
-    printf("Debug: Updating record at Page: %d, Slot: %d with Data: %s\n", record->id.page, record->id.slot, record->data);
+    printf("Debug: Updating record at Page: %d, Slot: %d with Data: %s\n", record->id.page, record->id.slot, serializeRecord(record, schema));
 
     if (updateRecord(&table, record) != RC_OK) {
         printf("Update failed!\n");
@@ -382,7 +2100,24 @@ int main() {
         printf("Retrieve after update failed!\n");
         return 1;
     }
-    printf("Updated Data: %s\n", updatedRecord->data);
+    printf("Updated Data: %s\n", serializeRecord(updatedRecord, schema));
+
+    printf("Testing Delete...\n");
+    printf("Debug: Before Deletion, Num Tuples: %d\n", getNumTuples(&table));
+
+    if (deleteRecord(&table, record->id) != RC_OK) {
+        printf("Delete failed!\n");
+        return 1;
+    }
+    printf("Debug: Record deleted at Page: %d, Slot: %d\n", record->id.page, record->id.slot);
+    printf("Debug: After Deletion, Num Tuples: %d\n", getNumTuples(&table));
+
+    // a deleted record is gone, so updating it fails
+    if (updateRecord(&table, record) != RC_RM_NO_SUCH_TUPLE) {
+        printf("Update of deleted record did not fail!\n");
+        return 1;
+    }
+    printf("Update of deleted record rejected.\n");
 
     printf("Testing Scan...\n");
     RM_ScanHandle scan;
@@ -398,7 +2133,7 @@ int main() {
     }
 
     while (next(&scan, scannedRecord) != RC_RM_NO_MORE_TUPLES) {
-        printf("Scanned Record: %s\n", scannedRecord->data);
+        printf("Scanned Record: %s\n", serializeRecord(scannedRecord, schema));
     }
     printf("Scan completed.\n");
 
@@ -411,6 +2146,8 @@ int main() {
     closeTable(&table);
     deleteTable("test_table");
     shutdownRecordManager();
+    // the table is gone, so its log is of no more use
+    remove(RM_LOG_FILE);
 
     printf("Record Manager shutdown complete.\n");
     return 0;
@@ -11,26 +11,101 @@ typedef struct RM_ScanHandle {
     Expr *expr;
 } RM_ScanHandle; 
 
+// How a table lays out its data pages. RM_LAYOUT_ROW keeps the attributes
+// of each record together. RM_LAYOUT_PAX keeps each attribute of the
+// records on a page in one array, so scans that look at few attributes
+// read less; its strings always take their declared length and are never
+// stored out of line.
+typedef enum RM_Layout {
+    RM_LAYOUT_ROW = 0,
+    RM_LAYOUT_PAX = 1
+} RM_Layout;
+
+// compress lets a PAX table encode the columns of a page that fills up,
+// choosing per page and column among dictionary, run-length and
+// frame-of-reference encodings; it is ignored for the row layout.
+// bloomAttrs names numBloomAttrs attributes to keep per-page Bloom filters
+// on, so scans looking for one value of them pass over the pages without
+// it.
+typedef struct RM_TableOptions {
+    RM_Layout layout;
+    bool compress;
+    int *bloomAttrs;
+    int numBloomAttrs;
+} RM_TableOptions;
+
 // table and manager
 extern RC initRecordManager (void *mgmtData);
 extern RC shutdownRecordManager ();
 extern RC createTable (char *name, Schema *schema);
+// options may be NULL for the defaults createTable uses
+extern RC createTableWithOptions (char *name, Schema *schema, RM_TableOptions *options);
 extern RC openTable (RM_TableData *rel, char *name);
 extern RC closeTable (RM_TableData *rel);
 extern RC deleteTable (char *name);
 extern int getNumTuples (RM_TableData *rel);
 
+// Checkpoints write out the pages dirtied since the last one, while other
+// calls keep running, and release the log space they no longer need. A
+// background thread takes one whenever the log grows by the interval
+// (0 disables it); the rate limits checkpoint writes (0 is unlimited).
+extern RC checkpoint (void);
+extern void setCheckpointInterval (long logBytes);
+extern void setCheckpointRate (int pagesPerSecond);
+
+// Transactions. A transaction belongs to the thread that began it; the
+// record and scan calls that thread makes until it commits or aborts are
+// part of it and see its snapshot. Calls made outside a transaction commit
+// on their own. A change to a record another running transaction changed
+// waits for it to end, and fails with RC_RM_WRITE_CONFLICT if it committed
+// after this transaction began. Waiting fails with RC_LK_DEADLOCK or
+// RC_LK_TIMEOUT (see lock_mgr.h), after which the transaction should abort.
+// Reads and scans never wait for writers.
+extern RC beginTransaction (void);
+extern RC commitTransaction (void);
+extern RC abortTransaction (void);
+
 // handling records in a table
 extern RC insertRecord (RM_TableData *rel, Record *record);
+extern RC insertRecords (RM_TableData *rel, Record **records, int n);
 extern RC deleteRecord (RM_TableData *rel, RID id);
 extern RC updateRecord (RM_TableData *rel, Record *record);
 extern RC getRecord (RM_TableData *rel, RID id, Record *record);
 
+// Removes the deleted records and older versions no snapshot can see any
+// more, compacts each page and gives the empty pages at the end of the
+// table back to the file system. Runs alongside other calls, for instance
+// from a background thread, holding the table latch for one page at a time.
+extern RC vacuumTable (RM_TableData *rel);
+
 // scans
 extern RC startScan (RM_TableData *rel, RM_ScanHandle *scan, Expr *cond);
 extern RC next (RM_ScanHandle *scan, Record *record);
 extern RC closeScan (RM_ScanHandle *scan);
 
+// A batch of records read by nextBatch: numTuples records of recordSize
+// bytes each in data, of which the numSelected listed in selection, in
+// order, satisfy the scan's condition
+typedef struct RecordBatch {
+    int capacity;
+    int recordSize;
+    int numTuples;
+    RID *ids;
+    char *data;
+    int numSelected;
+    int *selection;
+} RecordBatch;
+
+extern RC createRecordBatch (RecordBatch **batch, Schema *schema, int capacity);
+extern RC freeRecordBatch (RecordBatch *batch);
+// Points record at the record at index in the batch, valid until the next call
+extern void batchRecord (RecordBatch *batch, int index, Record *record);
+// Reads the next records the scan sees into the batch, up to maxTuples (and
+// the batch's capacity) and stopping at the end of a page, then evaluates
+// the condition over all of them at once. Mixing it with next() is fine.
+// Returns RC_RM_NO_MORE_TUPLES once the scan has read every record.
+extern RC nextBatch (RM_ScanHandle *scan, RecordBatch *batch, int maxTuples);
+
 // dealing with schemas
 extern int getRecordSize (Schema *schema);
 extern Schema *createSchema (int numAttr, char **attrNames, DataType *dataTypes, int *typeLength, int keySize, int *keys);
@@ -42,4 +117,19 @@ extern RC freeRecord (Record *record);
 extern RC getAttr (Record *record, Schema *schema, int attrNum, Value **value);
 extern RC setAttr (Record *record, Schema *schema, int attrNum, Value *value);
 
+// allocation-free accessors working directly on record->data; the caller
+// guarantees attrNum is in range and of the accessor's type
+extern int getAttrInt (Record *record, Schema *schema, int attrNum);
+extern float getAttrFloat (Record *record, Schema *schema, int attrNum);
+extern bool getAttrBool (Record *record, Schema *schema, int attrNum);
+extern const char *getAttrString (Record *record, Schema *schema, int attrNum, int *length);
+extern void setAttrInt (Record *record, Schema *schema, int attrNum, int value);
+extern void setAttrFloat (Record *record, Schema *schema, int attrNum, float value);
+extern void setAttrBool (Record *record, Schema *schema, int attrNum, bool value);
+extern void setAttrString (Record *record, Schema *schema, int attrNum, const char *value, int length);
+// a NULL attribute reads as zero or an empty string; the setters above
+// clear its null bit. An attribute the schema does not have is not NULL.
+extern bool isAttrNull (Record *record, Schema *schema, int attrNum);
+extern void setAttrNull (Record *record, Schema *schema, int attrNum);
+
 #endif // RECORD_MGR_H
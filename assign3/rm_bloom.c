@@ -0,0 +1,344 @@
+#include "rm_page.h"
+#include "rm_txn.h"
+#include "storage_mgr.h"
+#include "dberror.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOOM_BITS (BLOOM_BYTES * 8)
+#define BLOOM_SUFFIX ".bloom"
+
+// Side file header, followed by the attribute numbers
+typedef struct BloomFileHeader {
+    int clean;
+    int numPages;
+    int numAttrs;
+} BloomFileHeader;
+
+static char *bloomFileName(const char *tableName) {
+    char *name = (char *)malloc(strlen(tableName) + strlen(BLOOM_SUFFIX) + 1);
+
+    if (name != NULL) {
+        strcpy(name, tableName);
+        strcat(name, BLOOM_SUFFIX);
+    }
+    return name;
+}
+
+RC createBloomFile(char *tableName, int *attrs, int numAttrs) {
+    char *name, *page;
+    BloomFileHeader header = { 1, 0, numAttrs };
+    SM_FileHandle fHandle;
+    RC rc;
+
+    if (sizeof(BloomFileHeader) + numAttrs * sizeof(int) > PAGE_SIZE)
+        return RC_RM_SCHEMA_TOO_LARGE;
+    if ((name = bloomFileName(tableName)) == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    if ((page = (char *)calloc(PAGE_SIZE, 1)) == NULL) {
+        free(name);
+        return RC_MEMORY_ALLOCATION_ERROR;
+    }
+    memcpy(page, &header, sizeof(BloomFileHeader));
+    memcpy(page + sizeof(BloomFileHeader), attrs, numAttrs * sizeof(int));
+
+    rc = createPageFile(name);
+    if (rc == RC_OK && (rc = openPageFile(name, &fHandle)) == RC_OK) {
+        rc = writeBlock(0, &fHandle, page);
+        if (rc == RC_OK)
+            rc = syncPageFile(&fHandle);
+        closePageFile(&fHandle);
+    }
+    free(page);
+    free(name);
+    return rc;
+}
+
+RC destroyBloomFile(char *tableName) {
+    char *name = bloomFileName(tableName);
+    RC rc;
+
+    if (name == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    rc = destroyPageFile(name);
+    free(name);
+    return rc;
+}
+
+// The filters of a page, making room for them if the page is new to the map
+static unsigned char *pageFilters(RM_BloomMap *map, int pageNum) {
+    size_t perPage = (size_t)map->numAttrs * BLOOM_BYTES;
+
+    if (pageNum >= map->capacity) {
+        int capacity = (map->capacity == 0) ? 64 : map->capacity;
+        unsigned char *bits;
+        while (capacity <= pageNum)
+            capacity *= 2;
+        bits = (unsigned char *)realloc(map->bits, perPage * capacity);
+        if (bits == NULL)
+            return NULL;
+        memset(bits + perPage * map->capacity, 0, perPage * (capacity - map->capacity));
+        map->bits = bits;
+        map->capacity = capacity;
+    }
+    return map->bits + perPage * pageNum;
+}
+
+// FNV-1a; the two halves make the probes by double hashing
+static uint64_t hashBytes(const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Hashes a value as valueEquals compares it: floats equal as numbers hash
+// alike, and strings up to their terminator
+static uint64_t hashValue(DataType dt, int intV, float floatV, const char *stringV, size_t length) {
+    switch (dt) {
+        case DT_FLOAT:
+            if (floatV == 0)
+                floatV = 0;
+            return hashBytes(&floatV, sizeof(float));
+        case DT_STRING:
+            return hashBytes(stringV, length);
+        case DT_INT:
+        case DT_BOOL:
+            break;
+    }
+    return hashBytes(&intV, sizeof(int));
+}
+
+static void setBits(unsigned char *filter, uint64_t hash) {
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        uint32_t bit = (h1 + i * h2) % BLOOM_BITS;
+        filter[bit / 8] |= (unsigned char)(1 << (bit % 8));
+    }
+}
+
+static bool testBits(const unsigned char *filter, uint64_t hash) {
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        uint32_t bit = (h1 + i * h2) % BLOOM_BITS;
+        if (!(filter[bit / 8] & (1 << (bit % 8))))
+            return false;
+    }
+    return true;
+}
+
+void bloomMapAdd(RM_BloomMap *map, Schema *schema, int pageNum, const char *recordData) {
+    unsigned char *filters = pageFilters(map, pageNum);
+
+    if (filters == NULL) {
+        map->incomplete = true;
+        return;
+    }
+    for (int i = 0; i < map->numAttrs; i++, filters += BLOOM_BYTES) {
+        int attrNum = map->attrs[i], typeLength = schema->typeLength[attrNum];
+        const char *attr = recordData + schema->attrOffsets[attrNum];
+        const char *end;
+        int v = 0;
+        float f = 0;
+
+        // a NULL or NaN equals nothing
+        if ((recordData[attrNum / 8] >> (attrNum % 8)) & 1)
+            continue;
+        switch (schema->dataTypes[attrNum]) {
+            case DT_INT:
+                memcpy(&v, attr, sizeof(int));
+                break;
+            case DT_FLOAT:
+                memcpy(&f, attr, sizeof(float));
+                if (isnan(f))
+                    continue;
+                break;
+            case DT_BOOL:
+                v = (*(const bool *)attr) ? 1 : 0;
+                break;
+            case DT_STRING:
+                // a string stored out of line is not at hand to hash
+                if (typeLength > TOAST_THRESHOLD && attr[0] == '\0' && attr[1] == TOAST_REF_MAGIC) {
+                    memset(filters, 0xFF, BLOOM_BYTES);
+                    continue;
+                }
+                end = memchr(attr, '\0', typeLength);
+                setBits(filters, hashValue(DT_STRING, 0, 0, attr, (end != NULL) ? (size_t)(end - attr) : (size_t)typeLength));
+                continue;
+        }
+        setBits(filters, hashValue(schema->dataTypes[attrNum], v, f, NULL, 0));
+    }
+}
+
+void bloomMapMerge(RM_BloomMap *map, int to, int from) {
+    size_t perPage = (size_t)map->numAttrs * BLOOM_BYTES;
+
+    if (pageFilters(map, (to > from) ? to : from) == NULL) {
+        map->incomplete = true;
+        return;
+    }
+    for (size_t i = 0; i < perPage; i++)
+        map->bits[perPage * to + i] |= map->bits[perPage * from + i];
+}
+
+bool bloomMapMayContain(RM_BloomMap *map, int pageNum, int attrNum, const Value *value) {
+    const unsigned char *filter;
+    int i;
+
+    for (i = 0; i < map->numAttrs && map->attrs[i] != attrNum; i++)
+        ;
+    if (i == map->numAttrs || map->incomplete || pageNum >= map->capacity)
+        return true;
+    filter = map->bits + ((size_t)pageNum * map->numAttrs + i) * BLOOM_BYTES;
+    switch (value->dt) {
+        case DT_FLOAT:
+            if (isnan(value->v.floatV))
+                return false;
+            return testBits(filter, hashValue(DT_FLOAT, 0, value->v.floatV, NULL, 0));
+        case DT_STRING:
+            return testBits(filter, hashValue(DT_STRING, 0, 0, value->v.stringV, strlen(value->v.stringV)));
+        case DT_BOOL:
+            return testBits(filter, hashValue(DT_BOOL, value->v.boolV ? 1 : 0, 0, NULL, 0));
+        case DT_INT:
+            break;
+    }
+    return testBits(filter, hashValue(DT_INT, value->v.intV, 0, NULL, 0));
+}
+
+static void addVersion(void *arg, int pageNum, const char *recordData) {
+    RM_TableMgmt *mgmt = (RM_TableMgmt *)arg;
+
+    bloomMapAdd(mgmt->blooms, mgmt->schema, pageNum, recordData);
+}
+
+void bloomMapRebuildPage(RM_TableMgmt *mgmt, int pageNum) {
+    unsigned char *filters = pageFilters(mgmt->blooms, pageNum);
+
+    if (filters == NULL) {
+        mgmt->blooms->incomplete = true;
+        return;
+    }
+    memset(filters, 0, (size_t)mgmt->blooms->numAttrs * BLOOM_BYTES);
+    if (visitPageVersions(mgmt, pageNum, addVersion, mgmt) != RC_OK)
+        memset(filters, 0xFF, (size_t)mgmt->blooms->numAttrs * BLOOM_BYTES);
+}
+
+// Reads the filters of numPages table pages, or writes them if write
+static RC transferFilters(RM_BloomMap *map, SM_FileHandle *fHandle, int numPages, bool write) {
+    size_t total = (size_t)numPages * map->numAttrs * BLOOM_BYTES;
+    char page[PAGE_SIZE];
+    RC rc = RC_OK;
+
+    for (size_t done = 0; done < total && rc == RC_OK; done += PAGE_SIZE) {
+        size_t n = (total - done < PAGE_SIZE) ? total - done : PAGE_SIZE;
+        int pageNum = 1 + (int)(done / PAGE_SIZE);
+        if (write) {
+            memset(page, 0, PAGE_SIZE);
+            memcpy(page, map->bits + done, n);
+            rc = writeBlock(pageNum, fHandle, page);
+        } else if ((rc = readBlock(pageNum, fHandle, page)) == RC_OK) {
+            memcpy(map->bits + done, page, n);
+        }
+    }
+    return rc;
+}
+
+static RC writeBloomHeader(RM_BloomMap *map, SM_FileHandle *fHandle, bool clean, int numPages) {
+    char page[PAGE_SIZE];
+    BloomFileHeader header = { clean, numPages, map->numAttrs };
+
+    memset(page, 0, PAGE_SIZE);
+    memcpy(page, &header, sizeof(BloomFileHeader));
+    memcpy(page + sizeof(BloomFileHeader), map->attrs, map->numAttrs * sizeof(int));
+    return writeBlock(0, fHandle, page);
+}
+
+static void freeBloomMap(RM_BloomMap *map) {
+    free(map->fileName);
+    free(map->attrs);
+    free(map->bits);
+    free(map);
+}
+
+RM_BloomMap *openBloomMap(RM_TableMgmt *mgmt, char *tableName) {
+    SM_FileHandle fHandle;
+    BloomFileHeader header;
+    RM_BloomMap *map;
+    char page[PAGE_SIZE];
+    int numPages = atomic_load(&mgmt->numPages);
+    bool loaded;
+
+    if ((map = (RM_BloomMap *)calloc(1, sizeof(RM_BloomMap))) == NULL)
+        return NULL;
+    if ((map->fileName = bloomFileName(tableName)) == NULL
+            || openPageFile(map->fileName, &fHandle) != RC_OK) {
+        freeBloomMap(map);
+        return NULL;
+    }
+    if (readBlock(0, &fHandle, page) != RC_OK) {
+        closePageFile(&fHandle);
+        freeBloomMap(map);
+        return NULL;
+    }
+    memcpy(&header, page, sizeof(BloomFileHeader));
+    map->numAttrs = header.numAttrs;
+    map->attrs = (int *)malloc(sizeof(int) * (header.numAttrs > 0 ? header.numAttrs : 1));
+    if (map->attrs == NULL || header.numAttrs == 0) {
+        closePageFile(&fHandle);
+        freeBloomMap(map);
+        return NULL;
+    }
+    memcpy(map->attrs, page + sizeof(BloomFileHeader), header.numAttrs * sizeof(int));
+
+    // the filters written at the last close hold for the table only if it
+    // has not changed since
+    loaded = header.clean
+            && (header.numPages == 0 || pageFilters(map, header.numPages - 1) != NULL)
+            && transferFilters(map, &fHandle, header.numPages, false) == RC_OK;
+    if (!loaded) {
+        if (map->bits != NULL)
+            memset(map->bits, 0, (size_t)map->capacity * map->numAttrs * BLOOM_BYTES);
+        mgmt->blooms = map;
+        for (int p = 0; p < numPages; p++)
+            if (IS_DATA_PAGE(p))
+                bloomMapRebuildPage(mgmt, p);
+        mgmt->blooms = NULL;
+    }
+    if (writeBloomHeader(map, &fHandle, false, 0) != RC_OK || syncPageFile(&fHandle) != RC_OK)
+        map->incomplete = true;
+    closePageFile(&fHandle);
+    return map;
+}
+
+RC closeBloomMap(RM_BloomMap *map, int numPages) {
+    SM_FileHandle fHandle;
+    RC rc;
+
+    if (map->incomplete) {
+        freeBloomMap(map);
+        return RC_OK;
+    }
+    if (numPages > map->capacity)
+        numPages = map->capacity;
+    if ((rc = openPageFile(map->fileName, &fHandle)) == RC_OK) {
+        rc = transferFilters(map, &fHandle, numPages, true);
+        if (rc == RC_OK)
+            rc = syncPageFile(&fHandle);
+        // the header is marked clean only once the filters are durable
+        if (rc == RC_OK)
+            rc = writeBloomHeader(map, &fHandle, true, numPages);
+        if (rc == RC_OK)
+            rc = syncPageFile(&fHandle);
+        closePageFile(&fHandle);
+    }
+    freeBloomMap(map);
+    return rc;
+}
@@ -0,0 +1,314 @@
+#include "rm_page.h"
+#include "dberror.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int contiguousFree(char *page) {
+    RM_PageHeader *hdr = PAGE_HEADER(page);
+    return hdr->dataStart - (int)(sizeof(RM_PageHeader) + hdr->numSlots * sizeof(RM_Slot));
+}
+
+void pageInit(char *page) {
+    RM_PageHeader *hdr = PAGE_HEADER(page);
+
+    memset(page, 0, PAGE_SIZE);
+    hdr->numSlots = 0;
+    hdr->dataStart = PAGE_SIZE;
+    hdr->freeBytes = PAGE_SIZE - sizeof(RM_PageHeader);
+}
+
+// Slides every live tuple to the end of the page so all free bytes are
+// contiguous between the slot directory and the tuple data. Slot numbers do
+// not change.
+void pageCompact(char *page) {
+    RM_PageHeader *hdr = PAGE_HEADER(page);
+    RM_Slot *slots = PAGE_SLOTS(page);
+    char copy[PAGE_SIZE];
+    int dataStart = PAGE_SIZE;
+
+    if (IS_PAX_PAGE(page)) {
+        paxCompact(page);
+        return;
+    }
+    memcpy(copy, page, PAGE_SIZE);
+    for (int i = 0; i < hdr->numSlots; i++) {
+        int length = slots[i].length & SLOT_LENGTH_MASK;
+        if (slots[i].offset == 0)
+            continue;
+        dataStart -= length;
+        memcpy(page + dataStart, copy + slots[i].offset, length);
+        slots[i].offset = dataStart;
+    }
+    hdr->dataStart = dataStart;
+}
+
+bool pageFragmented(char *page) {
+    if (IS_PAX_PAGE(page))
+        return paxCompactable(page);
+    return contiguousFree(page) < PAGE_HEADER(page)->freeBytes;
+}
+
+// Returns the slot the tuple was stored in, or -1 if the page has no room.
+int pageInsert(char *page, const char *tuple, int length, uint16_t flags) {
+    RM_PageHeader *hdr = PAGE_HEADER(page);
+    RM_Slot *slots = PAGE_SLOTS(page);
+    int alloc = (length < MIN_TUPLE_SIZE) ? MIN_TUPLE_SIZE : length;
+    int slot, need;
+
+    if (IS_PAX_PAGE(page))
+        return paxInsert(page, tuple, flags);
+    for (slot = 0; slot < hdr->numSlots; slot++)
+        if (slots[slot].offset == 0)
+            break;
+    need = alloc + ((slot == hdr->numSlots) ? (int)sizeof(RM_Slot) : 0);
+
+    if (hdr->freeBytes < need)
+        return -1;
+    if (slot == hdr->numSlots) {
+        hdr->numSlots++;
+        slots[slot].offset = 0;
+    }
+    if (contiguousFree(page) < alloc)
+        pageCompact(page);
+
+    hdr->dataStart -= alloc;
+    memcpy(page + hdr->dataStart, tuple, length);
+    memset(page + hdr->dataStart + length, 0, alloc - length);
+    slots[slot].offset = hdr->dataStart;
+    slots[slot].length = alloc | flags;
+    hdr->freeBytes -= need;
+    return slot;
+}
+
+// Returns a pointer to the tuple bytes, or NULL if the slot is unused.
+char *pageGetTuple(char *page, int slot, int *length, uint16_t *flags) {
+    RM_PageHeader *hdr = PAGE_HEADER(page);
+    RM_Slot *slots = PAGE_SLOTS(page);
+
+    if (IS_PAX_PAGE(page))
+        return paxGetTuple(page, slot, length, flags);
+    if (slot < 0 || slot >= hdr->numSlots || slots[slot].offset == 0)
+        return NULL;
+    if (length != NULL)
+        *length = slots[slot].length & SLOT_LENGTH_MASK;
+    if (flags != NULL)
+        *flags = slots[slot].length & SLOT_FLAGS_MASK;
+    return page + slots[slot].offset;
+}
+
+// Replaces a tuple in place, compacting the page when it grows. Leaves the
+// page untouched and returns RC_RM_PAGE_FULL if it cannot fit.
+RC pageUpdate(char *page, int slot, const char *tuple, int length, uint16_t flags) {
+    RM_PageHeader *hdr = PAGE_HEADER(page);
+    RM_Slot *slots = PAGE_SLOTS(page);
+    int alloc = (length < MIN_TUPLE_SIZE) ? MIN_TUPLE_SIZE : length;
+    int old;
+
+    if (IS_PAX_PAGE(page))
+        return paxUpdate(page, slot, tuple, flags);
+    if (slot < 0 || slot >= hdr->numSlots || slots[slot].offset == 0)
+        return RC_RM_NO_SUCH_TUPLE;
+    old = slots[slot].length & SLOT_LENGTH_MASK;
+
+    if (alloc <= old) {
+        memcpy(page + slots[slot].offset, tuple, length);
+        memset(page + slots[slot].offset + length, 0, alloc - length);
+        slots[slot].length = alloc | flags;
+        hdr->freeBytes += old - alloc;
+        return RC_OK;
+    }
+
+    if (hdr->freeBytes + old < alloc)
+        return RC_RM_PAGE_FULL;
+
+    slots[slot].offset = 0;
+    hdr->freeBytes += old;
+    if (contiguousFree(page) < alloc)
+        pageCompact(page);
+
+    hdr->dataStart -= alloc;
+    memcpy(page + hdr->dataStart, tuple, length);
+    memset(page + hdr->dataStart + length, 0, alloc - length);
+    slots[slot].offset = hdr->dataStart;
+    slots[slot].length = alloc | flags;
+    hdr->freeBytes -= alloc;
+    return RC_OK;
+}
+
+// Frees the slot; trailing unused slots are dropped from the directory.
+void pageDelete(char *page, int slot) {
+    RM_PageHeader *hdr = PAGE_HEADER(page);
+    RM_Slot *slots = PAGE_SLOTS(page);
+
+    if (IS_PAX_PAGE(page)) {
+        paxDelete(page, slot);
+        return;
+    }
+    if (slot < 0 || slot >= hdr->numSlots || slots[slot].offset == 0)
+        return;
+    hdr->freeBytes += slots[slot].length & SLOT_LENGTH_MASK;
+    slots[slot].offset = 0;
+    slots[slot].length = 0;
+
+    while (hdr->numSlots > 0 && slots[hdr->numSlots - 1].offset == 0) {
+        hdr->numSlots--;
+        hdr->freeBytes += sizeof(RM_Slot);
+    }
+}
+
+int pageCopyTuple(const char *page, const char *tuple, int length, char *out) {
+    if (IS_PAX_PAGE(page))
+        return paxCopyTuple(page, tuple, out);
+    memcpy(out, tuple, length);
+    return length;
+}
+
+void pageDecodeTuple(Schema *schema, const char *page, const char *tuple, char *recordData, int tableId) {
+    if (IS_PAX_PAGE(page))
+        paxReadRow(page, paxRowOf(page, tuple), recordData);
+    else
+        decodeTuple(schema, tuple + sizeof(RM_TupleVersion), recordData, tableId);
+}
+
+int fsmCategory(int freeBytes) {
+    int category = freeBytes / FSM_CATEGORY_SIZE;
+    return (category > FSM_MAX_CATEGORY) ? FSM_MAX_CATEGORY : category;
+}
+
+void fsmPageSet(char *page, int leaf, int category) {
+    unsigned char *nodes = (unsigned char *)page;
+    int i = FSM_LEAVES - 1 + leaf;
+
+    nodes[i] = (unsigned char)category;
+    while (i > 0) {
+        int left, right, max;
+        i = (i - 1) / 2;
+        left = nodes[2 * i + 1];
+        right = nodes[2 * i + 2];
+        max = (left > right) ? left : right;
+        if (nodes[i] == max)
+            break;
+        nodes[i] = (unsigned char)max;
+    }
+}
+
+// Returns the leftmost leaf with at least the given category, or -1.
+int fsmPageSearch(char *page, int category) {
+    unsigned char *nodes = (unsigned char *)page;
+    int i = 0;
+
+    if (nodes[0] < category)
+        return -1;
+    while (i < FSM_LEAVES - 1)
+        i = (nodes[2 * i + 1] >= category) ? 2 * i + 1 : 2 * i + 2;
+    return i - (FSM_LEAVES - 1);
+}
+
+int maxTupleSize(Schema *schema) {
+    int size = NULL_BITMAP_SIZE(schema->numAttr);
+
+    for (int i = 0; i < schema->numAttr; i++) {
+        switch (schema->dataTypes[i]) {
+            case DT_INT: size += sizeof(int); break;
+            case DT_FLOAT: size += sizeof(float); break;
+            case DT_BOOL: size += sizeof(bool); break;
+            case DT_STRING:
+                size += sizeof(uint16_t) + ((schema->typeLength[i] > TOAST_THRESHOLD) ? TOAST_THRESHOLD : schema->typeLength[i]);
+                break;
+        }
+    }
+    return size;
+}
+
+int encodeTuple(Schema *schema, const char *recordData, char *tuple) {
+    char *out = tuple + NULL_BITMAP_SIZE(schema->numAttr);
+
+    memcpy(tuple, recordData, NULL_BITMAP_SIZE(schema->numAttr));
+
+    for (int i = 0; i < schema->numAttr; i++) {
+        const char *attr = recordData + schema->attrOffsets[i];
+        switch (schema->dataTypes[i]) {
+            case DT_INT:
+            case DT_FLOAT:
+                memcpy(out, attr, sizeof(int));
+                out += sizeof(int);
+                break;
+            case DT_BOOL:
+                memcpy(out, attr, sizeof(bool));
+                out += sizeof(bool);
+                break;
+            case DT_STRING: {
+                const char *end = memchr(attr, '\0', schema->typeLength[i]);
+                int length = (end != NULL) ? (int)(end - attr) : schema->typeLength[i];
+                uint16_t prefix = (length > TOAST_THRESHOLD) ? TOAST_MARK : (uint16_t)length;
+                memcpy(out, &prefix, sizeof(uint16_t));
+                out += sizeof(uint16_t);
+                if (prefix == TOAST_MARK) {
+                    RM_ToastPointer pointer = { length, { -1, -1 }, NO_TXN };
+                    memcpy(out, &pointer, sizeof(RM_ToastPointer));
+                    out += sizeof(RM_ToastPointer);
+                } else {
+                    memcpy(out, attr, length);
+                    out += length;
+                }
+                break;
+            }
+        }
+    }
+    return (int)(out - tuple);
+}
+
+int encodedAttrSize(DataType dt, const char *attr) {
+    uint16_t length;
+
+    switch (dt) {
+        case DT_INT:
+        case DT_FLOAT:
+            return sizeof(int);
+        case DT_BOOL:
+            return sizeof(bool);
+        case DT_STRING:
+            memcpy(&length, attr, sizeof(uint16_t));
+            return sizeof(uint16_t) + ((length == TOAST_MARK) ? (int)sizeof(RM_ToastPointer) : length);
+    }
+    return 0;
+}
+
+void decodeTuple(Schema *schema, const char *tuple, char *recordData, int tableId) {
+    const char *in = tuple + NULL_BITMAP_SIZE(schema->numAttr);
+
+    memset(recordData, 0, schema->recordSize);
+    memcpy(recordData, tuple, NULL_BITMAP_SIZE(schema->numAttr));
+    for (int i = 0; i < schema->numAttr; i++) {
+        char *attr = recordData + schema->attrOffsets[i];
+        switch (schema->dataTypes[i]) {
+            case DT_INT:
+            case DT_FLOAT:
+                memcpy(attr, in, sizeof(int));
+                in += sizeof(int);
+                break;
+            case DT_BOOL:
+                memcpy(attr, in, sizeof(bool));
+                in += sizeof(bool);
+                break;
+            case DT_STRING: {
+                uint16_t length;
+                memcpy(&length, in, sizeof(uint16_t));
+                if (length == TOAST_MARK) {
+                    RM_ToastRef ref;
+                    ref.empty = '\0';
+                    ref.magic = TOAST_REF_MAGIC;
+                    ref.tableId = tableId;
+                    memcpy(&ref.pointer, in + sizeof(uint16_t), sizeof(RM_ToastPointer));
+                    memcpy(attr, &ref, sizeof(RM_ToastRef));
+                    in += sizeof(uint16_t) + sizeof(RM_ToastPointer);
+                } else {
+                    memcpy(attr, in + sizeof(uint16_t), length);
+                    in += sizeof(uint16_t) + length;
+                }
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,359 @@
+#ifndef RM_PAGE_H
+#define RM_PAGE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "buffer_mgr.h"
+#include "expr.h"
+#include "log_mgr.h"
+#include "tables.h"
+
+// Page and tuple layout shared by the record and scan managers.
+//
+// Changes to the table header and to data pages are logged, so both kinds
+// of page start with a PAGE_LSN. The buffer pool writes such a page only
+// once the log is flushed up to it.
+// Page 0 of a table file is the table header:
+//   [pageLSN][numTuples int][recordSize int][numPages int][numAttr int]
+//   [flags int] followed by numAttr pairs of [dataType int][typeLength int], then
+//   [keySize int] and the keySize key attribute numbers, then the numAttr
+//   attribute names, each as [length uint16][characters]
+#define TABLE_HEADER_NUM_TUPLES (sizeof(LSN))
+#define TABLE_HEADER_RECORD_SIZE (sizeof(LSN) + 1 * sizeof(int))
+#define TABLE_HEADER_NUM_PAGES (sizeof(LSN) + 2 * sizeof(int))
+#define TABLE_HEADER_NUM_ATTR (sizeof(LSN) + 3 * sizeof(int))
+#define TABLE_HEADER_FLAGS (sizeof(LSN) + 4 * sizeof(int))
+#define TABLE_HEADER_ATTRS (sizeof(LSN) + 5 * sizeof(int))
+
+// The counters in the header may be behind the table: it changed since
+// they were last written back, so an open recounts them
+#define TABLE_COUNTS_STALE 1
+// The data pages are PAX pages (see below), encoded if TABLE_COMPRESSED
+#define TABLE_LAYOUT_PAX 2
+#define TABLE_COMPRESSED 4
+
+#define TABLE_POOL_SIZE 16
+
+// Free-space map pages record how much room each data page has as a one-byte
+// category (free bytes / FSM_CATEGORY_SIZE). A map page is a max-tree over
+// its leaves, so finding a page with room or updating an entry costs
+// O(log FSM_LEAVES). Map page k is page FSM_GROUP_PAGE(k) and is followed by
+// the FSM_LEAVES data pages it covers. The map is only a hint: inserts that
+// find a page fuller than recorded correct the entry and search again, so
+// map pages are not logged.
+#define FSM_LEAVES 2048
+#define FSM_NODES (2 * FSM_LEAVES - 1)
+#define FSM_GROUP_SIZE (FSM_LEAVES + 1)
+#define FSM_CATEGORY_SIZE 16
+#define FSM_MAX_CATEGORY 255
+
+#define FSM_GROUP_PAGE(group) (1 + (group) * FSM_GROUP_SIZE)
+#define IS_FSM_PAGE(pageNum) ((pageNum) > 0 && ((pageNum) - 1) % FSM_GROUP_SIZE == 0)
+#define IS_DATA_PAGE(pageNum) ((pageNum) > 1 && !IS_FSM_PAGE(pageNum))
+#define FSM_GROUP_OF(pageNum) (((pageNum) - 1) / FSM_GROUP_SIZE)
+#define FSM_LEAF_OF(pageNum) (((pageNum) - 1) % FSM_GROUP_SIZE - 1)
+#define FSM_DATA_PAGE(group, leaf) (FSM_GROUP_PAGE(group) + 1 + (leaf))
+
+// All other pages are slotted data pages: a slot directory grows up from the
+// page header and tuple bytes grow down from the end of the page. A RID names
+// a slot, so tuples can move within the page without changing RIDs.
+typedef struct RM_PageHeader {
+	LSN pageLSN;
+	uint16_t numSlots;
+	uint16_t dataStart; // lowest byte used by tuple data
+	uint16_t freeBytes; // all free bytes on the page, including holes
+	uint16_t flags;
+} RM_PageHeader;
+
+typedef struct RM_Slot {
+	uint16_t offset;    // 0 marks an unused slot
+	uint16_t length;    // tuple bytes, SLOT_* flags in the top bits
+} RM_Slot;
+
+// A tuple that no longer fits its home page moves elsewhere: the home slot
+// keeps an 8-byte stub holding the new RID (SLOT_REDIRECT) and the moved
+// copy starts with its home RID (SLOT_MOVED) so scans report the home RID.
+// Older versions of a record kept for running snapshots are SLOT_VERSION
+// tuples, reachable only through the version chain. SLOT_TOAST tuples hold
+// pieces of long strings stored out of line.
+#define SLOT_REDIRECT 0x8000
+#define SLOT_MOVED 0x4000
+#define SLOT_VERSION 0x2000
+#define SLOT_TOAST 0x1000
+#define SLOT_FLAGS_MASK 0xF000
+#define SLOT_LENGTH_MASK 0x0FFF
+#define MIN_TUPLE_SIZE ((int) sizeof(RID))
+
+// Every stored version starts with this header, followed by the encoded
+// attributes. The current version of a record is the one its home RID leads
+// to; prev links it to the version it replaced.
+typedef struct RM_TupleVersion {
+	TxnId xmin; // transaction that created this version
+	TxnId xmax; // transaction that deleted or replaced it, or NO_TXN
+	RID prev;   // older version, or page -1
+} RM_TupleVersion;
+
+// A string longer than TOAST_THRESHOLD bytes is stored out of line as a
+// chain of SLOT_TOAST chunks, each an RM_ToastChunk followed by up to
+// TOAST_CHUNK_SIZE bytes of the value. The tuple keeps TOAST_MARK in place
+// of the string's length, followed by an RM_ToastPointer. Each chain
+// belongs to the one stored version that points to it.
+#define TOAST_THRESHOLD 256
+#define TOAST_MARK 0xFFFF
+
+typedef struct RM_ToastPointer {
+	int length;  // of the whole value
+	RID first;   // first chunk; page -1 until the chain is stored
+	TxnId stamp; // operation that stored the chain
+} RM_ToastPointer;
+
+typedef struct RM_ToastChunk {
+	TxnId stamp; // same as in the pointer, so a chain freed and reused is noticed
+	RID next;    // page -1 in the last chunk
+} RM_ToastChunk;
+
+// Reading a tuple does not fetch its out-of-line values: the string in the
+// record holds this reference instead, and getAttr and getAttrString fetch
+// the value in its place when first asked for it. It starts with an empty
+// string followed by TOAST_REF_MAGIC, which setAttrString never leaves
+// after a terminator. tableId survives closing and reopening the table, so
+// a record read before still reaches its value once the table is open.
+typedef struct RM_ToastRef {
+	char empty;
+	char magic;
+	int tableId;
+	RM_ToastPointer pointer;
+} RM_ToastRef;
+
+#define TOAST_REF_MAGIC 0x54
+
+// The data pages of a table created with RM_LAYOUT_PAX are PAX pages,
+// flagged PAGE_PAX in their header. They keep their rows column by column:
+// the page header is followed by an RM_PaxHeader, one RM_PaxColumn per
+// attribute, an RM_PaxRow per row and then one minipage per attribute
+// holding that attribute's value for every row. The records' null bitmaps
+// are one more column, after the attributes. A row is a slot to the page
+// operations below, which take tuples as an RM_TupleVersion followed by the
+// record's data, with the home RID in front for SLOT_MOVED. pageGetTuple
+// returns only the row's header, from home on for a moved or redirected
+// row; pageCopyTuple gathers the whole tuple.
+//
+// A plain page has room for a fixed number of rows and stores each value
+// as in Record.data; its freeBytes counts whole free rows. On a page flagged
+// PAGE_PAX_ENCODED each minipage is encoded with the codec in its column,
+// picked from the values on the page when it is packed. Such a page holds
+// just the rows it has, so changing a value packs it again; a change that
+// no longer fits fails as on a full slotted page. Row headers are never
+// encoded. Only pages flagged PAGE_PAX_COMPRESS are ever encoded: a
+// compressing table's pages are, once they fill up or are compacted.
+#define PAGE_PAX 1
+#define PAGE_PAX_ENCODED 2
+#define PAGE_PAX_COMPRESS 4
+
+typedef struct RM_PaxHeader {
+	uint16_t capacity;   // rows the minipages hold
+	uint16_t numAttr;    // columns: the attributes and the null bitmap
+	uint16_t recordSize;
+	uint16_t rowSize;    // page bytes taken by one row on a plain page
+	uint16_t rows;       // offset of the first RM_PaxRow
+} RM_PaxHeader;
+
+// Codecs of an encoded minipage:
+//   PAX_PLAIN  each value as in Record.data
+//   PAX_DICT   (strings) the distinct values, then a bit-packed index into
+//              them per row
+//   PAX_RLE    runs of equal values, each as a row count and the value
+//   PAX_FOR    (integers) the minimum, then each value's bit-packed
+//              difference from it
+#define PAX_PLAIN 0
+#define PAX_DICT 1
+#define PAX_RLE 2
+#define PAX_FOR 3
+
+typedef struct RM_PaxColumn {
+	uint16_t recordOffset; // of the attribute in Record.data
+	uint16_t width;        // bytes per value in Record.data
+	uint16_t start;        // offset of the minipage
+	uint16_t size;         // bytes in the minipage
+	uint8_t dataType;
+	uint8_t codec;
+} RM_PaxColumn;
+
+typedef struct RM_PaxRow {
+	RID home;              // a moved row's home RID, or a redirect's target
+	RM_TupleVersion version;
+	uint16_t flags;        // PAX_ROW_USED, SLOT_* flags
+} RM_PaxRow;
+
+#define PAX_ROW_USED 0x0001
+
+#define PAGE_HEADER(page) ((RM_PageHeader *) (page))
+#define PAGE_SLOTS(page) ((RM_Slot *) ((page) + sizeof(RM_PageHeader)))
+#define IS_PAX_PAGE(page) ((PAGE_HEADER(page)->flags & PAGE_PAX) != 0)
+#define PAX_HEADER(page) ((RM_PaxHeader *) ((page) + sizeof(RM_PageHeader)))
+#define PAX_COLUMNS(page) ((RM_PaxColumn *) ((page) + sizeof(RM_PageHeader) + sizeof(RM_PaxHeader)))
+#define PAX_ROWS(page) ((RM_PaxRow *) ((page) + PAX_HEADER(page)->rows))
+#define PAGE_MAX_TUPLE_SIZE ((int) (PAGE_SIZE - sizeof(RM_PageHeader) - sizeof(RM_Slot)))
+#define TOAST_CHUNK_SIZE (PAGE_MAX_TUPLE_SIZE - (int) sizeof(RM_ToastChunk))
+
+// A zone map keeps, for each data page and attribute, the smallest and
+// largest value and the number of NULLs among the records found on the
+// page, so a scan can pass over pages its condition cannot match without
+// reading them. It covers every version a snapshot may reach from a
+// current tuple on the page: zones only ever widen, with each value
+// written and with the zones of the page a tuple moves from. It is kept in
+// memory, built by the first scan with a condition and kept up to date
+// under the table latch from then on.
+typedef struct RM_Zone {
+	union {
+		int intV;       // ints, and bools as 0 or 1
+		float floatV;
+	} min, max;
+	int numValues;      // neither NULL nor NaN; min and max are set if any
+	int numNulls;
+	bool hasNaN;
+} RM_Zone;
+
+typedef struct RM_ZoneMap {
+	int numAttr;
+	int capacity;       // pages with room for zones
+	RM_Zone *zones;     // numAttr per page
+	bool incomplete;    // some value went unrecorded; nothing is skipped
+} RM_ZoneMap;
+
+// A table can have Bloom filters on attributes chosen when it is created,
+// one of BLOOM_BYTES per page and attribute, telling which values of the
+// attribute may be on the page. Like zones they cover every version
+// reachable from a page's current tuples, and only gain values, except
+// that vacuuming a page rebuilds its filters from what is left on it.
+// They live in memory while the table is open and in the side file
+// <table>.bloom while it is closed:
+//   page 0: [clean int][numPages int][numAttrs int] and the attribute
+//           numbers, one int each
+//   from page 1 on: the filters of table page 0, 1, ..., numAttrs each,
+//           running across side file pages
+// An open clears clean, and a close writes the filters back and sets it;
+// a table that was not closed has its filters rebuilt from its pages.
+#define BLOOM_BYTES 128
+#define BLOOM_HASHES 3
+
+typedef struct RM_BloomMap {
+	char *fileName;        // of the side file
+	int numAttrs;
+	int *attrs;            // attributes with filters
+	int capacity;          // pages with room for filters
+	unsigned char *bits;   // numAttrs filters per page
+	bool incomplete;       // some value went unrecorded; nothing is skipped
+} RM_BloomMap;
+
+// Management data kept in RM_TableData.mgmtData for an open table. latch is
+// held for the duration of one call, shared by readers and exclusive for
+// changes; transactions never wait on it.
+typedef struct RM_TableMgmt {
+	BM_BufferPool bm;
+	pthread_rwlock_t latch;
+	Schema *schema; // layout decoded from the table header
+	int fsmHint;    // lowest map group that may still have free pages
+	int tableId;    // names the table in RM_ToastRef, the same each time it is opened
+	bool toasts;    // some string attribute may be stored out of line
+	bool pax;       // the data pages are PAX pages
+	bool compress;  // and may be encoded
+	int paxRowSize; // page bytes per row of a plain PAX page
+	// Header counters. The tuple count is written back to page 0 only at
+	// checkpoints and on close; the page count is logged as it changes.
+	// Changed under the latch, read without it.
+	_Atomic int numTuples;
+	_Atomic int numPages;
+	bool headerStale; // page 0 is flagged TABLE_COUNTS_STALE
+	RM_ZoneMap *zones; // NULL until a scan builds it
+	RM_BloomMap *blooms; // NULL without Bloom filters
+	struct RM_TableMgmt *next; // in the list of open tables
+} RM_TableMgmt;
+
+// data page operations, on slotted and PAX pages alike
+extern void pageInit (char *page);
+extern int pageInsert (char *page, const char *tuple, int length, uint16_t flags);
+extern char *pageGetTuple (char *page, int slot, int *length, uint16_t *flags);
+extern RC pageUpdate (char *page, int slot, const char *tuple, int length, uint16_t flags);
+extern void pageDelete (char *page, int slot);
+extern void pageCompact (char *page);
+// whether some free bytes lie between tuples rather than before them, or
+// a PAX page is due to be encoded
+extern bool pageFragmented (char *page);
+// copies the tuple pageGetTuple returned with the given length to out and
+// returns the length of the copy
+extern int pageCopyTuple (const char *page, const char *tuple, int length, char *out);
+// decodes the record of the stored version at tuple, as decodeTuple does
+extern void pageDecodeTuple (Schema *schema, const char *page, const char *tuple, char *recordData, int tableId);
+
+// PAX pages (rm_pax.c); the page operations above hand PAX pages to these.
+// paxCapacity returns the rows a plain page has room for and sets rowSize,
+// if not NULL, to the page bytes each takes.
+extern int paxCapacity (Schema *schema, int *rowSize);
+extern void paxPageInit (char *page, Schema *schema, bool compress);
+extern int paxInsert (char *page, const char *tuple, uint16_t flags);
+extern char *paxGetTuple (char *page, int row, int *length, uint16_t *flags);
+extern RC paxUpdate (char *page, int row, const char *tuple, uint16_t flags);
+extern void paxDelete (char *page, int row);
+// whether paxCompact would encode the page, or encode it afresh
+extern bool paxCompactable (char *page);
+extern void paxCompact (char *page);
+extern int paxCopyTuple (const char *page, const char *tuple, char *out);
+extern void paxReadRow (const char *page, int row, char *recordData);
+// the row whose header pageGetTuple returned
+extern int paxRowOf (const char *page, const char *tuple);
+// the minipage of an attribute stored plain, where row r's value is at r
+// times its width; NULL if it is encoded
+extern char *paxMinipage (char *page, int attrNum, int *width);
+// Sets match[r], for every row r below the page's numSlots, to whether the
+// row's value of the attribute is equal to (OP_COMP_EQUAL) or smaller than
+// (OP_COMP_SMALLER) value, given as in Record.data; never for a NULL
+// value. Encoded values are compared without decoding them one by one.
+extern void paxCompare (char *page, int attrNum, OpType op, const char *value, bool *match);
+
+// zone maps (rm_zone.c)
+extern void freeZoneMap (RM_ZoneMap *map);
+// sets mgmt->zones from the table's pages; called with the latch held for
+// writing
+extern void buildZoneMap (RM_TableMgmt *mgmt);
+// widens the zones of a page with the values of a record found on it
+extern void zoneMapAdd (RM_ZoneMap *map, Schema *schema, int pageNum, const char *recordData);
+// widens the zones of page to with those of page from
+extern void zoneMapMerge (RM_ZoneMap *map, Schema *schema, int to, int from);
+// false if cond is true for no record the page's zones and Bloom filters
+// allow
+extern bool pageMayMatch (RM_TableMgmt *mgmt, int pageNum, Expr *cond);
+
+// Bloom filters (rm_bloom.c)
+extern RC createBloomFile (char *tableName, int *attrs, int numAttrs);
+extern RC destroyBloomFile (char *tableName);
+// loads the table's filters, rebuilding them if it was not closed; NULL if
+// it has none
+extern RM_BloomMap *openBloomMap (RM_TableMgmt *mgmt, char *tableName);
+// writes the filters of the table's numPages pages back and frees the map
+extern RC closeBloomMap (RM_BloomMap *map, int numPages);
+extern void bloomMapAdd (RM_BloomMap *map, Schema *schema, int pageNum, const char *recordData);
+extern void bloomMapMerge (RM_BloomMap *map, int to, int from);
+extern void bloomMapRebuildPage (RM_TableMgmt *mgmt, int pageNum);
+// false if no record on the page has value in the attribute
+extern bool bloomMapMayContain (RM_BloomMap *map, int pageNum, int attrNum, const Value *value);
+
+// free-space map pages
+extern int fsmCategory (int freeBytes);
+extern void fsmPageSet (char *page, int leaf, int category);
+extern int fsmPageSearch (char *page, int category);
+
+// tuple encoding: the null bitmap, then fixed-size attributes as-is and
+// strings as a 2-byte length plus only the bytes actually used; a NULL
+// attribute is stored as zero or the empty string. encodeTuple leaves the pointers to
+// long strings unstored; decodeTuple leaves references to the table
+// tableId in their place.
+extern int maxTupleSize (Schema *schema);
+extern int encodeTuple (Schema *schema, const char *recordData, char *tuple);
+extern void decodeTuple (Schema *schema, const char *tuple, char *recordData, int tableId);
+// bytes taken by the encoded attribute at attr
+extern int encodedAttrSize (DataType dt, const char *attr);
+
+#endif // RM_PAGE_H
@@ -0,0 +1,785 @@
+#include "rm_page.h"
+#include "dberror.h"
+#include "expr.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Minipages start at multiples of this, so the values in them are aligned
+#define PAX_ALIGN 8
+// Most distinct values a dictionary-encoded minipage holds
+#define PAX_MAX_DICT 256
+
+// Headers of encoded minipages; the rest of the minipage follows each
+typedef struct PaxDict {
+    uint16_t numEntries; // then numEntries values, then the codes
+    uint16_t bits;       // per code
+} PaxDict;
+
+typedef struct PaxRuns {
+    uint16_t numRuns;    // then per run a uint16_t row count and the value
+    uint16_t unused;
+} PaxRuns;
+
+typedef struct PaxFor {
+    int base;            // smallest value
+    uint16_t bits;       // per difference
+    uint16_t unused;
+} PaxFor;
+
+// The rows of a PAX page with each attribute's values unpacked into an
+// array, for packing the page again after a change
+typedef struct PaxRows {
+    int numRows, numAttr;
+    RM_PaxRow *rows;
+    char **values;
+} PaxRows;
+
+// How one column is packed, worked out from its values
+typedef struct PaxPlan {
+    int codec;
+    int size;
+    int bits;
+    int base;
+    int numEntries;
+    char *entries; // PAX_MAX_DICT values, for PAX_DICT
+} PaxPlan;
+
+static int paxAlign(int offset) {
+    return (offset + PAX_ALIGN - 1) / PAX_ALIGN * PAX_ALIGN;
+}
+
+// attrNum numAttr is the null bitmap
+static int paxWidth(Schema *schema, int attrNum) {
+    if (attrNum == schema->numAttr)
+        return NULL_BITMAP_SIZE(schema->numAttr);
+    switch (schema->dataTypes[attrNum]) {
+        case DT_INT: return sizeof(int);
+        case DT_FLOAT: return sizeof(float);
+        case DT_BOOL: return sizeof(bool);
+        case DT_STRING: return schema->typeLength[attrNum];
+    }
+    return 0;
+}
+
+static int paxRowSize(Schema *schema) {
+    int rowSize = sizeof(RM_PaxRow);
+
+    for (int i = 0; i <= schema->numAttr; i++)
+        rowSize += paxWidth(schema, i);
+    return rowSize;
+}
+
+static int rowsStart(int numAttr) {
+    return paxAlign(sizeof(RM_PageHeader) + sizeof(RM_PaxHeader) + numAttr * sizeof(RM_PaxColumn));
+}
+
+// Rows a plain page with this header has room for; each minipage may lose
+// up to PAX_ALIGN - 1 bytes to its alignment
+static int plainCapacity(const RM_PaxHeader *pax) {
+    int capacity = (PAGE_SIZE - pax->rows - pax->numAttr * (PAX_ALIGN - 1)) / pax->rowSize;
+    return (capacity < 0) ? 0 : capacity;
+}
+
+// Lays out the minipages of a plain page with room for capacity rows
+static void plainLayout(char *page, int capacity) {
+    RM_PaxHeader *pax = PAX_HEADER(page);
+    RM_PaxColumn *columns = PAX_COLUMNS(page);
+    int start = pax->rows + capacity * sizeof(RM_PaxRow);
+
+    pax->capacity = capacity;
+    for (int i = 0; i < pax->numAttr; i++) {
+        start = paxAlign(start);
+        columns[i].start = start;
+        columns[i].size = capacity * columns[i].width;
+        columns[i].codec = PAX_PLAIN;
+        start += columns[i].size;
+    }
+}
+
+int paxCapacity(Schema *schema, int *rowSize) {
+    int size = paxRowSize(schema);
+    int capacity = (PAGE_SIZE - rowsStart(schema->numAttr + 1) - (schema->numAttr + 1) * (PAX_ALIGN - 1)) / size;
+
+    if (rowSize != NULL)
+        *rowSize = size;
+    return (capacity < 0) ? 0 : capacity;
+}
+
+void paxPageInit(char *page, Schema *schema, bool compress) {
+    RM_PageHeader *hdr = PAGE_HEADER(page);
+    RM_PaxHeader *pax = PAX_HEADER(page);
+    RM_PaxColumn *columns = PAX_COLUMNS(page);
+
+    memset(page, 0, PAGE_SIZE);
+    pax->numAttr = schema->numAttr + 1;
+    pax->recordSize = schema->recordSize;
+    pax->rowSize = paxRowSize(schema);
+    pax->rows = rowsStart(pax->numAttr);
+    for (int i = 0; i < schema->numAttr; i++) {
+        columns[i].recordOffset = schema->attrOffsets[i];
+        columns[i].width = paxWidth(schema, i);
+        columns[i].dataType = schema->dataTypes[i];
+    }
+    // the null bitmap packs like a short string
+    columns[schema->numAttr].recordOffset = 0;
+    columns[schema->numAttr].width = paxWidth(schema, schema->numAttr);
+    columns[schema->numAttr].dataType = DT_STRING;
+    plainLayout(page, plainCapacity(pax));
+
+    hdr->flags = PAGE_PAX | (compress ? PAGE_PAX_COMPRESS : 0);
+    hdr->numSlots = 0;
+    hdr->dataStart = PAGE_SIZE;
+    hdr->freeBytes = pax->capacity * pax->rowSize;
+}
+
+static bool isEncoded(const char *page) {
+    return (PAGE_HEADER(page)->flags & PAGE_PAX_ENCODED) != 0;
+}
+
+static bool rowUsed(const char *page, int row) {
+    return row >= 0 && row < PAGE_HEADER(page)->numSlots && (PAX_ROWS(page)[row].flags & PAX_ROW_USED);
+}
+
+// bit packing: value number index of the given width, least significant
+// bit first; out starts zeroed
+static void packBits(unsigned char *out, int index, int bits, uint32_t value) {
+    uint64_t bit = (uint64_t)index * bits;
+    uint64_t word = (uint64_t)value << (bit % 8);
+
+    for (int i = 0; i < (int)((bit % 8 + bits + 7) / 8); i++)
+        out[bit / 8 + i] |= (unsigned char)(word >> (8 * i));
+}
+
+static uint32_t unpackBits(const unsigned char *in, int index, int bits) {
+    uint64_t bit = (uint64_t)index * bits;
+    uint64_t word = 0;
+
+    for (int i = 0; i < (int)((bit % 8 + bits + 7) / 8); i++)
+        word |= (uint64_t)in[bit / 8 + i] << (8 * i);
+    return (uint32_t)((word >> (bit % 8)) & ((bits == 32) ? 0xFFFFFFFFu : ((1u << bits) - 1)));
+}
+
+static int bitsFor(uint32_t max) {
+    int bits = 0;
+
+    while (bits < 32 && (max >> bits) != 0)
+        bits++;
+    return bits;
+}
+
+static int packedSize(int numValues, int bits) {
+    return (int)(((int64_t)numValues * bits + 7) / 8);
+}
+
+// Copies the value of a row in a minipage to value
+static void decodeValue(const char *page, const RM_PaxColumn *column, int row, char *value) {
+    const unsigned char *block = (const unsigned char *)page + column->start;
+
+    switch (column->codec) {
+        case PAX_PLAIN:
+            memcpy(value, block + row * column->width, column->width);
+            break;
+        case PAX_DICT: {
+            PaxDict dict;
+            memcpy(&dict, block, sizeof(PaxDict));
+            uint32_t code = unpackBits(block + sizeof(PaxDict) + dict.numEntries * column->width, row, dict.bits);
+            memcpy(value, block + sizeof(PaxDict) + code * column->width, column->width);
+            break;
+        }
+        case PAX_RLE: {
+            PaxRuns runs;
+            const unsigned char *run = block + sizeof(PaxRuns);
+            uint16_t count;
+            memcpy(&runs, block, sizeof(PaxRuns));
+            for (int i = 0; i < runs.numRuns; i++, run += sizeof(uint16_t) + column->width) {
+                memcpy(&count, run, sizeof(uint16_t));
+                if (row < count) {
+                    memcpy(value, run + sizeof(uint16_t), column->width);
+                    return;
+                }
+                row -= count;
+            }
+            memset(value, 0, column->width);
+            break;
+        }
+        case PAX_FOR: {
+            PaxFor frame;
+            int v;
+            memcpy(&frame, block, sizeof(PaxFor));
+            v = (int)((int64_t)frame.base + unpackBits(block + sizeof(PaxFor), row, frame.bits));
+            memcpy(value, &v, sizeof(int));
+            break;
+        }
+    }
+}
+
+void paxReadRow(const char *page, int row, char *recordData) {
+    RM_PaxHeader *pax = PAX_HEADER(page);
+    RM_PaxColumn *columns = PAX_COLUMNS(page);
+
+    memset(recordData, 0, pax->recordSize);
+    for (int i = 0; i < pax->numAttr; i++)
+        decodeValue(page, &columns[i], row, recordData + columns[i].recordOffset);
+}
+
+static void freeRows(PaxRows *set) {
+    for (int i = 0; set->values != NULL && i < set->numAttr; i++)
+        free(set->values[i]);
+    free(set->values);
+    free(set->rows);
+}
+
+// Unpacks the rows of a page into set, with room for numRows rows at least
+// as many as the page has; the rows added are unused.
+static bool unpackRows(const char *page, int numRows, PaxRows *set) {
+    RM_PaxHeader *pax = PAX_HEADER(page);
+    RM_PaxColumn *columns = PAX_COLUMNS(page);
+    int numSlots = PAGE_HEADER(page)->numSlots;
+
+    set->numRows = numRows;
+    set->numAttr = pax->numAttr;
+    set->rows = (RM_PaxRow *)calloc(numRows > 0 ? numRows : 1, sizeof(RM_PaxRow));
+    set->values = (char **)calloc(pax->numAttr > 0 ? pax->numAttr : 1, sizeof(char *));
+    if (set->rows == NULL || set->values == NULL) {
+        freeRows(set);
+        return false;
+    }
+    memcpy(set->rows, PAX_ROWS(page), numSlots * sizeof(RM_PaxRow));
+    for (int i = 0; i < pax->numAttr; i++) {
+        set->values[i] = (char *)calloc((size_t)numRows * columns[i].width + 1, 1);
+        if (set->values[i] == NULL) {
+            freeRows(set);
+            return false;
+        }
+        for (int r = 0; r < numSlots; r++)
+            decodeValue(page, &columns[i], r, set->values[i] + r * columns[i].width);
+    }
+    return true;
+}
+
+// Works out the smallest way to pack n values of a column. Dictionaries
+// only pay off for strings and frames of reference only apply to integers;
+// ties go to the simpler codec.
+static void planColumn(const RM_PaxColumn *column, const char *values, int n, PaxPlan *plan) {
+    int width = column->width;
+    int size, runs = (n > 0) ? 1 : 0;
+
+    plan->codec = PAX_PLAIN;
+    plan->size = n * width;
+
+    for (int r = 1; r < n; r++)
+        if (memcmp(values + r * width, values + (r - 1) * width, width) != 0)
+            runs++;
+
+    if (column->dataType == DT_INT && n > 0) {
+        int min, max, v;
+        memcpy(&min, values, sizeof(int));
+        max = min;
+        for (int r = 1; r < n; r++) {
+            memcpy(&v, values + r * sizeof(int), sizeof(int));
+            if (v < min) min = v;
+            if (v > max) max = v;
+        }
+        int bits = bitsFor((uint32_t)((int64_t)max - min));
+        size = sizeof(PaxFor) + packedSize(n, bits);
+        if (size < plan->size) {
+            plan->codec = PAX_FOR;
+            plan->size = size;
+            plan->bits = bits;
+            plan->base = min;
+        }
+    }
+
+    plan->numEntries = 0;
+    if (column->dataType == DT_STRING && n > 0 && plan->entries != NULL) {
+        for (int r = 0; r < n && plan->numEntries <= PAX_MAX_DICT; r++) {
+            int e;
+            for (e = 0; e < plan->numEntries; e++)
+                if (memcmp(plan->entries + e * width, values + r * width, width) == 0)
+                    break;
+            if (e < plan->numEntries)
+                continue;
+            if (plan->numEntries == PAX_MAX_DICT) {
+                plan->numEntries++;
+                break;
+            }
+            memcpy(plan->entries + e * width, values + r * width, width);
+            plan->numEntries++;
+        }
+        if (plan->numEntries <= PAX_MAX_DICT) {
+            int bits = bitsFor(plan->numEntries - 1);
+            size = sizeof(PaxDict) + plan->numEntries * width + packedSize(n, bits);
+            if (size < plan->size) {
+                plan->codec = PAX_DICT;
+                plan->size = size;
+                plan->bits = bits;
+            }
+        }
+    }
+
+    size = sizeof(PaxRuns) + runs * (int)(sizeof(uint16_t) + width);
+    if (size < plan->size) {
+        plan->codec = PAX_RLE;
+        plan->size = size;
+    }
+}
+
+// Writes n values of a column into a zeroed minipage as planned
+static void encodeColumn(const RM_PaxColumn *column, const PaxPlan *plan, const char *values, int n, unsigned char *block) {
+    int width = column->width;
+
+    switch (plan->codec) {
+        case PAX_PLAIN:
+            memcpy(block, values, n * width);
+            break;
+        case PAX_DICT: {
+            PaxDict dict = { (uint16_t)plan->numEntries, (uint16_t)plan->bits };
+            unsigned char *codes = block + sizeof(PaxDict) + plan->numEntries * width;
+            memcpy(block, &dict, sizeof(PaxDict));
+            memcpy(block + sizeof(PaxDict), plan->entries, plan->numEntries * width);
+            for (int r = 0; r < n; r++) {
+                int e = 0;
+                while (memcmp(plan->entries + e * width, values + r * width, width) != 0)
+                    e++;
+                packBits(codes, r, plan->bits, (uint32_t)e);
+            }
+            break;
+        }
+        case PAX_RLE: {
+            PaxRuns runs = { 0, 0 };
+            unsigned char *run = block + sizeof(PaxRuns);
+            for (int r = 0; r < n; ) {
+                uint16_t count = 1;
+                while (r + count < n && memcmp(values + (r + count) * width, values + r * width, width) == 0)
+                    count++;
+                memcpy(run, &count, sizeof(uint16_t));
+                memcpy(run + sizeof(uint16_t), values + r * width, width);
+                run += sizeof(uint16_t) + width;
+                runs.numRuns++;
+                r += count;
+            }
+            memcpy(block, &runs, sizeof(PaxRuns));
+            break;
+        }
+        case PAX_FOR: {
+            PaxFor frame = { plan->base, (uint16_t)plan->bits, 0 };
+            int v;
+            memcpy(block, &frame, sizeof(PaxFor));
+            for (int r = 0; r < n; r++) {
+                memcpy(&v, values + r * sizeof(int), sizeof(int));
+                packBits(block + sizeof(PaxFor), r, plan->bits, (uint32_t)((int64_t)v - plan->base));
+            }
+            break;
+        }
+    }
+}
+
+// Writes the rows of set to the page, encoded if encode is set and the
+// page may be encoded, as long as that leaves room for another row or the
+// rows do not fit a plain page. Returns false, leaving the page untouched,
+// if they fit neither way.
+static bool packRows(char *page, PaxRows *set, bool encode) {
+    RM_PaxHeader *pax = PAX_HEADER(page);
+    RM_PaxColumn *columns;
+    RM_PageHeader *hdr;
+    PaxPlan *plans = NULL;
+    char image[PAGE_SIZE];
+    int n = set->numRows, capacity = plainCapacity(pax), used = 0, total, start;
+    bool encoded = false;
+
+    while (n > 0 && !(set->rows[n - 1].flags & PAX_ROW_USED))
+        n--;
+    for (int r = 0; r < n; r++)
+        if (set->rows[r].flags & PAX_ROW_USED)
+            used++;
+    // an unused row takes the value of the row before it, which packs best
+    for (int i = 0; i < set->numAttr; i++) {
+        int width = PAX_COLUMNS(page)[i].width;
+        for (int r = 1; r < n; r++)
+            if (!(set->rows[r].flags & PAX_ROW_USED))
+                memcpy(set->values[i] + r * width, set->values[i] + (r - 1) * width, width);
+    }
+
+    memset(image, 0, PAGE_SIZE);
+    memcpy(image, page, pax->rows);
+    hdr = PAGE_HEADER(image);
+    pax = PAX_HEADER(image);
+    columns = PAX_COLUMNS(image);
+
+    if (encode && (hdr->flags & PAGE_PAX_COMPRESS)
+            && (plans = (PaxPlan *)calloc(pax->numAttr > 0 ? pax->numAttr : 1, sizeof(PaxPlan))) != NULL) {
+        total = pax->rows + n * sizeof(RM_PaxRow);
+        for (int i = 0; i < pax->numAttr; i++) {
+            if (columns[i].dataType == DT_STRING)
+                plans[i].entries = (char *)malloc((size_t)PAX_MAX_DICT * columns[i].width + 1);
+            planColumn(&columns[i], set->values[i], n, &plans[i]);
+            total = paxAlign(total) + plans[i].size;
+        }
+        encoded = total <= PAGE_SIZE && (n > capacity || PAGE_SIZE - total >= pax->rowSize);
+    }
+
+    if (encoded) {
+        hdr->flags |= PAGE_PAX_ENCODED;
+        hdr->freeBytes = PAGE_SIZE - total;
+        pax->capacity = n;
+        start = pax->rows + n * sizeof(RM_PaxRow);
+        for (int i = 0; i < pax->numAttr; i++) {
+            start = paxAlign(start);
+            columns[i].start = start;
+            columns[i].size = plans[i].size;
+            columns[i].codec = plans[i].codec;
+            encodeColumn(&columns[i], &plans[i], set->values[i], n, (unsigned char *)image + start);
+            start += plans[i].size;
+        }
+    } else if (n <= capacity) {
+        hdr->flags &= ~PAGE_PAX_ENCODED;
+        hdr->freeBytes = (capacity - used) * pax->rowSize;
+        plainLayout(image, capacity);
+        for (int i = 0; i < pax->numAttr; i++)
+            memcpy(image + columns[i].start, set->values[i], n * columns[i].width);
+    }
+
+    for (int i = 0; plans != NULL && i < pax->numAttr; i++)
+        free(plans[i].entries);
+    free(plans);
+    if (!encoded && n > capacity)
+        return false;
+
+    hdr->numSlots = n;
+    memcpy(image + pax->rows, set->rows, n * sizeof(RM_PaxRow));
+    memcpy(page, image, PAGE_SIZE);
+    return true;
+}
+
+// Splits a tuple as the page operations take it into a row header and the
+// record data that follows, which it returns
+static const char *splitTuple(const char *tuple, uint16_t flags, RM_PaxRow *row) {
+    memset(row, 0, sizeof(RM_PaxRow));
+    if (flags & SLOT_MOVED) {
+        memcpy(&row->home, tuple, sizeof(RID));
+        tuple += sizeof(RID);
+    }
+    memcpy(&row->version, tuple, sizeof(RM_TupleVersion));
+    row->flags = PAX_ROW_USED | flags;
+    return tuple + sizeof(RM_TupleVersion);
+}
+
+static void writePlainRow(char *page, int row, const char *recordData) {
+    RM_PaxHeader *pax = PAX_HEADER(page);
+    RM_PaxColumn *columns = PAX_COLUMNS(page);
+
+    for (int i = 0; i < pax->numAttr; i++)
+        memcpy(page + columns[i].start + row * columns[i].width, recordData + columns[i].recordOffset, columns[i].width);
+}
+
+static void writeUnpackedRow(PaxRows *set, const RM_PaxColumn *columns, int row, const char *recordData) {
+    for (int i = 0; i < set->numAttr; i++)
+        memcpy(set->values[i] + row * columns[i].width, recordData + columns[i].recordOffset, columns[i].width);
+}
+
+// Sets a row of a page that has to be packed again for it, growing the
+// page by a row if row is its numSlots
+static bool repackWithRow(char *page, int row, const RM_PaxRow *header, const char *recordData) {
+    int numSlots = PAGE_HEADER(page)->numSlots;
+    PaxRows set;
+    bool packed;
+
+    if (!unpackRows(page, (row == numSlots) ? numSlots + 1 : numSlots, &set))
+        return false;
+    set.rows[row] = *header;
+    writeUnpackedRow(&set, PAX_COLUMNS(page), row, recordData);
+    packed = packRows(page, &set, true);
+    freeRows(&set);
+    return packed;
+}
+
+// Returns the row the tuple was stored in, or -1 if the page has no room. A
+// full plain page that may be encoded is, if that makes room.
+int paxInsert(char *page, const char *tuple, uint16_t flags) {
+    RM_PageHeader *hdr = PAGE_HEADER(page);
+    RM_PaxHeader *pax = PAX_HEADER(page);
+    RM_PaxRow *rows = PAX_ROWS(page);
+    RM_PaxRow header;
+    const char *recordData = splitTuple(tuple, flags, &header);
+    int row;
+
+    for (row = 0; row < hdr->numSlots; row++)
+        if (!(rows[row].flags & PAX_ROW_USED))
+            break;
+
+    if (!isEncoded(page) && row < pax->capacity) {
+        if (row == hdr->numSlots)
+            hdr->numSlots++;
+        rows[row] = header;
+        writePlainRow(page, row, recordData);
+        hdr->freeBytes -= pax->rowSize;
+        return row;
+    }
+    if (!(hdr->flags & PAGE_PAX_COMPRESS) || !repackWithRow(page, row, &header, recordData))
+        return -1;
+    return row;
+}
+
+char *paxGetTuple(char *page, int row, int *length, uint16_t *flags) {
+    RM_PaxRow *header;
+    uint16_t rowFlags;
+
+    if (!rowUsed(page, row))
+        return NULL;
+    header = &PAX_ROWS(page)[row];
+    rowFlags = header->flags & SLOT_FLAGS_MASK;
+    if (flags != NULL)
+        *flags = rowFlags;
+    if (rowFlags & SLOT_REDIRECT) {
+        if (length != NULL)
+            *length = sizeof(RID);
+        return (char *)&header->home;
+    }
+    if (rowFlags & SLOT_MOVED) {
+        if (length != NULL)
+            *length = sizeof(RID) + sizeof(RM_TupleVersion);
+        return (char *)&header->home;
+    }
+    if (length != NULL)
+        *length = sizeof(RM_TupleVersion);
+    return (char *)&header->version;
+}
+
+// Replaces a row. A redirect only changes the row header; other changes to
+// an encoded page pack it again and return RC_RM_PAGE_FULL, leaving it
+// untouched, if the row no longer fits.
+RC paxUpdate(char *page, int row, const char *tuple, uint16_t flags) {
+    RM_PaxRow *rows = PAX_ROWS(page);
+    RM_PaxRow header;
+    const char *recordData;
+
+    if (!rowUsed(page, row))
+        return RC_RM_NO_SUCH_TUPLE;
+    if (flags & SLOT_REDIRECT) {
+        memset(&rows[row], 0, sizeof(RM_PaxRow));
+        memcpy(&rows[row].home, tuple, sizeof(RID));
+        rows[row].flags = PAX_ROW_USED | flags;
+        return RC_OK;
+    }
+
+    recordData = splitTuple(tuple, flags, &header);
+    if (!isEncoded(page)) {
+        rows[row] = header;
+        writePlainRow(page, row, recordData);
+        return RC_OK;
+    }
+    return repackWithRow(page, row, &header, recordData) ? RC_OK : RC_RM_PAGE_FULL;
+}
+
+// Frees a row; trailing unused rows are dropped. The values of a row on an
+// encoded page stay until the page is packed again.
+void paxDelete(char *page, int row) {
+    RM_PageHeader *hdr = PAGE_HEADER(page);
+    RM_PaxRow *rows = PAX_ROWS(page);
+
+    if (!rowUsed(page, row))
+        return;
+    memset(&rows[row], 0, sizeof(RM_PaxRow));
+    if (!isEncoded(page))
+        hdr->freeBytes += PAX_HEADER(page)->rowSize;
+    while (hdr->numSlots > 0 && !(rows[hdr->numSlots - 1].flags & PAX_ROW_USED))
+        hdr->numSlots--;
+}
+
+bool paxCompactable(char *page) {
+    RM_PageHeader *hdr = PAGE_HEADER(page);
+
+    if (!(hdr->flags & PAGE_PAX_COMPRESS))
+        return false;
+    return isEncoded(page) || hdr->freeBytes < PAX_HEADER(page)->rowSize;
+}
+
+// Encodes a full page, or an encoded one afresh from the values it has
+// now. An encoded page left with rows for at most half a plain page goes
+// back to plain, so it is quick to fill again.
+void paxCompact(char *page) {
+    RM_PaxRow *rows = PAX_ROWS(page);
+    int numSlots = PAGE_HEADER(page)->numSlots, used = 0;
+    PaxRows set;
+
+    if (!paxCompactable(page))
+        return;
+    for (int r = 0; r < numSlots; r++)
+        if (rows[r].flags & PAX_ROW_USED)
+            used++;
+    if (!unpackRows(page, numSlots, &set))
+        return;
+    packRows(page, &set, used > plainCapacity(PAX_HEADER(page)) / 2);
+    freeRows(&set);
+}
+
+int paxRowOf(const char *page, const char *tuple) {
+    return (int)((tuple - (const char *)PAX_ROWS(page)) / sizeof(RM_PaxRow));
+}
+
+int paxCopyTuple(const char *page, const char *tuple, char *out) {
+    int row = paxRowOf(page, tuple);
+    RM_PaxRow *header = &PAX_ROWS(page)[row];
+    int length = 0;
+
+    if (tuple == (const char *)&header->home) {
+        memcpy(out, &header->home, sizeof(RID));
+        length += sizeof(RID);
+    }
+    memcpy(out + length, &header->version, sizeof(RM_TupleVersion));
+    length += sizeof(RM_TupleVersion);
+    paxReadRow(page, row, out + length);
+    return length + PAX_HEADER(page)->recordSize;
+}
+
+char *paxMinipage(char *page, int attrNum, int *width) {
+    RM_PaxColumn *column = &PAX_COLUMNS(page)[attrNum];
+
+    if (width != NULL)
+        *width = column->width;
+    return (column->codec == PAX_PLAIN) ? page + column->start : NULL;
+}
+
+// Compares two values of a column as stored in Record.data
+static int compareValues(const RM_PaxColumn *column, const char *left, const char *right) {
+    switch (column->dataType) {
+        case DT_INT: {
+            int l, r;
+            memcpy(&l, left, sizeof(int));
+            memcpy(&r, right, sizeof(int));
+            return (l > r) - (l < r);
+        }
+        case DT_FLOAT: {
+            float l, r;
+            memcpy(&l, left, sizeof(float));
+            memcpy(&r, right, sizeof(float));
+            return (l > r) - (l < r);
+        }
+        case DT_BOOL: {
+            bool l, r;
+            memcpy(&l, left, sizeof(bool));
+            memcpy(&r, right, sizeof(bool));
+            return (int)l - (int)r;
+        }
+        case DT_STRING:
+            return strncmp(left, right, column->width);
+    }
+    return 0;
+}
+
+static bool matches(const RM_PaxColumn *column, const char *stored, OpType op, const char *value) {
+    int cmp;
+
+    if (column->dataType == DT_FLOAT) {
+        // compareValues orders NaN equal to everything, but no comparison with it holds
+        float l, r;
+        memcpy(&l, stored, sizeof(float));
+        memcpy(&r, value, sizeof(float));
+        return (op == OP_COMP_EQUAL) ? l == r : l < r;
+    }
+    cmp = compareValues(column, stored, value);
+    return (op == OP_COMP_EQUAL) ? cmp == 0 : cmp < 0;
+}
+
+// Clears match[r] for every row whose value of the attribute is NULL
+static void maskNulls(const char *page, int attrNum, bool *match) {
+    RM_PaxColumn *nulls = &PAX_COLUMNS(page)[PAX_HEADER(page)->numAttr - 1];
+    const unsigned char *block = (const unsigned char *)page + nulls->start;
+    int numRows = PAGE_HEADER(page)->numSlots;
+    char bitmap[PAGE_SIZE];
+
+    if (nulls->codec == PAX_RLE) {
+        const unsigned char *run = block + sizeof(PaxRuns);
+        PaxRuns runs;
+        uint16_t count;
+        memcpy(&runs, block, sizeof(PaxRuns));
+        for (int i = 0, r = 0; i < runs.numRuns && r < numRows; i++, run += sizeof(uint16_t) + nulls->width) {
+            memcpy(&count, run, sizeof(uint16_t));
+            if ((run[sizeof(uint16_t) + attrNum / 8] >> (attrNum % 8)) & 1)
+                memset(match + r, 0, ((r + count < numRows) ? count : numRows - r) * sizeof(bool));
+            r += count;
+        }
+        return;
+    }
+    for (int r = 0; r < numRows; r++) {
+        decodeValue(page, nulls, r, bitmap);
+        if ((bitmap[attrNum / 8] >> (attrNum % 8)) & 1)
+            match[r] = false;
+    }
+}
+
+void paxCompare(char *page, int attrNum, OpType op, const char *value, bool *match) {
+    RM_PaxColumn *column = &PAX_COLUMNS(page)[attrNum];
+    const unsigned char *block = (const unsigned char *)page + column->start;
+    int numRows = PAGE_HEADER(page)->numSlots;
+    int width = column->width;
+
+    switch (column->codec) {
+        case PAX_PLAIN:
+            if (column->dataType == DT_INT || column->dataType == DT_FLOAT) {
+                // the values are contiguous, so the kernels load whole vectors
+                int selection[PAGE_SIZE / sizeof(int)], n;
+                Value constant;
+                constant.dt = column->dataType;
+                constant.isNull = FALSE;
+                memcpy(&constant.v, value, sizeof(int));
+                n = selectCompare(column->dataType, op, false, (const char *)block, width, numRows, &constant, selection);
+                memset(match, 0, numRows * sizeof(bool));
+                for (int i = 0; i < n; i++)
+                    match[selection[i]] = true;
+                break;
+            }
+            for (int r = 0; r < numRows; r++)
+                match[r] = matches(column, (const char *)block + r * width, op, value);
+            break;
+        case PAX_DICT: {
+            // each distinct value is compared once
+            bool entryMatch[PAX_MAX_DICT];
+            PaxDict dict;
+            memcpy(&dict, block, sizeof(PaxDict));
+            for (int e = 0; e < dict.numEntries; e++)
+                entryMatch[e] = matches(column, (const char *)block + sizeof(PaxDict) + e * width, op, value);
+            for (int r = 0; r < numRows; r++)
+                match[r] = entryMatch[unpackBits(block + sizeof(PaxDict) + dict.numEntries * width, r, dict.bits)];
+            break;
+        }
+        case PAX_RLE: {
+            // and so is each run
+            const unsigned char *run = block + sizeof(PaxRuns);
+            PaxRuns runs;
+            uint16_t count;
+            int r = 0;
+            memcpy(&runs, block, sizeof(PaxRuns));
+            for (int i = 0; i < runs.numRuns && r < numRows; i++, run += sizeof(uint16_t) + width) {
+                bool m = matches(column, (const char *)run + sizeof(uint16_t), op, value);
+                memcpy(&count, run, sizeof(uint16_t));
+                for (int end = (r + count < numRows) ? r + count : numRows; r < end; r++)
+                    match[r] = m;
+            }
+            while (r < numRows)
+                match[r++] = false;
+            break;
+        }
+        case PAX_FOR: {
+            // the value is moved into the frame instead of every difference out of it
+            PaxFor frame;
+            int v;
+            int64_t target;
+            uint32_t max;
+            memcpy(&frame, block, sizeof(PaxFor));
+            memcpy(&v, value, sizeof(int));
+            target = (int64_t)v - frame.base;
+            max = (frame.bits == 32) ? 0xFFFFFFFFu : ((1u << frame.bits) - 1);
+            for (int r = 0; r < numRows; r++) {
+                uint32_t diff = unpackBits(block + sizeof(PaxFor), r, frame.bits);
+                if (op == OP_COMP_EQUAL)
+                    match[r] = target >= 0 && target <= (int64_t)max && diff == (uint32_t)target;
+                else
+                    match[r] = target > 0 && (target > (int64_t)max || diff < (uint32_t)target);
+            }
+            break;
+        }
+    }
+    maskNulls(page, attrNum, match);
+}
@@ -18,7 +18,7 @@ typedef struct VarString {
 			var = (VarString *) malloc(sizeof(VarString));	\
 			var->size = 0;					\
 			var->bufsize = 100;					\
-			var->buf = calloc(100,0);				\
+			var->buf = calloc(100,1);				\
 		} while (0)
 
 #define FREE_VARSTRING(var)			\
@@ -179,6 +179,12 @@ serializeAttr(Record *record, Schema *schema, int attrNum)
 	attrOffset(schema, attrNum, &offset);
 	attrData = record->data + offset;
 
+	if (isAttrNull(record, schema, attrNum))
+	{
+		APPEND(result, "%s:NULL", schema->attrNames[attrNum]);
+		RETURN_STRING(result);
+	}
+
 	switch(schema->dataTypes[attrNum])
 	{
 	case DT_INT:
@@ -190,14 +196,9 @@ serializeAttr(Record *record, Schema *schema, int attrNum)
 	break;
 	case DT_STRING:
 	{
-		char *buf;
-		int len = schema->typeLength[attrNum];
-		buf = (char *) malloc(len + 1);
-		strncpy(buf, attrData, len);
-		buf[len] = '\0';
-
-		APPEND(result, "%s:%s", schema->attrNames[attrNum], buf);
-		free(buf);
+		int len;
+		const char *str = getAttrString(record, schema, attrNum, &len);
+		APPEND(result, "%s:%.*s", schema->attrNames[attrNum], len, str);
 	}
 	break;
 	case DT_FLOAT:
@@ -227,6 +228,12 @@ serializeValue(Value *val)
 	VarString *result;
 	MAKE_VARSTRING(result);
 
+	if (val->isNull)
+	{
+		APPEND_STRING(result, "NULL");
+		RETURN_STRING(result);
+	}
+
 	switch(val->dt)
 	{
 	case DT_INT:
@@ -251,6 +258,7 @@ stringToValue(char *val)
 {
 	Value *result = (Value *) malloc(sizeof(Value));
 
+	result->isNull = FALSE;
 	switch(val[0])
 	{
 	case 'i':
@@ -283,26 +291,6 @@ stringToValue(char *val)
 RC 
 attrOffset (Schema *schema, int attrNum, int *result)
 {
-	int offset = 0;
-	int attrPos = 0;
-
-	for(attrPos = 0; attrPos < attrNum; attrPos++)
-		switch (schema->dataTypes[attrPos])
-		{
-		case DT_STRING:
-			offset += schema->typeLength[attrPos];
-			break;
-		case DT_INT:
-			offset += sizeof(int);
-			break;
-		case DT_FLOAT:
-			offset += sizeof(float);
-			break;
-		case DT_BOOL:
-			offset += sizeof(bool);
-			break;
-		}
-
-	*result = offset;
+	*result = schema->attrOffsets[attrNum];
 	return RC_OK;
 }
@@ -0,0 +1,237 @@
+#include "rm_txn.h"
+#include "dberror.h"
+#include "lock_mgr.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Running transactions and the xmin of every live snapshot. Ids are handed
+// out under the same lock, so a snapshot never misses a transaction that
+// started before it.
+static struct {
+    pthread_mutex_t lock;
+    TxnId *running;
+    int numRunning, cap;
+    TxnId *horizons;
+    int numHorizons, horizonCap;
+} txnTable = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static __thread RM_Transaction *currentTxn = NULL;
+
+RM_Transaction *getCurrentTransaction(void) {
+    return currentTxn;
+}
+
+void setCurrentTransaction(RM_Transaction *txn) {
+    currentTxn = txn;
+}
+
+// Called with the lock held
+static void addHorizon(TxnId xmin) {
+    if (txnTable.numHorizons == txnTable.horizonCap) {
+        txnTable.horizonCap = (txnTable.horizonCap == 0) ? 16 : 2 * txnTable.horizonCap;
+        txnTable.horizons = (TxnId *)realloc(txnTable.horizons, sizeof(TxnId) * txnTable.horizonCap);
+    }
+    txnTable.horizons[txnTable.numHorizons++] = xmin;
+}
+
+// Called with the lock held
+static void snapshotLocked(RM_Snapshot *snapshot, TxnId xid) {
+    snapshot->xid = xid;
+    snapshot->xmax = snapshot->xmin = getNextTxnId();
+    snapshot->numActive = txnTable.numRunning;
+    snapshot->active = (TxnId *)malloc(sizeof(TxnId) * (txnTable.numRunning > 0 ? txnTable.numRunning : 1));
+    memcpy(snapshot->active, txnTable.running, sizeof(TxnId) * txnTable.numRunning);
+    for (int i = 0; i < txnTable.numRunning; i++)
+        if (txnTable.running[i] != xid && txnTable.running[i] < snapshot->xmin)
+            snapshot->xmin = txnTable.running[i];
+    addHorizon(snapshot->xmin);
+}
+
+void startTransaction(RM_Transaction *txn) {
+    memset(txn, 0, sizeof(RM_Transaction));
+
+    pthread_mutex_lock(&txnTable.lock);
+    txn->xid = newTxnId();
+    if (txnTable.numRunning == txnTable.cap) {
+        txnTable.cap = (txnTable.cap == 0) ? 16 : 2 * txnTable.cap;
+        txnTable.running = (TxnId *)realloc(txnTable.running, sizeof(TxnId) * txnTable.cap);
+    }
+    txnTable.running[txnTable.numRunning++] = txn->xid;
+    snapshotLocked(&txn->snapshot, txn->xid);
+    pthread_mutex_unlock(&txnTable.lock);
+}
+
+void endTransaction(RM_Transaction *txn) {
+    pthread_mutex_lock(&txnTable.lock);
+    for (int i = 0; i < txnTable.numRunning; i++) {
+        if (txnTable.running[i] == txn->xid) {
+            txnTable.running[i] = txnTable.running[--txnTable.numRunning];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&txnTable.lock);
+
+    // only now, so whoever waited for a lock sees the transaction as ended
+    unlockAll(txn->xid);
+    freeSnapshot(&txn->snapshot);
+    for (int i = 0; i < txn->numUndo; i++)
+        free(txn->undo[i].fileName);
+    free(txn->undo);
+    txn->undo = NULL;
+    txn->numUndo = txn->undoCap = 0;
+}
+
+void addUndo(RM_Transaction *txn, const char *fileName, RM_RowChange change) {
+    RM_UndoEntry *entry;
+
+    if (txn->numUndo == txn->undoCap) {
+        txn->undoCap = (txn->undoCap == 0) ? 16 : 2 * txn->undoCap;
+        txn->undo = (RM_UndoEntry *)realloc(txn->undo, sizeof(RM_UndoEntry) * txn->undoCap);
+    }
+    entry = &txn->undo[txn->numUndo++];
+    entry->fileName = (char *)malloc(strlen(fileName) + 1);
+    strcpy(entry->fileName, fileName);
+    entry->change = change;
+}
+
+void takeSnapshot(RM_Snapshot *snapshot, TxnId xid) {
+    pthread_mutex_lock(&txnTable.lock);
+    snapshotLocked(snapshot, xid);
+    pthread_mutex_unlock(&txnTable.lock);
+}
+
+void renewSnapshot(RM_Transaction *txn) {
+    freeSnapshot(&txn->snapshot);
+    takeSnapshot(&txn->snapshot, txn->xid);
+}
+
+void copySnapshot(RM_Snapshot *to, const RM_Snapshot *from) {
+    *to = *from;
+    to->active = (TxnId *)malloc(sizeof(TxnId) * (from->numActive > 0 ? from->numActive : 1));
+    memcpy(to->active, from->active, sizeof(TxnId) * from->numActive);
+    pthread_mutex_lock(&txnTable.lock);
+    addHorizon(to->xmin);
+    pthread_mutex_unlock(&txnTable.lock);
+}
+
+void freeSnapshot(RM_Snapshot *snapshot) {
+    if (snapshot->active == NULL)
+        return;
+    pthread_mutex_lock(&txnTable.lock);
+    for (int i = 0; i < txnTable.numHorizons; i++) {
+        if (txnTable.horizons[i] == snapshot->xmin) {
+            txnTable.horizons[i] = txnTable.horizons[--txnTable.numHorizons];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&txnTable.lock);
+    free(snapshot->active);
+    snapshot->active = NULL;
+    snapshot->numActive = 0;
+}
+
+bool xidVisible(const RM_Snapshot *snapshot, TxnId xid) {
+    if (xid == snapshot->xid)
+        return true;
+    if (xid >= snapshot->xmax)
+        return false;
+    for (int i = 0; i < snapshot->numActive; i++)
+        if (snapshot->active[i] == xid)
+            return false;
+    return true;
+}
+
+bool xidVisibleToAll(TxnId xid) {
+    bool visible = true;
+
+    pthread_mutex_lock(&txnTable.lock);
+    for (int i = 0; i < txnTable.numRunning && visible; i++)
+        visible = (txnTable.running[i] != xid);
+    for (int i = 0; i < txnTable.numHorizons && visible; i++)
+        visible = (xid < txnTable.horizons[i]);
+    pthread_mutex_unlock(&txnTable.lock);
+    return visible;
+}
+
+bool versionVisible(const RM_Snapshot *snapshot, const RM_TupleVersion *version) {
+    return xidVisible(snapshot, version->xmin)
+            && (version->xmax == NO_TXN || !xidVisible(snapshot, version->xmax));
+}
+
+RC readVisibleVersion(RM_TableMgmt *mgmt, const RM_Snapshot *snapshot, const char *pageData, const char *payload, char *recordData) {
+    BM_PageHandle page;
+    RM_TupleVersion version;
+    bool pinned = false;
+    RC rc = RC_RM_NO_SUCH_TUPLE;
+
+    for (;;) {
+        memcpy(&version, payload, sizeof(RM_TupleVersion));
+        // a version whose creator is seen ends the chain: everything older
+        // was replaced before it existed
+        if (xidVisible(snapshot, version.xmin)) {
+            if (version.xmax == NO_TXN || !xidVisible(snapshot, version.xmax)) {
+                pageDecodeTuple(mgmt->schema, pageData, payload, recordData, mgmt->tableId);
+                rc = RC_OK;
+            }
+            break;
+        }
+        if (pinned)
+            unpinPage(&mgmt->bm, &page);
+        pinned = false;
+        if (version.prev.page < 0 || pinPage(&mgmt->bm, &page, version.prev.page) != RC_OK)
+            break;
+        pinned = true;
+        pageData = page.data;
+        payload = pageGetTuple(page.data, version.prev.slot, NULL, NULL);
+        if (payload == NULL)
+            break;
+    }
+    if (pinned)
+        unpinPage(&mgmt->bm, &page);
+    return rc;
+}
+
+RC visitPageVersions(RM_TableMgmt *mgmt, int pageNum, RM_VersionVisitor visit, void *arg) {
+    BM_PageHandle page, older;
+    RM_TupleVersion version;
+    char *recordData, *tuple;
+    uint16_t flags;
+    RC rc = RC_OK;
+
+    if ((recordData = (char *)malloc(mgmt->schema->recordSize)) == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    if (pinPage(&mgmt->bm, &page, pageNum) != RC_OK) {
+        free(recordData);
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    for (int slot = 0; slot < PAGE_HEADER(page.data)->numSlots && rc == RC_OK; slot++) {
+        tuple = pageGetTuple(page.data, slot, NULL, &flags);
+        if (tuple == NULL || (flags & (SLOT_REDIRECT | SLOT_VERSION | SLOT_TOAST)))
+            continue;
+        if (flags & SLOT_MOVED)
+            tuple += sizeof(RID);
+        pageDecodeTuple(mgmt->schema, page.data, tuple, recordData, mgmt->tableId);
+        visit(arg, pageNum, recordData);
+        memcpy(&version, tuple, sizeof(RM_TupleVersion));
+        while (version.prev.page >= 0) {
+            if (pinPage(&mgmt->bm, &older, version.prev.page) != RC_OK) {
+                rc = RC_READ_NON_EXISTING_PAGE;
+                break;
+            }
+            tuple = pageGetTuple(older.data, version.prev.slot, NULL, NULL);
+            if (tuple != NULL) {
+                pageDecodeTuple(mgmt->schema, older.data, tuple, recordData, mgmt->tableId);
+                visit(arg, pageNum, recordData);
+                memcpy(&version, tuple, sizeof(RM_TupleVersion));
+            }
+            unpinPage(&mgmt->bm, &older);
+            if (tuple == NULL)
+                break;
+        }
+    }
+    unpinPage(&mgmt->bm, &page);
+    free(recordData);
+    return rc;
+}
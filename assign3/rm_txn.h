@@ -0,0 +1,82 @@
+#ifndef RM_TXN_H
+#define RM_TXN_H
+
+#include "log_mgr.h"
+#include "rm_page.h"
+#include "tables.h"
+
+// Transaction state shared by the record and scan managers.
+//
+// A snapshot tells which transactions' changes a reader sees: its own and
+// those of every transaction that ended before the snapshot was taken.
+// Aborted transactions restore the versions they replaced before they end,
+// so any transaction id that is no longer running counts as committed.
+typedef struct RM_Snapshot {
+	TxnId xid;      // reader's own transaction, or NO_TXN
+	TxnId xmin;     // every transaction before this one is seen
+	TxnId xmax;     // transactions from this id on started later
+	TxnId *active;  // transactions running when the snapshot was taken
+	int numActive;
+} RM_Snapshot;
+
+// A row change as logged in LOG_ROW records and kept for abort
+typedef enum RM_RowChangeKind {
+	ROW_INSERT = 1,
+	ROW_DELETE = 2,
+	ROW_UPDATE = 3
+} RM_RowChangeKind;
+
+typedef struct RM_RowChange {
+	int kind;
+	RID rid;
+} RM_RowChange;
+
+typedef struct RM_UndoEntry {
+	char *fileName;
+	RM_RowChange change;
+} RM_UndoEntry;
+
+typedef struct RM_Transaction {
+	TxnId xid;
+	LSN lastLSN; // latest LOG_ROW record
+	RM_Snapshot snapshot;
+	RM_UndoEntry *undo;
+	int numUndo, undoCap;
+} RM_Transaction;
+
+// Registers a new running transaction and takes its snapshot
+extern void startTransaction (RM_Transaction *txn);
+// Unregisters it, so its changes become visible to later snapshots, and
+// releases its locks
+extern void endTransaction (RM_Transaction *txn);
+extern void addUndo (RM_Transaction *txn, const char *fileName, RM_RowChange change);
+
+// The transaction begun by the calling thread, or NULL
+extern RM_Transaction *getCurrentTransaction (void);
+extern void setCurrentTransaction (RM_Transaction *txn);
+
+extern void takeSnapshot (RM_Snapshot *snapshot, TxnId xid);
+// Replaces the transaction's snapshot with a current one
+extern void renewSnapshot (RM_Transaction *txn);
+extern void copySnapshot (RM_Snapshot *to, const RM_Snapshot *from);
+extern void freeSnapshot (RM_Snapshot *snapshot);
+extern bool xidVisible (const RM_Snapshot *snapshot, TxnId xid);
+// Whether every snapshot, now and later, sees the ended transaction xid; if
+// so, the versions it deleted or replaced can be removed
+extern bool xidVisibleToAll (TxnId xid);
+extern bool versionVisible (const RM_Snapshot *snapshot, const RM_TupleVersion *version);
+
+// Decodes the version of a record that the snapshot sees, starting from the
+// current version at payload on the pinned page pageData and following older
+// versions as needed. Returns RC_RM_NO_SUCH_TUPLE if the snapshot sees none.
+extern RC readVisibleVersion (RM_TableMgmt *mgmt, const RM_Snapshot *snapshot,
+		const char *pageData, const char *payload, char *recordData);
+
+// Decodes, for each current tuple on a data page, every version reachable
+// from it, whichever page that version is on, and hands each to visit with
+// the page number. Returns an error if a page could not be read.
+typedef void (*RM_VersionVisitor) (void *arg, int pageNum, const char *recordData);
+
+extern RC visitPageVersions (RM_TableMgmt *mgmt, int pageNum, RM_VersionVisitor visit, void *arg);
+
+#endif // RM_TXN_H
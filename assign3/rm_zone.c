@@ -0,0 +1,255 @@
+#include "rm_page.h"
+#include "dberror.h"
+#include "rm_txn.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// What a condition, or part of one, may be for some record on a page
+typedef struct ZoneTruth {
+    bool mayTrue;
+    bool mayFalse;
+    bool mayNull;
+} ZoneTruth;
+
+static const ZoneTruth unknownTruth = { true, true, true };
+
+static RM_ZoneMap *createZoneMap(Schema *schema) {
+    RM_ZoneMap *map = (RM_ZoneMap *)calloc(1, sizeof(RM_ZoneMap));
+
+    if (map != NULL)
+        map->numAttr = schema->numAttr;
+    return map;
+}
+
+void freeZoneMap(RM_ZoneMap *map) {
+    if (map == NULL)
+        return;
+    free(map->zones);
+    free(map);
+}
+
+// The zones of a page, making room for them if the page is new to the map
+static RM_Zone *pageZones(RM_ZoneMap *map, int pageNum) {
+    if (pageNum >= map->capacity) {
+        int capacity = (map->capacity == 0) ? 64 : map->capacity;
+        RM_Zone *zones;
+        while (capacity <= pageNum)
+            capacity *= 2;
+        zones = (RM_Zone *)realloc(map->zones, sizeof(RM_Zone) * capacity * map->numAttr);
+        if (zones == NULL)
+            return NULL;
+        memset(zones + map->capacity * map->numAttr, 0, sizeof(RM_Zone) * (capacity - map->capacity) * map->numAttr);
+        map->zones = zones;
+        map->capacity = capacity;
+    }
+    return map->zones + pageNum * map->numAttr;
+}
+
+void zoneMapAdd(RM_ZoneMap *map, Schema *schema, int pageNum, const char *recordData) {
+    RM_Zone *zones = pageZones(map, pageNum);
+
+    if (zones == NULL) {
+        // a page without zones is never skipped, so neither is this one
+        map->incomplete = true;
+        return;
+    }
+    for (int i = 0; i < schema->numAttr; i++) {
+        RM_Zone *zone = &zones[i];
+        const char *attr = recordData + schema->attrOffsets[i];
+        int v = 0;
+        float f;
+
+        if ((recordData[i / 8] >> (i % 8)) & 1) {
+            zone->numNulls++;
+            continue;
+        }
+        switch (schema->dataTypes[i]) {
+            case DT_INT:
+                memcpy(&v, attr, sizeof(int));
+                break;
+            case DT_BOOL:
+                v = (*(const bool *)attr) ? 1 : 0;
+                break;
+            case DT_FLOAT:
+                memcpy(&f, attr, sizeof(float));
+                if (isnan(f)) {
+                    zone->hasNaN = true;
+                    continue;
+                }
+                if (zone->numValues == 0 || f < zone->min.floatV)
+                    zone->min.floatV = f;
+                if (zone->numValues == 0 || f > zone->max.floatV)
+                    zone->max.floatV = f;
+                zone->numValues++;
+                continue;
+            case DT_STRING:
+                zone->numValues++;
+                continue;
+        }
+        if (zone->numValues == 0 || v < zone->min.intV)
+            zone->min.intV = v;
+        if (zone->numValues == 0 || v > zone->max.intV)
+            zone->max.intV = v;
+        zone->numValues++;
+    }
+}
+
+void zoneMapMerge(RM_ZoneMap *map, Schema *schema, int to, int from) {
+    RM_Zone *target = pageZones(map, (to > from) ? to : from);
+    RM_Zone *source;
+
+    if (target == NULL) {
+        map->incomplete = true;
+        return;
+    }
+    target = map->zones + to * map->numAttr;
+    source = map->zones + from * map->numAttr;
+    for (int i = 0; i < schema->numAttr; i++) {
+        RM_Zone *t = &target[i], *s = &source[i];
+        bool isFloat = (schema->dataTypes[i] == DT_FLOAT);
+
+        if (s->numValues > 0 && (t->numValues == 0 || (isFloat ? s->min.floatV < t->min.floatV : s->min.intV < t->min.intV)))
+            t->min = s->min;
+        if (s->numValues > 0 && (t->numValues == 0 || (isFloat ? s->max.floatV > t->max.floatV : s->max.intV > t->max.intV)))
+            t->max = s->max;
+        t->numValues += s->numValues;
+        t->numNulls += s->numNulls;
+        t->hasNaN = t->hasNaN || s->hasNaN;
+    }
+}
+
+// attr OP constant, or constant OP attr if constFirst, over a zone
+static ZoneTruth compareZone(const RM_Zone *zone, DataType dt, OpType op, const Value *constant, bool constFirst) {
+    ZoneTruth truth = { false, zone->hasNaN, zone->numNulls > 0 };
+    double min, max, c;
+
+    if (constant->isNull) {
+        truth.mayFalse = false;
+        truth.mayNull = zone->numValues > 0 || zone->hasNaN || zone->numNulls > 0;
+        return truth;
+    }
+    if (zone->numValues == 0)
+        return truth;
+    if (dt == DT_FLOAT) {
+        min = zone->min.floatV;
+        max = zone->max.floatV;
+        c = constant->v.floatV;
+    } else {
+        min = zone->min.intV;
+        max = zone->max.intV;
+        c = (dt == DT_BOOL) ? (constant->v.boolV ? 1 : 0) : constant->v.intV;
+    }
+    if (op == OP_COMP_EQUAL) {
+        truth.mayTrue = min <= c && c <= max;
+        truth.mayFalse |= min != c || max != c;
+    } else if (!constFirst) {
+        truth.mayTrue = min < c;
+        truth.mayFalse |= max >= c;
+    } else {
+        truth.mayTrue = max > c;
+        truth.mayFalse |= min <= c;
+    }
+    return truth;
+}
+
+// zones is NULL if the page has none; Bloom filters still narrow equalities
+static ZoneTruth pageTruth(RM_TableMgmt *mgmt, const RM_Zone *zones, int pageNum, Expr *expr) {
+    Schema *schema = mgmt->schema;
+    ZoneTruth truth = unknownTruth, l, r;
+    Expr **args;
+
+    switch (expr->type) {
+        case EXPR_CONST:
+            if (expr->expr.cons->isNull) {
+                truth.mayTrue = truth.mayFalse = false;
+            } else if (expr->expr.cons->dt == DT_BOOL) {
+                truth.mayTrue = expr->expr.cons->v.boolV;
+                truth.mayFalse = !expr->expr.cons->v.boolV;
+                truth.mayNull = false;
+            }
+            return truth;
+        case EXPR_ATTRREF:
+            if (zones != NULL && schema->dataTypes[expr->expr.attrRef] == DT_BOOL) {
+                const RM_Zone *zone = &zones[expr->expr.attrRef];
+                truth.mayTrue = zone->numValues > 0 && zone->max.intV == 1;
+                truth.mayFalse = zone->numValues > 0 && zone->min.intV == 0;
+                truth.mayNull = zone->numNulls > 0;
+            }
+            return truth;
+        case EXPR_OP:
+            break;
+    }
+
+    args = expr->expr.op->args;
+    switch (expr->expr.op->type) {
+        case OP_BOOL_NOT:
+            l = pageTruth(mgmt, zones, pageNum, args[0]);
+            truth.mayTrue = l.mayFalse;
+            truth.mayFalse = l.mayTrue;
+            truth.mayNull = l.mayNull;
+            return truth;
+        case OP_BOOL_AND:
+        case OP_BOOL_OR:
+            l = pageTruth(mgmt, zones, pageNum, args[0]);
+            r = pageTruth(mgmt, zones, pageNum, args[1]);
+            if (expr->expr.op->type == OP_BOOL_AND) {
+                truth.mayTrue = l.mayTrue && r.mayTrue;
+                truth.mayFalse = l.mayFalse || r.mayFalse;
+            } else {
+                truth.mayTrue = l.mayTrue || r.mayTrue;
+                truth.mayFalse = l.mayFalse && r.mayFalse;
+            }
+            truth.mayNull = l.mayNull || r.mayNull;
+            return truth;
+        case OP_COMP_EQUAL:
+        case OP_COMP_SMALLER: {
+            // only an attribute against a constant of its type is narrowed
+            int a = (args[0]->type == EXPR_ATTRREF) ? 0 : 1;
+            Value *constant;
+            DataType dt;
+            if (args[a]->type != EXPR_ATTRREF || args[1 - a]->type != EXPR_CONST)
+                return truth;
+            dt = schema->dataTypes[args[a]->expr.attrRef];
+            constant = args[1 - a]->expr.cons;
+            if (!constant->isNull && constant->dt != dt)
+                return truth;
+            if (zones != NULL && dt != DT_STRING && !(dt == DT_FLOAT && !constant->isNull && isnan(constant->v.floatV)))
+                truth = compareZone(&zones[args[a]->expr.attrRef], dt, expr->expr.op->type, constant, a == 1);
+            if (expr->expr.op->type == OP_COMP_EQUAL && !constant->isNull && mgmt->blooms != NULL
+                    && !bloomMapMayContain(mgmt->blooms, pageNum, args[a]->expr.attrRef, constant))
+                truth.mayTrue = false;
+            return truth;
+        }
+    }
+    return truth;
+}
+
+bool pageMayMatch(RM_TableMgmt *mgmt, int pageNum, Expr *cond) {
+    RM_ZoneMap *map = mgmt->zones;
+    const RM_Zone *zones = NULL;
+
+    if (map != NULL && !map->incomplete && pageNum < map->capacity)
+        zones = map->zones + pageNum * map->numAttr;
+    return pageTruth(mgmt, zones, pageNum, cond).mayTrue;
+}
+
+static void addVersion(void *arg, int pageNum, const char *recordData) {
+    RM_TableMgmt *mgmt = (RM_TableMgmt *)arg;
+
+    zoneMapAdd(mgmt->zones, mgmt->schema, pageNum, recordData);
+}
+
+void buildZoneMap(RM_TableMgmt *mgmt) {
+    int numPages = atomic_load(&mgmt->numPages);
+
+    if ((mgmt->zones = createZoneMap(mgmt->schema)) == NULL)
+        return;
+    for (int p = 0; p < numPages; p++) {
+        if (IS_DATA_PAGE(p) && visitPageVersions(mgmt, p, addVersion, mgmt) != RC_OK) {
+            mgmt->zones->incomplete = true;
+            break;
+        }
+    }
+}
@@ -4,60 +4,318 @@
 #include "expr.h"
 #include "dberror.h"
 #include "tables.h"
-#include <stdio.h>
+#include "rm_page.h"
+#include "rm_txn.h"
+#include "lock_mgr.h"
 #include <stdlib.h>
 #include <string.h> 
 
-#define PAGE_METADATA_SIZE sizeof(int)
-#define SLOT_SIZE 20
+// position of the next slot to examine, and the versions the scan sees.
+// The page being read stays pinned from one call to the next.
+typedef struct RM_ScanCursor {
+    int page;
+    int slot;
+    BM_PageHandle handle;
+    bool pinned;
+    RM_Snapshot snapshot;
+    ExprProgram *program; // the condition compiled, or NULL
+    Expr *zoneCond;       // checked against zones and Bloom filters before pinning a page, or NULL
+    // A condition comparing one attribute of a PAX table with a constant is
+    // made by nextBatch on the attribute's minipage: paxMatch holds the
+    // result for each row of page matchPage, or paxValue is NULL
+    int paxAttr;
+    OpType paxOp;
+    const char *paxValue;
+    bool *paxMatch;
+    int matchPage;
+} RM_ScanCursor;
 
+// Sets up the minipage comparison if the condition is one paxCompare makes
+// as the program would: attribute = constant, constant = attribute, or
+// attribute < constant, with a string constant no longer than the attribute
+static void preparePaxCompare(RM_ScanCursor *cursor, RM_TableMgmt *mgmt) {
+    Value *constant;
+    bool constFirst;
+
+    cursor->paxValue = NULL;
+    cursor->paxMatch = NULL;
+    cursor->matchPage = -1;
+    if (!mgmt->pax || cursor->program == NULL
+            || !programComparison(cursor->program, &cursor->paxAttr, &cursor->paxOp, &constant, &constFirst))
+        return;
+    if (constFirst && cursor->paxOp != OP_COMP_EQUAL)
+        return;
+    if (constant->dt == DT_STRING && (int)strlen(constant->v.stringV) > mgmt->schema->typeLength[cursor->paxAttr])
+        return;
+    if ((cursor->paxMatch = (bool *)malloc(sizeof(bool) * PAGE_SIZE)) == NULL)
+        return;
+    cursor->paxValue = (constant->dt == DT_STRING) ? constant->v.stringV : (const char *)&constant->v;
+}
+
+// A scan sees the table as of its start: the snapshot of the caller's
+// transaction, or of the moment startScan is called.
 RC startScan(RM_TableData *rel, RM_ScanHandle *scan, Expr *cond) {
+    RM_ScanCursor *cursor = (RM_ScanCursor *)malloc(sizeof(RM_ScanCursor));
+    RM_Transaction *txn = getCurrentTransaction();
+    RC rc;
+
+    if (cursor == NULL) return RC_MEMORY_ALLOCATION_ERROR;
+    if (txn != NULL && (rc = lockTable(txn->xid, ((RM_TableMgmt *)rel->mgmtData)->bm.pageFile, LOCK_IS)) != RC_OK) {
+        free(cursor);
+        return rc;
+    }
+    cursor->page = FSM_GROUP_PAGE(0) + 1;
+    cursor->slot = 0;
+    cursor->pinned = false;
+    cursor->program = (cond != NULL) ? compileExpr(cond, ((RM_TableMgmt *)rel->mgmtData)->schema) : NULL;
+    // only conditions that compile are sure not to fail on a record skipped
+    cursor->zoneCond = NULL;
+    if (cursor->program != NULL) {
+        RM_TableMgmt *mgmt = (RM_TableMgmt *)rel->mgmtData;
+        pthread_rwlock_wrlock(&mgmt->latch);
+        if (mgmt->zones == NULL)
+            buildZoneMap(mgmt);
+        pthread_rwlock_unlock(&mgmt->latch);
+        cursor->zoneCond = cond;
+    }
+    preparePaxCompare(cursor, (RM_TableMgmt *)rel->mgmtData);
+    if (txn != NULL)
+        copySnapshot(&cursor->snapshot, &txn->snapshot);
+    else
+        takeSnapshot(&cursor->snapshot, NO_TXN);
     scan->rel = rel;
-    scan->mgmtData = malloc(sizeof(int));
-    *(int *)(scan->mgmtData) = 0;
+    scan->mgmtData = cursor;
+    scan->expr = cond;
     return RC_OK;
 }
 
-RC next(RM_ScanHandle *scan, Record *record) {
-    int *currentSlot = (int *)scan->mgmtData;
-    BM_BufferPool *bm = (BM_BufferPool *)scan->rel->mgmtData;
-    BM_PageHandle page;
+// Reads the next record the snapshot sees into record, pinning the pages
+// it moves on to. Returns RC_RM_NO_MORE_TUPLES past the last page. If
+// matched is not NULL, rows the minipage comparison rejects are passed over
+// without being decoded, and *matched tells whether it accepted the record;
+// its results hold only while the latch is, so the caller resets matchPage
+// each time it takes the latch.
+static RC nextVisible(RM_ScanCursor *cursor, RM_TableMgmt *mgmt, Record *record, bool *matched) {
+    BM_BufferPool *bm = &mgmt->bm;
+    int numPages = atomic_load(&mgmt->numPages);
 
-    if (pinPage(bm, &page, 1) != RC_OK) {
-        return RC_READ_NON_EXISTING_PAGE;
-    }
+    while (cursor->page < numPages) {
+        if (!IS_DATA_PAGE(cursor->page)) {
+            cursor->page++;
+            continue;
+        }
+        if (!cursor->pinned && cursor->zoneCond != NULL && !pageMayMatch(mgmt, cursor->page, cursor->zoneCond)) {
+            cursor->page++;
+            continue;
+        }
+        if (!cursor->pinned) {
+            if (pinPage(bm, &cursor->handle, cursor->page) != RC_OK)
+                return RC_READ_NON_EXISTING_PAGE;
+            cursor->pinned = true;
+        }
 
-    int numRecords = getNumTuples(scan->rel);
-    printf("Debug: Total Records: %d\n", numRecords);
+        char *pageData = cursor->handle.data;
+        if (matched != NULL && cursor->paxValue != NULL && cursor->matchPage != cursor->page
+                && IS_PAX_PAGE(pageData)) {
+            paxCompare(pageData, cursor->paxAttr, cursor->paxOp, cursor->paxValue, cursor->paxMatch);
+            cursor->matchPage = cursor->page;
+        }
+        while (cursor->slot < PAGE_HEADER(pageData)->numSlots) {
+            uint16_t flags;
+            int slot = cursor->slot++;
+            char *tuple = pageGetTuple(pageData, slot, NULL, &flags);
+
+            // redirect stubs are skipped; the moved copy is returned where it
+            // lives. Older versions and out-of-line values are only reached
+            // through their record.
+            if (tuple == NULL || (flags & (SLOT_REDIRECT | SLOT_VERSION | SLOT_TOAST)))
+                continue;
+
+            if (flags & SLOT_MOVED) {
+                memcpy(&record->id, tuple, sizeof(RID));
+                tuple += sizeof(RID);
+            } else {
+                record->id.page = cursor->page;
+                record->id.slot = slot;
+            }
+            // the minipage only holds the version stored in the row
+            if (matched != NULL && cursor->matchPage == cursor->page) {
+                RM_TupleVersion version;
+                memcpy(&version, tuple, sizeof(RM_TupleVersion));
+                if (versionVisible(&cursor->snapshot, &version)) {
+                    if (!cursor->paxMatch[slot])
+                        continue;
+                    pageDecodeTuple(mgmt->schema, pageData, tuple, record->data, mgmt->tableId);
+                    *matched = true;
+                    return RC_OK;
+                }
+            }
+            if (readVisibleVersion(mgmt, &cursor->snapshot, pageData, tuple, record->data) == RC_OK)
+                return RC_OK;
+        }
 
-    if (numRecords < 0) {
-        printf("Warning: numRecords contains invalid data: %d. Resetting to 0.\n", numRecords);
-        numRecords = 0;
+        unpinPage(bm, &cursor->handle);
+        cursor->pinned = false;
+        cursor->matchPage = -1;
+        cursor->page++;
+        cursor->slot = 0;
     }
+    return RC_RM_NO_MORE_TUPLES;
+}
 
-    while (*currentSlot < numRecords) {
-        char *recordData = page.data + PAGE_METADATA_SIZE + (*currentSlot * SLOT_SIZE);
+// Evaluates the scan's condition for a record; a condition that is NULL
+// for it does not hold. It runs without the table latch, since fetching a
+// long string takes it again, and by evalExpr only if it could not be
+// compiled.
+static RC satisfies(RM_ScanHandle *scan, Record *record, bool *match) {
+    RM_ScanCursor *cursor = (RM_ScanCursor *)scan->mgmtData;
+    Value *result;
+    RC rc;
 
-        if (recordData[0] != '\0') {
-            memset(record->data, 0, SLOT_SIZE);
-            strncpy(record->data, recordData, SLOT_SIZE - 1);
-            record->data[SLOT_SIZE - 1] = '\0';
+    if (scan->expr == NULL) {
+        *match = true;
+        return RC_OK;
+    }
+    if (cursor->program != NULL) {
+        *match = evalProgram(cursor->program, record);
+        return RC_OK;
+    }
+    if ((rc = evalExpr(record, ((RM_TableMgmt *)scan->rel->mgmtData)->schema, scan->expr, &result)) != RC_OK)
+        return rc;
+    *match = result->dt == DT_BOOL && !result->isNull && result->v.boolV;
+    freeVal(result);
+    return RC_OK;
+}
 
-            printf("Debug: Scanned Record at Slot %d: %s\n", *currentSlot, record->data);
+// Returns the next record the scan sees that satisfies its condition
+RC next(RM_ScanHandle *scan, Record *record) {
+    RM_ScanCursor *cursor = (RM_ScanCursor *)scan->mgmtData;
+    RM_TableMgmt *mgmt = (RM_TableMgmt *)scan->rel->mgmtData;
+    bool match;
+    RC rc;
 
-            (*currentSlot)++;
-            unpinPage(bm, &page);
+    for (;;) {
+        pthread_rwlock_rdlock(&mgmt->latch);
+        rc = nextVisible(cursor, mgmt, record, NULL);
+        pthread_rwlock_unlock(&mgmt->latch);
+        if (rc != RC_OK || (rc = satisfies(scan, record, &match)) != RC_OK)
+            return rc;
+        if (match)
             return RC_OK;
-        }
+    }
+}
 
-        (*currentSlot)++;
+RC createRecordBatch(RecordBatch **batch, Schema *schema, int capacity) {
+    if (capacity < 1)
+        return RC_ERROR;
+    *batch = (RecordBatch *)calloc(1, sizeof(RecordBatch));
+    if (*batch == NULL) return RC_MEMORY_ALLOCATION_ERROR;
+    (*batch)->capacity = capacity;
+    (*batch)->recordSize = getRecordSize(schema);
+    (*batch)->ids = (RID *)malloc(sizeof(RID) * capacity);
+    (*batch)->data = (char *)malloc((size_t)(*batch)->recordSize * capacity);
+    (*batch)->selection = (int *)malloc(sizeof(int) * capacity);
+    if ((*batch)->ids == NULL || (*batch)->data == NULL || (*batch)->selection == NULL) {
+        freeRecordBatch(*batch);
+        return RC_MEMORY_ALLOCATION_ERROR;
     }
+    return RC_OK;
+}
 
-    unpinPage(bm, &page);
-    return RC_RM_NO_MORE_TUPLES;
+RC freeRecordBatch(RecordBatch *batch) {
+    free(batch->ids);
+    free(batch->data);
+    free(batch->selection);
+    free(batch);
+    return RC_OK;
+}
+
+void batchRecord(RecordBatch *batch, int index, Record *record) {
+    record->id = batch->ids[index];
+    record->data = batch->data + (size_t)index * batch->recordSize;
+}
+
+// Selects the batch's records with the comparison kernels when the
+// condition compares one int or float attribute with a constant
+static bool selectBatch(RM_ScanHandle *scan, RecordBatch *batch) {
+    RM_ScanCursor *cursor = (RM_ScanCursor *)scan->mgmtData;
+    Schema *schema = ((RM_TableMgmt *)scan->rel->mgmtData)->schema;
+    Record record;
+    Value *constant;
+    OpType op;
+    bool constFirst;
+    int attrNum, n = 0;
+
+    if (cursor->program == NULL || !programComparison(cursor->program, &attrNum, &op, &constant, &constFirst))
+        return false;
+    if (schema->dataTypes[attrNum] != DT_INT && schema->dataTypes[attrNum] != DT_FLOAT)
+        return false;
+    batch->numSelected = selectCompare(schema->dataTypes[attrNum], op, constFirst,
+            batch->data + schema->attrOffsets[attrNum], batch->recordSize, batch->numTuples,
+            constant, batch->selection);
+    // a NULL attribute holds zeros, which may pass the comparison
+    for (int i = 0; i < batch->numSelected; i++) {
+        batchRecord(batch, batch->selection[i], &record);
+        if (!isAttrNull(&record, schema, attrNum))
+            batch->selection[n++] = batch->selection[i];
+    }
+    batch->numSelected = n;
+    return true;
+}
+
+// One latch acquisition fills the batch; the condition then runs over it
+// in a single loop.
+RC nextBatch(RM_ScanHandle *scan, RecordBatch *batch, int maxTuples) {
+    RM_ScanCursor *cursor = (RM_ScanCursor *)scan->mgmtData;
+    RM_TableMgmt *mgmt = (RM_TableMgmt *)scan->rel->mgmtData;
+    Record record;
+    bool match;
+    RC rc = RC_OK;
+
+    if (maxTuples > batch->capacity || maxTuples < 1)
+        maxTuples = batch->capacity;
+    batch->numTuples = batch->numSelected = 0;
+
+    pthread_rwlock_rdlock(&mgmt->latch);
+    cursor->matchPage = -1;
+    while (batch->numTuples < maxTuples) {
+        batchRecord(batch, batch->numTuples, &record);
+        match = false;
+        if ((rc = nextVisible(cursor, mgmt, &record, &match)) != RC_OK)
+            break;
+        // until the selection is made, it flags the records already accepted
+        batch->selection[batch->numTuples] = match;
+        batch->ids[batch->numTuples++] = record.id;
+        // a batch ends with the page it reads
+        if (cursor->slot >= PAGE_HEADER(cursor->handle.data)->numSlots)
+            break;
+    }
+    pthread_rwlock_unlock(&mgmt->latch);
+    if (batch->numTuples == 0)
+        return (rc == RC_OK) ? RC_RM_NO_MORE_TUPLES : rc;
+
+    if (cursor->paxValue == NULL && selectBatch(scan, batch))
+        return RC_OK;
+    for (int i = 0; i < batch->numTuples; i++) {
+        match = (cursor->paxValue != NULL && batch->selection[i]);
+        batchRecord(batch, i, &record);
+        if (!match && (rc = satisfies(scan, &record, &match)) != RC_OK)
+            return rc;
+        if (match)
+            batch->selection[batch->numSelected++] = i;
+    }
+    return RC_OK;
 }
 
 RC closeScan(RM_ScanHandle *scan) {
-    free(scan->mgmtData);
+    RM_ScanCursor *cursor = (RM_ScanCursor *)scan->mgmtData;
+
+    if (cursor->pinned)
+        unpinPage(&((RM_TableMgmt *)scan->rel->mgmtData)->bm, &cursor->handle);
+    if (cursor->program != NULL)
+        freeProgram(cursor->program);
+    free(cursor->paxMatch);
+    freeSnapshot(&cursor->snapshot);
+    free(cursor);
     return RC_OK;
 }
@@ -6,5 +6,6 @@
 RC startScan(RM_TableData *rel, RM_ScanHandle *scan, Expr *cond);
 RC next(RM_ScanHandle *scan, Record *record);
 RC closeScan(RM_ScanHandle *scan);
+RC nextBatch(RM_ScanHandle *scan, RecordBatch *batch, int maxTuples);
 
 #endif
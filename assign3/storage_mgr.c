@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 void initStorageManager() {
 } 
@@ -40,7 +41,8 @@ RC destroyPageFile(char *fileName) {
 RC readBlock(int pageNum, SM_FileHandle *fHandle, char *memPage) {
     FILE *file = (FILE *)fHandle->mgmtInfo;
     if (fseek(file, pageNum * PAGE_SIZE, SEEK_SET) != 0) return RC_READ_NON_EXISTING_PAGE;
-    fread(memPage, sizeof(char), PAGE_SIZE, file);
+    size_t n = fread(memPage, sizeof(char), PAGE_SIZE, file);
+    if (n < PAGE_SIZE) memset(memPage + n, 0, PAGE_SIZE - n);  // page past EOF reads as empty
     return RC_OK;
 }
 
@@ -49,4 +51,16 @@ RC writeBlock(int pageNum, SM_FileHandle *fHandle, char *memPage) {
     if (fseek(file, pageNum * PAGE_SIZE, SEEK_SET) != 0) return RC_WRITE_FAILED;
     fwrite(memPage, sizeof(char), PAGE_SIZE, file);
     return RC_OK;
+}
+
+RC truncatePageFile(int numberOfPages, SM_FileHandle *fHandle) {
+    FILE *file = (FILE *)fHandle->mgmtInfo;
+    if (fflush(file) != 0 || ftruncate(fileno(file), (off_t)numberOfPages * PAGE_SIZE) != 0) return RC_WRITE_FAILED;
+    return RC_OK;
+}
+
+RC syncPageFile(SM_FileHandle *fHandle) {
+    FILE *file = (FILE *)fHandle->mgmtInfo;
+    if (fflush(file) != 0 || fsync(fileno(file)) != 0) return RC_WRITE_FAILED;
+    return RC_OK;
 }
\ No newline at end of file
@@ -39,5 +39,10 @@ extern RC writeBlock (int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage
 extern RC writeCurrentBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC appendEmptyBlock (SM_FileHandle *fHandle);
 extern RC ensureCapacity (int numberOfPages, SM_FileHandle *fHandle);
+/* dropping every page from numberOfPages on */
+extern RC truncatePageFile (int numberOfPages, SM_FileHandle *fHandle);
+
+/* making written blocks durable */
+extern RC syncPageFile (SM_FileHandle *fHandle);
 
 #endif
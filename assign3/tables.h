@@ -11,8 +11,10 @@ typedef enum DataType {
 	DT_BOOL = 3
 } DataType;
 
+// A NULL value has isNull set and v unset; its stringV is NULL
 typedef struct Value {
 	DataType dt;
+	bool isNull;
 	union v {
 		int intV;
 		char *stringV;
@@ -33,6 +35,9 @@ typedef struct Record
 } Record;
 
 // information of a table schema: its attributes, datatypes, 
+// attrOffsets and recordSize describe the record layout computed by createSchema.
+// Record.data starts with a null bitmap of NULL_BITMAP_SIZE bytes, bit
+// attrNum % 8 of byte attrNum / 8 set when the attribute is NULL.
 typedef struct Schema
 {
 	int numAttr;
@@ -41,8 +46,12 @@ typedef struct Schema
 	int *typeLength;
 	int *keyAttrs;
 	int keySize;
+	int *attrOffsets;
+	int recordSize;
 } Schema;
 
+#define NULL_BITMAP_SIZE(numAttr) (((numAttr) + 7) / 8)
+
 // TableData: Management Structure for a Record Manager to handle one relation
 typedef struct RM_TableData
 {
@@ -55,6 +64,7 @@ typedef struct RM_TableData
 		do {									\
 			(result) = (Value *) malloc(sizeof(Value));				\
 			(result)->dt = DT_STRING;						\
+			(result)->isNull = FALSE;						\
 			(result)->v.stringV = (char *) malloc(strlen(value) + 1);		\
 			strcpy((result)->v.stringV, value);					\
 		} while(0)
@@ -64,6 +74,7 @@ typedef struct RM_TableData
 		do {									\
 			(result) = (Value *) malloc(sizeof(Value));				\
 			(result)->dt = datatype;						\
+			(result)->isNull = FALSE;						\
 			switch(datatype)							\
 			{									\
 			case DT_INT:							\
@@ -78,6 +89,14 @@ typedef struct RM_TableData
 			}									\
 		} while(0)
 
+#define MAKE_NULL_VALUE(result, datatype)				\
+		do {									\
+			(result) = (Value *) malloc(sizeof(Value));				\
+			(result)->dt = datatype;						\
+			(result)->isNull = TRUE;						\
+			(result)->v.stringV = NULL;						\
+		} while(0)
+
 
 // debug and read methods
 extern Value *stringToValue (char *value);
@@ -1,7 +1,16 @@
+#include <pthread.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "dberror.h"
+#include "buffer_mgr_trace.h"
 #include "expr.h"
+#include "lock_mgr.h"
+#include "log_mgr.h"
 #include "record_mgr.h"
+#include "rm_page.h"
+#include "rm_txn.h"
+#include "storage_mgr.h"
 #include "tables.h"
 #include "test_helper.h"
 
@@ -49,12 +58,35 @@
 
 // test methods
 static void testRecords (void);
+static void testRecordLayout (void);
 static void testCreateTableAndInsert (void);
 static void testUpdateTable (void);
 static void testScans (void);
 static void testScansTwo (void);
 static void testInsertManyRecords(void);
 static void testMultipleScans(void);
+static void testPoolStatistics(void);
+static void testReleasedPins(void);
+static void testPageTrace(void);
+static void testVarLengthRecords(void);
+static void testBulkInsert(void);
+static void testGroupCommit(void);
+static void testRecovery(void);
+static void testCheckpoint(void);
+static void testCommitOrder(void);
+static void testTransactions(void);
+static void testLocks(void);
+static void testTableSchema(void);
+static void testVacuum(void);
+static void testToast(void);
+static void testPaxLayout(void);
+static void testPaxCompression(void);
+static void testNullValues(void);
+static void testScanCursor(void);
+static void testBatchScan(void);
+static void testZoneMaps(void);
+static void testBloomFilters(void);
+static void testPaxBatchScan(void);
 
 // struct for test records
 typedef struct TestRecord {
@@ -79,11 +111,34 @@ main (void)
 
 	testInsertManyRecords();
 	testRecords();
+	testRecordLayout();
 	testCreateTableAndInsert();
 	testUpdateTable();
 	testScans();
 	testScansTwo();
 	testMultipleScans();
+	testPoolStatistics();
+	testReleasedPins();
+	testPageTrace();
+	testVarLengthRecords();
+	testBulkInsert();
+	testGroupCommit();
+	testRecovery();
+	testCheckpoint();
+	testCommitOrder();
+	testTransactions();
+	testLocks();
+	testTableSchema();
+	testVacuum();
+	testToast();
+	testPaxLayout();
+	testPaxCompression();
+	testNullValues();
+	testScanCursor();
+	testBatchScan();
+	testZoneMaps();
+	testBloomFilters();
+	testPaxBatchScan();
 
 	return 0;
 }
@@ -98,6 +153,8 @@ testRecords (void)
 	Schema *schema;
 	Record *r;
 	Value *value;
+	const char *str;
+	int len;
 	testName = "test creating records and manipulating attributes";
 
 	// check attributes of created record
@@ -122,7 +179,61 @@ testRecords (void)
 	OP_TRUE(stringToValue("i4"), value, valueEquals, "third attr after setting");
 	freeVal(value);
 
+	// typed accessors read the same bytes without allocating
+	ASSERT_EQUALS_INT(4, getAttrInt(r, schema, 2), "third attr via typed accessor");
+	str = getAttrString(r, schema, 1, &len);
+	ASSERT_EQUALS_INT(4, len, "second attr length");
+	ASSERT_TRUE(memcmp(str, "aaaa", 4) == 0, "second attr via string view");
+	setAttrString(r, schema, 1, "bb", 2);
+	getAttr(r, schema, 1, &value);
+	OP_TRUE(stringToValue("sbb"), value, valueEquals, "shorter string is zero padded");
+	freeVal(value);
+
+	freeRecord(r);
+	TEST_DONE();
+}
+
+void
+testRecordLayout (void)
+{
+	char *names[] = { "s", "i", "b", "f" };
+	DataType dt[] = { DT_STRING, DT_INT, DT_BOOL, DT_FLOAT };
+	int sizes[] = { 3, 0, 0, 0 };
+	int keys[] = { 1 };
+	// after the one-byte null bitmap, each attribute at the next offset aligned for its type
+	int offsets[] = { 1, 4, 8, 12 };
+	char *values[] = { "sabc", "i-7", "bt", "f2.5" };
+	Schema *schema;
+	Record *r;
+	Value *value;
+	int i;
+	testName = "test record layout of a mixed schema";
+
+	schema = createSchema(4, names, dt, sizes, 1, keys);
+	for(i = 0; i < 4; i++)
+		ASSERT_EQUALS_INT(offsets[i], schema->attrOffsets[i], "attribute offset");
+	ASSERT_EQUALS_INT(16, getRecordSize(schema), "record size padded to the widest alignment");
+
+	// every attribute is set before any is read back, so overlaps would show
+	TEST_CHECK(createRecord(&r, schema));
+	for(i = 0; i < 4; i++)
+	{
+		value = stringToValue(values[i]);
+		TEST_CHECK(setAttr(r, schema, i, value));
+		freeVal(value);
+	}
+	for(i = 0; i < 4; i++)
+	{
+		TEST_CHECK(getAttr(r, schema, i, &value));
+		OP_TRUE(stringToValue(values[i]), value, valueEquals, "attribute round trip");
+		freeVal(value);
+	}
+	ASSERT_EQUALS_INT(-7, getAttrInt(r, schema, 1), "int via typed accessor");
+	ASSERT_TRUE(getAttrBool(r, schema, 2), "bool via typed accessor");
+	ASSERT_TRUE(getAttrFloat(r, schema, 3) == 2.5f, "float via typed accessor");
+
 	freeRecord(r);
+	freeSchema(schema);
 	TEST_DONE();
 }
 
@@ -615,6 +726,2455 @@ void testScansTwo (void)
 	TEST_DONE();
 }
 
+// pages in use by a table
+static int
+tablePages (RM_TableData *table)
+{
+	return ((RM_TableMgmt *) table->mgmtData)->numPages;
+}
+
+// frames of the pool pinned right now
+static int
+pinnedPages (BM_BufferPool *bm)
+{
+	int *fixCounts = getFixCounts(bm);
+	int pinned = 0, i;
+
+	for(i = 0; i < bm->numPages; i++)
+		pinned += fixCounts[i];
+	free(fixCounts);
+	return pinned;
+}
+
+// records a scan with the condition returns
+static int
+scanCount (RM_TableData *table, Expr *cond)
+{
+	RM_ScanHandle sc;
+	Record *r;
+	int count = 0;
+
+	createRecord(&r, table->schema);
+	startScan(table, &sc, cond);
+	while(next(&sc, r) == RC_OK)
+		count++;
+	closeScan(&sc);
+	freeRecord(r);
+	return count;
+}
+
+// whether a page is in one of the pool's frames
+static bool
+poolHolds (BM_BufferPool *bm, PageNumber pageNum)
+{
+	PageNumber *contents = getFrameContents(bm);
+	bool found = false;
+	int i;
+
+	for(i = 0; i < bm->numPages; i++)
+		found = found || contents[i] == pageNum;
+	free(contents);
+	return found;
+}
+
+static void
+pinAndUnpin (BM_BufferPool *bm, PageNumber pageNum, bool dirty)
+{
+	BM_PageHandle page;
+
+	TEST_CHECK(pinPage(bm, &page, pageNum));
+	if (dirty)
+		TEST_CHECK(markDirty(bm, &page));
+	TEST_CHECK(unpinPage(bm, &page));
+}
+
+void
+testPoolStatistics (void)
+{
+	ReplacementStrategy strategies[] = { RS_FIFO, RS_LRU };
+	// page 0 is used again before the pool fills: FIFO still evicts it first, LRU evicts page 1
+	PageNumber kept[] = { 2, 0 };
+	PageNumber evicted[] = { 0, 1 };
+	char *file = "test_pool_stats.bin";
+	BM_FrameStatistics frames[3];
+	BM_PoolStatistics stats;
+	BM_BufferPool bm;
+	int s, i;
+	testName = "test buffer pool statistics count hits, misses and evictions";
+
+	TEST_CHECK(createPageFile(file));
+	for(s = 0; s < 2; s++)
+	{
+		TEST_CHECK(initBufferPool(&bm, file, 3, strategies[s], NULL));
+		for(i = 0; i < 3; i++)
+			pinAndUnpin(&bm, i, i == 1);
+		pinAndUnpin(&bm, 0, false);
+		pinAndUnpin(&bm, 3, false);
+		pinAndUnpin(&bm, 4, false);
+
+		TEST_CHECK(getPoolStatistics(&bm, &stats, frames));
+		ASSERT_EQUALS_INT(3, stats.numFrames, "frames in the pool");
+		ASSERT_EQUALS_INT(6, (int) stats.numPins, "every pin counted");
+		ASSERT_EQUALS_INT(1, (int) stats.numHits, "one pin found its page in the pool");
+		ASSERT_EQUALS_INT(5, (int) stats.numMisses, "the other pins read their page");
+		ASSERT_EQUALS_INT(2, (int) stats.numEvictions, "two frames reused");
+		ASSERT_EQUALS_INT(1, (int) stats.numDirtyEvictions, "the dirty page written back on eviction");
+		ASSERT_EQUALS_INT(5, stats.numReadIO, "one read per miss");
+		ASSERT_EQUALS_INT(1, stats.numWriteIO, "one write for the dirty eviction");
+		ASSERT_EQUALS_INT(getNumReadIO(&bm), stats.numReadIO, "read count agrees with getNumReadIO");
+		ASSERT_TRUE(poolHolds(&bm, kept[s]), "page kept by the strategy");
+		ASSERT_TRUE(!poolHolds(&bm, evicted[s]), "page evicted by the strategy");
+		for(i = 0; i < 3; i++)
+			ASSERT_TRUE(frames[i].fixCount == 0 && !frames[i].dirty, "frames unpinned and clean");
+
+		TEST_CHECK(resetPoolStatistics(&bm));
+		TEST_CHECK(getPoolStatistics(&bm, &stats, NULL));
+		ASSERT_EQUALS_INT(3, stats.numFrames, "reset keeps the frame count");
+		ASSERT_TRUE(stats.numPins == 0 && stats.numHits == 0 && stats.numMisses == 0, "reset clears the pin counters");
+		ASSERT_TRUE(stats.numEvictions == 0 && stats.numDirtyEvictions == 0, "reset clears the eviction counters");
+		ASSERT_TRUE(stats.numReadIO == 0 && stats.numWriteIO == 0 && stats.pinWaitNanos == 0, "reset clears I/O counters");
+
+		pinAndUnpin(&bm, 3, false);
+		TEST_CHECK(getPoolStatistics(&bm, &stats, NULL));
+		ASSERT_TRUE(stats.numPins == 1 && stats.numHits == 1 && stats.numMisses == 0, "counting resumes after reset");
+		TEST_CHECK(shutdownBufferPool(&bm));
+	}
+	TEST_CHECK(destroyPageFile(file));
+	TEST_DONE();
+}
+
+void
+testReleasedPins (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	BM_BufferPool *bm;
+	char page[PAGE_SIZE];
+	SM_FileHandle fh;
+	Schema *schema;
+	Record *r;
+	RID missing;
+	int i;
+	testName = "test record operations release their pins and pages past the end read empty";
+
+	schema = testSchema();
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_pins", schema));
+	TEST_CHECK(openTable(table, "test_table_pins"));
+	bm = &((RM_TableMgmt *) table->mgmtData)->bm;
+
+	r = testRecord(schema, 1, "pins", 2);
+	for(i = 0; i < 20; i++)
+		TEST_CHECK(insertRecord(table, r));
+	ASSERT_EQUALS_INT(0, pinnedPages(bm), "inserts leave no page pinned");
+	TEST_CHECK(getRecord(table, r->id, r));
+	missing = r->id;
+	missing.slot += 100;
+	ASSERT_ERROR(getRecord(table, missing, r), "no record in the slot");
+	ASSERT_EQUALS_INT(0, pinnedPages(bm), "reads leave no page pinned, failed or not");
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_pins"));
+	TEST_CHECK(shutdownRecordManager());
+
+	TEST_CHECK(createPageFile("test_pins.bin"));
+	TEST_CHECK(openPageFile("test_pins.bin", &fh));
+	memset(page, 0xFF, PAGE_SIZE);
+	TEST_CHECK(readBlock(3, &fh, page));
+	for(i = 0; i < PAGE_SIZE && page[i] == 0; i++)
+		;
+	ASSERT_EQUALS_INT(PAGE_SIZE, i, "page past the end of the file reads as zeros");
+	TEST_CHECK(closePageFile(&fh));
+	TEST_CHECK(destroyPageFile("test_pins.bin"));
+
+	freeRecord(r);
+	freeSchema(schema);
+	free(table);
+	TEST_DONE();
+}
+
+void
+testPageTrace (void)
+{
+	char *file = "test_trace.bin", *traceFile = "test_trace.trc";
+	BM_TraceEntry *entries;
+	BM_BufferPool bm;
+	BM_Trace *trace;
+	int numEntries, i;
+	testName = "test page access traces survive a dump and read back";
+
+	// pins and unpins through a pool, in order
+	TEST_CHECK(createPageFile(file));
+	TEST_CHECK(initBufferPool(&bm, file, 3, RS_LRU, NULL));
+	trace = createTrace(16);
+	TEST_CHECK(setPoolTrace(&bm, trace));
+	for(i = 0; i < 5; i++)
+		pinAndUnpin(&bm, i % 3, false);
+	TEST_CHECK(setPoolTrace(&bm, NULL));
+	TEST_CHECK(shutdownBufferPool(&bm));
+	TEST_CHECK(destroyPageFile(file));
+
+	ASSERT_EQUALS_INT(0, (int) getTraceDropped(trace), "nothing dropped");
+	TEST_CHECK(dumpTrace(trace, traceFile));
+	TEST_CHECK(readTrace(traceFile, &entries, &numEntries));
+	ASSERT_EQUALS_INT(10, numEntries, "one entry per pin and unpin");
+	for(i = 0; i < numEntries; i++)
+	{
+		ASSERT_EQUALS_INT((i / 2) % 3, entries[i].pageNum, "page of the access");
+		ASSERT_EQUALS_INT((i % 2 == 0) ? BM_TRACE_PIN : BM_TRACE_UNPIN, (int) entries[i].op, "pin, then its unpin");
+		ASSERT_TRUE(i == 0 || entries[i].timestamp >= entries[i - 1].timestamp, "entries in time order");
+	}
+	free(entries);
+	freeTrace(trace);
+
+	// a wrapped ring keeps only the newest entries
+	trace = createTrace(4);
+	for(i = 0; i < 10; i++)
+		traceAccess(trace, i, BM_TRACE_PIN);
+	ASSERT_EQUALS_INT(6, (int) getTraceDropped(trace), "older entries overwritten");
+	TEST_CHECK(dumpTrace(trace, traceFile));
+	TEST_CHECK(readTrace(traceFile, &entries, &numEntries));
+	ASSERT_EQUALS_INT(4, numEntries, "one entry per slot");
+	for(i = 0; i < numEntries; i++)
+		ASSERT_EQUALS_INT(6 + i, entries[i].pageNum, "newest entries, oldest first");
+	free(entries);
+	freeTrace(trace);
+	remove(traceFile);
+	TEST_DONE();
+}
+
+void
+testVarLengthRecords (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	RM_ScanHandle *sc = (RM_ScanHandle *) malloc(sizeof(RM_ScanHandle));
+	char *names[] = { "id", "text" };
+	DataType dt[] = { DT_INT, DT_STRING };
+	int sizes[] = { 0, 1000 };
+	int keys[] = {0};
+	int numInserts = 400, i, len, scanned = 0, rc, numPages;
+	char longText[1000];
+	const char *str;
+	Record *r;
+	RID *rids;
+	Schema *schema;
+	testName = "test variable length records growing in place and across pages";
+
+	schema = createSchema(2, names, dt, sizes, 1, keys);
+	rids = (RID *) malloc(sizeof(RID) * numInserts);
+	memset(longText, 'x', sizeof(longText));
+
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_v",schema));
+	TEST_CHECK(openTable(table, "test_table_v"));
+
+	// short strings are stored densely, so one page holds many of them
+	TEST_CHECK(createRecord(&r, schema));
+	for(i = 0; i < numInserts; i++)
+	{
+		setAttrInt(r, schema, 0, i);
+		setAttrString(r, schema, 1, "ab", 2);
+		TEST_CHECK(insertRecord(table, r));
+		rids[i] = r->id;
+	}
+	ASSERT_TRUE(rids[numInserts - 1].page < 5, "short records share pages");
+
+	// grow every tenth record to the full width; RIDs must stay valid
+	for(i = 0; i < numInserts; i += 10)
+	{
+		setAttrInt(r, schema, 0, i);
+		setAttrString(r, schema, 1, longText, sizeof(longText));
+		r->id = rids[i];
+		TEST_CHECK(updateRecord(table, r));
+	}
+
+	for(i = 0; i < numInserts; i++)
+	{
+		TEST_CHECK(getRecord(table, rids[i], r));
+		ASSERT_EQUALS_INT(i, getAttrInt(r, schema, 0), "id survives update");
+		str = getAttrString(r, schema, 1, &len);
+		ASSERT_EQUALS_INT((i % 10 == 0) ? 1000 : 2, len, "string length");
+		ASSERT_TRUE(memcmp(str, (i % 10 == 0) ? longText : "ab", len) == 0, "string content");
+	}
+
+	// every record is returned exactly once, under its original RID
+	TEST_CHECK(startScan(table, sc, NULL));
+	while((rc = next(sc, r)) == RC_OK)
+	{
+		i = getAttrInt(r, schema, 0);
+		ASSERT_TRUE(r->id.page == rids[i].page && r->id.slot == rids[i].slot, "scan reports home RID");
+		scanned++;
+	}
+	if (rc != RC_RM_NO_MORE_TUPLES)
+		TEST_CHECK(rc);
+	TEST_CHECK(closeScan(sc));
+	ASSERT_EQUALS_INT(numInserts, scanned, "scan sees every record once");
+
+	numPages = tablePages(table);
+	TEST_CHECK(deleteRecord(table, rids[0]));
+	ASSERT_ERROR(getRecord(table, rids[0], r), "deleted record is gone");
+
+	// no snapshot sees the deleted record any more, so its room is freed
+	// and the free-space map hands it to the next insert
+	setAttrInt(r, schema, 0, numInserts);
+	setAttrString(r, schema, 1, longText, sizeof(longText));
+	TEST_CHECK(insertRecord(table, r));
+	ASSERT_EQUALS_INT(numPages, tablePages(table), "insert reuses freed space");
+	TEST_CHECK(getRecord(table, r->id, r));
+	ASSERT_EQUALS_INT(numInserts, getAttrInt(r, schema, 0), "reinserted record readable");
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_v"));
+	TEST_CHECK(shutdownRecordManager());
+
+	freeRecord(r);
+	freeSchema(schema);
+	free(rids);
+	free(sc);
+	free(table);
+	TEST_DONE();
+}
+
+void
+testBulkInsert (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	int numInserts = 5000, batchSize = 1000, i, j;
+	Record **batch;
+	Record *r;
+	RID *rids;
+	Schema *schema;
+	testName = "test inserting records in batches";
+
+	schema = testSchema();
+	rids = (RID *) malloc(sizeof(RID) * numInserts);
+	batch = (Record **) malloc(sizeof(Record *) * batchSize);
+	for(j = 0; j < batchSize; j++)
+		TEST_CHECK(createRecord(&batch[j], schema));
+
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_b",schema));
+	TEST_CHECK(openTable(table, "test_table_b"));
+
+	for(i = 0; i < numInserts; i += batchSize)
+	{
+		for(j = 0; j < batchSize; j++)
+		{
+			setAttrInt(batch[j], schema, 0, i + j);
+			setAttrString(batch[j], schema, 1, "bulk", 4);
+			setAttrInt(batch[j], schema, 2, (i + j) % 7);
+		}
+		TEST_CHECK(insertRecords(table, batch, batchSize));
+		for(j = 0; j < batchSize; j++)
+			rids[i + j] = batch[j]->id;
+	}
+	ASSERT_EQUALS_INT(numInserts, getNumTuples(table), "tuple count updated per batch");
+
+	// consecutive records fill a page before moving on to the next one
+	for(i = 1; i < numInserts; i++)
+		ASSERT_TRUE(rids[i].page > rids[i - 1].page
+				|| (rids[i].page == rids[i - 1].page && rids[i].slot == rids[i - 1].slot + 1),
+				"records placed sequentially");
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(openTable(table, "test_table_b"));
+	ASSERT_TRUE(!((RM_TableMgmt *) table->mgmtData)->headerStale, "counters written back on close");
+	ASSERT_EQUALS_INT(numInserts, getNumTuples(table), "tuple count kept across reopen");
+
+	r = batch[0];
+	for(i = 0; i < numInserts; i++)
+	{
+		TEST_CHECK(getRecord(table, rids[i], r));
+		ASSERT_EQUALS_INT(i, getAttrInt(r, schema, 0), "first attr");
+		ASSERT_EQUALS_INT(i % 7, getAttrInt(r, schema, 2), "third attr");
+	}
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_b"));
+	TEST_CHECK(shutdownRecordManager());
+
+	for(j = 0; j < batchSize; j++)
+		freeRecord(batch[j]);
+	free(batch);
+	freeSchema(schema);
+	free(rids);
+	free(table);
+	TEST_DONE();
+}
+
+#define GC_THREADS 4
+#define GC_INSERTS 200
+
+typedef struct GroupCommitWork {
+	RM_TableData table;
+	Schema *schema;
+	RID rids[GC_INSERTS];
+	RC rc;
+} GroupCommitWork;
+
+static void *
+groupCommitWorker (void *arg)
+{
+	GroupCommitWork *work = (GroupCommitWork *) arg;
+	Record *r;
+	int i;
+
+	work->rc = createRecord(&r, work->schema);
+	for(i = 0; i < GC_INSERTS && work->rc == RC_OK; i++)
+	{
+		setAttrInt(r, work->schema, 0, i);
+		setAttrString(r, work->schema, 1, "gc", 2);
+		setAttrInt(r, work->schema, 2, -i);
+		work->rc = insertRecord(&work->table, r);
+		work->rids[i] = r->id;
+	}
+	freeRecord(r);
+	return NULL;
+}
+
+void
+testGroupCommit (void)
+{
+	char *names[GC_THREADS] = { "test_table_g0", "test_table_g1", "test_table_g2", "test_table_g3" };
+	GroupCommitWork *work = (GroupCommitWork *) calloc(GC_THREADS, sizeof(GroupCommitWork));
+	pthread_t threads[GC_THREADS];
+	LM_Statistics stats;
+	Schema *schema;
+	Record *r;
+	int t, i;
+	testName = "test concurrent commits share log flushes";
+
+	schema = testSchema();
+	TEST_CHECK(initRecordManager(NULL));
+	for(t = 0; t < GC_THREADS; t++)
+	{
+		TEST_CHECK(createTable(names[t], schema));
+		TEST_CHECK(openTable(&work[t].table, names[t]));
+		work[t].schema = schema;
+	}
+
+	// each thread works on its own table; only the log is shared
+	for(t = 0; t < GC_THREADS; t++)
+		pthread_create(&threads[t], NULL, groupCommitWorker, &work[t]);
+	for(t = 0; t < GC_THREADS; t++)
+		pthread_join(threads[t], NULL);
+
+	getLogStatistics(&stats);
+	ASSERT_TRUE(stats.numSyncs > 0, "commits are synced to the log");
+	ASSERT_TRUE(stats.numSyncs <= stats.numFlushRequests, "no more syncs than commits");
+	ASSERT_TRUE(getFlushedLSN() > NO_LSN, "log has a durable prefix");
+
+	TEST_CHECK(createRecord(&r, schema));
+	for(t = 0; t < GC_THREADS; t++)
+	{
+		TEST_CHECK(work[t].rc);
+		for(i = 0; i < GC_INSERTS; i++)
+		{
+			TEST_CHECK(getRecord(&work[t].table, work[t].rids[i], r));
+			ASSERT_EQUALS_INT(-i, getAttrInt(r, schema, 2), "record committed by its thread");
+		}
+		TEST_CHECK(closeTable(&work[t].table));
+		TEST_CHECK(deleteTable(names[t]));
+	}
+	TEST_CHECK(shutdownRecordManager());
+
+	freeRecord(r);
+	freeSchema(schema);
+	free(work);
+	TEST_DONE();
+}
+
+void
+testRecovery (void)
+{
+	char *file = "test_recovery.bin", *log = "test_recovery.wal";
+	char before[PAGE_SIZE], after[PAGE_SIZE], page[PAGE_SIZE];
+	int numPages = 300, i;
+	LM_RecoveryStatistics stats;
+	SM_FileHandle fh;
+	TxnId winner, loser;
+	LSN lsn = NO_LSN;
+	testName = "test recovery redoes committed and undoes uncommitted changes";
+
+	TEST_CHECK(initRecordManager(log));
+	TEST_CHECK(createPageFile(file));
+	logCreate(file);
+	memset(before, 0, PAGE_SIZE);
+
+	// committed changes that never reached the file
+	winner = newTxnId();
+	for(i = 1; i <= numPages; i++)
+	{
+		memcpy(after, before, PAGE_SIZE);
+		memcpy(after + 100, &i, sizeof(int));
+		lsn = logPageUpdate(winner, lsn, file, i, sizeof(LSN), PAGE_SIZE - sizeof(LSN), before, after);
+	}
+	TEST_CHECK(flushLog(logCommit(winner, lsn)));
+
+	// an uncommitted change whose page was written after its log record
+	memcpy(after, before, PAGE_SIZE);
+	memset(after + 200, 'u', 50);
+	loser = newTxnId();
+	lsn = logPageUpdate(loser, NO_LSN, file, numPages + 1, sizeof(LSN), PAGE_SIZE - sizeof(LSN), before, after);
+	TEST_CHECK(flushLog(lsn));
+	PAGE_LSN(after) = lsn;
+	TEST_CHECK(openPageFile(file, &fh));
+	TEST_CHECK(writeBlock(numPages + 1, &fh, after));
+	TEST_CHECK(closePageFile(&fh));
+
+	// crash: the log is closed without being emptied
+	TEST_CHECK(closeLog());
+	TEST_CHECK(openLog(log));
+	TEST_CHECK(recoverLog(&stats));
+	ASSERT_EQUALS_INT(numPages, (int) stats.numRedone, "committed pages redone");
+	ASSERT_EQUALS_INT(1, stats.numLosers, "one uncommitted transaction");
+	ASSERT_EQUALS_INT(1, (int) stats.numUndone, "its update undone");
+	ASSERT_TRUE(stats.numThreads >= 1, "redo ran");
+
+	TEST_CHECK(openPageFile(file, &fh));
+	for(i = 1; i <= numPages; i++)
+	{
+		int value;
+		TEST_CHECK(readBlock(i, &fh, page));
+		memcpy(&value, page + 100, sizeof(int));
+		ASSERT_EQUALS_INT(i, value, "redone page content");
+		ASSERT_TRUE(PAGE_LSN(page) != NO_LSN, "redone page carries its LSN");
+	}
+	TEST_CHECK(readBlock(numPages + 1, &fh, page));
+	ASSERT_TRUE(memcmp(page + sizeof(LSN), before + sizeof(LSN), PAGE_SIZE - sizeof(LSN)) == 0, "uncommitted change rolled back");
+	TEST_CHECK(closePageFile(&fh));
+
+	// recovery leaves an empty log, so running it again changes nothing
+	TEST_CHECK(recoverLog(&stats));
+	ASSERT_EQUALS_INT(0, (int) stats.numRecords, "log emptied by recovery");
+
+	TEST_CHECK(shutdownRecordManager());
+	TEST_CHECK(destroyPageFile(file));
+	remove(log);
+	TEST_DONE();
+}
+
+static long
+logLength (void)
+{
+	char *records;
+	size_t length;
+
+	if (readLog(&records, &length) != RC_OK)
+		return -1;
+	free(records);
+	return (long) length;
+}
+
+// write hook that loses every page, as if the process died before writing
+static RC
+dropWrite (PageNumber pageNum, char *data)
+{
+	return RC_WRITE_FAILED;
+}
+
+void
+testCheckpoint (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	char *log = "test_checkpoint.wal";
+	int numInserts = 200, numLate = 10, numBackground = 2000, i, waited;
+	long before;
+	LM_RecoveryStatistics stats;
+	Record *r;
+	RID *rids;
+	Schema *schema;
+	testName = "test checkpoints release the log and bound recovery";
+
+	schema = testSchema();
+	rids = (RID *) malloc(sizeof(RID) * (numInserts + numLate));
+	TEST_CHECK(createRecord(&r, schema));
+
+	TEST_CHECK(initRecordManager(log));
+	setCheckpointInterval(0);
+	TEST_CHECK(createTable("test_table_ck", schema));
+	TEST_CHECK(openTable(table, "test_table_ck"));
+
+	for(i = 0; i < numInserts + numLate; i++)
+	{
+		if (i == numInserts)
+		{
+			before = logLength();
+			TEST_CHECK(checkpoint());
+			ASSERT_TRUE(logLength() < before / 10, "checkpoint released the log");
+		}
+		setAttrInt(r, schema, 0, i);
+		setAttrString(r, schema, 1, "ckpt", 4);
+		setAttrInt(r, schema, 2, i % 5);
+		TEST_CHECK(insertRecords(table, &r, 1));
+		rids[i] = r->id;
+	}
+
+	// crash: the pages dirtied after the checkpoint never reach the file
+	setWriteHook(&((RM_TableMgmt *) table->mgmtData)->bm, dropWrite);
+	closeTable(table);
+	TEST_CHECK(closeLog());
+	TEST_CHECK(openLog(log));
+	TEST_CHECK(recoverLog(&stats));
+	// each late insert logs its page change, its row change and its commit
+	ASSERT_TRUE(stats.numRecords < 4 * numLate, "recovery starts at the checkpoint");
+	ASSERT_TRUE(stats.numRedone > 0, "late inserts redone");
+
+	TEST_CHECK(openTable(table, "test_table_ck"));
+	ASSERT_EQUALS_INT(numInserts + numLate, getNumTuples(table), "tuple count recovered");
+	for(i = 0; i < numInserts + numLate; i++)
+	{
+		TEST_CHECK(getRecord(table, rids[i], r));
+		ASSERT_EQUALS_INT(i, getAttrInt(r, schema, 0), "record survives");
+	}
+
+	// the background checkpointer keeps the log near its interval
+	setCheckpointInterval(32 * 1024);
+	for(i = 0; i < numBackground; i++)
+	{
+		setAttrInt(r, schema, 0, i);
+		TEST_CHECK(insertRecords(table, &r, 1));
+	}
+	for(waited = 0; waited < 200 && logLength() >= 64 * 1024; waited++)
+		usleep(10000);
+	ASSERT_TRUE(logLength() < 64 * 1024, "log released by background checkpoints");
+	setCheckpointInterval(16L * 1024 * 1024);
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_ck"));
+	TEST_CHECK(shutdownRecordManager());
+	remove(log);
+
+	freeRecord(r);
+	freeSchema(schema);
+	free(rids);
+	free(table);
+	TEST_DONE();
+}
+
+#define CO_THREADS 4
+#define CO_ROWS 40
+#define CO_ROUNDS 50
+
+typedef struct CommitOrderWork {
+	RM_TableData *table;
+	Schema *schema;
+	RID *rids;
+	int thread;
+	RC rc;
+} CommitOrderWork;
+
+// updates the rows of one thread, all on the same pages as the others'
+static void *
+commitOrderWorker (void *arg)
+{
+	CommitOrderWork *work = (CommitOrderWork *) arg;
+	Record *r;
+	int round, i;
+
+	work->rc = createRecord(&r, work->schema);
+	for(round = 1; round <= CO_ROUNDS && work->rc == RC_OK; round++)
+		for(i = work->thread; i < CO_ROWS && work->rc == RC_OK; i += CO_THREADS)
+		{
+			r->id = work->rids[i];
+			setAttrInt(r, work->schema, 0, i);
+			setAttrString(r, work->schema, 1, "ordr", 4);
+			setAttrInt(r, work->schema, 2, round);
+			work->rc = updateRecord(work->table, r);
+		}
+	freeRecord(r);
+	return NULL;
+}
+
+// Every prefix of the log is a crash recovery has to survive. Returns
+// whether, in all of them, an update of a page of file by one op only
+// follows the commit of the op that updated the page before it, so that
+// undoing a loser never restores a page over a winner's change.
+static bool
+commitsPrecedeOverwrites (const char *file)
+{
+	TxnId writer[1024];
+	bool committed[1024], ordered = true;
+	LM_RecordHeader header;
+	char *records;
+	size_t length, offset;
+	int p;
+
+	if (readLog(&records, &length) != RC_OK)
+		return false;
+	memset(writer, 0, sizeof(writer));
+	for(offset = 0; offset + sizeof(LM_RecordHeader) <= length; offset += header.length)
+	{
+		memcpy(&header, records + offset, sizeof(LM_RecordHeader));
+		if (header.length < sizeof(LM_RecordHeader))
+			break;
+		if (header.type == LOG_COMMIT)
+		{
+			for(p = 0; p < 1024; p++)
+				if (writer[p] == header.xid)
+					committed[p] = true;
+			continue;
+		}
+		if (header.type != LOG_UPDATE || header.pageNum < 0 || header.pageNum >= 1024
+				|| header.fileNameLength != strlen(file)
+				|| memcmp(records + offset + sizeof(LM_RecordHeader), file, header.fileNameLength) != 0)
+			continue;
+		p = header.pageNum;
+		if (writer[p] != 0 && writer[p] != header.xid && !committed[p])
+			ordered = false;
+		if (writer[p] != header.xid)
+			committed[p] = false;
+		writer[p] = header.xid;
+	}
+	free(records);
+	return ordered;
+}
+
+void
+testCommitOrder (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	CommitOrderWork work[CO_THREADS];
+	pthread_t threads[CO_THREADS];
+	char *log = "test_commit_order.wal";
+	LM_RecoveryStatistics stats;
+	RID rids[CO_ROWS];
+	Record *r;
+	Schema *schema;
+	bool correct;
+	int t, i;
+	testName = "test ops commit before others change their pages";
+
+	schema = testSchema();
+	TEST_CHECK(createRecord(&r, schema));
+	TEST_CHECK(initRecordManager(log));
+	setCheckpointInterval(0);
+	TEST_CHECK(createTable("test_table_co", schema));
+	TEST_CHECK(openTable(table, "test_table_co"));
+	for(i = 0; i < CO_ROWS; i++)
+	{
+		setAttrInt(r, schema, 0, i);
+		setAttrString(r, schema, 1, "ordr", 4);
+		setAttrInt(r, schema, 2, 0);
+		TEST_CHECK(insertRecords(table, &r, 1));
+		rids[i] = r->id;
+	}
+
+	for(t = 0; t < CO_THREADS; t++)
+	{
+		work[t].table = table;
+		work[t].schema = schema;
+		work[t].rids = rids;
+		work[t].thread = t;
+		pthread_create(&threads[t], NULL, commitOrderWorker, &work[t]);
+	}
+	for(t = 0; t < CO_THREADS; t++)
+	{
+		pthread_join(threads[t], NULL);
+		TEST_CHECK(work[t].rc);
+	}
+	ASSERT_TRUE(commitsPrecedeOverwrites(((RM_TableMgmt *) table->mgmtData)->bm.pageFile),
+			"no page is changed between another op's change and its commit");
+
+	// crash: no page reaches the file, so recovery redoes every update
+	setWriteHook(&((RM_TableMgmt *) table->mgmtData)->bm, dropWrite);
+	closeTable(table);
+	TEST_CHECK(closeLog());
+	TEST_CHECK(openLog(log));
+	TEST_CHECK(recoverLog(&stats));
+	ASSERT_TRUE(stats.numRedone > 0, "updates redone");
+
+	TEST_CHECK(openTable(table, "test_table_co"));
+	correct = true;
+	for(i = 0; i < CO_ROWS; i++)
+	{
+		TEST_CHECK(getRecord(table, rids[i], r));
+		correct = correct && getAttrInt(r, schema, 0) == i && getAttrInt(r, schema, 2) == CO_ROUNDS;
+	}
+	ASSERT_TRUE(correct, "every committed update survives the crash");
+	setCheckpointInterval(16L * 1024 * 1024);
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_co"));
+	TEST_CHECK(shutdownRecordManager());
+	remove(log);
+
+	freeRecord(r);
+	freeSchema(schema);
+	free(table);
+	TEST_DONE();
+}
+
+typedef struct TxnWork {
+	RM_TableData *table;
+	Schema *schema;
+	RID rid;
+	int seen;      // attribute a of the version the thread read
+	RC updateRc;
+	RC deleteRc;
+	RM_Transaction *txn;
+} TxnWork;
+
+// reads and then tries to change a record without a transaction of its own
+static void *
+conflictWorker (void *arg)
+{
+	TxnWork *work = (TxnWork *) arg;
+	Record *r;
+
+	createRecord(&r, work->schema);
+	work->seen = (getRecord(work->table, work->rid, r) == RC_OK) ? getAttrInt(r, work->schema, 0) : -1;
+	setAttrInt(r, work->schema, 0, -2);
+	r->id = work->rid;
+	work->updateRc = updateRecord(work->table, r);
+	work->deleteRc = deleteRecord(work->table, work->rid);
+	freeRecord(r);
+	return NULL;
+}
+
+// inserts a record in a transaction and dies before ending it
+static void *
+loserWorker (void *arg)
+{
+	TxnWork *work = (TxnWork *) arg;
+	Record *r;
+
+	createRecord(&r, work->schema);
+	setAttrInt(r, work->schema, 0, -3);
+	beginTransaction();
+	work->updateRc = insertRecord(work->table, r);
+	work->rid = r->id;
+	work->txn = getCurrentTransaction();
+	freeRecord(r);
+	return NULL;
+}
+
+void
+testTransactions (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	RM_ScanHandle *sc = (RM_ScanHandle *) malloc(sizeof(RM_ScanHandle));
+	char *log = "test_transactions.wal";
+	int numInserts = 50, i, scanned = 0, sum = 0, rc;
+	LM_RecoveryStatistics stats;
+	pthread_t thread;
+	TxnWork work;
+	Record *r;
+	RID rids[50], extra;
+	Schema *schema;
+	testName = "test transactions see snapshots and roll back on abort";
+
+	schema = testSchema();
+	TEST_CHECK(createRecord(&r, schema));
+	TEST_CHECK(initRecordManager(log));
+	TEST_CHECK(createTable("test_table_tx", schema));
+	TEST_CHECK(openTable(table, "test_table_tx"));
+	for(i = 0; i < numInserts; i++)
+	{
+		setAttrInt(r, schema, 0, i);
+		setAttrString(r, schema, 1, "txn", 3);
+		setAttrInt(r, schema, 2, 0);
+		TEST_CHECK(insertRecord(table, r));
+		rids[i] = r->id;
+	}
+
+	ASSERT_EQUALS_INT(RC_RM_NO_TRANSACTION, commitTransaction(), "no transaction to commit");
+	TEST_CHECK(beginTransaction());
+	ASSERT_EQUALS_INT(RC_RM_TRANSACTION_ACTIVE, beginTransaction(), "one transaction per thread");
+	TEST_CHECK(commitTransaction());
+
+	// a scan keeps the snapshot it started with
+	TEST_CHECK(startScan(table, sc, NULL));
+	TEST_CHECK(deleteRecord(table, rids[0]));
+	setAttrInt(r, schema, 0, 1000);
+	r->id = rids[1];
+	TEST_CHECK(updateRecord(table, r));
+	TEST_CHECK(insertRecord(table, r));
+	extra = r->id;
+	while((rc = next(sc, r)) == RC_OK)
+	{
+		sum += getAttrInt(r, schema, 0);
+		scanned++;
+	}
+	if (rc != RC_RM_NO_MORE_TUPLES)
+		TEST_CHECK(rc);
+	TEST_CHECK(closeScan(sc));
+	ASSERT_EQUALS_INT(numInserts, scanned, "scan ignores later inserts and deletes");
+	ASSERT_EQUALS_INT(numInserts * (numInserts - 1) / 2, sum, "scan reads the versions it started with");
+	ASSERT_ERROR(getRecord(table, rids[0], r), "later reads see the delete");
+	TEST_CHECK(getRecord(table, rids[1], r));
+	ASSERT_EQUALS_INT(1000, getAttrInt(r, schema, 0), "later reads see the update");
+	TEST_CHECK(deleteRecord(table, extra));
+
+	// uncommitted changes are hidden from others, whose writes wait for them
+	TEST_CHECK(beginTransaction());
+	setAttrInt(r, schema, 0, 2000);
+	r->id = rids[2];
+	TEST_CHECK(updateRecord(table, r));
+	TEST_CHECK(getRecord(table, rids[2], r));
+	ASSERT_EQUALS_INT(2000, getAttrInt(r, schema, 0), "transaction reads its own update");
+	work.table = table;
+	work.schema = schema;
+	work.rid = rids[2];
+	setLockTimeout(50);
+	pthread_create(&thread, NULL, conflictWorker, &work);
+	pthread_join(thread, NULL);
+	setLockTimeout(10000);
+	ASSERT_EQUALS_INT(2, work.seen, "others read the committed version");
+	ASSERT_EQUALS_INT(RC_LK_TIMEOUT, work.updateRc, "concurrent update waits");
+	ASSERT_EQUALS_INT(RC_LK_TIMEOUT, work.deleteRc, "concurrent delete waits");
+	TEST_CHECK(commitTransaction());
+	pthread_create(&thread, NULL, conflictWorker, &work);
+	pthread_join(thread, NULL);
+	ASSERT_EQUALS_INT(2000, work.seen, "committed update visible");
+	TEST_CHECK(work.updateRc);
+	TEST_CHECK(work.deleteRc);
+
+	// a record changed since the transaction began cannot be changed by it
+	TEST_CHECK(beginTransaction());
+	work.rid = rids[5];
+	pthread_create(&thread, NULL, conflictWorker, &work);
+	pthread_join(thread, NULL);
+	TEST_CHECK(work.deleteRc);
+	r->id = rids[5];
+	rc = updateRecord(table, r);
+	ASSERT_EQUALS_INT(RC_RM_WRITE_CONFLICT, rc, "write conflict");
+	TEST_CHECK(abortTransaction());
+
+	// abort restores every change of the transaction
+	TEST_CHECK(beginTransaction());
+	setAttrInt(r, schema, 0, 3000);
+	TEST_CHECK(insertRecord(table, r));
+	extra = r->id;
+	r->id = rids[3];
+	TEST_CHECK(updateRecord(table, r));
+	TEST_CHECK(deleteRecord(table, rids[4]));
+	ASSERT_ERROR(getRecord(table, rids[4], r), "transaction sees its own delete");
+	TEST_CHECK(abortTransaction());
+	ASSERT_EQUALS_INT(numInserts - 3, getNumTuples(table), "tuple count restored");
+	ASSERT_ERROR(getRecord(table, extra, r), "aborted insert removed");
+	TEST_CHECK(getRecord(table, rids[3], r));
+	ASSERT_EQUALS_INT(3, getAttrInt(r, schema, 0), "aborted update rolled back");
+	TEST_CHECK(getRecord(table, rids[4], r));
+	ASSERT_EQUALS_INT(4, getAttrInt(r, schema, 0), "aborted delete rolled back");
+
+	// crash with a transaction still running: recovery rolls it back
+	pthread_create(&thread, NULL, loserWorker, &work);
+	pthread_join(thread, NULL);
+	TEST_CHECK(work.updateRc);
+	setAttrInt(r, schema, 0, 4000);
+	TEST_CHECK(insertRecord(table, r));
+	extra = r->id;
+	setWriteHook(&((RM_TableMgmt *) table->mgmtData)->bm, dropWrite);
+	closeTable(table);
+	TEST_CHECK(closeLog());
+	endTransaction(work.txn);
+	free(work.txn);
+	TEST_CHECK(openLog(log));
+	TEST_CHECK(recoverLog(&stats));
+	ASSERT_TRUE(stats.numRowsUndone > 0, "unfinished insert undone");
+
+	TEST_CHECK(openTable(table, "test_table_tx"));
+	ASSERT_EQUALS_INT(numInserts - 2, getNumTuples(table), "tuple count recovered");
+	ASSERT_ERROR(getRecord(table, work.rid, r), "unfinished insert gone");
+	TEST_CHECK(getRecord(table, extra, r));
+	ASSERT_EQUALS_INT(4000, getAttrInt(r, schema, 0), "committed insert survives");
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_tx"));
+	TEST_CHECK(shutdownRecordManager());
+	remove(log);
+
+	freeRecord(r);
+	freeSchema(schema);
+	free(table);
+	free(sc);
+	TEST_DONE();
+}
+
+#define LOCK_THREADS 8
+#define LOCK_ROWS 25
+#define LOCK_ROUNDS 10
+
+typedef struct LockWork {
+	RM_TableData *table;
+	Schema *schema;
+	RID rids[LOCK_ROWS];
+	int numRids;
+	int rounds;
+	int value;
+	int autocommit; // each update commits on its own
+	RC rc;
+} LockWork;
+
+// sets attribute c of its records to its value, in one transaction per
+// round, and aborts a round that fails
+static void *
+lockWorker (void *arg)
+{
+	LockWork *work = (LockWork *) arg;
+	Record *r;
+	int round, i;
+
+	createRecord(&r, work->schema);
+	for(round = 0; round < work->rounds && work->rc == RC_OK; round++)
+	{
+		if (!work->autocommit)
+			beginTransaction();
+		for(i = 0; i < work->numRids && work->rc == RC_OK; i++)
+		{
+			work->rc = getRecord(work->table, work->rids[i], r);
+			setAttrInt(r, work->schema, 2, work->value);
+			if (work->rc == RC_OK)
+				work->rc = updateRecord(work->table, r);
+		}
+		if (work->autocommit)
+			continue;
+		if (work->rc == RC_OK)
+			work->rc = commitTransaction();
+		else
+			abortTransaction();
+	}
+	freeRecord(r);
+	return NULL;
+}
+
+// waits until some request beyond the given count has had to wait
+static void
+awaitLockWait (long numWaits)
+{
+	LK_Statistics stats;
+	int i;
+
+	for(i = 0; i < 1000; i++)
+	{
+		getLockStatistics(&stats);
+		if (stats.numWaits > numWaits)
+			return;
+		usleep(1000);
+	}
+}
+
+void
+testLocks (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	LockWork *work = (LockWork *) calloc(LOCK_THREADS, sizeof(LockWork));
+	pthread_t threads[LOCK_THREADS];
+	char *log = "test_locks.wal";
+	LK_Statistics stats, last;
+	TxnId t1, t2;
+	Schema *schema;
+	Record *r;
+	RID a, b;
+	int t, i;
+	RC rc;
+	testName = "test row locks let writers of disjoint rows run together";
+
+	schema = testSchema();
+	TEST_CHECK(createRecord(&r, schema));
+	TEST_CHECK(initRecordManager(log));
+	TEST_CHECK(createTable("test_table_lk", schema));
+	TEST_CHECK(openTable(table, "test_table_lk"));
+
+	// modes: intention locks share the table, S and X exclude writers
+	setLockTimeout(20);
+	t1 = newTxnId();
+	t2 = newTxnId();
+	a.page = 2;
+	a.slot = 0;
+	TEST_CHECK(lockTable(t1, "test_table_lk", LOCK_IX));
+	TEST_CHECK(lockTable(t2, "test_table_lk", LOCK_IS));
+	TEST_CHECK(lockRecord(t1, "test_table_lk", a, LOCK_X));
+	rc = lockTable(t2, "test_table_lk", LOCK_S);
+	ASSERT_EQUALS_INT(RC_LK_TIMEOUT, rc, "S waits for IX");
+	rc = lockRecord(t2, "test_table_lk", a, LOCK_S);
+	ASSERT_EQUALS_INT(RC_LK_TIMEOUT, rc, "S waits for X");
+	unlockAll(t1);
+	TEST_CHECK(lockTable(t2, "test_table_lk", LOCK_S));
+	TEST_CHECK(lockRecord(t2, "test_table_lk", a, LOCK_S));
+	unlockAll(t2);
+	setLockTimeout(10000);
+
+	for(t = 0; t < LOCK_THREADS; t++)
+	{
+		work[t].table = table;
+		work[t].schema = schema;
+		work[t].numRids = LOCK_ROWS;
+		work[t].rounds = LOCK_ROUNDS;
+		work[t].value = t + 1;
+		for(i = 0; i < LOCK_ROWS; i++)
+		{
+			setAttrInt(r, schema, 0, t * LOCK_ROWS + i);
+			setAttrString(r, schema, 1, "lock", 4);
+			setAttrInt(r, schema, 2, 0);
+			TEST_CHECK(insertRecord(table, r));
+			work[t].rids[i] = r->id;
+		}
+	}
+
+	// every thread updates its own rows of the one table at the same time
+	getLockStatistics(&last);
+	for(t = 0; t < LOCK_THREADS; t++)
+		pthread_create(&threads[t], NULL, lockWorker, &work[t]);
+	for(t = 0; t < LOCK_THREADS; t++)
+		pthread_join(threads[t], NULL);
+	getLockStatistics(&stats);
+	ASSERT_EQUALS_INT(0, (int) (stats.numDeadlocks - last.numDeadlocks), "disjoint rows never deadlock");
+	for(t = 0; t < LOCK_THREADS; t++)
+	{
+		TEST_CHECK(work[t].rc);
+		for(i = 0; i < LOCK_ROWS; i++)
+		{
+			TEST_CHECK(getRecord(table, work[t].rids[i], r));
+			ASSERT_EQUALS_INT(t + 1, getAttrInt(r, schema, 2), "thread's update committed");
+		}
+	}
+
+	// a writer of a locked row waits for its owner to commit
+	a = work[0].rids[0];
+	b = work[1].rids[0];
+	work[2].autocommit = 1;
+	work[2].numRids = 1;
+	work[2].rids[0] = a;
+	work[2].rounds = 1;
+	work[2].value = 100;
+	TEST_CHECK(beginTransaction());
+	TEST_CHECK(getRecord(table, a, r));
+	setAttrInt(r, schema, 2, 50);
+	TEST_CHECK(updateRecord(table, r));
+	getLockStatistics(&last);
+	pthread_create(&threads[2], NULL, lockWorker, &work[2]);
+	awaitLockWait(last.numWaits);
+	TEST_CHECK(commitTransaction());
+	pthread_join(threads[2], NULL);
+	TEST_CHECK(work[2].rc);
+	TEST_CHECK(getRecord(table, a, r));
+	ASSERT_EQUALS_INT(100, getAttrInt(r, schema, 2), "waiting update applied after commit");
+
+	// two transactions each waiting for the other's row: the one closing
+	// the cycle is refused, and the other goes on once it aborts
+	work[3].numRids = 2;
+	work[3].rids[0] = b;
+	work[3].rids[1] = a;
+	work[3].rounds = 1;
+	work[3].value = 200;
+	TEST_CHECK(beginTransaction());
+	TEST_CHECK(getRecord(table, a, r));
+	setAttrInt(r, schema, 2, 150);
+	TEST_CHECK(updateRecord(table, r));
+	getLockStatistics(&last);
+	pthread_create(&threads[3], NULL, lockWorker, &work[3]);
+	awaitLockWait(last.numWaits);
+	TEST_CHECK(getRecord(table, b, r));
+	rc = updateRecord(table, r);
+	ASSERT_EQUALS_INT(RC_LK_DEADLOCK, rc, "deadlock detected");
+	TEST_CHECK(abortTransaction());
+	pthread_join(threads[3], NULL);
+	TEST_CHECK(work[3].rc);
+	getLockStatistics(&stats);
+	ASSERT_EQUALS_INT(1, (int) (stats.numDeadlocks - last.numDeadlocks), "one deadlock");
+	TEST_CHECK(getRecord(table, a, r));
+	ASSERT_EQUALS_INT(200, getAttrInt(r, schema, 2), "survivor's update committed");
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_lk"));
+	TEST_CHECK(shutdownRecordManager());
+	remove(log);
+
+	freeRecord(r);
+	freeSchema(schema);
+	free(work);
+	free(table);
+	TEST_DONE();
+}
+
+void
+testTableSchema (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	Schema *schema, *big;
+	char **names;
+	DataType *dt;
+	int *sizes, *keys;
+	int numBig = 300, i, rc;
+	testName = "test the table header keeps the whole schema";
+
+	schema = testSchema();
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_s", schema));
+
+	// each open decodes the schema kept in the header, names and keys included
+	for(i = 0; i < 2; i++)
+	{
+		TEST_CHECK(openTable(table, "test_table_s"));
+		ASSERT_TRUE(table->schema != NULL, "openTable sets the schema");
+		ASSERT_EQUALS_INT(schema->numAttr, table->schema->numAttr, "number of attributes");
+		ASSERT_EQUALS_STRING("a", table->schema->attrNames[0], "first name");
+		ASSERT_EQUALS_STRING("c", table->schema->attrNames[2], "last name");
+		ASSERT_EQUALS_INT(DT_STRING, table->schema->dataTypes[1], "data type");
+		ASSERT_EQUALS_INT(4, table->schema->typeLength[1], "type length");
+		ASSERT_EQUALS_INT(1, table->schema->keySize, "key size");
+		ASSERT_EQUALS_INT(0, table->schema->keyAttrs[0], "key attribute");
+		ASSERT_EQUALS_INT(getRecordSize(schema), getRecordSize(table->schema), "record size");
+		ASSERT_EQUALS_INT(schema->attrOffsets[2], table->schema->attrOffsets[2], "attribute offset");
+		TEST_CHECK(closeTable(table));
+		ASSERT_TRUE(table->schema == NULL, "closeTable drops the schema");
+	}
+	TEST_CHECK(deleteTable("test_table_s"));
+
+	// a schema whose names do not fit the header page is refused
+	names = (char **) malloc(sizeof(char *) * numBig);
+	dt = (DataType *) malloc(sizeof(DataType) * numBig);
+	sizes = (int *) malloc(sizeof(int) * numBig);
+	keys = (int *) malloc(sizeof(int));
+	for(i = 0; i < numBig; i++)
+	{
+		names[i] = "a_rather_long_attribute_name";
+		dt[i] = DT_INT;
+		sizes[i] = 0;
+	}
+	keys[0] = 0;
+	big = createSchema(numBig, names, dt, sizes, 1, keys);
+	rc = createTable("test_table_s", big);
+	ASSERT_EQUALS_INT(RC_RM_SCHEMA_TOO_LARGE, rc, "schema too large for the header");
+	TEST_CHECK(shutdownRecordManager());
+
+	freeSchema(big);
+	free(names);
+	free(dt);
+	free(sizes);
+	free(keys);
+	freeSchema(schema);
+	free(table);
+	TEST_DONE();
+}
+
+void
+testVacuum (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	int numInserts = 3000, batchSize = 1000, numKept = 200, numPages, i, j, rc;
+	RM_Snapshot snapshot;
+	RM_PageHeader *hdr;
+	BM_PageHandle page;
+	struct stat st;
+	Record **batch;
+	Record *r;
+	RID *rids;
+	Schema *schema;
+	testName = "test vacuuming deleted records and empty pages";
+
+	schema = testSchema();
+	rids = (RID *) malloc(sizeof(RID) * numInserts);
+	batch = (Record **) malloc(sizeof(Record *) * batchSize);
+	for(j = 0; j < batchSize; j++)
+		TEST_CHECK(createRecord(&batch[j], schema));
+
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_v", schema));
+	TEST_CHECK(openTable(table, "test_table_v"));
+	for(i = 0; i < numInserts; i += batchSize)
+	{
+		for(j = 0; j < batchSize; j++)
+		{
+			setAttrInt(batch[j], schema, 0, i + j);
+			setAttrString(batch[j], schema, 1, "vac", 3);
+			setAttrInt(batch[j], schema, 2, 0);
+		}
+		TEST_CHECK(insertRecords(table, batch, batchSize));
+		for(j = 0; j < batchSize; j++)
+			rids[i + j] = batch[j]->id;
+	}
+	numPages = tablePages(table);
+
+	// a snapshot taken before the deletes keeps every record it sees
+	takeSnapshot(&snapshot, NO_TXN);
+	for(i = 0; i < numInserts; i++)
+		if (i >= numKept || i % 2 == 0)
+			TEST_CHECK(deleteRecord(table, rids[i]));
+	TEST_CHECK(vacuumTable(table));
+	ASSERT_EQUALS_INT(numPages, tablePages(table), "versions still seen are kept");
+	freeSnapshot(&snapshot);
+
+	TEST_CHECK(vacuumTable(table));
+	ASSERT_TRUE(tablePages(table) < numPages, "empty trailing pages truncated");
+	ASSERT_TRUE(stat("test_table_v", &st) == 0 && st.st_size <= (off_t) tablePages(table) * PAGE_SIZE,
+			"page file shrinks");
+	ASSERT_EQUALS_INT(numKept / 2, getNumTuples(table), "tuple count unchanged");
+
+	TEST_CHECK(pinPage(&((RM_TableMgmt *) table->mgmtData)->bm, &page, rids[1].page));
+	hdr = PAGE_HEADER(page.data);
+	ASSERT_EQUALS_INT(hdr->dataStart - (int) (sizeof(RM_PageHeader) + hdr->numSlots * sizeof(RM_Slot)),
+			hdr->freeBytes, "page compacted");
+	TEST_CHECK(unpinPage(&((RM_TableMgmt *) table->mgmtData)->bm, &page));
+
+	r = batch[0];
+	for(i = 0; i < numKept; i++)
+	{
+		rc = getRecord(table, rids[i], r);
+		if (i % 2 == 0)
+			ASSERT_EQUALS_INT(RC_RM_NO_SUCH_TUPLE, rc, "deleted record removed");
+		else
+			ASSERT_EQUALS_INT(i, getAttrInt(r, schema, 0), "kept record intact");
+	}
+
+	// freed space is reused before the table grows again
+	numPages = tablePages(table);
+	TEST_CHECK(insertRecords(table, batch, 50));
+	ASSERT_EQUALS_INT(numPages, tablePages(table), "insert reuses vacuumed space");
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(openTable(table, "test_table_v"));
+	ASSERT_EQUALS_INT(numKept / 2 + 50, getNumTuples(table), "tuple count kept across reopen");
+	ASSERT_EQUALS_INT(numPages, tablePages(table), "page count kept across reopen");
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_v"));
+	TEST_CHECK(shutdownRecordManager());
+
+	for(j = 0; j < batchSize; j++)
+		freeRecord(batch[j]);
+	free(batch);
+	freeSchema(schema);
+	free(rids);
+	free(table);
+	TEST_DONE();
+}
+
+// fills buf with a string of the given length that differs for each seed
+static void
+longString (char *buf, int length, int seed)
+{
+	int i;
+
+	for(i = 0; i < length; i++)
+		buf[i] = 'a' + (seed + i) % 26;
+	buf[length] = '\0';
+}
+
+void
+testToast (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	char *names[] = { "id", "text", "n" };
+	DataType dt[] = { DT_INT, DT_STRING, DT_INT };
+	int sizes[] = { 0, 10000, 0 };
+	int keys[] = { 0 };
+	int numInserts = 20, numPages, length, i, rc;
+	BM_PageHandle page;
+	char *text, *expected;
+	Schema *schema;
+	Record *r, *stale;
+	RID rids[20];
+	Value *v;
+	testName = "test long strings stored out of line";
+
+	schema = createSchema(3, names, dt, sizes, 1, keys);
+	text = (char *) malloc(sizes[1] + 1);
+	expected = (char *) malloc(sizes[1] + 1);
+	TEST_CHECK(createRecord(&r, schema));
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_t", schema));
+	TEST_CHECK(openTable(table, "test_table_t"));
+	numPages = tablePages(table);
+
+	for(i = 0; i < numInserts; i++)
+	{
+		// every other value is short enough to stay in the tuple
+		longString(text, (i % 2 == 0) ? 9000 : 100, i);
+		setAttrInt(r, schema, 0, i);
+		setAttrString(r, schema, 1, text, strlen(text));
+		setAttrInt(r, schema, 2, 0);
+		TEST_CHECK(insertRecord(table, r));
+		rids[i] = r->id;
+	}
+	TEST_CHECK(pinPage(&((RM_TableMgmt *) table->mgmtData)->bm, &page, rids[0].page));
+	ASSERT_TRUE(pageGetTuple(page.data, rids[0].slot, &length, NULL) != NULL && length < TOAST_THRESHOLD,
+			"tuple keeps only a pointer");
+	TEST_CHECK(unpinPage(&((RM_TableMgmt *) table->mgmtData)->bm, &page));
+
+	// getRecord leaves the value where it is until getAttr asks for it
+	TEST_CHECK(getRecord(table, rids[0], r));
+	ASSERT_TRUE(r->data[schema->attrOffsets[1]] == '\0' && r->data[schema->attrOffsets[1] + 1] == TOAST_REF_MAGIC,
+			"value not fetched by getRecord");
+	TEST_CHECK(getAttr(r, schema, 1, &v));
+	longString(expected, 9000, 0);
+	ASSERT_EQUALS_STRING(expected, v->v.stringV, "value fetched by getAttr");
+	free(v->v.stringV);
+	free(v);
+
+	// updating another attribute keeps the long one
+	TEST_CHECK(getRecord(table, rids[2], r));
+	setAttrInt(r, schema, 2, 7);
+	TEST_CHECK(updateRecord(table, r));
+	TEST_CHECK(getRecord(table, rids[2], r));
+	ASSERT_EQUALS_INT(7, getAttrInt(r, schema, 2), "updated attribute");
+	TEST_CHECK(getAttr(r, schema, 1, &v));
+	longString(expected, 9000, 2);
+	ASSERT_EQUALS_STRING(expected, v->v.stringV, "long value kept across update");
+	free(v->v.stringV);
+	free(v);
+
+	// an aborted update restores the value it replaced
+	TEST_CHECK(beginTransaction());
+	longString(text, 8000, 99);
+	setAttrString(r, schema, 1, text, strlen(text));
+	TEST_CHECK(updateRecord(table, r));
+	TEST_CHECK(abortTransaction());
+	TEST_CHECK(getRecord(table, rids[2], r));
+	TEST_CHECK(getAttr(r, schema, 1, &v));
+	ASSERT_EQUALS_STRING(expected, v->v.stringV, "aborted update rolled back");
+	free(v->v.stringV);
+	free(v);
+
+	// deleting the records frees their chunks, so the table shrinks back
+	for(i = 0; i < numInserts; i++)
+		TEST_CHECK(deleteRecord(table, rids[i]));
+	TEST_CHECK(vacuumTable(table));
+	ASSERT_EQUALS_INT(numPages, tablePages(table), "chunks freed with their records");
+
+	// a reference outlives neither its table nor its value
+	setAttrString(r, schema, 1, text, strlen(text));
+	TEST_CHECK(insertRecord(table, r));
+	TEST_CHECK(getRecord(table, r->id, r));
+	TEST_CHECK(closeTable(table));
+	rc = getAttr(r, schema, 1, &v);
+	ASSERT_EQUALS_INT(RC_RM_NO_SUCH_TUPLE, rc, "table closed");
+	ASSERT_TRUE(r->data[schema->attrOffsets[1] + 1] == TOAST_REF_MAGIC, "reference kept");
+
+	// reopened, the table is found again, so updating another attribute keeps the value
+	TEST_CHECK(openTable(table, "test_table_t"));
+	setAttrInt(r, schema, 2, 8);
+	TEST_CHECK(updateRecord(table, r));
+	TEST_CHECK(getRecord(table, r->id, r));
+	ASSERT_EQUALS_INT(8, getAttrInt(r, schema, 2), "updated after reopening");
+	TEST_CHECK(getAttr(r, schema, 1, &v));
+	ASSERT_EQUALS_STRING(text, v->v.stringV, "long value kept across reopening");
+	free(v->v.stringV);
+	free(v);
+
+	// a copy read before its value was replaced cannot be written back
+	TEST_CHECK(createRecord(&stale, schema));
+	TEST_CHECK(getRecord(table, r->id, stale));
+	longString(text, 7000, 5);
+	setAttrString(r, schema, 1, text, strlen(text));
+	TEST_CHECK(updateRecord(table, r));
+	setAttrInt(stale, schema, 2, 9);
+	rc = updateRecord(table, stale);
+	ASSERT_EQUALS_INT(RC_RM_NO_SUCH_TUPLE, rc, "value of the copy is gone");
+	ASSERT_TRUE(stale->data[schema->attrOffsets[1] + 1] == TOAST_REF_MAGIC, "copy keeps its reference");
+	TEST_CHECK(getRecord(table, r->id, r));
+	ASSERT_EQUALS_INT(8, getAttrInt(r, schema, 2), "failed update changed nothing");
+	TEST_CHECK(getAttr(r, schema, 1, &v));
+	ASSERT_EQUALS_STRING(text, v->v.stringV, "newer value kept");
+	free(v->v.stringV);
+	free(v);
+	freeRecord(stale);
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_t"));
+	TEST_CHECK(shutdownRecordManager());
+
+	freeRecord(r);
+	free(schema->attrOffsets);
+	free(schema);
+	free(text);
+	free(expected);
+	free(table);
+	TEST_DONE();
+}
+
+void
+testPaxLayout (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	RM_TableOptions options = { .layout = RM_LAYOUT_PAX };
+	char *names[] = { "id", "text" };
+	DataType dt[] = { DT_INT, DT_STRING };
+	int sizes[] = { 0, 5000 };
+	int keys[] = { 0 };
+	int numInserts = 600, batchSize = 100, numPages, numRows, width, length, i, j, rc;
+	BM_PageHandle page;
+	RM_ScanHandle *sc = (RM_ScanHandle *) malloc(sizeof(RM_ScanHandle));
+	Record **batch;
+	Record *r;
+	RID *rids;
+	Schema *schema, *wide;
+	int *ids;
+	bool inOrder;
+	testName = "test tables with PAX pages";
+
+	schema = testSchema();
+	rids = (RID *) malloc(sizeof(RID) * numInserts);
+	batch = (Record **) malloc(sizeof(Record *) * batchSize);
+	for(j = 0; j < batchSize; j++)
+		TEST_CHECK(createRecord(&batch[j], schema));
+
+	TEST_CHECK(initRecordManager(NULL));
+	wide = createSchema(2, names, dt, sizes, 1, keys);
+	rc = createTableWithOptions("test_table_p", wide, &options);
+	ASSERT_EQUALS_INT(RC_RM_RECORD_TOO_LARGE, rc, "a PAX row must fit a page");
+
+	TEST_CHECK(createTableWithOptions("test_table_p", schema, &options));
+	TEST_CHECK(openTable(table, "test_table_p"));
+	for(i = 0; i < numInserts; i += batchSize)
+	{
+		for(j = 0; j < batchSize; j++)
+		{
+			setAttrInt(batch[j], schema, 0, i + j);
+			setAttrString(batch[j], schema, 1, "pax", 3);
+			setAttrInt(batch[j], schema, 2, 2 * (i + j));
+		}
+		TEST_CHECK(insertRecords(table, batch, batchSize));
+		for(j = 0; j < batchSize; j++)
+			rids[i + j] = batch[j]->id;
+	}
+	ASSERT_TRUE(rids[numInserts - 1].page > rids[0].page, "records fill several pages");
+
+	// the first attribute of a page's rows is one array
+	TEST_CHECK(pinPage(&((RM_TableMgmt *) table->mgmtData)->bm, &page, rids[0].page));
+	ASSERT_TRUE(IS_PAX_PAGE(page.data), "data page is a PAX page");
+	ids = (int *) paxMinipage(page.data, 0, &width);
+	numRows = 0;
+	inOrder = true;
+	for(i = 0; i < numInserts; i++)
+	{
+		if (rids[i].page != rids[0].page)
+			continue;
+		inOrder = inOrder && ids[rids[i].slot] == i;
+		numRows++;
+	}
+	ASSERT_EQUALS_INT((int) sizeof(int), width, "minipage holds ints");
+	ASSERT_TRUE(inOrder && numRows == PAGE_HEADER(page.data)->numSlots, "minipage holds every row's value");
+	TEST_CHECK(unpinPage(&((RM_TableMgmt *) table->mgmtData)->bm, &page));
+
+	r = batch[0];
+	TEST_CHECK(getRecord(table, rids[124], r));
+	ASSERT_EQUALS_INT(124, getAttrInt(r, schema, 0), "read back first attribute");
+	ASSERT_EQUALS_STRING("pax", getAttrString(r, schema, 1, &length), "read back string");
+	ASSERT_EQUALS_INT(248, getAttrInt(r, schema, 2), "read back last attribute");
+
+	// updates write the row in place; an aborted one restores the old values
+	setAttrInt(r, schema, 2, -1);
+	TEST_CHECK(updateRecord(table, r));
+	TEST_CHECK(beginTransaction());
+	setAttrInt(r, schema, 2, -2);
+	setAttrString(r, schema, 1, "abrt", 4);
+	TEST_CHECK(updateRecord(table, r));
+	TEST_CHECK(abortTransaction());
+	TEST_CHECK(getRecord(table, rids[124], r));
+	ASSERT_EQUALS_INT(-1, getAttrInt(r, schema, 2), "aborted update rolled back");
+	ASSERT_EQUALS_STRING("pax", getAttrString(r, schema, 1, &length), "aborted string rolled back");
+
+	for(i = 0; i < numInserts; i++)
+		if (i % 2 == 1)
+			TEST_CHECK(deleteRecord(table, rids[i]));
+	TEST_CHECK(startScan(table, sc, NULL));
+	numRows = 0;
+	inOrder = true;
+	while((rc = next(sc, r)) == RC_OK)
+	{
+		inOrder = inOrder && getAttrInt(r, schema, 0) % 2 == 0;
+		numRows++;
+	}
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "scan ends");
+	TEST_CHECK(closeScan(sc));
+	ASSERT_EQUALS_INT(numInserts / 2, numRows, "scan returns the records left");
+	ASSERT_TRUE(inOrder, "scan returns only records left");
+
+	// freed rows are reused before the table grows
+	TEST_CHECK(vacuumTable(table));
+	numPages = tablePages(table);
+	TEST_CHECK(insertRecords(table, batch, batchSize));
+	ASSERT_EQUALS_INT(numPages, tablePages(table), "insert reuses vacuumed rows");
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(openTable(table, "test_table_p"));
+	ASSERT_EQUALS_INT(numInserts / 2 + batchSize, getNumTuples(table), "tuple count kept across reopen");
+	TEST_CHECK(getRecord(table, rids[124], r));
+	ASSERT_EQUALS_INT(-1, getAttrInt(r, schema, 2), "record kept across reopen");
+	TEST_CHECK(insertRecords(table, batch, 1));
+	TEST_CHECK(pinPage(&((RM_TableMgmt *) table->mgmtData)->bm, &page, batch[0]->id.page));
+	ASSERT_TRUE(IS_PAX_PAGE(page.data), "layout kept across reopen");
+	TEST_CHECK(unpinPage(&((RM_TableMgmt *) table->mgmtData)->bm, &page));
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_p"));
+	TEST_CHECK(shutdownRecordManager());
+
+	for(j = 0; j < batchSize; j++)
+		freeRecord(batch[j]);
+	free(batch);
+	freeSchema(schema);
+	free(wide->attrOffsets);
+	free(wide);
+	free(rids);
+	free(sc);
+	free(table);
+	TEST_DONE();
+}
+
+// Checks paxCompare on a page against the values its rows decode to
+static bool
+paxCompareAgrees (char *page, Schema *schema, int attrNum, OpType op, Value *value)
+{
+	int numRows = PAGE_HEADER(page)->numSlots;
+	bool *match = (bool *) malloc(sizeof(bool) * numRows);
+	char *data = (char *) malloc(schema->recordSize);
+	Record record = { { -1, -1 }, data };
+	Value *stored, result;
+	bool agrees = true;
+	int i;
+
+	paxCompare(page, attrNum, op, (value->dt == DT_STRING) ? value->v.stringV : (char *) &value->v, match);
+	for(i = 0; i < numRows; i++)
+	{
+		paxReadRow(page, i, data);
+		getAttr(&record, schema, attrNum, &stored);
+		if (op == OP_COMP_EQUAL)
+			valueEquals(stored, value, &result);
+		else
+			valueSmaller(stored, value, &result);
+		agrees = agrees && result.v.boolV == match[i];
+		freeVal(stored);
+	}
+	free(match);
+	free(data);
+	return agrees;
+}
+
+void
+testPaxCompression (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	RM_TableOptions options = { .layout = RM_LAYOUT_PAX, .compress = true };
+	char *names[] = { "id", "country", "bucket" };
+	char *countries[] = { "Chile", "Denmark", "Japan", "Kenya", "Peru" };
+	DataType dt[] = { DT_INT, DT_STRING, DT_INT };
+	int sizes[] = { 0, 32, 0 };
+	int keys[] = { 0 };
+	int numInserts = 3000, batchSize = 100, plainPages, numRows, length, i, j, rc;
+	char buf[32];
+	BM_PageHandle page;
+	RM_PaxColumn *columns;
+	RM_ScanHandle *sc = (RM_ScanHandle *) malloc(sizeof(RM_ScanHandle));
+	Record **batch;
+	Record *r;
+	RID *rids;
+	Schema *schema;
+	Value *value;
+	bool correct;
+	testName = "test compressed PAX pages";
+
+	schema = createSchema(3, names, dt, sizes, 1, keys);
+	rids = (RID *) malloc(sizeof(RID) * numInserts);
+	batch = (Record **) malloc(sizeof(Record *) * batchSize);
+	for(j = 0; j < batchSize; j++)
+		TEST_CHECK(createRecord(&batch[j], schema));
+
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTableWithOptions("test_table_z", schema, &options));
+	TEST_CHECK(openTable(table, "test_table_z"));
+	for(i = 0; i < numInserts; i += batchSize)
+	{
+		for(j = 0; j < batchSize; j++)
+		{
+			setAttrInt(batch[j], schema, 0, i + j);
+			setAttrString(batch[j], schema, 1, countries[(i + j) % 5], strlen(countries[(i + j) % 5]));
+			setAttrInt(batch[j], schema, 2, (i + j) / 40 * 100000);
+		}
+		TEST_CHECK(insertRecords(table, batch, batchSize));
+		for(j = 0; j < batchSize; j++)
+			rids[i + j] = batch[j]->id;
+	}
+	// header and free-space map pages aside
+	plainPages = (numInserts + paxCapacity(schema, NULL) - 1) / paxCapacity(schema, NULL);
+	ASSERT_TRUE(tablePages(table) - 2 < plainPages * 2 / 3, "encoded pages hold more rows");
+
+	// each column gets the codec that suits its values
+	TEST_CHECK(pinPage(&((RM_TableMgmt *) table->mgmtData)->bm, &page, rids[0].page));
+	columns = PAX_COLUMNS(page.data);
+	ASSERT_TRUE(PAGE_HEADER(page.data)->flags & PAGE_PAX_ENCODED, "full page is encoded");
+	ASSERT_EQUALS_INT(PAX_FOR, columns[0].codec, "ids use a frame of reference");
+	ASSERT_EQUALS_INT(PAX_DICT, columns[1].codec, "countries use a dictionary");
+	ASSERT_EQUALS_INT(PAX_RLE, columns[2].codec, "buckets use runs");
+	ASSERT_TRUE(paxMinipage(page.data, 1, NULL) == NULL, "encoded minipage is not an array");
+
+	// predicates evaluated on the encoded values
+	MAKE_STRING_VALUE(value, "Japan");
+	ASSERT_TRUE(paxCompareAgrees(page.data, schema, 1, OP_COMP_EQUAL, value), "dictionary equality");
+	ASSERT_TRUE(paxCompareAgrees(page.data, schema, 1, OP_COMP_SMALLER, value), "dictionary order");
+	freeVal(value);
+	correct = true;
+	for(i = -1; correct && i <= PAGE_HEADER(page.data)->numSlots; i += 7)
+	{
+		MAKE_VALUE(value, DT_INT, i);
+		correct = paxCompareAgrees(page.data, schema, 0, OP_COMP_EQUAL, value)
+				&& paxCompareAgrees(page.data, schema, 0, OP_COMP_SMALLER, value);
+		freeVal(value);
+	}
+	for(i = -1; correct && i <= 5; i++)
+	{
+		MAKE_VALUE(value, DT_INT, i * 100000);
+		correct = paxCompareAgrees(page.data, schema, 2, OP_COMP_EQUAL, value)
+				&& paxCompareAgrees(page.data, schema, 2, OP_COMP_SMALLER, value);
+		freeVal(value);
+	}
+	ASSERT_TRUE(correct, "frame of reference and run comparisons");
+	TEST_CHECK(unpinPage(&((RM_TableMgmt *) table->mgmtData)->bm, &page));
+
+	r = batch[0];
+	TEST_CHECK(getRecord(table, rids[1234], r));
+	ASSERT_EQUALS_INT(1234, getAttrInt(r, schema, 0), "read back id");
+	ASSERT_EQUALS_STRING("Peru", getAttrString(r, schema, 1, &length), "read back country");
+	ASSERT_EQUALS_INT(3000000, getAttrInt(r, schema, 2), "read back bucket");
+
+	// values that do not encode as well move rows off their full pages
+	for(i = 0; i < numInserts; i += 10)
+	{
+		sprintf(buf, "country-%d", i);
+		TEST_CHECK(getRecord(table, rids[i], r));
+		setAttrString(r, schema, 1, buf, strlen(buf));
+		TEST_CHECK(updateRecord(table, r));
+	}
+	for(i = 0; i < numInserts; i++)
+		if (i % 3 == 0)
+			TEST_CHECK(deleteRecord(table, rids[i]));
+	TEST_CHECK(vacuumTable(table));
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(openTable(table, "test_table_z"));
+
+	TEST_CHECK(startScan(table, sc, NULL));
+	numRows = 0;
+	correct = true;
+	while((rc = next(sc, r)) == RC_OK)
+	{
+		i = getAttrInt(r, schema, 0);
+		if (i % 10 == 0)
+			sprintf(buf, "country-%d", i);
+		else
+			strcpy(buf, countries[i % 5]);
+		correct = correct && i % 3 != 0 && getAttrInt(r, schema, 2) == i / 40 * 100000
+				&& strcmp(buf, getAttrString(r, schema, 1, &length)) == 0;
+		numRows++;
+	}
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "scan ends");
+	TEST_CHECK(closeScan(sc));
+	ASSERT_EQUALS_INT(numInserts - numInserts / 3, numRows, "scan returns the records left");
+	ASSERT_TRUE(correct, "records decode after updates, vacuum and reopen");
+	TEST_CHECK(getRecord(table, rids[1240], r));
+	ASSERT_EQUALS_STRING("country-1240", getAttrString(r, schema, 1, &length), "moved record found from its home");
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_z"));
+	TEST_CHECK(shutdownRecordManager());
+
+	for(j = 0; j < batchSize; j++)
+		freeRecord(batch[j]);
+	free(batch);
+	free(schema->attrOffsets);
+	free(schema);
+	free(rids);
+	free(sc);
+	free(table);
+	TEST_DONE();
+}
+
+void
+testNullValues (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	RM_TableOptions options = { .layout = RM_LAYOUT_PAX, .compress = true };
+	char *tables[] = { "test_table_n", "test_table_np" };
+	int numInserts = 200, length, i, t, rc;
+	bool match[PAGE_SIZE];
+	BM_PageHandle page;
+	Record **records;
+	Record *r;
+	Schema *schema;
+	Value *value, *result;
+	Expr *attr, *cons, *cmp, *other, *both;
+	bool correct;
+	testName = "test NULL values";
+
+	schema = testSchema();
+	records = (Record **) malloc(sizeof(Record *) * numInserts);
+	TEST_CHECK(createRecord(&r, schema));
+
+	// NULL is a bit apart from the value; an empty string is not NULL
+	setAttrString(r, schema, 1, "", 0);
+	ASSERT_TRUE(!isAttrNull(r, schema, 1), "empty string is not NULL");
+	MAKE_NULL_VALUE(value, DT_INT);
+	TEST_CHECK(setAttr(r, schema, 2, value));
+	freeVal(value);
+	ASSERT_TRUE(isAttrNull(r, schema, 2) && !isAttrNull(r, schema, 0), "setAttr sets only its null bit");
+	TEST_CHECK(getAttr(r, schema, 2, &value));
+	ASSERT_TRUE(value->isNull && value->dt == DT_INT, "getAttr returns NULL");
+	freeVal(value);
+	setAttrInt(r, schema, 2, 0);
+	ASSERT_TRUE(!isAttrNull(r, schema, 2), "setter clears the null bit");
+	ASSERT_TRUE(!isAttrNull(r, schema, -1) && !isAttrNull(r, schema, schema->numAttr), "attributes out of range are not NULL");
+
+	// comparisons with NULL are NULL; AND and OR may still decide
+	setAttrNull(r, schema, 2);
+	MAKE_ATTRREF(attr, 2);
+	MAKE_VALUE(value, DT_INT, 0);
+	MAKE_CONS(cons, value);
+	MAKE_BINOP_EXPR(cmp, attr, cons, OP_COMP_EQUAL);
+	TEST_CHECK(evalExpr(r, schema, cmp, &result));
+	ASSERT_TRUE(result->isNull, "NULL = 0 is NULL");
+	freeVal(result);
+	MAKE_VALUE(value, DT_BOOL, false);
+	MAKE_CONS(other, value);
+	MAKE_BINOP_EXPR(both, cmp, other, OP_BOOL_AND);
+	TEST_CHECK(evalExpr(r, schema, both, &result));
+	ASSERT_TRUE(!result->isNull && !result->v.boolV, "NULL AND false is false");
+	freeVal(result);
+	both->expr.op->type = OP_BOOL_OR;
+	TEST_CHECK(evalExpr(r, schema, both, &result));
+	ASSERT_TRUE(result->isNull, "NULL OR false is NULL");
+	freeVal(result);
+	other->expr.cons->v.boolV = true;
+	TEST_CHECK(evalExpr(r, schema, both, &result));
+	ASSERT_TRUE(!result->isNull && result->v.boolV, "NULL OR true is true");
+	freeVal(result);
+	freeExpr(both);
+
+	// NULLs are stored in either layout, and never match a comparison
+	TEST_CHECK(initRecordManager(NULL));
+	for(t = 0; t < 2; t++)
+	{
+		TEST_CHECK(createTableWithOptions(tables[t], schema, (t == 0) ? NULL : &options));
+		TEST_CHECK(openTable(table, tables[t]));
+		for(i = 0; i < numInserts; i++)
+		{
+			TEST_CHECK(createRecord(&records[i], schema));
+			setAttrInt(records[i], schema, 0, i);
+			setAttrString(records[i], schema, 1, "", 0);
+			if (i % 3 == 0)
+				setAttrNull(records[i], schema, 1);
+			if (i % 4 == 0)
+				setAttrNull(records[i], schema, 2);
+			else
+				setAttrInt(records[i], schema, 2, 0);
+		}
+		TEST_CHECK(insertRecords(table, records, numInserts));
+		TEST_CHECK(closeTable(table));
+		TEST_CHECK(openTable(table, tables[t]));
+
+		correct = true;
+		for(i = 0; i < numInserts; i++)
+		{
+			TEST_CHECK(getRecord(table, records[i]->id, r));
+			getAttrString(r, schema, 1, &length);
+			correct = correct && getAttrInt(r, schema, 0) == i && length == 0
+					&& isAttrNull(r, schema, 1) == (i % 3 == 0)
+					&& isAttrNull(r, schema, 2) == (i % 4 == 0) && !isAttrNull(r, schema, 0);
+		}
+		ASSERT_TRUE(correct, "null bits read back after reopen");
+
+		if (t == 1)
+		{
+			TEST_CHECK(pinPage(&((RM_TableMgmt *) table->mgmtData)->bm, &page, records[0]->id.page));
+			rc = 0;
+			paxCompare(page.data, 2, OP_COMP_EQUAL, (char *) &rc, match);
+			for(i = 0; i < PAGE_HEADER(page.data)->numSlots; i++)
+				correct = correct && match[i] == (i % 4 != 0);
+			TEST_CHECK(unpinPage(&((RM_TableMgmt *) table->mgmtData)->bm, &page));
+			ASSERT_TRUE(correct, "NULL does not equal zero on a PAX page");
+		}
+
+		for(i = 0; i < numInserts; i++)
+			freeRecord(records[i]);
+		TEST_CHECK(closeTable(table));
+		TEST_CHECK(deleteTable(tables[t]));
+	}
+	TEST_CHECK(shutdownRecordManager());
+
+	freeRecord(r);
+	free(records);
+	freeSchema(schema);
+	free(table);
+	TEST_DONE();
+}
+
+void
+testScanCursor (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	RM_ScanHandle *sc = (RM_ScanHandle *) malloc(sizeof(RM_ScanHandle));
+	BM_BufferPool *bm;
+	int numInserts = 2000, batchSize = 100, numRows, numPages, page, i, j, rc;
+	Record **batch;
+	Record *r;
+	Schema *schema;
+	Expr *sel, *left, *right;
+	bool correct;
+	testName = "test scans walk every page with a pinned cursor";
+
+	schema = testSchema();
+	batch = (Record **) malloc(sizeof(Record *) * batchSize);
+	for(j = 0; j < batchSize; j++)
+		TEST_CHECK(createRecord(&batch[j], schema));
+	TEST_CHECK(createRecord(&r, schema));
+
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_c", schema));
+	TEST_CHECK(openTable(table, "test_table_c"));
+	for(i = 0; i < numInserts; i += batchSize)
+	{
+		for(j = 0; j < batchSize; j++)
+		{
+			setAttrInt(batch[j], schema, 0, i + j);
+			setAttrString(batch[j], schema, 1, "scan", 4);
+			if ((i + j) % 10 == 0)
+				setAttrNull(batch[j], schema, 2);
+			else
+				setAttrInt(batch[j], schema, 2, (i + j) % 7);
+		}
+		TEST_CHECK(insertRecords(table, batch, batchSize));
+	}
+	bm = &((RM_TableMgmt *) table->mgmtData)->bm;
+	ASSERT_TRUE(batch[batchSize - 1]->id.page > 3, "records fill several pages");
+
+	// c < 3 holds for c in 0..2, never for NULL
+	MAKE_CONS(left, stringToValue("i3"));
+	MAKE_ATTRREF(right, 2);
+	MAKE_BINOP_EXPR(sel, right, left, OP_COMP_SMALLER);
+	TEST_CHECK(startScan(table, sc, sel));
+	numRows = 0;
+	numPages = 0;
+	page = -1;
+	correct = true;
+	while((rc = next(sc, r)) == RC_OK)
+	{
+		i = getAttrInt(r, schema, 0);
+		correct = correct && i % 10 != 0 && i % 7 < 3 && !isAttrNull(r, schema, 2);
+		numRows++;
+		// the page of the record returned stays pinned, and only it
+		if (r->id.page != page)
+		{
+			page = r->id.page;
+			numPages++;
+			correct = correct && pinnedPages(bm) == 1;
+		}
+	}
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "scan ends");
+	TEST_CHECK(closeScan(sc));
+	for(i = 0, j = 0; i < numInserts; i++)
+		if (i % 10 != 0 && i % 7 < 3)
+			j++;
+	ASSERT_EQUALS_INT(j, numRows, "scan returns every matching record");
+	ASSERT_TRUE(correct, "scan returns only matching records, holding one pin");
+	ASSERT_TRUE(numPages > 3, "scan reaches every page");
+	ASSERT_EQUALS_INT(0, pinnedPages(bm), "closeScan unpins the cursor");
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_c"));
+	TEST_CHECK(shutdownRecordManager());
+
+	for(j = 0; j < batchSize; j++)
+		freeRecord(batch[j]);
+	free(batch);
+	freeRecord(r);
+	freeExpr(sel);
+	freeSchema(schema);
+	free(sc);
+	free(table);
+	TEST_DONE();
+}
+
+void
+testBatchScan (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	RM_ScanHandle *sc = (RM_ScanHandle *) malloc(sizeof(RM_ScanHandle));
+	int numInserts = 2000, batchSize = 100, maxTuples = 64, numRows, numSelected, expected, i, j, rc;
+	RecordBatch *rb;
+	Record **batch;
+	Record r;
+	Schema *schema;
+	Expr *sel, *left, *right;
+	bool correct, onePage;
+	testName = "test batch scans with a selection vector";
+
+	schema = testSchema();
+	batch = (Record **) malloc(sizeof(Record *) * batchSize);
+	for(j = 0; j < batchSize; j++)
+		TEST_CHECK(createRecord(&batch[j], schema));
+
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_b", schema));
+	TEST_CHECK(openTable(table, "test_table_b"));
+	for(i = 0; i < numInserts; i += batchSize)
+	{
+		for(j = 0; j < batchSize; j++)
+		{
+			setAttrInt(batch[j], schema, 0, i + j);
+			setAttrString(batch[j], schema, 1, "btch", 4);
+			setAttrInt(batch[j], schema, 2, (i + j) % 7);
+		}
+		TEST_CHECK(insertRecords(table, batch, batchSize));
+	}
+
+	// c < 3
+	MAKE_CONS(left, stringToValue("i3"));
+	MAKE_ATTRREF(right, 2);
+	MAKE_BINOP_EXPR(sel, right, left, OP_COMP_SMALLER);
+	TEST_CHECK(createRecordBatch(&rb, schema, 256));
+	TEST_CHECK(startScan(table, sc, sel));
+	numRows = numSelected = 0;
+	correct = onePage = true;
+	while((rc = nextBatch(sc, rb, maxTuples)) == RC_OK)
+	{
+		correct = correct && rb->numTuples > 0 && rb->numTuples <= maxTuples;
+		onePage = onePage && rb->ids[0].page == rb->ids[rb->numTuples - 1].page;
+		for(i = 0; i < rb->numSelected; i++)
+		{
+			batchRecord(rb, rb->selection[i], &r);
+			correct = correct && getAttrInt(&r, schema, 2) < 3
+					&& (i == 0 || rb->selection[i - 1] < rb->selection[i]);
+		}
+		numRows += rb->numTuples;
+		numSelected += rb->numSelected;
+	}
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "batch scan ends");
+	TEST_CHECK(closeScan(sc));
+	for(i = 0, expected = 0; i < numInserts; i++)
+		if (i % 7 < 3)
+			expected++;
+	ASSERT_EQUALS_INT(numInserts, numRows, "batches hold every record");
+	ASSERT_EQUALS_INT(expected, numSelected, "selection holds every matching record");
+	ASSERT_TRUE(correct, "selection holds only matching records, in order");
+	ASSERT_TRUE(onePage, "a batch stays within a page");
+
+	TEST_CHECK(freeRecordBatch(rb));
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_b"));
+	TEST_CHECK(shutdownRecordManager());
+
+	for(j = 0; j < batchSize; j++)
+		freeRecord(batch[j]);
+	free(batch);
+	freeExpr(sel);
+	freeSchema(schema);
+	free(sc);
+	free(table);
+	TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testZoneMaps (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	int numInserts = 2000, batchSize = 100, reads, numPages, i, j;
+	Record **batch;
+	Record *r;
+	RID late;
+	Schema *schema;
+	BM_BufferPool *bm;
+	Expr *low, *notHigh, *negative, *left, *right;
+	testName = "test zone maps skipping pages";
+
+	schema = testSchema();
+	batch = (Record **) malloc(sizeof(Record *) * batchSize);
+	for(j = 0; j < batchSize; j++)
+		TEST_CHECK(createRecord(&batch[j], schema));
+
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_z", schema));
+	TEST_CHECK(openTable(table, "test_table_z"));
+	bm = &((RM_TableMgmt *) table->mgmtData)->bm;
+	// a grows with the insertion order, so each page holds a narrow range
+	for(i = 0; i < numInserts; i += batchSize)
+	{
+		for(j = 0; j < batchSize; j++)
+		{
+			setAttrInt(batch[j], schema, 0, i + j);
+			setAttrString(batch[j], schema, 1, "zone", 4);
+			setAttrInt(batch[j], schema, 2, (i + j) % 7);
+		}
+		TEST_CHECK(insertRecords(table, batch, batchSize));
+		if (i + batchSize > 1990)
+			late = batch[1990 - i]->id;
+	}
+	numPages = tablePages(table);
+
+	// a < 50, NOT (a < 1950) and a < 0
+	MAKE_ATTRREF(left, 0);
+	MAKE_CONS(right, stringToValue("i50"));
+	MAKE_BINOP_EXPR(low, left, right, OP_COMP_SMALLER);
+	MAKE_ATTRREF(left, 0);
+	MAKE_CONS(right, stringToValue("i1950"));
+	MAKE_BINOP_EXPR(negative, left, right, OP_COMP_SMALLER);
+	MAKE_UNOP_EXPR(notHigh, negative, OP_BOOL_NOT);
+	MAKE_ATTRREF(left, 0);
+	MAKE_CONS(right, stringToValue("i0"));
+	MAKE_BINOP_EXPR(negative, left, right, OP_COMP_SMALLER);
+
+	// the first scan with a condition builds the map
+	ASSERT_EQUALS_INT(50, scanCount(table, low), "range scan finds every match");
+	reads = getNumReadIO(bm);
+	ASSERT_EQUALS_INT(50, scanCount(table, low), "range scan finds every match again");
+	ASSERT_TRUE(getNumReadIO(bm) - reads < numPages / 4, "range scan skips the pages out of range");
+	ASSERT_EQUALS_INT(50, scanCount(table, notHigh), "negated range scan finds every match");
+
+	// updates and inserts widen the zones of their pages
+	createRecord(&r, schema);
+	TEST_CHECK(getRecord(table, late, r));
+	setAttrInt(r, schema, 0, -5);
+	TEST_CHECK(updateRecord(table, r));
+	setAttrInt(batch[0], schema, 0, -10);
+	TEST_CHECK(insertRecords(table, batch, 1));
+	ASSERT_EQUALS_INT(2, scanCount(table, negative), "scan finds updated and inserted records");
+	ASSERT_EQUALS_INT(52, scanCount(table, low), "range scan finds them too");
+	ASSERT_EQUALS_INT(49, scanCount(table, notHigh), "negated range scan misses the updated record");
+
+	// older versions stay reachable for the snapshots that see them
+	TEST_CHECK(beginTransaction());
+	TEST_CHECK(getRecord(table, late, r));
+	setAttrInt(r, schema, 0, 3000);
+	TEST_CHECK(updateRecord(table, r));
+	TEST_CHECK(abortTransaction());
+	ASSERT_EQUALS_INT(2, scanCount(table, negative), "aborted update restores the older value");
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_z"));
+	TEST_CHECK(shutdownRecordManager());
+
+	for(j = 0; j < batchSize; j++)
+		freeRecord(batch[j]);
+	free(batch);
+	freeRecord(r);
+	freeExpr(low);
+	freeExpr(notHigh);
+	freeExpr(negative);
+	freeSchema(schema);
+	free(table);
+	TEST_DONE();
+}
+
+// a = value, freed by the caller
+static Expr *
+equalsInt (int attrNum, int value)
+{
+	Expr *eq, *left, *right;
+	char buf[32];
+
+	sprintf(buf, "i%d", value);
+	MAKE_ATTRREF(left, attrNum);
+	MAKE_CONS(right, stringToValue(buf));
+	MAKE_BINOP_EXPR(eq, left, right, OP_COMP_EQUAL);
+	return eq;
+}
+
+// ************************************************************ 
+void
+testBloomFilters (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	int numInserts = 2000, batchSize = 100, bloomAttrs[] = { 0 }, badAttrs[] = { 3 };
+	int reads, numPages, i, j, rc;
+	RM_TableOptions options = { .layout = RM_LAYOUT_ROW, .bloomAttrs = bloomAttrs, .numBloomAttrs = 1 };
+	RM_TableOptions badOptions = { .layout = RM_LAYOUT_ROW, .bloomAttrs = badAttrs, .numBloomAttrs = 1 };
+	Record **batch;
+	Record *r;
+	RID rid, gone;
+	Schema *schema;
+	Expr *present, *absent, *updated, *deleted;
+	testName = "test Bloom filters skipping pages";
+
+	schema = testSchema();
+	batch = (Record **) malloc(sizeof(Record *) * batchSize);
+	for(j = 0; j < batchSize; j++)
+		TEST_CHECK(createRecord(&batch[j], schema));
+
+	TEST_CHECK(initRecordManager(NULL));
+	rc = createTableWithOptions("test_table_f", schema, &badOptions);
+	ASSERT_EQUALS_INT(RC_RM_NO_SUCH_ATTR, rc, "filter on a missing attribute is refused");
+	TEST_CHECK(createTableWithOptions("test_table_f", schema, &options));
+	TEST_CHECK(openTable(table, "test_table_f"));
+	// a is unique but scattered, so every page's range spans most values
+	for(i = 0; i < numInserts; i += batchSize)
+	{
+		for(j = 0; j < batchSize; j++)
+		{
+			setAttrInt(batch[j], schema, 0, (i + j) * 7919 % 100003);
+			setAttrString(batch[j], schema, 1, "blom", 4);
+			setAttrInt(batch[j], schema, 2, (i + j) % 7);
+		}
+		TEST_CHECK(insertRecords(table, batch, batchSize));
+		if (i == 1000)
+			rid = batch[17]->id;
+		if (i == 500)
+			gone = batch[3]->id;
+	}
+	numPages = tablePages(table);
+
+	present = equalsInt(0, 1017 * 7919 % 100003);
+	// the value the next record would have, inside most pages' ranges
+	absent = equalsInt(0, numInserts * 7919 % 100003);
+	updated = equalsInt(0, 100003);
+	deleted = equalsInt(0, 503 * 7919 % 100003);
+
+	ASSERT_EQUALS_INT(1, scanCount(table, present), "equality scan finds the record");
+	reads = getNumReadIO(&((RM_TableMgmt *) table->mgmtData)->bm);
+	ASSERT_EQUALS_INT(0, scanCount(table, absent), "equality scan finds no missing value");
+	ASSERT_TRUE(getNumReadIO(&((RM_TableMgmt *) table->mgmtData)->bm) - reads < numPages / 4,
+			"equality scan skips the pages without the value");
+
+	// filters follow updates, and vacuum drops deleted values from them
+	createRecord(&r, schema);
+	TEST_CHECK(getRecord(table, rid, r));
+	setAttrInt(r, schema, 0, 100003);
+	TEST_CHECK(updateRecord(table, r));
+	TEST_CHECK(deleteRecord(table, gone));
+	TEST_CHECK(vacuumTable(table));
+	ASSERT_EQUALS_INT(0, scanCount(table, present), "old value is gone");
+	ASSERT_EQUALS_INT(1, scanCount(table, updated), "equality scan finds the updated record");
+	ASSERT_EQUALS_INT(0, scanCount(table, deleted), "deleted value is gone");
+
+	// the side file keeps them across a close
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(openTable(table, "test_table_f"));
+	ASSERT_EQUALS_INT(1, scanCount(table, updated), "filters are read back");
+	reads = getNumReadIO(&((RM_TableMgmt *) table->mgmtData)->bm);
+	ASSERT_EQUALS_INT(0, scanCount(table, absent), "equality scan finds no missing value after reopening");
+	ASSERT_TRUE(getNumReadIO(&((RM_TableMgmt *) table->mgmtData)->bm) - reads < numPages / 4,
+			"equality scan still skips pages");
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_f"));
+	ASSERT_TRUE(access("test_table_f.bloom", F_OK) != 0, "side file is deleted with the table");
+	TEST_CHECK(shutdownRecordManager());
+
+	for(j = 0; j < batchSize; j++)
+		freeRecord(batch[j]);
+	free(batch);
+	freeRecord(r);
+	freeExpr(present);
+	freeExpr(absent);
+	freeExpr(updated);
+	freeExpr(deleted);
+	freeSchema(schema);
+	free(table);
+	TEST_DONE();
+}
+
+// Counts the records a scan with cond selects, through nextBatch or next();
+// numDecoded gets the rows nextBatch decoded and idSum the selected ids
+static int
+countScan (RM_TableData *table, RM_ScanHandle *sc, bool batched, int *numDecoded, long *idSum)
+{
+	RecordBatch *rb;
+	Record *r;
+	int count = 0, i, rc;
+
+	*numDecoded = 0;
+	*idSum = 0;
+	if (batched)
+	{
+		TEST_CHECK(createRecordBatch(&rb, table->schema, 256));
+		while((rc = nextBatch(sc, rb, 64)) == RC_OK)
+		{
+			Record view;
+			for(i = 0; i < rb->numSelected; i++)
+			{
+				batchRecord(rb, rb->selection[i], &view);
+				*idSum += getAttrInt(&view, table->schema, 0);
+			}
+			*numDecoded += rb->numTuples;
+			count += rb->numSelected;
+		}
+		TEST_CHECK(freeRecordBatch(rb));
+	}
+	else
+	{
+		TEST_CHECK(createRecord(&r, table->schema));
+		while((rc = next(sc, r)) == RC_OK)
+		{
+			*idSum += getAttrInt(r, table->schema, 0);
+			count++;
+		}
+		freeRecord(r);
+	}
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "scan ends");
+	TEST_CHECK(closeScan(sc));
+	return count;
+}
+
+// ************************************************************ 
+void
+testPaxBatchScan (void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	RM_ScanHandle *sc = (RM_ScanHandle *) malloc(sizeof(RM_ScanHandle));
+	RM_TableOptions options[] = {
+		{ .layout = RM_LAYOUT_PAX },
+		{ .layout = RM_LAYOUT_PAX, .compress = true }
+	};
+	char *tables[] = { "test_table_sp", "test_table_sz" };
+	char *names[] = { "id", "country", "bucket", "score" };
+	char *countries[] = { "Chile", "Denmark", "Japan", "Kenya", "Peru" };
+	DataType dt[] = { DT_INT, DT_STRING, DT_INT, DT_FLOAT };
+	int sizes[] = { 0, 8, 0, 0 };
+	int keys[] = { 0 };
+	// attribute, operator, constant, constant first
+	struct { int attr; OpType op; char *value; bool constFirst; } conds[] = {
+		{ 1, OP_COMP_EQUAL, "sJapan", false },
+		{ 1, OP_COMP_EQUAL, "sPeru", true },
+		{ 1, OP_COMP_SMALLER, "sJapan", false },
+		{ 1, OP_COMP_EQUAL, "sJapanese", false },
+		{ 2, OP_COMP_SMALLER, "i1000000", false },
+		{ 2, OP_COMP_EQUAL, "i500000", false },
+		{ 2, OP_COMP_SMALLER, "i1000000", true },
+		{ 0, OP_COMP_EQUAL, "i1234", false },
+		{ 0, OP_COMP_SMALLER, "i100", false },
+		{ 3, OP_COMP_SMALLER, "f10", false },
+		{ 3, OP_COMP_EQUAL, "f7", false },
+		{ 3, OP_COMP_EQUAL, "fnan", false }
+	};
+	int numConds = sizeof(conds) / sizeof(conds[0]);
+	int numInserts = 3000, batchSize = 100, expected, numBatched, numRows, numDecoded, unused, japan = 0, i, j, c, t;
+	long expectedSum, batchedSum, rowSum, japanSum = 0;
+	Record **batch;
+	Record *r;
+	RID *rids;
+	Schema *schema;
+	Expr *sel, *attr, *cons;
+	bool agrees, selects, decodesMatches;
+	testName = "test batch scans comparing PAX minipages";
+
+	schema = createSchema(4, names, dt, sizes, 1, keys);
+	rids = (RID *) malloc(sizeof(RID) * numInserts);
+	batch = (Record **) malloc(sizeof(Record *) * batchSize);
+	for(j = 0; j < batchSize; j++)
+		TEST_CHECK(createRecord(&batch[j], schema));
+
+	TEST_CHECK(initRecordManager(NULL));
+	for(t = 0; t < 2; t++)
+	{
+		TEST_CHECK(createTableWithOptions(tables[t], schema, &options[t]));
+		TEST_CHECK(openTable(table, tables[t]));
+		for(i = 0; i < numInserts; i += batchSize)
+		{
+			for(j = 0; j < batchSize; j++)
+			{
+				int k = i + j;
+				setAttrInt(batch[j], schema, 0, k);
+				setAttrString(batch[j], schema, 1, countries[k % 5], strlen(countries[k % 5]));
+				if (k % 13 == 0)
+					setAttrNull(batch[j], schema, 1);
+				setAttrInt(batch[j], schema, 2, k / 40 * 100000);
+				if (k % 17 == 0)
+					setAttrNull(batch[j], schema, 2);
+				setAttrFloat(batch[j], schema, 3, (k / 25 % 19 == 0) ? atof("nan") : (float) (k / 25 % 50));
+			}
+			TEST_CHECK(insertRecords(table, batch, batchSize));
+			for(j = 0; j < batchSize; j++)
+				rids[i + j] = batch[j]->id;
+		}
+
+		// the minipage comparison selects what the row path does, NULLs and NaNs excluded
+		agrees = selects = decodesMatches = true;
+		for(c = 0; c < numConds; c++)
+		{
+			MAKE_ATTRREF(attr, conds[c].attr);
+			MAKE_CONS(cons, stringToValue(conds[c].value));
+			if (conds[c].constFirst)
+				MAKE_BINOP_EXPR(sel, cons, attr, conds[c].op);
+			else
+				MAKE_BINOP_EXPR(sel, attr, cons, conds[c].op);
+
+			expected = 0;
+			expectedSum = 0;
+			for(i = 0; i < numInserts; i++)
+			{
+				int country = strcmp(countries[i % 5], conds[c].value + 1);
+				int bucket = i / 40 * 100000, limit = atoi(conds[c].value + 1);
+				float score = (float) (i / 25 % 50), f = atof(conds[c].value + 1);
+				bool match = false;
+				switch (conds[c].attr)
+				{
+				case 0:
+					match = (conds[c].op == OP_COMP_EQUAL) ? i == limit : i < limit;
+					break;
+				case 1:
+					match = i % 13 != 0 && ((conds[c].op == OP_COMP_EQUAL) ? country == 0 : country < 0);
+					break;
+				case 2:
+					match = i % 17 != 0 && ((conds[c].op == OP_COMP_EQUAL) ? bucket == limit
+							: conds[c].constFirst ? limit < bucket : bucket < limit);
+					break;
+				case 3:
+					match = i / 25 % 19 != 0 && ((conds[c].op == OP_COMP_EQUAL) ? score == f : score < f);
+					break;
+				}
+				if (match)
+				{
+					expected++;
+					expectedSum += i;
+				}
+			}
+
+			TEST_CHECK(startScan(table, sc, sel));
+			numBatched = countScan(table, sc, true, &numDecoded, &batchedSum);
+			TEST_CHECK(startScan(table, sc, sel));
+			numRows = countScan(table, sc, false, &unused, &rowSum);
+			agrees = agrees && numBatched == numRows && batchedSum == rowSum;
+			selects = selects && numBatched == expected && batchedSum == expectedSum;
+			if (c == 0)
+			{
+				japan = expected;
+				japanSum = expectedSum;
+			}
+			// rows the minipage rejects are never decoded
+			if (conds[c].attr == 1 && !conds[c].constFirst)
+				decodesMatches = decodesMatches && numDecoded == expected;
+			freeExpr(sel);
+		}
+		ASSERT_TRUE(agrees, "batch and row scans select the same records");
+		ASSERT_TRUE(selects, "batch scans select the matching records");
+		ASSERT_TRUE(decodesMatches, "batch scans decode only the matching rows");
+
+		// a scan sees its snapshot, not the rows updates stored since
+		MAKE_ATTRREF(attr, 1);
+		MAKE_CONS(cons, stringToValue("sJapan"));
+		MAKE_BINOP_EXPR(sel, attr, cons, OP_COMP_EQUAL);
+		TEST_CHECK(startScan(table, sc, sel));
+		r = batch[0];
+		expected = japan;
+		for(i = 0; i < 200; i++)
+		{
+			if (i % 5 != 0 && i % 5 != 2)
+				continue;
+			TEST_CHECK(getRecord(table, rids[i], r));
+			setAttrString(r, schema, 1, (i % 5 == 0) ? "Japan" : "Chile", 5);
+			TEST_CHECK(updateRecord(table, r));
+			if (i % 5 == 0)
+				expected++;
+			else if (i % 13 != 0)
+				expected--;
+		}
+		numBatched = countScan(table, sc, true, &numDecoded, &batchedSum);
+		ASSERT_TRUE(numBatched == japan && batchedSum == japanSum, "batch scan reads the versions its snapshot sees");
+		TEST_CHECK(startScan(table, sc, sel));
+		numBatched = countScan(table, sc, true, &numDecoded, &batchedSum);
+		ASSERT_EQUALS_INT(expected, numBatched, "a later batch scan sees the updates");
+		freeExpr(sel);
+		TEST_CHECK(closeTable(table));
+		TEST_CHECK(deleteTable(tables[t]));
+	}
+	TEST_CHECK(shutdownRecordManager());
+
+	for(j = 0; j < batchSize; j++)
+		freeRecord(batch[j]);
+	free(batch);
+	free(schema->attrOffsets);
+	free(schema);
+	free(rids);
+	free(sc);
+	free(table);
+	TEST_DONE();
+}
 
 Schema *
 testSchema (void)
@@ -4,6 +4,9 @@
 #include "tables.h"
 #include "test_helper.h"
 
+#include <math.h>
+#include <string.h>
+
 // helper macros
 #define OP_TRUE(left, right, op, message)		\
 		do {							\
@@ -29,6 +32,8 @@
 static void testValueSerialize (void);
 static void testOperators (void);
 static void testExpressions (void);
+static void testCompiledExpressions (void);
+static void testSimdKernels (void);
 
 char *testName;
 
@@ -41,6 +46,8 @@ main (void)
 	testValueSerialize();
 	testOperators();
 	testExpressions();
+	testCompiledExpressions();
+	testSimdKernels();
 
 	return 0;
 }
@@ -123,3 +130,149 @@ testExpressions (void)
 
 	TEST_DONE();
 }
+
+// ************************************************************
+void
+testCompiledExpressions (void)
+{
+	char *names[] = { "a", "b", "c" };
+	DataType dt[] = { DT_INT, DT_STRING, DT_BOOL };
+	int sizes[] = { 0, 4, 0 };
+	int keys[] = { 0 };
+	char *strings[] = { "", "ab", "abcd", "b" };
+	Schema *schema = createSchema(3, names, dt, sizes, 1, keys);
+	Expr *exprs[4], *l, *r, *cmp, *eq;
+	ExprProgram *program;
+	Record *record;
+	Value *res;
+	bool agrees = true;
+	int i, e;
+	testName = "test compiled expressions";
+
+	// a < 5 AND NOT c
+	MAKE_ATTRREF(l, 0);
+	MAKE_CONS(r, stringToValue("i5"));
+	MAKE_BINOP_EXPR(cmp, l, r, OP_COMP_SMALLER);
+	MAKE_ATTRREF(l, 2);
+	MAKE_UNOP_EXPR(r, l, OP_BOOL_NOT);
+	MAKE_BINOP_EXPR(exprs[0], cmp, r, OP_BOOL_AND);
+	// 'ab' < b OR b = 'b'
+	MAKE_CONS(l, stringToValue("sab"));
+	MAKE_ATTRREF(r, 1);
+	MAKE_BINOP_EXPR(cmp, l, r, OP_COMP_SMALLER);
+	MAKE_ATTRREF(l, 1);
+	MAKE_CONS(r, stringToValue("sb"));
+	MAKE_BINOP_EXPR(eq, l, r, OP_COMP_EQUAL);
+	MAKE_BINOP_EXPR(exprs[1], cmp, eq, OP_BOOL_OR);
+	// NOT (a = a) OR c
+	MAKE_ATTRREF(l, 0);
+	MAKE_ATTRREF(r, 0);
+	MAKE_BINOP_EXPR(eq, l, r, OP_COMP_EQUAL);
+	MAKE_UNOP_EXPR(cmp, eq, OP_BOOL_NOT);
+	MAKE_ATTRREF(r, 2);
+	MAKE_BINOP_EXPR(exprs[2], cmp, r, OP_BOOL_OR);
+	// 3 < 4 AND b = 'abcd'
+	MAKE_CONS(l, stringToValue("i3"));
+	MAKE_CONS(r, stringToValue("i4"));
+	MAKE_BINOP_EXPR(cmp, l, r, OP_COMP_SMALLER);
+	MAKE_ATTRREF(l, 1);
+	MAKE_CONS(r, stringToValue("sabcd"));
+	MAKE_BINOP_EXPR(eq, l, r, OP_COMP_EQUAL);
+	MAKE_BINOP_EXPR(exprs[3], cmp, eq, OP_BOOL_AND);
+
+	// the program agrees with evalExpr on every record, NULLs included
+	TEST_CHECK(createRecord(&record, schema));
+	for(e = 0; e < 4; e++)
+	{
+		program = compileExpr(exprs[e], schema);
+		ASSERT_TRUE(program != NULL, "expression compiles");
+		for(i = 0; i < 64; i++)
+		{
+			setAttrInt(record, schema, 0, i % 8);
+			setAttrString(record, schema, 1, strings[(i / 8) % 4], strlen(strings[(i / 8) % 4]));
+			setAttrBool(record, schema, 2, (i / 2) % 2);
+			if (i % 5 == 0)
+				setAttrNull(record, schema, i % 3);
+			TEST_CHECK(evalExpr(record, schema, exprs[e], &res));
+			agrees = agrees && evalProgram(program, record) == (!res->isNull && res->v.boolV);
+			freeVal(res);
+		}
+		freeProgram(program);
+	}
+	ASSERT_TRUE(agrees, "compiled expressions agree with evalExpr");
+
+	// comparisons of comparisons are left to evalExpr
+	MAKE_BINOP_EXPR(cmp, exprs[0], exprs[2], OP_COMP_EQUAL);
+	ASSERT_TRUE(compileExpr(cmp, schema) == NULL, "comparison of conditions is not compiled");
+	MAKE_ATTRREF(l, 0);
+	MAKE_CONS(r, stringToValue("sx"));
+	MAKE_BINOP_EXPR(exprs[0], l, r, OP_COMP_EQUAL);
+	ASSERT_TRUE(compileExpr(exprs[0], schema) == NULL, "type mismatch is not compiled");
+
+	freeExpr(cmp);
+	freeExpr(exprs[0]);
+	freeExpr(exprs[1]);
+	freeExpr(exprs[3]);
+	freeRecord(record);
+	free(schema->attrOffsets);
+	free(schema);
+
+	TEST_DONE();
+}
+
+// ************************************************************ 
+void
+testSimdKernels (void)
+{
+	// 37 values, so every level leaves a tail for the scalar loop, both
+	// contiguous and 12 bytes apart at offset 4 as in a record
+	char data[37 * 12];
+	int ints[37], selection[37], expected[37];
+	float floats[37];
+	OpType ops[] = { OP_COMP_EQUAL, OP_COMP_SMALLER, OP_COMP_SMALLER };
+	bool constFirst[] = { FALSE, FALSE, TRUE };
+	Value constant;
+	bool agrees = true;
+	int i, t, s, n, m, level, supported = getSimdLevel();
+	testName = "test SIMD comparison kernels";
+
+	for(i = 0; i < 37; i++)
+	{
+		ints[i] = (i * 7) % 11 - 5;
+		floats[i] = (i % 9 == 4) ? NAN : (float) ints[i] / 2;
+		memcpy(data + i * 12 + 4, &ints[i], sizeof(int));
+	}
+
+	for(level = SIMD_SCALAR; level <= supported; level++)
+	{
+		ASSERT_EQUALS_INT(level, (int) setSimdLevel(level), "kernel level set");
+		for(t = 0; t < 3; t++)
+		{
+			// ints, contiguous and strided
+			constant.dt = DT_INT;
+			constant.isNull = FALSE;
+			constant.v.intV = 1;
+			for(i = 0, m = 0; i < 37; i++)
+				if (ops[t] == OP_COMP_EQUAL ? ints[i] == 1 : constFirst[t] ? 1 < ints[i] : ints[i] < 1)
+					expected[m++] = i;
+			for(s = 0; s < 2; s++)
+			{
+				n = selectCompare(DT_INT, ops[t], constFirst[t], s ? data + 4 : (char *) ints, s ? 12 : 4,
+						37, &constant, selection);
+				agrees = agrees && n == m && memcmp(selection, expected, sizeof(int) * m) == 0;
+			}
+			// floats, where NaN matches nothing
+			constant.dt = DT_FLOAT;
+			constant.v.floatV = 0.5;
+			for(i = 0, m = 0; i < 37; i++)
+				if (ops[t] == OP_COMP_EQUAL ? floats[i] == 0.5 : constFirst[t] ? 0.5 < floats[i] : floats[i] < 0.5)
+					expected[m++] = i;
+			n = selectCompare(DT_FLOAT, ops[t], constFirst[t], (char *) floats, 4, 37, &constant, selection);
+			agrees = agrees && n == m && memcmp(selection, expected, sizeof(int) * m) == 0;
+		}
+		ASSERT_TRUE(agrees, "kernels select what valueEquals and valueSmaller would");
+	}
+	setSimdLevel(supported);
+
+	TEST_DONE();
+}
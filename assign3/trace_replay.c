@@ -0,0 +1,146 @@
+// Offline replay of a buffer pool access trace (see buffer_mgr_trace.h).
+// Runs the trace against every replacement strategy at a range of pool sizes
+// and prints one hit-ratio row per strategy.
+//
+// usage: trace_replay <trace file> [minFrames maxFrames]
+
+#include "buffer_mgr.h"
+#include "buffer_mgr_trace.h"
+#include "storage_mgr.h"
+#include "dberror.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCRATCH_FILE "trace_replay.bin"
+#define MAX_POOL_SIZES 32
+
+static const char *strategyNames[] = { "FIFO", "LRU", "CLOCK", "LFU", "LRU-K" };
+static const ReplacementStrategy strategies[] = { RS_FIFO, RS_LRU, RS_CLOCK, RS_LFU, RS_LRU_K };
+#define NUM_STRATEGIES ((int)(sizeof(strategies) / sizeof(strategies[0])))
+
+static PageNumber maxPageNum(BM_TraceEntry *entries, int numEntries) {
+    PageNumber maxPage = 0;
+
+    for (int i = 0; i < numEntries; i++)
+        if (entries[i].pageNum > maxPage)
+            maxPage = entries[i].pageNum;
+    return maxPage;
+}
+
+static int countDistinctPages(BM_TraceEntry *entries, int numEntries) {
+    PageNumber maxPage = maxPageNum(entries, numEntries);
+    char *seen;
+    int i, distinct = 0;
+
+    seen = (char *)calloc(maxPage + 1, 1);
+    for (i = 0; i < numEntries; i++) {
+        if (entries[i].pageNum >= 0 && !seen[entries[i].pageNum]) {
+            seen[entries[i].pageNum] = 1;
+            distinct++;
+        }
+    }
+    free(seen);
+    return distinct;
+}
+
+// Replays pins and unpins in trace order. A pin the pool cannot satisfy
+// (every frame pinned) is counted as a miss and its unpin is ignored.
+static double replay(BM_TraceEntry *entries, int numEntries, PageNumber maxPage, ReplacementStrategy strategy, int numFrames) {
+    BM_BufferPool bm;
+    BM_PageHandle page;
+    BM_PoolStatistics stats;
+    int *failedPins;
+    long failed = 0;
+    int i;
+
+    // failed pins per page still waiting for their unpin
+    failedPins = (int *)calloc(maxPage + 1, sizeof(int));
+    if (failedPins == NULL)
+        return -1.0;
+    if (initBufferPool(&bm, SCRATCH_FILE, numFrames, strategy, NULL) != RC_OK) {
+        free(failedPins);
+        return -1.0;
+    }
+
+    for (i = 0; i < numEntries; i++) {
+        PageNumber pageNum = entries[i].pageNum;
+        page.pageNum = pageNum;
+        if (pageNum < 0)
+            continue;
+        if (entries[i].op == BM_TRACE_PIN) {
+            if (pinPage(&bm, &page, pageNum) != RC_OK) {
+                failedPins[pageNum]++;
+                failed++;
+            }
+        } else if (failedPins[pageNum] > 0) {
+            failedPins[pageNum]--;
+        } else {
+            unpinPage(&bm, &page);
+        }
+    }
+
+    getPoolStatistics(&bm, &stats, NULL);
+    shutdownBufferPool(&bm);
+    free(failedPins);
+
+    if (stats.numPins + failed == 0)
+        return 0.0;
+    return (double)stats.numHits / (double)(stats.numPins + failed);
+}
+
+int main(int argc, char *argv[]) {
+    BM_TraceEntry *entries;
+    int numEntries, distinct, minFrames = 1, maxFrames;
+    PageNumber maxPage;
+    int sizes[MAX_POOL_SIZES], numSizes = 0;
+    int s, i;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace file> [minFrames maxFrames]\n", argv[0]);
+        return 1;
+    }
+    if (readTrace(argv[1], &entries, &numEntries) != RC_OK) {
+        fprintf(stderr, "cannot read trace file %s\n", argv[1]);
+        return 1;
+    }
+
+    distinct = countDistinctPages(entries, numEntries);
+    maxPage = maxPageNum(entries, numEntries);
+    maxFrames = (distinct > 0) ? distinct : 1;
+    if (argc >= 4) {
+        minFrames = atoi(argv[2]);
+        maxFrames = atoi(argv[3]);
+    }
+    if (minFrames < 1) minFrames = 1;
+    if (maxFrames < minFrames) maxFrames = minFrames;
+
+    // geometric steps from minFrames, always ending at maxFrames
+    for (s = minFrames; s < maxFrames && numSizes < MAX_POOL_SIZES - 1; s *= 2)
+        sizes[numSizes++] = s;
+    sizes[numSizes++] = maxFrames;
+
+    if (createPageFile(SCRATCH_FILE) != RC_OK) {
+        fprintf(stderr, "cannot create scratch file %s\n", SCRATCH_FILE);
+        free(entries);
+        return 1;
+    }
+
+    printf("trace %s: %i accesses, %i distinct pages\n", argv[1], numEntries, distinct);
+    printf("%-8s", "frames");
+    for (i = 0; i < numSizes; i++)
+        printf(" %7i", sizes[i]);
+    printf("\n");
+
+    for (s = 0; s < NUM_STRATEGIES; s++) {
+        printf("%-8s", strategyNames[s]);
+        for (i = 0; i < numSizes; i++)
+            printf(" %7.3f", replay(entries, numEntries, maxPage, strategies[s], sizes[i]));
+        printf("\n");
+    }
+
+    destroyPageFile(SCRATCH_FILE);
+    free(entries);
+    return 0;
+}